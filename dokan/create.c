@@ -141,6 +141,11 @@ VOID DispatchCreate(HANDLE Handle, // This handle is not for a file. It is for
     return;
   }
   ZeroMemory(openInfo, sizeof(DOKAN_OPEN_INFO));
+  InitializeListHead(&openInfo->EventOrder.EventQueue);
+  openInfo->EventOrder.NextSequence = 1;
+  InitializeListHead(&openInfo->BulkEventOrder.EventQueue);
+  openInfo->BulkEventOrder.NextSequence = 1;
+  InitializeListHead(&openInfo->IoRequests);
   openInfo->OpenCount = 1;
   openInfo->EventContext = EventContext;
   openInfo->DokanInstance = DokanInstance;
@@ -57,6 +57,8 @@ NewDokanInstance() {
 
   (void)InitializeCriticalSectionAndSpinCount(&instance->CriticalSection,
                                               0x80000400);
+  instance->CompletionDevice = INVALID_HANDLE_VALUE;
+  instance->IoRequestsDrained = CreateEvent(NULL, TRUE, TRUE, NULL);
 
   InitializeListHead(&instance->ListEntry);
 
@@ -68,6 +70,11 @@ NewDokanInstance() {
 }
 
 VOID DeleteDokanInstance(PDOKAN_INSTANCE Instance) {
+  DeleteWorkerPool(&Instance->WorkerPool);
+  DeleteWorkerPool(&Instance->BulkWorkerPool);
+  if (Instance->IoRequestsDrained != NULL) {
+    CloseHandle(Instance->IoRequestsDrained);
+  }
   DeleteCriticalSection(&Instance->CriticalSection);
 
   EnterCriticalSection(&g_InstanceCriticalSection);
@@ -173,7 +180,8 @@ void CheckAllocationUnitSectorSize(PDOKAN_OPTIONS DokanOptions) {
 int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
                        PDOKAN_OPERATIONS DokanOperations) {
   HANDLE device;
-  HANDLE threadIds[DOKAN_MAX_THREAD];
+  ULONG maxThreadCount;
+  ULONG maxBulkThreadCount;
   HANDLE legacyKeepAliveThreadIds = NULL;
   BOOL keepalive_active = FALSE;
   PDOKAN_INSTANCE instance;
@@ -215,6 +223,39 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     DokanOptions->ThreadCount = DOKAN_MAX_THREAD;
   }
 
+  if (DokanOptions->Options & DOKAN_OPTION_PRIORITY_LANES) {
+    if (DokanOptions->BulkThreadCount == 0) {
+      DokanOptions->BulkThreadCount = 5;
+
+    } else if (DOKAN_MAX_THREAD < DokanOptions->BulkThreadCount) {
+      DokanDbgPrintW(L"Dokan Error: too many bulk thread count %d\n",
+                     DokanOptions->BulkThreadCount);
+      DokanOptions->BulkThreadCount = DOKAN_MAX_THREAD;
+    }
+  }
+
+  // Only read the fields that come after SectorSize when their option is set,
+  // DOKAN_OPTIONS of older applications does not have them.
+  maxThreadCount = DokanOptions->ThreadCount;
+  maxBulkThreadCount = 0;
+  if (DokanOptions->Options & DOKAN_OPTION_PRIORITY_LANES) {
+    maxBulkThreadCount = DokanOptions->BulkThreadCount;
+  }
+  if (DokanOptions->Options & DOKAN_OPTION_AUTO_SCALE_THREADS) {
+    maxThreadCount = DokanOptions->MaxThreadCount == 0
+                         ? DOKAN_MAX_THREAD
+                         : min(DokanOptions->MaxThreadCount, DOKAN_MAX_THREAD);
+    maxThreadCount = max(maxThreadCount, DokanOptions->ThreadCount);
+    if (DokanOptions->Options & DOKAN_OPTION_PRIORITY_LANES) {
+      maxBulkThreadCount =
+          DokanOptions->MaxBulkThreadCount == 0
+              ? DOKAN_MAX_THREAD
+              : min(DokanOptions->MaxBulkThreadCount, DOKAN_MAX_THREAD);
+      maxBulkThreadCount =
+          max(maxBulkThreadCount, DokanOptions->BulkThreadCount);
+    }
+  }
+
   device = CreateFile(DOKAN_GLOBAL_DEVICE_NAME,           // lpFileName
                       GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
                       FILE_SHARE_READ | FILE_SHARE_WRITE, // dwShareMode
@@ -260,18 +301,35 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     return DOKAN_START_ERROR;
   }
 
-  for (ULONG i = 0; i < DokanOptions->ThreadCount; ++i) {
-    threadIds[i] = (HANDLE)_beginthreadex(NULL, // Security Attributes
-                                          0,    // stack size
-                                          DokanLoop,
-                                          (PVOID)instance, // param
-                                          0, // create flag
-                                          NULL);
+  if (DokanOptions->Options & DOKAN_OPTION_ASYNC_COMPLETION) {
+    WCHAR rawDeviceName[MAX_PATH];
+    GetRawDeviceName(instance->DeviceName, rawDeviceName, MAX_PATH);
+    instance->CompletionDevice =
+        CreateFile(rawDeviceName, GENERIC_READ | GENERIC_WRITE,
+                   FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0,
+                   NULL);
+    if (instance->CompletionDevice == INVALID_HANDLE_VALUE) {
+      DbgPrintW(L"Failed to open completion handle: %s\n", rawDeviceName);
+    }
+  }
+
+  InitializeWorkerPool(&instance->WorkerPool, instance, IOCTL_EVENT_WAIT,
+                       DokanOptions->ThreadCount, maxThreadCount);
+  StartWorkers(&instance->WorkerPool, DokanOptions->ThreadCount);
+  if (DokanOptions->Options & DOKAN_OPTION_PRIORITY_LANES) {
+    InitializeWorkerPool(&instance->BulkWorkerPool, instance,
+                         IOCTL_EVENT_WAIT_BULK, DokanOptions->BulkThreadCount,
+                         maxBulkThreadCount);
+    StartWorkers(&instance->BulkWorkerPool, DokanOptions->BulkThreadCount);
   }
 
   if (!DokanMount(instance->MountPoint, instance->DeviceName, DokanOptions)) {
     SendReleaseIRP(instance->DeviceName);
     DokanDbgPrint("Dokan Error: DokanMount Failed\n");
+    if (instance->CompletionDevice != INVALID_HANDLE_VALUE) {
+      CloseHandle(instance->CompletionDevice);
+      instance->CompletionDevice = INVALID_HANDLE_VALUE;
+    }
     CloseHandle(device);
     return DOKAN_MOUNT_ERROR;
   }
@@ -332,10 +390,7 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
   }
 
   // wait for loop thread terminations
-  WaitForMultipleObjects(DokanOptions->ThreadCount, threadIds, TRUE, INFINITE);
-  for (ULONG i = 0; i < DokanOptions->ThreadCount; ++i) {
-    CloseHandle(threadIds[i]);
-  }
+  WaitWorkerPools(instance);
 
   if (legacyKeepAliveThreadIds) {
     WaitForSingleObject(legacyKeepAliveThreadIds, INFINITE);
@@ -359,6 +414,16 @@ int DOKANAPI DokanMain(PDOKAN_OPTIONS DokanOptions,
     DokanOperations->Unmounted(&fileInfo);
   }
 
+  // Requests the FileSystem left pending still use the instance and reply on
+  // its completion handle, see DOKAN_OPTION_ASYNC_COMPLETION.
+  if (instance->IoRequestsDrained != NULL) {
+    WaitForSingleObject(instance->IoRequestsDrained, INFINITE);
+  }
+  if (instance->CompletionDevice != INVALID_HANDLE_VALUE) {
+    CloseHandle(instance->CompletionDevice);
+    instance->CompletionDevice = INVALID_HANDLE_VALUE;
+  }
+
   Sleep(1000);
 
   DbgPrint("\nunload\n");
@@ -383,18 +448,90 @@ void ALIGN_ALLOCATION_SIZE(PLARGE_INTEGER size, PDOKAN_OPTIONS DokanOptions) {
       (size->QuadPart + (r > 0 ? DokanOptions->AllocationUnitSize - r : 0));
 }
 
-UINT WINAPI DokanLoop(PVOID pDokanInstance) {
+BOOL StartWorkers(PDOKAN_WORKER_POOL Pool, ULONG Count) {
+  HANDLE thread;
+  ULONG i;
+
+  for (i = 0; i < Count; ++i) {
+    EnterCriticalSection(&Pool->CriticalSection);
+    Pool->Workers++;
+    Pool->PeakWorkers = max(Pool->PeakWorkers, Pool->Workers);
+    LeaveCriticalSection(&Pool->CriticalSection);
+
+    thread = (HANDLE)_beginthreadex(NULL, // Security Attributes
+                                    0,    // stack size
+                                    DokanLoop,
+                                    (PVOID)Pool, // param
+                                    0,           // create flag
+                                    NULL);
+    if (thread == NULL) {
+      DbgPrint("Dokan Error: Failed to start a worker thread\n");
+      EnterCriticalSection(&Pool->CriticalSection);
+      WorkerExited(Pool);
+      LeaveCriticalSection(&Pool->CriticalSection);
+      return FALSE;
+    }
+    // Workers are tracked through Pool->Workers and StoppedEvent
+    CloseHandle(thread);
+  }
+  return TRUE;
+}
+
+// Waits for the workers of both lanes to exit. The extra workers of an auto
+// scaled pool only check whether they can retire after an event, so idle
+// pools are trimmed from here meanwhile.
+VOID WaitWorkerPools(PDOKAN_INSTANCE Instance) {
+  PDOKAN_WORKER_POOL pools[2] = {&Instance->WorkerPool,
+                                 &Instance->BulkWorkerPool};
+  HANDLE stoppedEvents[2];
+  DWORD count = 0;
+  DWORD timeout = INFINITE;
+  ULONG i;
+
+  for (i = 0; i < 2; ++i) {
+    if (pools[i]->DokanInstance == NULL || pools[i]->StoppedEvent == NULL) {
+      continue;
+    }
+    stoppedEvents[count++] = pools[i]->StoppedEvent;
+    if (IsWorkerPoolAutoScaled(pools[i])) {
+      timeout = min(timeout, pools[i]->IdleTimeout / 2);
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+  while (WaitForMultipleObjects(count, stoppedEvents, TRUE, timeout) ==
+         WAIT_TIMEOUT) {
+    TrimWorkerPool(&Instance->WorkerPool);
+    TrimWorkerPool(&Instance->BulkWorkerPool);
+  }
+}
+
+UINT WINAPI DokanLoop(PVOID pWorkerPool) {
+  PDOKAN_WORKER_POOL pool = pWorkerPool;
+  PDOKAN_INSTANCE DokanInstance = pool->DokanInstance;
   HANDLE device = INVALID_HANDLE_VALUE;
   char *buffer = NULL;
   BOOL status;
+  BOOL retire = FALSE;
   ULONG returnedLength;
   DWORD result = 0;
   DWORD lastError = 0;
   WCHAR rawDeviceName[MAX_PATH];
-  PDOKAN_INSTANCE DokanInstance = pDokanInstance;
+  DOKAN_WORKER worker;
 
+  ZeroMemory(&worker, sizeof(DOKAN_WORKER));
+  InitializeListHead(&worker.ListEntry);
   buffer = malloc(sizeof(char) * EVENT_CONTEXT_MAX_SIZE);
-  if (buffer == NULL) {
+  // TrimWorkerPool needs a real handle to cancel our wait on the driver.
+  if (buffer == NULL ||
+      !DuplicateHandle(GetCurrentProcess(), GetCurrentThread(),
+                       GetCurrentProcess(), &worker.Thread, 0, FALSE,
+                       DUPLICATE_SAME_ACCESS)) {
+    free(buffer);
+    EnterCriticalSection(&pool->CriticalSection);
+    WorkerExited(pool);
+    LeaveCriticalSection(&pool->CriticalSection);
     result = (DWORD)-1;
     _endthreadex(result);
     return result;
@@ -404,7 +541,7 @@ UINT WINAPI DokanLoop(PVOID pDokanInstance) {
   GetRawDeviceName(DokanInstance->DeviceName, rawDeviceName, MAX_PATH);
 
   status = TRUE;
-  while (status) {
+  while (status && !retire) {
 
     device = CreateFile(rawDeviceName,                 // lpFileName
                    GENERIC_READ | GENERIC_WRITE,       // dwDesiredAccess
@@ -421,23 +558,40 @@ UINT WINAPI DokanLoop(PVOID pDokanInstance) {
           rawDeviceName,
           GetLastError());
       free(buffer);
+      CloseHandle(worker.Thread);
+      EnterCriticalSection(&pool->CriticalSection);
+      WorkerExited(pool);
+      LeaveCriticalSection(&pool->CriticalSection);
       result = (DWORD)-1;
       _endthreadex(result);
       return result;
     }
 
+    WorkerWaitStarted(pool, &worker);
+
     status = DeviceIoControl(
-        device,           // Handle to device
-        IOCTL_EVENT_WAIT, // IO Control code
-        NULL,             // Input Buffer to driver.
-        0,                // Length of input buffer in bytes.
-        buffer,           // Output Buffer from driver.
+        device,              // Handle to device
+        pool->IoControlCode, // IO Control code
+        NULL,                // Input Buffer to driver.
+        0,                   // Length of input buffer in bytes.
+        buffer,              // Output Buffer from driver.
         sizeof(char) *
             EVENT_CONTEXT_MAX_SIZE, // Length of output buffer in bytes.
         &returnedLength,            // Bytes placed in buffer.
         NULL                        // synchronous call
         );
 
+    if (WorkerWaitEnded(pool, &worker, status && returnedLength > 0)) {
+      StartWorkers(pool, 1);
+    }
+
+    // TrimWorkerPool cancelled our wait, unless the event came first.
+    if (worker.Retired && !(status && returnedLength > 0)) {
+      retire = TRUE;
+      CloseHandle(device);
+      break;
+    }
+
     if (!status) {
       lastError = GetLastError();
       DbgPrint("Ioctl failed for wait with code %d.\n", lastError);
@@ -459,54 +613,12 @@ UINT WINAPI DokanLoop(PVOID pDokanInstance) {
       if (context->MountId != DokanInstance->MountId) {
         DbgPrint("Dokan Error: Invalid MountId (expected:%d, acctual:%d)\n",
                  DokanInstance->MountId, context->MountId);
-        CloseHandle(device);
-        continue;
-      }
-
-      switch (context->MajorFunction) {
-      case IRP_MJ_CREATE:
-        DispatchCreate(device, context, DokanInstance);
-        break;
-      case IRP_MJ_CLEANUP:
-        DispatchCleanup(device, context, DokanInstance);
-        break;
-      case IRP_MJ_CLOSE:
-        DispatchClose(device, context, DokanInstance);
-        break;
-      case IRP_MJ_DIRECTORY_CONTROL:
-        DispatchDirectoryInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_READ:
-        DispatchRead(device, context, DokanInstance);
-        break;
-      case IRP_MJ_WRITE:
-        DispatchWrite(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_INFORMATION:
-        DispatchQueryInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_VOLUME_INFORMATION:
-        DispatchQueryVolumeInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_LOCK_CONTROL:
-        DispatchLock(device, context, DokanInstance);
-        break;
-      case IRP_MJ_SET_INFORMATION:
-        DispatchSetInformation(device, context, DokanInstance);
-        break;
-      case IRP_MJ_FLUSH_BUFFERS:
-        DispatchFlush(device, context, DokanInstance);
-        break;
-      case IRP_MJ_QUERY_SECURITY:
-        DispatchQuerySecurity(device, context, DokanInstance);
-        break;
-      case IRP_MJ_SET_SECURITY:
-        DispatchSetSecurity(device, context, DokanInstance);
-        break;
-      default:
-        break;
+      } else {
+        DispatchEvent(device, context, DokanInstance,
+                      pool->IoControlCode == IOCTL_EVENT_WAIT_BULK);
       }
 
+      retire = WorkerEventDone(pool, &worker);
     } else {
       DbgPrint("ReturnedLength %d\n", returnedLength);
     }
@@ -514,13 +626,246 @@ UINT WINAPI DokanLoop(PVOID pDokanInstance) {
     CloseHandle(device);
   }
 
-  CloseHandle(device);
   free(buffer);
+  CloseHandle(worker.Thread);
+  if (!retire) {
+    CloseHandle(device);
+    EnterCriticalSection(&pool->CriticalSection);
+    WorkerExited(pool);
+    LeaveCriticalSection(&pool->CriticalSection);
+  }
   _endthreadex(result);
 
   return result;
 }
 
+BOOL DOKANAPI DokanGetWorkerStatistics(PDOKAN_OPTIONS DokanOptions,
+                                       BOOL BulkLane,
+                                       PDOKAN_WORKER_STATISTICS Statistics) {
+  PLIST_ENTRY entry;
+  PDOKAN_INSTANCE instance;
+  PDOKAN_WORKER_POOL pool;
+  BOOL found = FALSE;
+
+  if (DokanOptions == NULL || Statistics == NULL) {
+    return FALSE;
+  }
+
+  EnterCriticalSection(&g_InstanceCriticalSection);
+  for (entry = g_InstanceList.Flink; entry != &g_InstanceList;
+       entry = entry->Flink) {
+    instance = CONTAINING_RECORD(entry, DOKAN_INSTANCE, ListEntry);
+    if (instance->DokanOptions != DokanOptions) {
+      continue;
+    }
+    pool = BulkLane ? &instance->BulkWorkerPool : &instance->WorkerPool;
+    if (pool->DokanInstance == NULL) {
+      break;
+    }
+    EnterCriticalSection(&pool->CriticalSection);
+    Statistics->Workers = pool->Workers;
+    Statistics->BusyWorkers = pool->BusyWorkers;
+    Statistics->PeakWorkers = pool->PeakWorkers;
+    Statistics->Events = pool->Events;
+    Statistics->SaturatedTime = pool->SaturatedTime;
+    if (pool->SaturatedSince != 0) {
+      Statistics->SaturatedTime += GetTickCount64() - pool->SaturatedSince;
+    }
+    LeaveCriticalSection(&pool->CriticalSection);
+    found = TRUE;
+    break;
+  }
+  LeaveCriticalSection(&g_InstanceCriticalSection);
+
+  return found;
+}
+
+VOID DispatchEventContext(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                          PDOKAN_INSTANCE DokanInstance) {
+  switch (EventContext->MajorFunction) {
+  case IRP_MJ_CREATE:
+    DispatchCreate(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_CLEANUP:
+    DispatchCleanup(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_CLOSE:
+    DispatchClose(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_DIRECTORY_CONTROL:
+    DispatchDirectoryInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_READ:
+    DispatchRead(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_WRITE:
+    DispatchWrite(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_INFORMATION:
+    DispatchQueryInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_VOLUME_INFORMATION:
+    DispatchQueryVolumeInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_LOCK_CONTROL:
+    DispatchLock(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_SET_INFORMATION:
+    DispatchSetInformation(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_FLUSH_BUFFERS:
+    DispatchFlush(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_QUERY_SECURITY:
+    DispatchQuerySecurity(Handle, EventContext, DokanInstance);
+    break;
+  case IRP_MJ_SET_SECURITY:
+    DispatchSetSecurity(Handle, EventContext, DokanInstance);
+    break;
+  default:
+    break;
+  }
+}
+
+// Whether the event can be dispatched now on its lane as far as ordering is
+// concerned. Events without sequence come from a driver that does not number
+// them and are only serialized. Events below NextSequence are late ones
+// whose slot was skipped when they could not be held back.
+static BOOL IsNextEvent(PDOKAN_EVENT_ORDER Order,
+                        PEVENT_CONTEXT EventContext) {
+  return EventContext->OpenSequence <= Order->NextSequence;
+}
+
+static VOID AdvanceSequence(PDOKAN_EVENT_ORDER Order,
+                            PEVENT_CONTEXT EventContext) {
+  if (EventContext->OpenSequence >= Order->NextSequence) {
+    Order->NextSequence = EventContext->OpenSequence + 1;
+  }
+}
+
+// Holds the event back in the lane queue, sorted by sequence.
+static BOOL HoldBackEvent(PDOKAN_EVENT_ORDER Order,
+                          PEVENT_CONTEXT EventContext) {
+  PDOKAN_QUEUED_EVENT queuedEvent;
+  PDOKAN_QUEUED_EVENT next;
+  PLIST_ENTRY entry;
+
+  // The driver buffer is reused by our worker loop so we need our own copy of
+  // the event.
+  queuedEvent = malloc(FIELD_OFFSET(DOKAN_QUEUED_EVENT, EventContext) +
+                       EventContext->Length);
+  if (queuedEvent == NULL) {
+    return FALSE;
+  }
+  CopyMemory(&queuedEvent->EventContext, EventContext, EventContext->Length);
+
+  entry = Order->EventQueue.Flink;
+  if (EventContext->OpenSequence != 0) {
+    for (; entry != &Order->EventQueue; entry = entry->Flink) {
+      next = CONTAINING_RECORD(entry, DOKAN_QUEUED_EVENT, ListEntry);
+      if (next->EventContext.OpenSequence == 0 ||
+          next->EventContext.OpenSequence > EventContext->OpenSequence) {
+        break;
+      }
+    }
+  } else {
+    entry = &Order->EventQueue;
+  }
+  // Insert before entry
+  InsertTailList(entry, &queuedEvent->ListEntry);
+  return TRUE;
+}
+
+VOID DispatchEvent(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                   PDOKAN_INSTANCE DokanInstance, BOOL BulkLane) {
+  PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_EVENT_ORDER order;
+  PDOKAN_EVENT_ORDER otherOrder;
+  PDOKAN_QUEUED_EVENT queuedEvent = NULL;
+  PLIST_ENTRY entry;
+  BOOL lastEvent;
+
+  openInfo = (PDOKAN_OPEN_INFO)(UINT_PTR)EventContext->Context;
+  if (openInfo == NULL ||
+      !(DokanInstance->DokanOptions->Options & DOKAN_OPTION_ORDERED_DISPATCH)) {
+    DispatchEventContext(Handle, EventContext, DokanInstance);
+    return;
+  }
+  // The driver numbers the events of each lane on their own, and the events
+  // held back on a lane are only dispatched by the workers of that lane.
+  order = BulkLane ? &openInfo->BulkEventOrder : &openInfo->EventOrder;
+  otherOrder = BulkLane ? &openInfo->EventOrder : &openInfo->BulkEventOrder;
+
+  EnterCriticalSection(&DokanInstance->CriticalSection);
+  if (order->Dispatching || !IsNextEvent(order, EventContext)) {
+    // Another worker is processing an event of this open or the previous
+    // event has not reached us yet. Whoever dispatches the previous event
+    // will dispatch ours once it is done.
+    if (HoldBackEvent(order, EventContext)) {
+      LeaveCriticalSection(&DokanInstance->CriticalSection);
+      return;
+    }
+    DbgPrint("Dokan Error: Failed to queue event, dispatch it unordered\n");
+    if (order->Dispatching) {
+      // Skip over our slot so the events behind us are not stuck.
+      AdvanceSequence(order, EventContext);
+      LeaveCriticalSection(&DokanInstance->CriticalSection);
+      DispatchEventContext(Handle, EventContext, DokanInstance);
+      return;
+    }
+    // Nobody would dispatch the events held back behind us, do it ourselves.
+  }
+  order->Dispatching = TRUE;
+  LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+  while (TRUE) {
+    // Close is the last event the driver sends for an open and can release
+    // openInfo, nothing can be queued behind it. While the other lane still
+    // has events of the open to dispatch, the close is left to its workers.
+    lastEvent = EventContext->MajorFunction == IRP_MJ_CLOSE;
+    if (lastEvent) {
+      EnterCriticalSection(&DokanInstance->CriticalSection);
+      if (otherOrder->Dispatching || !IsListEmpty(&otherOrder->EventQueue)) {
+        // Without sequence, it goes after every event held on that lane.
+        EventContext->OpenSequence = 0;
+        if (HoldBackEvent(otherOrder, EventContext)) {
+          order->Dispatching = FALSE;
+          LeaveCriticalSection(&DokanInstance->CriticalSection);
+          free(queuedEvent);
+          return;
+        }
+      }
+      LeaveCriticalSection(&DokanInstance->CriticalSection);
+    }
+    DispatchEventContext(Handle, EventContext, DokanInstance);
+    if (lastEvent) {
+      free(queuedEvent);
+      return;
+    }
+
+    EnterCriticalSection(&DokanInstance->CriticalSection);
+    AdvanceSequence(order, EventContext);
+    if (queuedEvent != NULL) {
+      free(queuedEvent);
+      queuedEvent = NULL;
+    }
+    entry = order->EventQueue.Flink;
+    if (entry == &order->EventQueue ||
+        !IsNextEvent(order,
+                     &CONTAINING_RECORD(entry, DOKAN_QUEUED_EVENT, ListEntry)
+                          ->EventContext)) {
+      order->Dispatching = FALSE;
+      LeaveCriticalSection(&DokanInstance->CriticalSection);
+      return;
+    }
+    RemoveEntryList(entry);
+    LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+    queuedEvent = CONTAINING_RECORD(entry, DOKAN_QUEUED_EVENT, ListEntry);
+    EventContext = &queuedEvent->EventContext;
+  }
+}
+
 VOID SendEventInformation(HANDLE Handle, PEVENT_INFORMATION EventInfo,
                           ULONG EventLength) {
   BOOL status;
@@ -619,6 +964,152 @@ DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
   return eventInfo;
 }
 
+PDOKAN_IO_REQUEST
+DispatchIoRequest(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
+                  PDOKAN_INSTANCE DokanInstance) {
+  PDOKAN_IO_REQUEST request = (PDOKAN_IO_REQUEST)malloc(sizeof(DOKAN_IO_REQUEST));
+
+  if (request == NULL) {
+    return NULL;
+  }
+  RtlZeroMemory(request, sizeof(DOKAN_IO_REQUEST));
+  request->DokanInstance = DokanInstance;
+  request->EventContext = EventContext;
+  request->EventInfoLength = SizeOfEventInfo;
+
+  if (DokanInstance->DokanOptions->Options & DOKAN_OPTION_ASYNC_COMPLETION) {
+    // The callback can return pending while our worker goes back to reuse its
+    // event buffer, so the request needs its own copy of the event.
+    request->EventContext = (PEVENT_CONTEXT)malloc(EventContext->Length);
+    if (request->EventContext == NULL) {
+      free(request);
+      return NULL;
+    }
+    CopyMemory(request->EventContext, EventContext, EventContext->Length);
+    request->EventContextAllocated = TRUE;
+  }
+
+  request->EventInfo =
+      DispatchCommon(request->EventContext, SizeOfEventInfo, DokanInstance,
+                     &request->FileInfo, &request->OpenInfo);
+  if (request->EventInfo == NULL) {
+    if (request->EventContextAllocated) {
+      free(request->EventContext);
+    }
+    free(request);
+    return NULL;
+  }
+
+  EnterCriticalSection(&DokanInstance->CriticalSection);
+  if (DokanInstance->PendingIoRequests++ == 0) {
+    ResetEvent(DokanInstance->IoRequestsDrained);
+  }
+  // Let DokanResetTimeout find the event of this request.
+  InitializeListHead(&request->ListEntry);
+  if (request->OpenInfo != NULL) {
+    InsertTailList(&request->OpenInfo->IoRequests, &request->ListEntry);
+  }
+  LeaveCriticalSection(&DokanInstance->CriticalSection);
+
+  return request;
+}
+
+BOOL IsIoRequestAsync(PDOKAN_IO_REQUEST Request) {
+  return (Request->DokanInstance->DokanOptions->Options &
+          DOKAN_OPTION_ASYNC_COMPLETION) != 0;
+}
+
+VOID CompleteIoRequest(HANDLE Handle, PDOKAN_IO_REQUEST Request) {
+  PDOKAN_INSTANCE instance = Request->DokanInstance;
+  WCHAR rawDeviceName[MAX_PATH];
+  ULONG returnedLength;
+
+  if (Request->OpenInfo != NULL) {
+    EnterCriticalSection(&instance->CriticalSection);
+    Request->OpenInfo->UserContext = Request->FileInfo.Context;
+    LeaveCriticalSection(&instance->CriticalSection);
+  }
+
+  // Completed outside of a worker, the reply can be sent on any handle of
+  // the device as the driver finds the IRP by its SerialNumber.
+  if (Handle == INVALID_HANDLE_VALUE) {
+    Handle = instance->CompletionDevice;
+  }
+  if (Handle != INVALID_HANDLE_VALUE) {
+    SendEventInformation(Handle, Request->EventInfo, Request->EventInfoLength);
+  } else {
+    // No completion handle could be opened at mount.
+    GetRawDeviceName(instance->DeviceName, rawDeviceName, MAX_PATH);
+    SendToDevice(rawDeviceName, IOCTL_EVENT_INFO, Request->EventInfo,
+                 Request->EventInfoLength, NULL, 0, &returnedLength);
+  }
+  FreeIoRequest(Request);
+}
+
+VOID FreeIoRequest(PDOKAN_IO_REQUEST Request) {
+  PDOKAN_INSTANCE instance = Request->DokanInstance;
+  BOOL drained;
+
+  if (Request->OpenInfo != NULL) {
+    EnterCriticalSection(&instance->CriticalSection);
+    RemoveEntryList(&Request->ListEntry);
+    // Do not leave DokanResetTimeout a pointer to the event we free below.
+    if (Request->EventContextAllocated &&
+        Request->OpenInfo->EventContext == Request->EventContext) {
+      Request->OpenInfo->EventContext = NULL;
+    }
+    LeaveCriticalSection(&instance->CriticalSection);
+  }
+  ReleaseDokanOpenInfo(Request->EventInfo, &Request->FileInfo, instance);
+
+  free(Request->EventInfo);
+  if (Request->EventContextAllocated) {
+    free(Request->EventContext);
+  }
+  free(Request);
+
+  EnterCriticalSection(&instance->CriticalSection);
+  drained = --instance->PendingIoRequests == 0;
+  LeaveCriticalSection(&instance->CriticalSection);
+  // Last use of the instance, DokanMain deletes it once this is set. Only
+  // workers add requests and they are gone by then.
+  if (drained) {
+    SetEvent(instance->IoRequestsDrained);
+  }
+}
+
+VOID DOKANAPI DokanCompleteRequest(PDOKAN_FILE_INFO DokanFileInfo,
+                                   NTSTATUS Status, DWORD Length) {
+  PDOKAN_IO_REQUEST request;
+
+  if (DokanFileInfo == NULL || DokanFileInfo->DokanOptions == NULL ||
+      !(DokanFileInfo->DokanOptions->Options & DOKAN_OPTION_ASYNC_COMPLETION)) {
+    DbgPrint("Dokan Error: DokanCompleteRequest needs "
+             "DOKAN_OPTION_ASYNC_COMPLETION\n");
+    return;
+  }
+
+  request = CONTAINING_RECORD(DokanFileInfo, DOKAN_IO_REQUEST, FileInfo);
+  switch (request->EventContext->MajorFunction) {
+  case IRP_MJ_READ:
+    SetReadResult(request, Status, Length);
+    break;
+  case IRP_MJ_WRITE:
+    SetWriteResult(request, Status, Length);
+    break;
+  case IRP_MJ_FLUSH_BUFFERS:
+    SetFlushResult(request, Status);
+    break;
+  default:
+    DbgPrint("Dokan Error: DokanCompleteRequest called for an unsupported "
+             "request %d\n",
+             request->EventContext->MajorFunction);
+    return;
+  }
+
+  CompleteIoRequest(INVALID_HANDLE_VALUE, request);
+}
+
 PDOKAN_OPEN_INFO
 GetDokanOpenInfo(PEVENT_CONTEXT EventContext, PDOKAN_INSTANCE DokanInstance) {
   PDOKAN_OPEN_INFO openInfo;
@@ -768,6 +1259,9 @@ BOOL DokanStart(PDOKAN_INSTANCE Instance) {
   if (Instance->DokanOptions->Options & DOKAN_OPTION_CASE_SENSITIVE) {
     eventStart.Flags |= DOKAN_EVENT_CASE_SENSITIVE;
   }
+  if (Instance->DokanOptions->Options & DOKAN_OPTION_PRIORITY_LANES) {
+    eventStart.Flags |= DOKAN_EVENT_PRIORITY_LANES;
+  }
 
   memcpy_s(eventStart.MountPoint, sizeof(eventStart.MountPoint),
            Instance->MountPoint, sizeof(Instance->MountPoint));
@@ -1057,6 +1551,69 @@ BOOL DOKANAPI DokanNotifyPath(LPCWSTR FilePath, ULONG CompletionFilter,
   return TRUE;
 }
 
+// Largest FSCTL_NOTIFY_PATHS buffer sent by DokanNotifyBatch, bigger batches
+// are split in several requests.
+#define DOKAN_NOTIFY_BATCH_BUFFER_SIZE (256 * 1024)
+
+BOOL SendNotifyPaths(PCHAR Buffer, ULONG BufferLength) {
+  ULONG returnedLength;
+  if (!DeviceIoControl(g_notify_handle, FSCTL_NOTIFY_PATHS, Buffer,
+                       BufferLength, NULL, 0, &returnedLength, NULL)) {
+    DbgPrint("Failed to send notify paths command: %d\n", GetLastError());
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL DOKANAPI DokanNotifyBatch(const DOKAN_NOTIFY_ENTRY *Entries, ULONG Count) {
+  const size_t prefixSize = 2; // size of mount letter plus ":"
+  PDOKAN_NOTIFY_PATH_INTERMEDIATE pNotifyPath;
+  PCHAR buffer;
+  ULONG offset = 0;
+  ULONG recordSize;
+  size_t length;
+  BOOL success = TRUE;
+
+  if (Entries == NULL || g_notify_handle == INVALID_HANDLE_VALUE) {
+    return FALSE;
+  }
+  buffer = malloc(DOKAN_NOTIFY_BATCH_BUFFER_SIZE);
+  if (buffer == NULL) {
+    DbgPrint("Failed to allocate NotifyPaths\n");
+    return FALSE;
+  }
+
+  for (ULONG i = 0; i < Count; ++i) {
+    length = Entries[i].FilePath != NULL ? wcslen(Entries[i].FilePath) : 0;
+    if (length <= prefixSize ||
+        (length - prefixSize) * sizeof(WCHAR) > MAXUSHORT) {
+      success = FALSE;
+      continue;
+    }
+    // remove the mount letter and colon from length, for example: "G:"
+    length -= prefixSize;
+    recordSize = DOKAN_NOTIFY_PATH_RECORD_SIZE((ULONG)(length * sizeof(WCHAR)));
+    if (offset + recordSize > DOKAN_NOTIFY_BATCH_BUFFER_SIZE) {
+      success &= SendNotifyPaths(buffer, offset);
+      offset = 0;
+    }
+    pNotifyPath = (PDOKAN_NOTIFY_PATH_INTERMEDIATE)(buffer + offset);
+    ZeroMemory(pNotifyPath, recordSize);
+    pNotifyPath->CompletionFilter = Entries[i].CompletionFilter;
+    pNotifyPath->Action = Entries[i].Action;
+    pNotifyPath->Length = (USHORT)(length * sizeof(WCHAR));
+    CopyMemory(pNotifyPath->Buffer, Entries[i].FilePath + prefixSize,
+               pNotifyPath->Length);
+    offset += recordSize;
+  }
+  if (offset > 0) {
+    success &= SendNotifyPaths(buffer, offset);
+  }
+
+  free(buffer);
+  return success;
+}
+
 BOOL DOKANAPI DokanNotifyCreate(LPCWSTR FilePath, BOOL IsDirectory) {
   return DokanNotifyPath(FilePath,
                          IsDirectory ? FILE_NOTIFY_CHANGE_DIR_NAME
@@ -126,6 +126,53 @@ extern "C" {
 #define DOKAN_OPTION_CASE_SENSITIVE 4096
 /** Allows unmounting of network drive via explorer */
 #define DOKAN_OPTION_ENABLE_UNMOUNT_NETWORK_DRIVE 8192
+/**
+ * Dispatch the requests of a same open handle one at a time, in the order the
+ * driver sent them. The driver numbers the requests of each handle and a
+ * request received before its predecessor, or while another request of the
+ * same handle is processed, is held back and run once it is its turn, so
+ * writes to a file can be pipelined without the FileSystem having to
+ * serialize them itself. Requests of different handles still run in parallel
+ * on all threads.
+ *
+ * The order is the one in which the driver sent the requests to user mode:
+ * requests issued concurrently by applications on the same handle have no
+ * order of their own. With a driver that does not number requests, they are
+ * only serialized, in the order the threads received them.
+ *
+ * With \ref DOKAN_OPTION_PRIORITY_LANES, each lane keeps the order of its own
+ * requests: the metadata requests of a handle are not held back behind its
+ * read, write and flush requests, and the requests of a lane are only run by
+ * the threads of that lane. Only the close of a handle waits for the requests
+ * of both lanes.
+ */
+#define DOKAN_OPTION_ORDERED_DISPATCH 16384
+/**
+ * Serve read, write and flush requests in a separate bulk lane with its own
+ * \ref DOKAN_OPTIONS.BulkThreadCount threads, so large data transfers cannot
+ * occupy all the threads and delay metadata requests (create, query, listing...)
+ * that are served by the \ref DOKAN_OPTIONS.ThreadCount threads.
+ */
+#define DOKAN_OPTION_PRIORITY_LANES 32768
+/**
+ * Allow DOKAN_OPERATIONS.ReadFile, DOKAN_OPERATIONS.WriteFile and
+ * DOKAN_OPERATIONS.FlushFileBuffers to return \c STATUS_PENDING and complete
+ * the request later from any thread with \ref DokanCompleteRequest, so a
+ * request waiting on the network does not hold a Dokan thread.
+ * Every pending request must be completed, with an error status if the
+ * FileSystem is stopping: \ref DokanMain does not return before then, and
+ * \ref DokanCompleteRequest must not be called once it has returned.
+ */
+#define DOKAN_OPTION_ASYNC_COMPLETION 65536
+/**
+ * Let the number of threads grow between \ref DOKAN_OPTIONS.ThreadCount and
+ * \ref DOKAN_OPTIONS.MaxThreadCount while all of them are busy in callbacks,
+ * and shrink back once they are idle again.
+ * Same for the bulk lane with \ref DOKAN_OPTIONS.BulkThreadCount and
+ * \ref DOKAN_OPTIONS.MaxBulkThreadCount.
+ * \see DokanGetWorkerStatistics
+ */
+#define DOKAN_OPTION_AUTO_SCALE_THREADS 131072
 
 /** @} */
 
@@ -161,8 +208,44 @@ typedef struct _DOKAN_OPTIONS {
   ULONG AllocationUnitSize;
   /** Sector Size of the volume. This will affect the file size. */
   ULONG SectorSize;
+  /**
+   * Number of threads serving read, write and flush requests.
+   * Only read when \ref DOKAN_OPTION_PRIORITY_LANES is set. Default is 5.
+   */
+  USHORT BulkThreadCount;
+  /**
+   * Maximum number of threads when \ref DOKAN_OPTION_AUTO_SCALE_THREADS is set.
+   * ThreadCount is then the minimum. Default is 63.
+   */
+  USHORT MaxThreadCount;
+  /**
+   * Maximum number of bulk threads when \ref DOKAN_OPTION_AUTO_SCALE_THREADS
+   * and \ref DOKAN_OPTION_PRIORITY_LANES are set. Default is 63.
+   */
+  USHORT MaxBulkThreadCount;
 } DOKAN_OPTIONS, *PDOKAN_OPTIONS;
 
+/**
+ * \struct DOKAN_WORKER_STATISTICS
+ * \brief Activity of the threads dispatching the requests of a mount.
+ * \see DokanGetWorkerStatistics
+ */
+typedef struct _DOKAN_WORKER_STATISTICS {
+  /** Number of threads currently running. */
+  ULONG Workers;
+  /** Number of threads currently processing a request. */
+  ULONG BusyWorkers;
+  /** Highest number of threads that ran at the same time. */
+  ULONG PeakWorkers;
+  /** Number of requests received. */
+  ULONG64 Events;
+  /**
+   * Total time in milliseconds during which all threads were busy.
+   * New requests had to wait in the driver queue during that time.
+   */
+  ULONG64 SaturatedTime;
+} DOKAN_WORKER_STATISTICS, *PDOKAN_WORKER_STATISTICS;
+
 /**
  * \struct DOKAN_FILE_INFO
  * \brief Dokan file information on the current operation.
@@ -312,6 +395,8 @@ typedef struct _DOKAN_OPERATIONS {
   * \param Offset Offset from where the read has to be continued.
   * \param DokanFileInfo Information about the file or directory.
   * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * With \ref DOKAN_OPTION_ASYNC_COMPLETION, \c STATUS_PENDING can be returned and the read completed
+  * with \ref DokanCompleteRequest. FileName, Buffer and DokanFileInfo stay valid until then.
   * \see WriteFile
   */
   NTSTATUS(DOKAN_CALLBACK *ReadFile)(LPCWSTR FileName,
@@ -334,6 +419,8 @@ typedef struct _DOKAN_OPERATIONS {
   * \param Offset Offset from where the write has to be continued.
   * \param DokanFileInfo Information about the file or directory.
   * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * With \ref DOKAN_OPTION_ASYNC_COMPLETION, \c STATUS_PENDING can be returned and the write completed
+  * with \ref DokanCompleteRequest. FileName, Buffer and DokanFileInfo stay valid until then.
   * \see ReadFile
   */
   NTSTATUS(DOKAN_CALLBACK *WriteFile)(LPCWSTR FileName,
@@ -351,6 +438,8 @@ typedef struct _DOKAN_OPERATIONS {
   * \param FileName File path requested by the Kernel on the FileSystem.
   * \param DokanFileInfo Information about the file or directory.
   * \return \c STATUS_SUCCESS on success or NTSTATUS appropriate to the request result.
+  * With \ref DOKAN_OPTION_ASYNC_COMPLETION, \c STATUS_PENDING can be returned and the flush completed
+  * with \ref DokanCompleteRequest.
   */
   NTSTATUS(DOKAN_CALLBACK *FlushFileBuffers)(LPCWSTR FileName,
     PDOKAN_FILE_INFO DokanFileInfo);
@@ -842,6 +931,33 @@ ULONG DOKANAPI DokanDriverVersion();
  */
 BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO DokanFileInfo);
 
+/**
+ * \brief Completes a request for which the callback returned \c STATUS_PENDING.
+ *
+ * Requires \ref DOKAN_OPTION_ASYNC_COMPLETION. Can be called from any thread, once
+ * per pending request, also after DOKAN_OPERATIONS.Unmounted as \ref DokanMain
+ * waits for it. DokanFileInfo, the FileName and the Buffer given to the
+ * callback must no longer be used after this call.
+ *
+ * \param DokanFileInfo \ref DOKAN_FILE_INFO given to the pending callback.
+ * \param Status Result of the operation, as the callback would have returned it.
+ * \param Length Number of bytes read or written. Ignored for flush.
+ */
+VOID DOKANAPI DokanCompleteRequest(PDOKAN_FILE_INFO DokanFileInfo,
+                                   NTSTATUS Status, DWORD Length);
+
+/**
+ * \brief Get the activity of the threads dispatching the requests of a mount.
+ *
+ * \param DokanOptions \ref DOKAN_OPTIONS given to \ref DokanMain for the mount.
+ * \param BulkLane Get the threads of the bulk lane. See \ref DOKAN_OPTION_PRIORITY_LANES.
+ * \param Statistics Receives the statistics.
+ * \return \c TRUE if the mount and the lane were found.
+ */
+BOOL DOKANAPI DokanGetWorkerStatistics(PDOKAN_OPTIONS DokanOptions,
+                                       BOOL BulkLane,
+                                       PDOKAN_WORKER_STATISTICS Statistics);
+
 /**
  * \brief Get the handle to Access Token.
  *
@@ -964,6 +1080,128 @@ BOOL DOKANAPI DokanNotifyXAttrUpdate(LPCWSTR FilePath);
 BOOL DOKANAPI DokanNotifyRename(LPCWSTR OldPath, LPCWSTR NewPath,
                                 BOOL IsDirectory, BOOL IsInSameDirectory);
 
+/**
+ * \struct DOKAN_NOTIFY_ENTRY
+ * \brief A change reported with \ref DokanNotifyBatch.
+ */
+typedef struct _DOKAN_NOTIFY_ENTRY {
+  /** Absolute path to the file or directory, including the mount-point of the file system. */
+  LPCWSTR FilePath;
+  /**
+   * \c FILE_NOTIFY_CHANGE_* flags of the change.
+   * \ref DokanNotifyCreate uses \c FILE_NOTIFY_CHANGE_FILE_NAME or \c FILE_NOTIFY_CHANGE_DIR_NAME
+   * and \ref DokanNotifyUpdate uses \c FILE_NOTIFY_CHANGE_ATTRIBUTES.
+   */
+  ULONG CompletionFilter;
+  /** \c FILE_ACTION_* value of the change. A rename takes an entry for each name. */
+  ULONG Action;
+} DOKAN_NOTIFY_ENTRY, *PDOKAN_NOTIFY_ENTRY;
+
+/**
+ * \brief Notify dokan of many changes at once.
+ *
+ * Same as calling the other DokanNotify* functions for each entry, but the
+ * changes are sent to the driver in as few requests as possible.
+ *
+ * \param Entries Changes to report, in order.
+ * \param Count Number of entries.
+ * \return \c TRUE if all the notifications succeeded.
+ */
+BOOL DOKANAPI DokanNotifyBatch(const DOKAN_NOTIFY_ENTRY *Entries, ULONG Count);
+
+/**@}*/
+
+/**
+ * \defgroup DokanRangeLock Dokan Range Lock
+ * \brief Byte-range locks for file systems handling \ref DOKAN_OPTION_FILELOCK_USER_MODE
+ *
+ * A \ref DOKAN_RANGE_LOCKS holds the byte-range locks of one file.
+ * The file system usually creates one per file and calls \ref DokanLockRange and
+ * \ref DokanUnlockRange from \ref DOKAN_OPERATIONS.LockFile and \ref DOKAN_OPERATIONS.UnlockFile,
+ * \ref DokanUnlockAllRanges from \ref DOKAN_OPERATIONS.Cleanup and \ref DokanCheckRangeAccess
+ * before reading or writing. The owner of a lock is any value identifying the open handle,
+ * like \ref DOKAN_FILE_INFO.DokanContext.
+ *
+ * The locks are kept in an interval tree so a conflict check costs O(log n).
+ * All the functions are thread safe.
+ * @{
+ */
+
+/** Byte-range locks of a file. */
+typedef struct _DOKAN_RANGE_LOCKS DOKAN_RANGE_LOCKS, *PDOKAN_RANGE_LOCKS;
+
+/**
+ * \brief Create an empty set of byte-range locks.
+ *
+ * \return The locks to release with \ref DokanDeleteRangeLocks, or \c NULL when out of memory.
+ */
+PDOKAN_RANGE_LOCKS DOKANAPI DokanCreateRangeLocks();
+
+/**
+ * \brief Release a set of byte-range locks created by \ref DokanCreateRangeLocks and all its locks.
+ *
+ * \param RangeLocks The locks to release.
+ */
+VOID DOKANAPI DokanDeleteRangeLocks(PDOKAN_RANGE_LOCKS RangeLocks);
+
+/**
+ * \brief Lock a byte range.
+ *
+ * An exclusive lock cannot overlap any other lock and a shared lock cannot overlap an exclusive lock,
+ * even when they have the same owner. A range of length 0 never conflicts.
+ * The request fails immediately and never waits for a conflicting lock to be released.
+ *
+ * \param RangeLocks The locks of the file.
+ * \param Owner The handle owning the lock.
+ * \param ByteOffset Offset of the range.
+ * \param Length Length of the range.
+ * \param Exclusive Whether the lock is exclusive or shared.
+ * \return \c STATUS_SUCCESS, or \c STATUS_LOCK_NOT_GRANTED when the range conflicts with another lock.
+ */
+NTSTATUS DOKANAPI DokanLockRange(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner,
+                                 LONGLONG ByteOffset, LONGLONG Length,
+                                 BOOL Exclusive);
+
+/**
+ * \brief Unlock a byte range locked by \ref DokanLockRange.
+ *
+ * \param RangeLocks The locks of the file.
+ * \param Owner The handle owning the lock.
+ * \param ByteOffset Offset of the range, as locked.
+ * \param Length Length of the range, as locked.
+ * \return \c STATUS_SUCCESS, or \c STATUS_RANGE_NOT_LOCKED when Owner has no lock of this exact range.
+ */
+NTSTATUS DOKANAPI DokanUnlockRange(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner,
+                                   LONGLONG ByteOffset, LONGLONG Length);
+
+/**
+ * \brief Unlock all the byte ranges of an owner, usually when its handle is closed.
+ *
+ * The locks are tracked per owner, releasing k locks costs O(k log n) and an owner without
+ * locks costs a lookup.
+ *
+ * \param RangeLocks The locks of the file.
+ * \param Owner The handle owning the locks.
+ */
+VOID DOKANAPI DokanUnlockAllRanges(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner);
+
+/**
+ * \brief Check whether the locks allow an owner to read or write a byte range.
+ *
+ * An exclusive lock denies the read and the write to the other owners.
+ * A shared lock denies the write to everyone, including its owner.
+ *
+ * \param RangeLocks The locks of the file.
+ * \param Owner The handle reading or writing.
+ * \param ByteOffset Offset of the access.
+ * \param Length Length of the access.
+ * \param Write Whether the access is a write.
+ * \return \c TRUE if the access is allowed, \c FALSE if a lock conflicts.
+ */
+BOOL DOKANAPI DokanCheckRangeAccess(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner,
+                                    LONGLONG ByteOffset, LONGLONG Length,
+                                    BOOL Write);
+
 /**@}*/
 
 /**
@@ -47,6 +47,10 @@ extern "C" {
 
 #define DOKAN_MAX_THREAD 63
 
+// Time without saturation after which the extra threads of an auto scaled
+// worker pool exit, in milliseconds
+#define DOKAN_WORKER_IDLE_TIMEOUT 10000
+
 // DokanOptions->DebugMode is ON?
 extern BOOL g_DebugMode;
 
@@ -35,6 +35,65 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif
 
+typedef struct _DOKAN_INSTANCE DOKAN_INSTANCE, *PDOKAN_INSTANCE;
+
+/**
+ * \struct DOKAN_WORKER
+ * \brief A thread of a DOKAN_WORKER_POOL
+ */
+typedef struct _DOKAN_WORKER {
+  /** Entry in DOKAN_WORKER_POOL.IdleWorkerList while waiting on the driver */
+  LIST_ENTRY ListEntry;
+  /** Handle of the thread, to cancel its wait on the driver */
+  HANDLE Thread;
+  /** Set once the worker is accounted as exited and must stop */
+  BOOL Retired;
+} DOKAN_WORKER, *PDOKAN_WORKER;
+
+/**
+ * \struct DOKAN_WORKER_POOL
+ * \brief Threads waiting for the events of one lane of a mount
+ *
+ * The pool runs MinWorkers threads and, when MaxWorkers is higher, starts a
+ * new one each time no thread is left waiting on the driver. Extra threads
+ * exit once the pool was not saturated for IdleTimeout, after their event or,
+ * when no event comes, through TrimWorkerPool.
+ */
+typedef struct _DOKAN_WORKER_POOL {
+  /** Protects the counters below */
+  CRITICAL_SECTION CriticalSection;
+  /** Dokan instance the pool dispatches the events of */
+  PDOKAN_INSTANCE DokanInstance;
+  /** IOCTL used to wait for an event, IOCTL_EVENT_WAIT or IOCTL_EVENT_WAIT_BULK */
+  DWORD IoControlCode;
+  /** Number of threads always kept running */
+  ULONG MinWorkers;
+  /** Maximum number of threads */
+  ULONG MaxWorkers;
+  /** Threads started and not exited or retiring yet */
+  ULONG Workers;
+  /** Threads waiting for an event in the driver */
+  ULONG IdleWorkers;
+  /** Threads dispatching an event */
+  ULONG BusyWorkers;
+  /** Highest value Workers had */
+  ULONG PeakWorkers;
+  /** Number of events received */
+  ULONG64 Events;
+  /** Total time in milliseconds with no thread waiting in the driver */
+  ULONG64 SaturatedTime;
+  /** Tick at which the current saturation started, 0 if not saturated */
+  ULONGLONG SaturatedSince;
+  /** Tick of the last time the pool got saturated */
+  ULONGLONG LastSaturatedTick;
+  /** Time without saturation after which extra threads exit, in milliseconds */
+  ULONG IdleTimeout;
+  /** DOKAN_WORKER waiting on the driver */
+  LIST_ENTRY IdleWorkerList;
+  /** Set when the last thread exits */
+  HANDLE StoppedEvent;
+} DOKAN_WORKER_POOL, *PDOKAN_WORKER_POOL;
+
 /**
  * \struct DOKAN_INSTANCE
  * \brief Dokan mount instance informations
@@ -44,7 +103,7 @@ extern "C" {
  * \see DOKAN_OPTIONS
  * \see DOKAN_OPERATIONS
  */
-typedef struct _DOKAN_INSTANCE {
+struct _DOKAN_INSTANCE {
   /** to ensure that unmount dispatch is called at once */
   CRITICAL_SECTION CriticalSection;
 
@@ -70,7 +129,52 @@ typedef struct _DOKAN_INSTANCE {
 
   /** Current list entry informations */
   LIST_ENTRY ListEntry;
-} DOKAN_INSTANCE, *PDOKAN_INSTANCE;
+
+  /** Threads serving IOCTL_EVENT_WAIT */
+  DOKAN_WORKER_POOL WorkerPool;
+  /** Threads serving IOCTL_EVENT_WAIT_BULK, see DOKAN_OPTION_PRIORITY_LANES */
+  DOKAN_WORKER_POOL BulkWorkerPool;
+  /**
+   * Device handle the replies completed outside of a worker are sent on, see
+   * DOKAN_OPTION_ASYNC_COMPLETION. INVALID_HANDLE_VALUE when not opened.
+   */
+  HANDLE CompletionDevice;
+  /** DOKAN_IO_REQUEST not freed yet, protected by CriticalSection */
+  ULONG PendingIoRequests;
+  /** Set while PendingIoRequests is 0 */
+  HANDLE IoRequestsDrained;
+};
+
+/**
+ * \struct DOKAN_QUEUED_EVENT
+ * \brief Event held back until the previous events of its open are dispatched
+ *
+ * Used with \ref DOKAN_OPTION_ORDERED_DISPATCH.
+ */
+typedef struct _DOKAN_QUEUED_EVENT {
+  /** Entry in DOKAN_EVENT_ORDER.EventQueue */
+  LIST_ENTRY ListEntry;
+  /** Copy of the event received from the driver. Must stay the last field */
+  EVENT_CONTEXT EventContext;
+} DOKAN_QUEUED_EVENT, *PDOKAN_QUEUED_EVENT;
+
+/**
+ * \struct DOKAN_EVENT_ORDER
+ * \brief Dispatch order of the events of an open received on one lane
+ *
+ * Used with \ref DOKAN_OPTION_ORDERED_DISPATCH.
+ */
+typedef struct _DOKAN_EVENT_ORDER {
+  /** A worker is currently dispatching an event of this lane */
+  BOOL Dispatching;
+  /** EVENT_CONTEXT.OpenSequence of the next event to dispatch */
+  ULONG NextSequence;
+  /**
+   * Events held back, ordered by EVENT_CONTEXT.OpenSequence. Events without
+   * sequence are kept in arrival order after them.
+   */
+  LIST_ENTRY EventQueue;
+} DOKAN_EVENT_ORDER, *PDOKAN_EVENT_ORDER;
 
 /**
  * \struct DOKAN_OPEN_INFO
@@ -97,8 +201,41 @@ typedef struct _DOKAN_OPEN_INFO {
   PLIST_ENTRY StreamListHead;
   /** Used when dispatching the close once the OpenCount drops to 0 **/
   LPWSTR FileName;
+  /** Order of the events received on the metadata lane */
+  DOKAN_EVENT_ORDER EventOrder;
+  /** Order of the events received on the bulk lane */
+  DOKAN_EVENT_ORDER BulkEventOrder;
+  /** DOKAN_IO_REQUEST of this open not completed yet */
+  LIST_ENTRY IoRequests;
 } DOKAN_OPEN_INFO, *PDOKAN_OPEN_INFO;
 
+/**
+ * \struct DOKAN_IO_REQUEST
+ * \brief Read, write or flush request being dispatched
+ *
+ * Keeps everything the reply needs so that, with \ref DOKAN_OPTION_ASYNC_COMPLETION,
+ * the request can outlive the worker that dispatched it until
+ * \ref DokanCompleteRequest is called.
+ */
+typedef struct _DOKAN_IO_REQUEST {
+  /** Given to the FileSystem callback. Must stay the first field */
+  DOKAN_FILE_INFO FileInfo;
+  /** Entry in DOKAN_OPEN_INFO.IoRequests */
+  LIST_ENTRY ListEntry;
+  /** Dokan instance linked to the request */
+  PDOKAN_INSTANCE DokanInstance;
+  /** Open the request is done on, referenced until completion */
+  PDOKAN_OPEN_INFO OpenInfo;
+  /** Event received from the driver */
+  PEVENT_CONTEXT EventContext;
+  /** EventContext was allocated for this request and is freed with it */
+  BOOL EventContextAllocated;
+  /** Reply sent to the driver on completion */
+  PEVENT_INFORMATION EventInfo;
+  /** Size of EventInfo */
+  ULONG EventInfoLength;
+} DOKAN_IO_REQUEST, *PDOKAN_IO_REQUEST;
+
 BOOL DokanStart(PDOKAN_INSTANCE Instance);
 
 BOOL SendToDevice(LPCWSTR DeviceName, DWORD IoControlCode, PVOID InputBuffer,
@@ -113,6 +250,41 @@ void ALIGN_ALLOCATION_SIZE(PLARGE_INTEGER size, PDOKAN_OPTIONS DokanOptions);
 
 UINT __stdcall DokanLoop(PVOID Param);
 
+VOID InitializeWorkerPool(PDOKAN_WORKER_POOL Pool,
+                          PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                          ULONG MinWorkers, ULONG MaxWorkers);
+
+VOID DeleteWorkerPool(PDOKAN_WORKER_POOL Pool);
+
+BOOL StartWorkers(PDOKAN_WORKER_POOL Pool, ULONG Count);
+
+VOID WaitWorkerPools(PDOKAN_INSTANCE Instance);
+
+BOOL IsWorkerPoolAutoScaled(PDOKAN_WORKER_POOL Pool);
+
+VOID WorkerExited(PDOKAN_WORKER_POOL Pool);
+
+VOID WorkerWaitStarted(PDOKAN_WORKER_POOL Pool, PDOKAN_WORKER Worker);
+
+/**
+ * Accounts the end of a wait on the driver, that got an event or not.
+ * Returns TRUE when the pool is saturated and a new worker must be started.
+ */
+BOOL WorkerWaitEnded(PDOKAN_WORKER_POOL Pool, PDOKAN_WORKER Worker,
+                     BOOL GotEvent);
+
+/**
+ * Accounts the end of an event dispatch.
+ * Returns TRUE when the worker must exit, it is then accounted as exited.
+ */
+BOOL WorkerEventDone(PDOKAN_WORKER_POOL Pool, PDOKAN_WORKER Worker);
+
+/**
+ * Cancels the wait of the idle extra workers of a pool that was not saturated
+ * for its IdleTimeout, so they exit without waiting for an event.
+ */
+VOID TrimWorkerPool(PDOKAN_WORKER_POOL Pool);
+
 BOOL DokanMount(LPCWSTR MountPoint, LPCWSTR DeviceName,
                 PDOKAN_OPTIONS DokanOptions);
 
@@ -123,6 +295,31 @@ VOID SendEventInformation(HANDLE Handle, PEVENT_INFORMATION EventInfo,
 
 ULONG DispatchGetEventInformationLength(ULONG bufferSize);
 
+VOID DispatchEvent(HANDLE Handle, PEVENT_CONTEXT EventContext,
+                   PDOKAN_INSTANCE DokanInstance, BOOL BulkLane);
+
+PDOKAN_IO_REQUEST
+DispatchIoRequest(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
+                  PDOKAN_INSTANCE DokanInstance);
+
+BOOL IsIoRequestAsync(PDOKAN_IO_REQUEST Request);
+
+VOID CompleteIoRequest(HANDLE Handle, PDOKAN_IO_REQUEST Request);
+
+/**
+ * Unlinks and frees a request from DispatchIoRequest without replying.
+ * CompleteIoRequest ends with it.
+ */
+VOID FreeIoRequest(PDOKAN_IO_REQUEST Request);
+
+VOID SetReadResult(PDOKAN_IO_REQUEST Request, NTSTATUS Status,
+                   ULONG ReadLength);
+
+VOID SetWriteResult(PDOKAN_IO_REQUEST Request, NTSTATUS Status,
+                    ULONG WrittenLength);
+
+VOID SetFlushResult(PDOKAN_IO_REQUEST Request, NTSTATUS Status);
+
 PEVENT_INFORMATION
 DispatchCommon(PEVENT_CONTEXT EventContext, ULONG SizeOfEventInfo,
                PDOKAN_INSTANCE DokanInstance, PDOKAN_FILE_INFO DokanFileInfo,
@@ -22,41 +22,45 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 
+VOID SetFlushResult(PDOKAN_IO_REQUEST Request, NTSTATUS Status) {
+  if (Status == STATUS_NOT_IMPLEMENTED) {
+    Request->EventInfo->Status = STATUS_SUCCESS;
+  } else {
+    Request->EventInfo->Status =
+        Status != STATUS_SUCCESS ? STATUS_NOT_SUPPORTED : STATUS_SUCCESS;
+  }
+}
+
 VOID DispatchFlush(HANDLE Handle, PEVENT_CONTEXT EventContext,
                    PDOKAN_INSTANCE DokanInstance) {
-  DOKAN_FILE_INFO fileInfo;
-  PEVENT_INFORMATION eventInfo;
-  PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_IO_REQUEST request;
   NTSTATUS status;
   ULONG sizeOfEventInfo = DispatchGetEventInformationLength(0);
 
   CheckFileName(EventContext->Operation.Flush.FileName);
 
-  eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+  request = DispatchIoRequest(EventContext, sizeOfEventInfo, DokanInstance);
+  if (request == NULL) {
+    return;
+  }
 
-  DbgPrint("###Flush %04d\n", openInfo != NULL ? openInfo->EventId : -1);
+  DbgPrint("###Flush %04d\n",
+           request->OpenInfo != NULL ? request->OpenInfo->EventId : -1);
 
   if (DokanInstance->DokanOperations->FlushFileBuffers) {
 
     status = DokanInstance->DokanOperations->FlushFileBuffers(
-        EventContext->Operation.Flush.FileName, &fileInfo);
+        request->EventContext->Operation.Flush.FileName, &request->FileInfo);
 
   } else {
     status = STATUS_NOT_IMPLEMENTED;
   }
 
-  if (status == STATUS_NOT_IMPLEMENTED) {
-    eventInfo->Status = STATUS_SUCCESS;
-  } else {
-    eventInfo->Status =
-        status != STATUS_SUCCESS ? STATUS_NOT_SUPPORTED : STATUS_SUCCESS;
+  if (status == STATUS_PENDING && IsIoRequestAsync(request)) {
+    // Owned by the FileSystem until DokanCompleteRequest.
+    return;
   }
 
-  if (openInfo != NULL)
-    openInfo->UserContext = fileInfo.Context;
-
-  SendEventInformation(Handle, eventInfo, sizeOfEventInfo);
-  ReleaseDokanOpenInfo(eventInfo, &fileInfo, DokanInstance);
-  free(eventInfo);
+  SetFlushResult(request, status);
+  CompleteIoRequest(Handle, request);
 }
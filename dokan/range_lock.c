@@ -0,0 +1,551 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+  Copyright (C) 2015 - 2019 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+// A locked range [Start, End) of a file. The ranges are kept in an AVL tree
+// ordered by Start (then by Sequence for the ranges starting at the same
+// offset) where each node also stores the highest End of its subtree, which
+// lets a conflict lookup skip the subtrees that end before the range. Empty
+// ranges never conflict and are left out of these maximums.
+typedef struct _DOKAN_RANGE_LOCK {
+  struct _DOKAN_RANGE_LOCK *Left;
+  struct _DOKAN_RANGE_LOCK *Right;
+  ULONGLONG Start;
+  ULONGLONG End;
+  // Highest End of the non-empty ranges of the subtree, 0 if none.
+  ULONGLONG MaxEnd;
+  // Highest End of the non-empty exclusive ranges of the subtree, 0 if none.
+  ULONGLONG MaxExclusiveEnd;
+  ULONGLONG Sequence;
+  PVOID Owner;
+  // Ranges of the same owner.
+  LIST_ENTRY OwnerListEntry;
+  struct _DOKAN_RANGE_LOCK_OWNER *OwnerRanges;
+  BOOL Exclusive;
+  LONG Height;
+} DOKAN_RANGE_LOCK, *PDOKAN_RANGE_LOCK;
+
+// The ranges of an owner, so that releasing them does not look at the others.
+// Owners are in a hash table of chained buckets while they hold a range.
+typedef struct _DOKAN_RANGE_LOCK_OWNER {
+  struct _DOKAN_RANGE_LOCK_OWNER *Next;
+  PVOID Owner;
+  LIST_ENTRY Ranges;
+  ULONG Count;
+} DOKAN_RANGE_LOCK_OWNER, *PDOKAN_RANGE_LOCK_OWNER;
+
+struct _DOKAN_RANGE_LOCKS {
+  SRWLOCK Lock;
+  PDOKAN_RANGE_LOCK Root;
+  ULONG Count;
+  ULONGLONG NextSequence;
+  // Hash table of the owners, BucketCount is 0 or a power of two.
+  PDOKAN_RANGE_LOCK_OWNER *Owners;
+  ULONG BucketCount;
+  ULONG OwnerCount;
+};
+
+static LONG RangeLockHeight(PDOKAN_RANGE_LOCK Node) {
+  return Node ? Node->Height : 0;
+}
+
+static ULONGLONG RangeLockMaxEnd(PDOKAN_RANGE_LOCK Node) {
+  return Node ? Node->MaxEnd : 0;
+}
+
+static ULONGLONG RangeLockMaxExclusiveEnd(PDOKAN_RANGE_LOCK Node) {
+  return Node ? Node->MaxExclusiveEnd : 0;
+}
+
+// Recompute Height and the subtree maximums of Node from its children.
+static VOID RangeLockUpdate(PDOKAN_RANGE_LOCK Node) {
+  LONG leftHeight = RangeLockHeight(Node->Left);
+  LONG rightHeight = RangeLockHeight(Node->Right);
+  ULONGLONG maxEnd = Node->Start < Node->End ? Node->End : 0;
+  ULONGLONG maxExclusiveEnd = Node->Exclusive ? maxEnd : 0;
+
+  Node->Height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+  if (RangeLockMaxEnd(Node->Left) > maxEnd)
+    maxEnd = Node->Left->MaxEnd;
+  if (RangeLockMaxEnd(Node->Right) > maxEnd)
+    maxEnd = Node->Right->MaxEnd;
+  if (RangeLockMaxExclusiveEnd(Node->Left) > maxExclusiveEnd)
+    maxExclusiveEnd = Node->Left->MaxExclusiveEnd;
+  if (RangeLockMaxExclusiveEnd(Node->Right) > maxExclusiveEnd)
+    maxExclusiveEnd = Node->Right->MaxExclusiveEnd;
+  Node->MaxEnd = maxEnd;
+  Node->MaxExclusiveEnd = maxExclusiveEnd;
+}
+
+static PDOKAN_RANGE_LOCK RangeLockRotateRight(PDOKAN_RANGE_LOCK Node) {
+  PDOKAN_RANGE_LOCK left = Node->Left;
+  Node->Left = left->Right;
+  left->Right = Node;
+  RangeLockUpdate(Node);
+  RangeLockUpdate(left);
+  return left;
+}
+
+static PDOKAN_RANGE_LOCK RangeLockRotateLeft(PDOKAN_RANGE_LOCK Node) {
+  PDOKAN_RANGE_LOCK right = Node->Right;
+  Node->Right = right->Left;
+  right->Left = Node;
+  RangeLockUpdate(Node);
+  RangeLockUpdate(right);
+  return right;
+}
+
+// Update Node after one of its subtrees changed and rotate it when the
+// heights of its subtrees differ by more than one. Return the new subtree
+// root.
+static PDOKAN_RANGE_LOCK RangeLockBalance(PDOKAN_RANGE_LOCK Node) {
+  LONG balance;
+
+  RangeLockUpdate(Node);
+  balance = RangeLockHeight(Node->Left) - RangeLockHeight(Node->Right);
+  if (balance > 1) {
+    if (RangeLockHeight(Node->Left->Left) < RangeLockHeight(Node->Left->Right))
+      Node->Left = RangeLockRotateLeft(Node->Left);
+    return RangeLockRotateRight(Node);
+  }
+  if (balance < -1) {
+    if (RangeLockHeight(Node->Right->Right) <
+        RangeLockHeight(Node->Right->Left))
+      Node->Right = RangeLockRotateRight(Node->Right);
+    return RangeLockRotateLeft(Node);
+  }
+  return Node;
+}
+
+static BOOL RangeLockIsBefore(PDOKAN_RANGE_LOCK A, PDOKAN_RANGE_LOCK B) {
+  return A->Start < B->Start ||
+         (A->Start == B->Start && A->Sequence < B->Sequence);
+}
+
+static PDOKAN_RANGE_LOCK RangeLockInsert(PDOKAN_RANGE_LOCK Node,
+                                         PDOKAN_RANGE_LOCK NewNode) {
+  if (Node == NULL) {
+    RangeLockUpdate(NewNode);
+    return NewNode;
+  }
+  if (RangeLockIsBefore(NewNode, Node))
+    Node->Left = RangeLockInsert(Node->Left, NewNode);
+  else
+    Node->Right = RangeLockInsert(Node->Right, NewNode);
+  return RangeLockBalance(Node);
+}
+
+// Unlink the leftmost node of the subtree into *Min.
+static PDOKAN_RANGE_LOCK RangeLockRemoveMin(PDOKAN_RANGE_LOCK Node,
+                                            PDOKAN_RANGE_LOCK *Min) {
+  if (Node->Left == NULL) {
+    *Min = Node;
+    return Node->Right;
+  }
+  Node->Left = RangeLockRemoveMin(Node->Left, Min);
+  return RangeLockBalance(Node);
+}
+
+// Unlink Target from the subtree. Target must be in the subtree.
+static PDOKAN_RANGE_LOCK RangeLockRemove(PDOKAN_RANGE_LOCK Node,
+                                         PDOKAN_RANGE_LOCK Target) {
+  PDOKAN_RANGE_LOCK min;
+
+  if (Node == Target) {
+    if (Node->Right == NULL)
+      return Node->Left;
+    Node->Right = RangeLockRemoveMin(Node->Right, &min);
+    min->Left = Node->Left;
+    min->Right = Node->Right;
+    return RangeLockBalance(min);
+  }
+  if (RangeLockIsBefore(Target, Node))
+    Node->Left = RangeLockRemove(Node->Left, Target);
+  else
+    Node->Right = RangeLockRemove(Node->Right, Target);
+  return RangeLockBalance(Node);
+}
+
+// Return a range overlapping [Start, End), only looking at the exclusive
+// ranges when ExclusiveOnly is set. A subtree holding an overlapping range
+// that ends after Start is always the left one when the left subtree has one
+// ending after Start: otherwise that range starts after End and so do all the
+// ranges on the right. Only one path is walked.
+static PDOKAN_RANGE_LOCK RangeLockFindOverlap(PDOKAN_RANGE_LOCK Node,
+                                              ULONGLONG Start, ULONGLONG End,
+                                              BOOL ExclusiveOnly) {
+  if (Start == End)
+    return NULL;
+  while (Node != NULL) {
+    if (Node->Start < End && Start < Node->End && Node->Start < Node->End &&
+        (!ExclusiveOnly || Node->Exclusive))
+      return Node;
+    if (ExclusiveOnly ? RangeLockMaxExclusiveEnd(Node->Left) > Start
+                      : RangeLockMaxEnd(Node->Left) > Start)
+      Node = Node->Left;
+    else
+      Node = Node->Right;
+  }
+  return NULL;
+}
+
+// Return whether a range overlapping [Start, End) denies the access to
+// Owner. A range only allows the access to its owner when it is exclusive,
+// and shared ranges deny the write to everyone. Only the subtrees that can
+// overlap the range are visited.
+static BOOL RangeLockDeniesAccess(PDOKAN_RANGE_LOCK Node, PVOID Owner,
+                                  ULONGLONG Start, ULONGLONG End, BOOL Write) {
+  if (Start == End)
+    return FALSE;
+  while (Node != NULL) {
+    if ((Write ? Node->MaxEnd : Node->MaxExclusiveEnd) <= Start)
+      return FALSE;
+    if (RangeLockDeniesAccess(Node->Left, Owner, Start, End, Write))
+      return TRUE;
+    if (Node->Start >= End)
+      return FALSE;
+    if (Start < Node->End && Node->Start < Node->End &&
+        (Write || Node->Exclusive) &&
+        !(Node->Exclusive && Node->Owner == Owner))
+      return TRUE;
+    Node = Node->Right;
+  }
+  return FALSE;
+}
+
+// Return the range [Start, End) locked by Owner.
+static PDOKAN_RANGE_LOCK RangeLockFind(PDOKAN_RANGE_LOCK Node, PVOID Owner,
+                                       ULONGLONG Start, ULONGLONG End) {
+  PDOKAN_RANGE_LOCK found;
+
+  while (Node != NULL) {
+    if (Start < Node->Start) {
+      Node = Node->Left;
+    } else if (Start > Node->Start) {
+      Node = Node->Right;
+    } else {
+      if (Node->End == End && Node->Owner == Owner)
+        return Node;
+      // Ranges starting at the same offset can be on both sides.
+      found = RangeLockFind(Node->Left, Owner, Start, End);
+      if (found != NULL)
+        return found;
+      Node = Node->Right;
+    }
+  }
+  return NULL;
+}
+
+static VOID RangeLockFreeAll(PDOKAN_RANGE_LOCK Node) {
+  if (Node == NULL)
+    return;
+  RangeLockFreeAll(Node->Left);
+  RangeLockFreeAll(Node->Right);
+  free(Node);
+}
+
+// Owners are often pointers to aligned allocations, the multiplication mixes
+// their low bits in the high ones that are kept.
+static ULONG RangeLockOwnerBucket(PVOID Owner, ULONG BucketCount) {
+  ULONGLONG hash = (ULONGLONG)(ULONG_PTR)Owner * 0x9E3779B97F4A7C15ULL;
+  return (ULONG)(hash >> 32) & (BucketCount - 1);
+}
+
+static PDOKAN_RANGE_LOCK_OWNER RangeLockFindOwner(PDOKAN_RANGE_LOCKS RangeLocks,
+                                                  PVOID Owner) {
+  PDOKAN_RANGE_LOCK_OWNER owner;
+
+  if (RangeLocks->OwnerCount == 0)
+    return NULL;
+  owner = RangeLocks->Owners[RangeLockOwnerBucket(Owner,
+                                                  RangeLocks->BucketCount)];
+  while (owner != NULL && owner->Owner != Owner)
+    owner = owner->Next;
+  return owner;
+}
+
+// Return the entry of Owner, added when it holds no range yet. NULL when out
+// of memory.
+static PDOKAN_RANGE_LOCK_OWNER RangeLockAddOwner(PDOKAN_RANGE_LOCKS RangeLocks,
+                                                 PVOID Owner) {
+  PDOKAN_RANGE_LOCK_OWNER owner, next;
+  PDOKAN_RANGE_LOCK_OWNER *owners;
+  ULONG bucketCount, i, bucket;
+
+  owner = RangeLockFindOwner(RangeLocks, Owner);
+  if (owner != NULL)
+    return owner;
+
+  if (RangeLocks->OwnerCount >= RangeLocks->BucketCount) {
+    bucketCount = RangeLocks->BucketCount ? RangeLocks->BucketCount * 2 : 8;
+    owners = (PDOKAN_RANGE_LOCK_OWNER *)calloc(
+        bucketCount, sizeof(PDOKAN_RANGE_LOCK_OWNER));
+    if (owners == NULL)
+      return NULL;
+    for (i = 0; i < RangeLocks->BucketCount; ++i) {
+      for (owner = RangeLocks->Owners[i]; owner != NULL; owner = next) {
+        next = owner->Next;
+        bucket = RangeLockOwnerBucket(owner->Owner, bucketCount);
+        owner->Next = owners[bucket];
+        owners[bucket] = owner;
+      }
+    }
+    free(RangeLocks->Owners);
+    RangeLocks->Owners = owners;
+    RangeLocks->BucketCount = bucketCount;
+  }
+
+  owner = (PDOKAN_RANGE_LOCK_OWNER)malloc(sizeof(DOKAN_RANGE_LOCK_OWNER));
+  if (owner == NULL)
+    return NULL;
+  owner->Owner = Owner;
+  InitializeListHead(&owner->Ranges);
+  owner->Count = 0;
+  bucket = RangeLockOwnerBucket(Owner, RangeLocks->BucketCount);
+  owner->Next = RangeLocks->Owners[bucket];
+  RangeLocks->Owners[bucket] = owner;
+  ++RangeLocks->OwnerCount;
+  return owner;
+}
+
+static VOID RangeLockRemoveOwner(PDOKAN_RANGE_LOCKS RangeLocks,
+                                 PDOKAN_RANGE_LOCK_OWNER Owner) {
+  PDOKAN_RANGE_LOCK_OWNER *link;
+
+  link = &RangeLocks->Owners[RangeLockOwnerBucket(Owner->Owner,
+                                                 RangeLocks->BucketCount)];
+  while (*link != Owner)
+    link = &(*link)->Next;
+  *link = Owner->Next;
+  --RangeLocks->OwnerCount;
+  free(Owner);
+}
+
+// Unlink RangeLock from the ranges of its owner, whose entry is removed with
+// its last range.
+static VOID RangeLockRemoveFromOwner(PDOKAN_RANGE_LOCKS RangeLocks,
+                                     PDOKAN_RANGE_LOCK RangeLock) {
+  RemoveEntryList(&RangeLock->OwnerListEntry);
+  if (--RangeLock->OwnerRanges->Count == 0)
+    RangeLockRemoveOwner(RangeLocks, RangeLock->OwnerRanges);
+}
+
+// Convert ByteOffset and Length to the range [*Start, *End).
+static BOOL RangeLockGetRange(LONGLONG ByteOffset, LONGLONG Length,
+                              ULONGLONG *Start, ULONGLONG *End) {
+  if (ByteOffset < 0 || Length < 0)
+    return FALSE;
+  *Start = (ULONGLONG)ByteOffset;
+  *End = *Start + (ULONGLONG)Length;
+  return TRUE;
+}
+
+PDOKAN_RANGE_LOCKS DOKANAPI DokanCreateRangeLocks() {
+  PDOKAN_RANGE_LOCKS rangeLocks;
+
+  rangeLocks = (PDOKAN_RANGE_LOCKS)malloc(sizeof(DOKAN_RANGE_LOCKS));
+  if (rangeLocks == NULL)
+    return NULL;
+  RtlZeroMemory(rangeLocks, sizeof(DOKAN_RANGE_LOCKS));
+  InitializeSRWLock(&rangeLocks->Lock);
+  return rangeLocks;
+}
+
+VOID DOKANAPI DokanDeleteRangeLocks(PDOKAN_RANGE_LOCKS RangeLocks) {
+  PDOKAN_RANGE_LOCK_OWNER owner, next;
+  ULONG i;
+
+  if (RangeLocks == NULL)
+    return;
+  RangeLockFreeAll(RangeLocks->Root);
+  for (i = 0; i < RangeLocks->BucketCount; ++i) {
+    for (owner = RangeLocks->Owners[i]; owner != NULL; owner = next) {
+      next = owner->Next;
+      free(owner);
+    }
+  }
+  free(RangeLocks->Owners);
+  free(RangeLocks);
+}
+
+NTSTATUS DOKANAPI DokanLockRange(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner,
+                                 LONGLONG ByteOffset, LONGLONG Length,
+                                 BOOL Exclusive) {
+  PDOKAN_RANGE_LOCK rangeLock;
+  PDOKAN_RANGE_LOCK_OWNER owner;
+  ULONGLONG start, end;
+
+  if (!RangeLockGetRange(ByteOffset, Length, &start, &end))
+    return STATUS_INVALID_PARAMETER;
+
+  rangeLock = (PDOKAN_RANGE_LOCK)malloc(sizeof(DOKAN_RANGE_LOCK));
+  if (rangeLock == NULL)
+    return STATUS_INSUFFICIENT_RESOURCES;
+  RtlZeroMemory(rangeLock, sizeof(DOKAN_RANGE_LOCK));
+  rangeLock->Start = start;
+  rangeLock->End = end;
+  rangeLock->Owner = Owner;
+  rangeLock->Exclusive = Exclusive;
+
+  AcquireSRWLockExclusive(&RangeLocks->Lock);
+  // An exclusive range cannot overlap any range and a shared range cannot
+  // overlap an exclusive one, whoever owns them.
+  if (RangeLockFindOverlap(RangeLocks->Root, start, end, !Exclusive)) {
+    ReleaseSRWLockExclusive(&RangeLocks->Lock);
+    free(rangeLock);
+    return STATUS_LOCK_NOT_GRANTED;
+  }
+  owner = RangeLockAddOwner(RangeLocks, Owner);
+  if (owner == NULL) {
+    ReleaseSRWLockExclusive(&RangeLocks->Lock);
+    free(rangeLock);
+    return STATUS_INSUFFICIENT_RESOURCES;
+  }
+  InsertTailList(&owner->Ranges, &rangeLock->OwnerListEntry);
+  ++owner->Count;
+  rangeLock->OwnerRanges = owner;
+  rangeLock->Sequence = RangeLocks->NextSequence++;
+  RangeLocks->Root = RangeLockInsert(RangeLocks->Root, rangeLock);
+  ++RangeLocks->Count;
+  ReleaseSRWLockExclusive(&RangeLocks->Lock);
+  return STATUS_SUCCESS;
+}
+
+NTSTATUS DOKANAPI DokanUnlockRange(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner,
+                                   LONGLONG ByteOffset, LONGLONG Length) {
+  PDOKAN_RANGE_LOCK rangeLock;
+  ULONGLONG start, end;
+
+  if (!RangeLockGetRange(ByteOffset, Length, &start, &end))
+    return STATUS_RANGE_NOT_LOCKED;
+
+  AcquireSRWLockExclusive(&RangeLocks->Lock);
+  rangeLock = RangeLockFind(RangeLocks->Root, Owner, start, end);
+  if (rangeLock == NULL) {
+    ReleaseSRWLockExclusive(&RangeLocks->Lock);
+    return STATUS_RANGE_NOT_LOCKED;
+  }
+  RangeLocks->Root = RangeLockRemove(RangeLocks->Root, rangeLock);
+  --RangeLocks->Count;
+  RangeLockRemoveFromOwner(RangeLocks, rangeLock);
+  ReleaseSRWLockExclusive(&RangeLocks->Lock);
+  free(rangeLock);
+  return STATUS_SUCCESS;
+}
+
+// Move the ranges of the subtree to the list *Kept in order, chained by
+// their Right pointer, except the ranges of Owner that are moved to *Freed.
+static VOID RangeLockFlatten(PDOKAN_RANGE_LOCK Node, PVOID Owner,
+                             PDOKAN_RANGE_LOCK *Kept, PDOKAN_RANGE_LOCK *Freed) {
+  PDOKAN_RANGE_LOCK left;
+
+  while (Node != NULL) {
+    // Walk from the last range so each one is pushed at the list head.
+    RangeLockFlatten(Node->Right, Owner, Kept, Freed);
+    left = Node->Left;
+    Node->Left = NULL;
+    if (Node->Owner == Owner) {
+      Node->Right = *Freed;
+      *Freed = Node;
+    } else {
+      Node->Right = *Kept;
+      *Kept = Node;
+    }
+    Node = left;
+  }
+}
+
+// Build a balanced tree from the Count first ranges of the ordered list
+// *List, which is advanced past them.
+static PDOKAN_RANGE_LOCK RangeLockBuild(PDOKAN_RANGE_LOCK *List, ULONG Count) {
+  PDOKAN_RANGE_LOCK left, node;
+
+  if (Count == 0)
+    return NULL;
+  left = RangeLockBuild(List, Count / 2);
+  node = *List;
+  *List = node->Right;
+  node->Left = left;
+  node->Right = RangeLockBuild(List, Count - Count / 2 - 1);
+  RangeLockUpdate(node);
+  return node;
+}
+
+VOID DOKANAPI DokanUnlockAllRanges(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner) {
+  PDOKAN_RANGE_LOCK_OWNER owner;
+  PDOKAN_RANGE_LOCK kept = NULL;
+  PDOKAN_RANGE_LOCK freed = NULL;
+  PDOKAN_RANGE_LOCK next;
+  PLIST_ENTRY entry;
+  ULONG count = 0;
+
+  AcquireSRWLockExclusive(&RangeLocks->Lock);
+  // A handle releases all its ranges when it is closed, most hold none.
+  owner = RangeLockFindOwner(RangeLocks, Owner);
+  if (owner == NULL) {
+    ReleaseSRWLockExclusive(&RangeLocks->Lock);
+    return;
+  }
+  if ((ULONGLONG)owner->Count * RangeLockHeight(RangeLocks->Root) <
+      RangeLocks->Count) {
+    // Few ranges, removed one by one.
+    for (entry = owner->Ranges.Flink; entry != &owner->Ranges;
+         entry = entry->Flink) {
+      next = CONTAINING_RECORD(entry, DOKAN_RANGE_LOCK, OwnerListEntry);
+      RangeLocks->Root = RangeLockRemove(RangeLocks->Root, next);
+      next->Right = freed;
+      freed = next;
+    }
+    RangeLocks->Count -= owner->Count;
+  } else {
+    // The tree is rebuilt without them in a single pass.
+    RangeLockFlatten(RangeLocks->Root, Owner, &kept, &freed);
+    for (next = kept; next != NULL; next = next->Right)
+      ++count;
+    RangeLocks->Root = RangeLockBuild(&kept, count);
+    RangeLocks->Count = count;
+  }
+  RangeLockRemoveOwner(RangeLocks, owner);
+  ReleaseSRWLockExclusive(&RangeLocks->Lock);
+
+  while (freed != NULL) {
+    next = freed->Right;
+    free(freed);
+    freed = next;
+  }
+}
+
+BOOL DOKANAPI DokanCheckRangeAccess(PDOKAN_RANGE_LOCKS RangeLocks, PVOID Owner,
+                                    LONGLONG ByteOffset, LONGLONG Length,
+                                    BOOL Write) {
+  ULONGLONG start, end;
+  BOOL denied;
+
+  if (!RangeLockGetRange(ByteOffset, Length, &start, &end))
+    return TRUE;
+
+  AcquireSRWLockShared(&RangeLocks->Lock);
+  denied = RangeLockDeniesAccess(RangeLocks->Root, Owner, start, end, Write);
+  ReleaseSRWLockShared(&RangeLocks->Lock);
+  return !denied;
+}
@@ -22,46 +22,57 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "dokani.h"
 
+VOID SetReadResult(PDOKAN_IO_REQUEST Request, NTSTATUS Status,
+                   ULONG ReadLength) {
+  PEVENT_INFORMATION eventInfo = Request->EventInfo;
+
+  eventInfo->BufferLength = 0;
+  eventInfo->Status = Status;
+
+  if (Status == STATUS_SUCCESS) {
+    if (ReadLength == 0) {
+      eventInfo->Status = STATUS_END_OF_FILE;
+    } else {
+      eventInfo->BufferLength = ReadLength;
+      eventInfo->Operation.Read.CurrentByteOffset.QuadPart =
+          Request->EventContext->Operation.Read.ByteOffset.QuadPart +
+          ReadLength;
+    }
+  }
+}
+
 VOID DispatchRead(HANDLE Handle, PEVENT_CONTEXT EventContext,
                   PDOKAN_INSTANCE DokanInstance) {
-  PEVENT_INFORMATION eventInfo;
-  PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_IO_REQUEST request;
+  PEVENT_CONTEXT eventContext;
   ULONG readLength = 0;
   NTSTATUS status = STATUS_NOT_IMPLEMENTED;
-  DOKAN_FILE_INFO fileInfo;
   ULONG sizeOfEventInfo = DispatchGetEventInformationLength(
       EventContext->Operation.Read.BufferLength);
 
   CheckFileName(EventContext->Operation.Read.FileName);
 
-  eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+  request = DispatchIoRequest(EventContext, sizeOfEventInfo, DokanInstance);
+  if (request == NULL) {
+    return;
+  }
+  eventContext = request->EventContext;
 
-  DbgPrint("###Read %04d\n", openInfo != NULL ? openInfo->EventId : -1);
+  DbgPrint("###Read %04d\n",
+           request->OpenInfo != NULL ? request->OpenInfo->EventId : -1);
 
   if (DokanInstance->DokanOperations->ReadFile) {
     status = DokanInstance->DokanOperations->ReadFile(
-        EventContext->Operation.Read.FileName, eventInfo->Buffer,
-        EventContext->Operation.Read.BufferLength, &readLength,
-        EventContext->Operation.Read.ByteOffset.QuadPart, &fileInfo);
+        eventContext->Operation.Read.FileName, request->EventInfo->Buffer,
+        eventContext->Operation.Read.BufferLength, &readLength,
+        eventContext->Operation.Read.ByteOffset.QuadPart, &request->FileInfo);
   }
 
-  if (openInfo != NULL)
-    openInfo->UserContext = fileInfo.Context;
-  eventInfo->BufferLength = 0;
-  eventInfo->Status = status;
-
-  if (status == STATUS_SUCCESS) {
-    if (readLength == 0) {
-      eventInfo->Status = STATUS_END_OF_FILE;
-    } else {
-      eventInfo->BufferLength = readLength;
-      eventInfo->Operation.Read.CurrentByteOffset.QuadPart =
-          EventContext->Operation.Read.ByteOffset.QuadPart + readLength;
-    }
+  if (status == STATUS_PENDING && IsIoRequestAsync(request)) {
+    // Owned by the FileSystem until DokanCompleteRequest.
+    return;
   }
 
-  SendEventInformation(Handle, eventInfo, sizeOfEventInfo);
-  ReleaseDokanOpenInfo(eventInfo, &fileInfo, DokanInstance);
-  free(eventInfo);
+  SetReadResult(request, status, readLength);
+  CompleteIoRequest(Handle, request);
 }
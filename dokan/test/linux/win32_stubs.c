@@ -0,0 +1,99 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+
+#include <windows.h>
+
+typedef struct _TEST_EVENT {
+  pthread_mutex_t Mutex;
+  pthread_cond_t Signaled;
+  BOOL ManualReset;
+  BOOL State;
+} TEST_EVENT, *PTEST_EVENT;
+
+HANDLE CreateEvent(PVOID EventAttributes, BOOL ManualReset, BOOL InitialState,
+                   LPCWSTR Name) {
+  PTEST_EVENT event = (PTEST_EVENT)malloc(sizeof(TEST_EVENT));
+  (void)EventAttributes;
+  (void)Name;
+  if (event == NULL) {
+    return NULL;
+  }
+  pthread_mutex_init(&event->Mutex, NULL);
+  pthread_cond_init(&event->Signaled, NULL);
+  event->ManualReset = ManualReset;
+  event->State = InitialState;
+  return event;
+}
+
+BOOL SetEvent(HANDLE Event) {
+  PTEST_EVENT event = (PTEST_EVENT)Event;
+  pthread_mutex_lock(&event->Mutex);
+  event->State = TRUE;
+  pthread_cond_broadcast(&event->Signaled);
+  pthread_mutex_unlock(&event->Mutex);
+  return TRUE;
+}
+
+BOOL ResetEvent(HANDLE Event) {
+  PTEST_EVENT event = (PTEST_EVENT)Event;
+  pthread_mutex_lock(&event->Mutex);
+  event->State = FALSE;
+  pthread_mutex_unlock(&event->Mutex);
+  return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds) {
+  PTEST_EVENT event = (PTEST_EVENT)Handle;
+  struct timespec deadline;
+  DWORD result = WAIT_OBJECT_0;
+
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += Milliseconds / 1000;
+  deadline.tv_nsec += (long)(Milliseconds % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&event->Mutex);
+  while (!event->State) {
+    if (Milliseconds == INFINITE) {
+      pthread_cond_wait(&event->Signaled, &event->Mutex);
+    } else if (pthread_cond_timedwait(&event->Signaled, &event->Mutex,
+                                      &deadline) == ETIMEDOUT) {
+      result = WAIT_TIMEOUT;
+      break;
+    }
+  }
+  if (result == WAIT_OBJECT_0 && !event->ManualReset) {
+    event->State = FALSE;
+  }
+  pthread_mutex_unlock(&event->Mutex);
+  return result;
+}
+
+BOOL CloseHandle(HANDLE Object) {
+  PTEST_EVENT event = (PTEST_EVENT)Object;
+  pthread_cond_destroy(&event->Signaled);
+  pthread_mutex_destroy(&event->Mutex);
+  free(event);
+  return TRUE;
+}
@@ -0,0 +1,258 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Byte-range locks of range_lock.c against a brute force model, and their use
+// from several threads.
+//
+//   range_lock_test [operations]
+
+#include "dokan.h"
+
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+PVOID owner_of(int owner) { return reinterpret_cast<PVOID>(uintptr_t(owner)); }
+
+// Every lock in a list, in locking order. Empty ranges never conflict.
+struct model {
+  struct range {
+    LONGLONG start, end;
+    int owner;
+    bool exclusive;
+  };
+  std::vector<range> ranges;
+
+  static bool overlap(const range &r, LONGLONG start, LONGLONG end) {
+    return r.start < end && start < r.end && r.start < r.end && start < end;
+  }
+
+  NTSTATUS lock(int owner, LONGLONG offset, LONGLONG length, bool exclusive) {
+    if (offset < 0 || length < 0)
+      return STATUS_INVALID_PARAMETER;
+    for (const auto &r : ranges)
+      if (overlap(r, offset, offset + length) && (exclusive || r.exclusive))
+        return STATUS_LOCK_NOT_GRANTED;
+    ranges.push_back({offset, offset + length, owner, exclusive});
+    return STATUS_SUCCESS;
+  }
+
+  NTSTATUS unlock(int owner, LONGLONG offset, LONGLONG length) {
+    for (auto i = ranges.begin(); i != ranges.end(); ++i)
+      if (i->owner == owner && i->start == offset &&
+          i->end == offset + length) {
+        ranges.erase(i);
+        return STATUS_SUCCESS;
+      }
+    return STATUS_RANGE_NOT_LOCKED;
+  }
+
+  void unlock_all(int owner) {
+    std::vector<range> kept;
+    for (const auto &r : ranges)
+      if (r.owner != owner)
+        kept.push_back(r);
+    ranges.swap(kept);
+  }
+
+  bool check(int owner, LONGLONG offset, LONGLONG length, bool write) const {
+    if (offset < 0 || length < 0)
+      return true;
+    for (const auto &r : ranges)
+      if (overlap(r, offset, offset + length) && (write || r.exclusive) &&
+          !(r.exclusive && r.owner == owner))
+        return false;
+    return true;
+  }
+};
+
+// Random calls with a few owners on a small file so that ranges overlap
+// often, shared and exclusive.
+void test_model(int operations) {
+  PDOKAN_RANGE_LOCKS locks = DokanCreateRangeLocks();
+  CHECK(locks != NULL);
+  model expected;
+  std::mt19937 rng(1);
+  for (int f = 0; f < operations; ++f) {
+    const int operation = rng() % 10;
+    LONGLONG offset = rng() % 2000;
+    const LONGLONG length = rng() % 40;
+    int owner = rng() % 6 + 1;
+    const bool flag = rng() % 2;
+    if (rng() % 1000 == 0)
+      offset = -offset - 1;
+
+    if (operation < 4) {
+      CHECK(DokanLockRange(locks, owner_of(owner), offset, length, flag) ==
+            expected.lock(owner, offset, length, flag));
+    } else if (operation < 6 && !expected.ranges.empty()) {
+      // An existing lock, sometimes with the wrong owner
+      const auto r = expected.ranges[rng() % expected.ranges.size()];
+      owner = rng() % 4 ? r.owner : rng() % 6 + 1;
+      CHECK(DokanUnlockRange(locks, owner_of(owner), r.start,
+                             r.end - r.start) ==
+            expected.unlock(owner, r.start, r.end - r.start));
+    } else if (operation < 9) {
+      CHECK(DokanCheckRangeAccess(locks, owner_of(owner), offset, length,
+                                  flag) ==
+            (expected.check(owner, offset, length, flag) ? TRUE : FALSE));
+    } else if (rng() % 20 == 0) {
+      DokanUnlockAllRanges(locks, owner_of(owner));
+      expected.unlock_all(owner);
+    }
+  }
+  DokanDeleteRangeLocks(locks);
+}
+
+// Many owners holding a few ranges each, so that releasing the ranges of one
+// removes them one by one, and owners holding none.
+void test_owners() {
+  PDOKAN_RANGE_LOCKS locks = DokanCreateRangeLocks();
+  CHECK(locks != NULL);
+  model expected;
+  std::mt19937 rng(2);
+  const int owners = 300;
+  for (int round = 0; round < 3; ++round) {
+    for (int owner = 1; owner <= owners; ++owner)
+      for (int f = 0; f < 3; ++f) {
+        const LONGLONG offset = rng() % 100000;
+        const LONGLONG length = rng() % 50;
+        const bool exclusive = rng() % 2;
+        CHECK(DokanLockRange(locks, owner_of(owner), offset, length,
+                             exclusive) ==
+              expected.lock(owner, offset, length, exclusive));
+      }
+    for (int f = 0; f < owners; ++f) {
+      // Every other release is for an owner without ranges.
+      const int owner = f % 2 ? rng() % owners + 1 : owners + 1 + f;
+      DokanUnlockAllRanges(locks, owner_of(owner));
+      expected.unlock_all(owner);
+      const LONGLONG offset = rng() % 100000;
+      const int checker = rng() % (owners + 1);
+      CHECK(DokanCheckRangeAccess(locks, owner_of(checker), offset, 100,
+                                  TRUE) ==
+            (expected.check(checker, offset, 100, true) ? TRUE : FALSE));
+    }
+    // The ranges left are only unlocked by their owner.
+    const auto left = expected.ranges;
+    for (const auto &r : left) {
+      const int owner = r.owner + 1;
+      CHECK(DokanUnlockRange(locks, owner_of(owner), r.start,
+                             r.end - r.start) ==
+            expected.unlock(owner, r.start, r.end - r.start));
+    }
+  }
+  for (int owner = 1; owner <= owners; ++owner)
+    DokanUnlockAllRanges(locks, owner_of(owner));
+  CHECK(DokanLockRange(locks, owner_of(1), 0, 200000, TRUE) ==
+        STATUS_SUCCESS);
+  DokanDeleteRangeLocks(locks);
+}
+
+// Ranges at the end of the offsets.
+void test_limits() {
+  PDOKAN_RANGE_LOCKS locks = DokanCreateRangeLocks();
+  CHECK(locks != NULL);
+  const LONGLONG max = INT64_MAX;
+  CHECK(DokanLockRange(locks, owner_of(1), max - 10, 10, TRUE) ==
+        STATUS_SUCCESS);
+  CHECK(DokanLockRange(locks, owner_of(2), 0, max, TRUE) ==
+        STATUS_LOCK_NOT_GRANTED);
+  CHECK(DokanLockRange(locks, owner_of(2), max, max, TRUE) == STATUS_SUCCESS);
+  CHECK(!DokanCheckRangeAccess(locks, owner_of(2), max - 1, 1, FALSE));
+  CHECK(DokanCheckRangeAccess(locks, owner_of(1), max - 1, 1, TRUE));
+  // Empty ranges never conflict
+  CHECK(DokanLockRange(locks, owner_of(3), max - 5, 0, TRUE) ==
+        STATUS_SUCCESS);
+  CHECK(DokanUnlockRange(locks, owner_of(3), max - 5, 0) == STATUS_SUCCESS);
+  CHECK(DokanUnlockRange(locks, owner_of(3), max - 5, 0) ==
+        STATUS_RANGE_NOT_LOCKED);
+  DokanDeleteRangeLocks(locks);
+}
+
+// Empty ranges are kept but neither conflict nor deny any access.
+void test_empty() {
+  PDOKAN_RANGE_LOCKS locks = DokanCreateRangeLocks();
+  CHECK(locks != NULL);
+  for (LONGLONG offset = 0; offset < 100; offset += 10)
+    CHECK(DokanLockRange(locks, owner_of(1), offset + 5, 0, TRUE) ==
+          STATUS_SUCCESS);
+  CHECK(DokanLockRange(locks, owner_of(2), 57, 1, TRUE) == STATUS_SUCCESS);
+  CHECK(DokanLockRange(locks, owner_of(3), 0, 100, FALSE) ==
+        STATUS_LOCK_NOT_GRANTED);
+  CHECK(DokanCheckRangeAccess(locks, owner_of(3), 0, 57, TRUE));
+  CHECK(!DokanCheckRangeAccess(locks, owner_of(3), 0, 100, FALSE));
+  CHECK(DokanUnlockRange(locks, owner_of(2), 57, 1) == STATUS_SUCCESS);
+  CHECK(DokanLockRange(locks, owner_of(3), 0, 100, TRUE) == STATUS_SUCCESS);
+  CHECK(DokanCheckRangeAccess(locks, owner_of(2), 57, 0, TRUE));
+  CHECK(DokanUnlockRange(locks, owner_of(1), 55, 0) == STATUS_SUCCESS);
+  DokanDeleteRangeLocks(locks);
+}
+
+// Each thread locks, checks and unlocks its own ranges of a shared file while
+// reading a range locked shared by everyone. Meant for ThreadSanitizer.
+void test_threads() {
+  PDOKAN_RANGE_LOCKS locks = DokanCreateRangeLocks();
+  CHECK(locks != NULL);
+  CHECK(DokanLockRange(locks, owner_of(100), 0, 100, FALSE) ==
+        STATUS_SUCCESS);
+  const int threads = 4;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+    workers.emplace_back([locks, t] {
+      const LONGLONG base = 1000 * (t + 1);
+      for (int f = 0; f < 2000; ++f) {
+        CHECK(DokanLockRange(locks, owner_of(t), base + f % 10 * 10, 10,
+                             f % 2) == STATUS_SUCCESS);
+        CHECK(DokanCheckRangeAccess(locks, owner_of(t), base, 100, FALSE));
+        CHECK(!DokanCheckRangeAccess(locks, owner_of(t), 50, 10, TRUE));
+        if (f % 10 == 9)
+          DokanUnlockAllRanges(locks, owner_of(t));
+      }
+    });
+  for (auto &w : workers)
+    w.join();
+  DokanDeleteRangeLocks(locks);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int operations = argc > 1 ? atoi(argv[1]) : 400000;
+  test_model(operations);
+  test_owners();
+  test_limits();
+  test_empty();
+  test_threads();
+  printf("range_lock_test passed\n");
+  return 0;
+}
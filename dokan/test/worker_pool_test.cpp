@@ -0,0 +1,233 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+// Auto scaled worker pool of worker_pool.c: it grows while saturated and,
+// with no more traffic, TrimWorkerPool brings it back to MinWorkers.
+// The workers run the same steps as DokanLoop against a fake driver.
+//
+//   worker_pool_test
+
+#include "dokani.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+// A worker thread as seen by the fake driver, its address is the thread
+// handle given to CancelSynchronousIo.
+struct test_thread {
+  bool waiting = false;
+  bool cancelled = false;
+};
+
+// Queue of events of the fake driver. The dispatch of an event blocks while
+// the driver is held, to keep workers busy.
+struct fake_driver {
+  std::mutex mutex;
+  std::condition_variable changed;
+  int events = 0;
+  bool held = false;
+  bool stopping = false;
+
+  // Like the IOCTL_EVENT_WAIT of a worker, FALSE once cancelled or stopping.
+  bool wait(test_thread *self) {
+    std::unique_lock<std::mutex> lock(mutex);
+    self->waiting = true;
+    changed.wait(lock, [&] {
+      return events > 0 || self->cancelled || stopping;
+    });
+    self->waiting = false;
+    if (self->cancelled || events == 0)
+      return false;
+    --events;
+    return true;
+  }
+
+  void dispatch() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&] { return !held || stopping; });
+  }
+
+  bool cancel(test_thread *thread) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!thread->waiting)
+      return false;
+    thread->cancelled = true;
+    changed.notify_all();
+    return true;
+  }
+
+  void update(const std::function<void()> &change) {
+    std::lock_guard<std::mutex> lock(mutex);
+    change();
+    changed.notify_all();
+  }
+};
+
+fake_driver driver;
+std::mutex threads_mutex;
+std::vector<std::thread> threads;
+int retired = 0;
+
+void worker_loop(PDOKAN_WORKER_POOL pool);
+
+// StartWorkers of dokan.c.
+void start_workers(PDOKAN_WORKER_POOL pool, ULONG count) {
+  for (ULONG i = 0; i < count; ++i) {
+    EnterCriticalSection(&pool->CriticalSection);
+    pool->Workers++;
+    pool->PeakWorkers = std::max(pool->PeakWorkers, pool->Workers);
+    LeaveCriticalSection(&pool->CriticalSection);
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    threads.emplace_back(worker_loop, pool);
+  }
+}
+
+// DokanLoop of dokan.c, without the device.
+void worker_loop(PDOKAN_WORKER_POOL pool) {
+  test_thread self;
+  DOKAN_WORKER worker;
+  ZeroMemory(&worker, sizeof(DOKAN_WORKER));
+  InitializeListHead(&worker.ListEntry);
+  worker.Thread = &self;
+  for (;;) {
+    WorkerWaitStarted(pool, &worker);
+    const bool got_event = driver.wait(&self);
+    if (WorkerWaitEnded(pool, &worker, got_event))
+      start_workers(pool, 1);
+    if (!got_event) {
+      EnterCriticalSection(&pool->CriticalSection);
+      if (worker.Retired)
+        ++retired;
+      else
+        WorkerExited(pool);
+      LeaveCriticalSection(&pool->CriticalSection);
+      return;
+    }
+    driver.dispatch();
+    if (WorkerEventDone(pool, &worker)) {
+      EnterCriticalSection(&pool->CriticalSection);
+      ++retired;
+      LeaveCriticalSection(&pool->CriticalSection);
+      return;
+    }
+  }
+}
+
+// Waits up to 10 seconds for a state of the pool, calling step meanwhile.
+bool wait_for(PDOKAN_WORKER_POOL pool,
+              const std::function<bool()> &state,
+              const std::function<void()> &step = [] {}) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (std::chrono::steady_clock::now() < deadline) {
+    EnterCriticalSection(&pool->CriticalSection);
+    const bool reached = state();
+    LeaveCriticalSection(&pool->CriticalSection);
+    if (reached)
+      return true;
+    step();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+// Saturates the pool with held events until it reaches MaxWorkers.
+void grow(PDOKAN_WORKER_POOL pool) {
+  driver.update([&] {
+    driver.held = true;
+    driver.events = static_cast<int>(pool->MaxWorkers);
+  });
+  CHECK(wait_for(pool, [&] { return pool->BusyWorkers == pool->MaxWorkers; }));
+  CHECK(pool->Workers == pool->MaxWorkers);
+  CHECK(pool->IdleWorkers == 0);
+  driver.update([&] { driver.held = false; });
+  CHECK(wait_for(pool, [&] { return pool->IdleWorkers == pool->Workers; }));
+}
+
+void test_grow_and_shrink() {
+  DOKAN_WORKER_POOL pool;
+  int instance;
+  InitializeWorkerPool(&pool, reinterpret_cast<PDOKAN_INSTANCE>(&instance), 0,
+                       2, 6);
+  pool.IdleTimeout = 300;
+  start_workers(&pool, pool.MinWorkers);
+  CHECK(wait_for(&pool, [&] { return pool.IdleWorkers == 2; }));
+
+  for (int cycle = 0; cycle < 2; ++cycle) {
+    grow(&pool);
+    CHECK(pool.PeakWorkers == 6);
+
+    // Freshly saturated, the extra workers are kept.
+    TrimWorkerPool(&pool);
+    EnterCriticalSection(&pool.CriticalSection);
+    CHECK(pool.Workers == 6);
+    LeaveCriticalSection(&pool.CriticalSection);
+
+    // No event comes anymore, only the trim can retire them.
+    CHECK(wait_for(&pool, [&] { return pool.Workers == pool.MinWorkers; },
+                   [&] { TrimWorkerPool(&pool); }));
+    CHECK(wait_for(&pool, [&] {
+      return retired == 4 * (cycle + 1) && pool.IdleWorkers == 2;
+    }));
+    CHECK(pool.BusyWorkers == 0);
+    CHECK(pool.Events == 6u * (cycle + 1));
+  }
+
+  driver.update([&] { driver.stopping = true; });
+  CHECK(WaitForSingleObject(pool.StoppedEvent, INFINITE) == WAIT_OBJECT_0);
+  CHECK(pool.Workers == 0);
+  std::vector<std::thread> exited;
+  {
+    std::lock_guard<std::mutex> lock(threads_mutex);
+    exited.swap(threads);
+  }
+  for (auto &thread : exited)
+    thread.join();
+  DeleteWorkerPool(&pool);
+}
+
+} // namespace
+
+extern "C" BOOL CancelSynchronousIo(HANDLE Thread) {
+  return driver.cancel(static_cast<test_thread *>(Thread));
+}
+
+int main() {
+  test_grow_and_shrink();
+  printf("worker_pool_test passed\n");
+  return 0;
+}
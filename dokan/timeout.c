@@ -28,8 +28,11 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
   ULONG returnedLength;
   PDOKAN_INSTANCE instance;
   PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_IO_REQUEST request;
   PEVENT_CONTEXT eventContext;
   PEVENT_INFORMATION eventInfo;
+  PLIST_ENTRY entry;
+  ULONG serialNumber = 0;
   ULONG eventInfoSize = sizeof(EVENT_INFORMATION);
   WCHAR rawDeviceName[MAX_PATH];
 
@@ -39,13 +42,30 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
     return FALSE;
   }
 
-  eventContext = openInfo->EventContext;
-  if (eventContext == NULL) {
+  instance = openInfo->DokanInstance;
+  if (instance == NULL) {
     return FALSE;
   }
 
-  instance = openInfo->DokanInstance;
-  if (instance == NULL) {
+  // Several read, write or flush requests of the open can be pending with
+  // DOKAN_OPTION_ASYNC_COMPLETION, use the event of the one FileInfo belongs
+  // to rather than the last event received on the open.
+  EnterCriticalSection(&instance->CriticalSection);
+  eventContext = openInfo->EventContext;
+  for (entry = openInfo->IoRequests.Flink; entry != &openInfo->IoRequests;
+       entry = entry->Flink) {
+    request = CONTAINING_RECORD(entry, DOKAN_IO_REQUEST, ListEntry);
+    if (&request->FileInfo == FileInfo) {
+      eventContext = request->EventContext;
+      break;
+    }
+  }
+  if (eventContext != NULL) {
+    serialNumber = eventContext->SerialNumber;
+  }
+  LeaveCriticalSection(&instance->CriticalSection);
+
+  if (eventContext == NULL) {
     return FALSE;
   }
 
@@ -55,7 +75,7 @@ BOOL DOKANAPI DokanResetTimeout(ULONG Timeout, PDOKAN_FILE_INFO FileInfo) {
   }
   RtlZeroMemory(eventInfo, eventInfoSize);
 
-  eventInfo->SerialNumber = eventContext->SerialNumber;
+  eventInfo->SerialNumber = serialNumber;
   eventInfo->Operation.ResetTimeout.Timeout = Timeout;
   GetRawDeviceName(instance->DeviceName, rawDeviceName, MAX_PATH);
   status = SendToDevice(rawDeviceName,
@@ -0,0 +1,153 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+  Copyright (C) 2015 - 2019 Adrien J. <liryna.stark@gmail.com> and Maxime C. <maxime@islog.com>
+  Copyright (C) 2007 - 2011 Hiroki Asakawa <info@dokan-dev.net>
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dokani.h"
+
+VOID InitializeWorkerPool(PDOKAN_WORKER_POOL Pool,
+                          PDOKAN_INSTANCE DokanInstance, DWORD IoControlCode,
+                          ULONG MinWorkers, ULONG MaxWorkers) {
+  ZeroMemory(Pool, sizeof(DOKAN_WORKER_POOL));
+  (void)InitializeCriticalSectionAndSpinCount(&Pool->CriticalSection,
+                                              0x80000400);
+  Pool->DokanInstance = DokanInstance;
+  Pool->IoControlCode = IoControlCode;
+  Pool->MinWorkers = MinWorkers;
+  Pool->MaxWorkers = MaxWorkers;
+  Pool->IdleTimeout = DOKAN_WORKER_IDLE_TIMEOUT;
+  InitializeListHead(&Pool->IdleWorkerList);
+  Pool->StoppedEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+VOID DeleteWorkerPool(PDOKAN_WORKER_POOL Pool) {
+  if (Pool->DokanInstance == NULL) {
+    return;
+  }
+  if (Pool->StoppedEvent != NULL) {
+    CloseHandle(Pool->StoppedEvent);
+  }
+  DeleteCriticalSection(&Pool->CriticalSection);
+}
+
+BOOL IsWorkerPoolAutoScaled(PDOKAN_WORKER_POOL Pool) {
+  return Pool->MaxWorkers > Pool->MinWorkers;
+}
+
+// Called with Pool->CriticalSection held.
+VOID WorkerExited(PDOKAN_WORKER_POOL Pool) {
+  if (--Pool->Workers == 0) {
+    SetEvent(Pool->StoppedEvent);
+  }
+}
+
+VOID WorkerWaitStarted(PDOKAN_WORKER_POOL Pool, PDOKAN_WORKER Worker) {
+  EnterCriticalSection(&Pool->CriticalSection);
+  if (Pool->IdleWorkers++ == 0 && Pool->SaturatedSince != 0) {
+    Pool->SaturatedTime += GetTickCount64() - Pool->SaturatedSince;
+    Pool->SaturatedSince = 0;
+  }
+  InsertTailList(&Pool->IdleWorkerList, &Worker->ListEntry);
+  LeaveCriticalSection(&Pool->CriticalSection);
+}
+
+BOOL WorkerWaitEnded(PDOKAN_WORKER_POOL Pool, PDOKAN_WORKER Worker,
+                     BOOL GotEvent) {
+  BOOL startWorker = FALSE;
+  ULONGLONG now;
+
+  EnterCriticalSection(&Pool->CriticalSection);
+  // A retired worker was already taken out of the idle ones.
+  if (!Worker->Retired) {
+    RemoveEntryList(&Worker->ListEntry);
+    Pool->IdleWorkers--;
+  }
+  if (GotEvent) {
+    Pool->BusyWorkers++;
+    Pool->Events++;
+    if (Pool->IdleWorkers == 0) {
+      // Nobody is waiting on the driver anymore, new events stay queued
+      // there until one of us is done.
+      now = GetTickCount64();
+      Pool->SaturatedSince = now;
+      Pool->LastSaturatedTick = now;
+      if (IsWorkerPoolAutoScaled(Pool) && Pool->Workers < Pool->MaxWorkers) {
+        startWorker = TRUE;
+      }
+    }
+  }
+  LeaveCriticalSection(&Pool->CriticalSection);
+  return startWorker;
+}
+
+BOOL WorkerEventDone(PDOKAN_WORKER_POOL Pool, PDOKAN_WORKER Worker) {
+  BOOL retire;
+
+  EnterCriticalSection(&Pool->CriticalSection);
+  retire = Worker->Retired;
+  Pool->BusyWorkers--;
+  // Leave the pool once others are already waiting and the pool has not
+  // been saturated for a while. The worker is accounted as exited right
+  // away so that workers finishing together cannot all retire below
+  // MinWorkers.
+  if (!retire && IsWorkerPoolAutoScaled(Pool) &&
+      Pool->Workers > Pool->MinWorkers && Pool->IdleWorkers > 0 &&
+      GetTickCount64() - Pool->LastSaturatedTick > Pool->IdleTimeout) {
+    retire = TRUE;
+    Worker->Retired = TRUE;
+    WorkerExited(Pool);
+  }
+  LeaveCriticalSection(&Pool->CriticalSection);
+  return retire;
+}
+
+VOID TrimWorkerPool(PDOKAN_WORKER_POOL Pool) {
+  PLIST_ENTRY entry, next;
+  PDOKAN_WORKER worker;
+
+  if (Pool->DokanInstance == NULL || !IsWorkerPoolAutoScaled(Pool)) {
+    return;
+  }
+
+  EnterCriticalSection(&Pool->CriticalSection);
+  if (Pool->SaturatedSince == 0 &&
+      GetTickCount64() - Pool->LastSaturatedTick > Pool->IdleTimeout) {
+    // Keep one worker waiting on the driver, the others were idle since the
+    // last saturation and only an event would wake them up to retire.
+    for (entry = Pool->IdleWorkerList.Flink;
+         entry != &Pool->IdleWorkerList &&
+         Pool->Workers > Pool->MinWorkers && Pool->IdleWorkers > 1;
+         entry = next) {
+      next = entry->Flink;
+      worker = CONTAINING_RECORD(entry, DOKAN_WORKER, ListEntry);
+      // Fails when the worker is not in the driver yet or just got an event,
+      // the next trim will see it again.
+      if (!CancelSynchronousIo(worker->Thread)) {
+        continue;
+      }
+      RemoveEntryList(&worker->ListEntry);
+      InitializeListHead(&worker->ListEntry);
+      Pool->IdleWorkers--;
+      worker->Retired = TRUE;
+      WorkerExited(Pool);
+    }
+  }
+  LeaveCriticalSection(&Pool->CriticalSection);
+}
@@ -57,21 +57,35 @@ BOOL SendWriteRequest(_In_ HANDLE Handle, _In_ PEVENT_INFORMATION EventInfo,
   return status;
 }
 
+VOID SetWriteResult(PDOKAN_IO_REQUEST Request, NTSTATUS Status,
+                    ULONG WrittenLength) {
+  PEVENT_INFORMATION eventInfo = Request->EventInfo;
+
+  eventInfo->Status = Status;
+  eventInfo->BufferLength = 0;
+
+  if (Status == STATUS_SUCCESS) {
+    eventInfo->BufferLength = WrittenLength;
+    eventInfo->Operation.Write.CurrentByteOffset.QuadPart =
+        Request->EventContext->Operation.Write.ByteOffset.QuadPart +
+        WrittenLength;
+  }
+}
+
 VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
                    PDOKAN_INSTANCE DokanInstance) {
-  PEVENT_INFORMATION eventInfo;
-  PDOKAN_OPEN_INFO openInfo;
+  PDOKAN_IO_REQUEST request;
   ULONG writtenLength = 0;
   NTSTATUS status;
-  DOKAN_FILE_INFO fileInfo;
-  BOOL bufferAllocated = FALSE;
   ULONG returnedLength = 0;
   BOOL SendWriteRequestStatus = TRUE;	// otherwise DokanInstance->DokanOperations->WriteFile cannot be called
   DWORD SendWriteRequestLastError = 0;
   ULONG sizeOfEventInfo = DispatchGetEventInformationLength(0);
 
-  eventInfo = DispatchCommon(EventContext, sizeOfEventInfo, DokanInstance,
-                             &fileInfo, &openInfo);
+  request = DispatchIoRequest(EventContext, sizeOfEventInfo, DokanInstance);
+  if (request == NULL) {
+    return;
+  }
 
   // Since driver requested bigger memory,
   // allocate enough memory and send it to driver
@@ -79,19 +93,32 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
     ULONG contextLength = EventContext->Operation.Write.RequestLength;
     PEVENT_CONTEXT contextBuf = (PEVENT_CONTEXT)malloc(contextLength);
     if (contextBuf == NULL) {
-      free(eventInfo);
+      SetWriteResult(request, STATUS_INSUFFICIENT_RESOURCES, 0);
+      CompleteIoRequest(Handle, request);
       return;
     }
 
-	SendWriteRequestStatus = SendWriteRequest(Handle, eventInfo, sizeOfEventInfo, contextBuf,
+	SendWriteRequestStatus = SendWriteRequest(Handle, request->EventInfo, sizeOfEventInfo, contextBuf,
                      contextLength, &returnedLength, &SendWriteRequestLastError);
-    EventContext = contextBuf;
-    bufferAllocated = TRUE;
+
+    // The request now works on the full event sent by the driver
+    if (request->OpenInfo != NULL) {
+      EnterCriticalSection(&DokanInstance->CriticalSection);
+      if (request->OpenInfo->EventContext == request->EventContext)
+        request->OpenInfo->EventContext = contextBuf;
+      LeaveCriticalSection(&DokanInstance->CriticalSection);
+    }
+    if (request->EventContextAllocated)
+      free(request->EventContext);
+    request->EventContext = contextBuf;
+    request->EventContextAllocated = TRUE;
   }
+  EventContext = request->EventContext;
 
   CheckFileName(EventContext->Operation.Write.FileName);
 
-  DbgPrint("###WriteFile %04d\n", openInfo != NULL ? openInfo->EventId : -1);
+  DbgPrint("###WriteFile %04d\n",
+           request->OpenInfo != NULL ? request->OpenInfo->EventId : -1);
 
   if (!SendWriteRequestStatus) {
 	  if (SendWriteRequestLastError == ERROR_OPERATION_ABORTED) {
@@ -110,28 +137,19 @@ VOID DispatchWrite(HANDLE Handle, PEVENT_CONTEXT EventContext,
 			  EventContext->Operation.Write.FileName,
 			  (PCHAR)EventContext + EventContext->Operation.Write.BufferOffset,
 			  EventContext->Operation.Write.BufferLength, &writtenLength,
-			  EventContext->Operation.Write.ByteOffset.QuadPart, &fileInfo);
+			  EventContext->Operation.Write.ByteOffset.QuadPart, &request->FileInfo);
 	  }
 	  else {
 		  status = STATUS_NOT_IMPLEMENTED;
 	  }
   }
 
-  if (openInfo != NULL)
-    openInfo->UserContext = fileInfo.Context;
-  eventInfo->Status = status;
-  eventInfo->BufferLength = 0;
-
-  if (status == STATUS_SUCCESS) {
-    eventInfo->BufferLength = writtenLength;
-    eventInfo->Operation.Write.CurrentByteOffset.QuadPart =
-        EventContext->Operation.Write.ByteOffset.QuadPart + writtenLength;
+  if (status == STATUS_PENDING && SendWriteRequestStatus &&
+      IsIoRequestAsync(request)) {
+    // Owned by the FileSystem until DokanCompleteRequest.
+    return;
   }
 
-  SendEventInformation(Handle, eventInfo, sizeOfEventInfo);
-  ReleaseDokanOpenInfo(eventInfo, &fileInfo, DokanInstance);
-  free(eventInfo);
-
-  if (bufferAllocated)
-    free(EventContext);
+  SetWriteResult(request, status, writtenLength);
+  CompleteIoRequest(Handle, request);
 }
@@ -37,6 +37,7 @@ struct fuse_config
   int networkDrive;
   unsigned long allocationUnitSize;
   unsigned long sectorSize;
+  double entry_timeout, attr_timeout, negative_timeout;
 };
 
 struct fuse_session
@@ -82,6 +82,16 @@ struct fuse_file_info {
 	uint64_t lock_owner;
 };
 
+/**
+ * Capability bits for 'fuse_conn_info.capable' and 'fuse_conn_info.want'
+ *
+ * FUSE_CAP_READDIRPLUS: the attributes passed by readdir() to the filler
+ * function are complete (as returned by getattr()), so directory listings
+ * do not call getattr() again for each entry. Entries passed with a NULL
+ * stbuf are still completed with getattr().
+ */
+#define FUSE_CAP_READDIRPLUS	(1 << 13)
+
 /**
  * Connection information, passed to the ->init() method
  *
@@ -115,10 +125,20 @@ struct fuse_conn_info {
 	 */
 	unsigned max_readahead;
 
+	/**
+	 * Capability flags, that the kernel supports
+	 */
+	unsigned capable;
+
+	/**
+	 * Capability flags, that the filesystem wants to enable
+	 */
+	unsigned want;
+
 	/**
 	 * For future use.
 	 */
-	unsigned reserved[27];
+	unsigned reserved[25];
 };
 
 struct fuse_session;
@@ -8,6 +8,8 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <atomic>
 
 #define CHECKED(arg) if (0);else {int __res=arg; if (__res<0) return __res;}
 #define MAX_READ_SIZE (65536)
@@ -21,12 +23,20 @@ class impl_file_lock;
 class impl_file_locks
 {
 private:
-	typedef std::map<std::string, impl_file_lock *> file_locks_t;
-	file_locks_t file_locks;
-	CRITICAL_SECTION lock;
+	// The opened files are split in shards by name so that opening and
+	// closing different files do not contend on a single lock.
+	enum { shard_count = 16 };
+	typedef std::unordered_map<std::string, impl_file_lock *> file_locks_t;
+	struct shard
+	{
+		file_locks_t file_locks;
+		CRITICAL_SECTION lock;
+	};
+	shard shards[shard_count];
+	size_t shard_index(const std::string &name) const { return std::hash<std::string>()(name) % shard_count; }
 public:
-	impl_file_locks() { InitializeCriticalSection(&lock); }
-	~impl_file_locks() { DeleteCriticalSection(&lock); };
+	impl_file_locks() { for (auto &s : shards) InitializeCriticalSection(&s.lock); }
+	~impl_file_locks() { for (auto &s : shards) DeleteCriticalSection(&s.lock); };
 	impl_file_locks(impl_file_locks &other) = delete;
 	impl_file_locks &operator=(const impl_file_locks &other) = delete;
 	int get_file(const std::string &name, bool is_dir, DWORD access_mode, DWORD shared_mode, std::unique_ptr<impl_file_handle>& out);
@@ -34,6 +44,50 @@ public:
 	void remove_file(const std::string& name);
 };
 
+/*
+	Cache of getattr() results by path. A result is reused for name lookups
+	(existence and file type) during entry_timeout and for the complete
+	attributes during attr_timeout, -ENOENT is reused during negative_timeout.
+	A timeout of zero disables the matching cache.
+	Mutating calls made through impl_fuse_context invalidate the names they
+	change, changes made behind its back are seen once the timeouts expire.
+*/
+class impl_stat_cache
+{
+private:
+	struct entry
+	{
+		ULONGLONG time; // GetTickCount64() before getattr
+		int res; // 0 or -ENOENT
+		struct FUSE_STAT stat;
+	};
+	typedef std::map<std::string, entry> entries_t;
+	entries_t entries;
+	ULONGLONG entry_timeout_, attr_timeout_, negative_timeout_; // ms
+	// Incremented by each invalidation so a getattr that ran concurrently
+	// does not cache the state before the change.
+	ULONGLONG generation_;
+	SRWLOCK lock;
+
+	void invalidate_unlocked(const std::string &name);
+public:
+	impl_stat_cache(double entry_timeout, double attr_timeout, double negative_timeout);
+	impl_stat_cache(impl_stat_cache &other) = delete;
+	impl_stat_cache &operator=(const impl_stat_cache &other) = delete;
+
+	bool enabled() const { return entry_timeout_ || attr_timeout_ || negative_timeout_; }
+	// Return true and the cached getattr result if one is still valid.
+	// lookup_only accepts entries kept for entry_timeout.
+	bool get(const std::string &name, bool lookup_only, int *res, struct FUSE_STAT *stat);
+	// To be read before calling getattr and given back to put.
+	ULONGLONG generation();
+	void put(const std::string &name, ULONGLONG generation, int res, const struct FUSE_STAT *stat);
+	// Forget name and its parent directory whose times and links changed.
+	void invalidate(const std::string &name);
+	// Same as invalidate and also forget everything below name.
+	void invalidate_tree(const std::string &name);
+};
+
 struct impl_chain_link
 {
 	impl_chain_link *prev_link_;
@@ -82,10 +136,12 @@ class impl_fuse_context
 	const char *fsname_, *volname_, *uncname_;
 
 	impl_file_locks file_locks;
+	impl_stat_cache stat_cache;
 public:
 	impl_fuse_context(const struct fuse_operations *ops, void *user_data, 
 		bool debug, unsigned int filemask, unsigned int dirmask,
-		const char *fsname, const char *volname, const char *uncname);
+		const char *fsname, const char *volname, const char *uncname,
+		double entry_timeout, double attr_timeout, double negative_timeout);
 
 	bool debug() const {return debug_;}
 
@@ -105,6 +161,11 @@ public:
 
     static int convert_flags(DWORD Flags);
 
+	// ops_.getattr through the stat cache. lookup_only is for callers that
+	// only use the existence and the file type.
+	int cached_getattr(const std::string &name, struct FUSE_STAT *stbuf,
+		bool lookup_only = false);
+
 	int resolve_symlink(const std::string &name, std::string *res);
 	int check_and_resolve(std::string *name);
 
@@ -120,6 +181,7 @@ public:
 		PFillFindData delegate = nullptr;
 		PWalkDirectoryWithSetFuseContext delegateSetFuseContext = nullptr;
 		std::vector<std::string> getdir_data; //Used only in walk_directory_getdir()
+		ULONGLONG cache_generation = 0; // stat_cache generation before readdir
 	};
 	static int walk_directory(void *buf, const char *name,
 		const struct FUSE_STAT *stbuf, FUSE_OFF_T off);
@@ -210,11 +272,25 @@ class impl_file_lock
 	impl_file_handle *first;
 	CRITICAL_SECTION lock;
 
+	struct range_lock
+	{
+		long long len;
+		impl_file_handle *owner;
+	};
+	// Locks of all the handles by start. A lock is refused if it overlaps
+	// another one, so the ranges never overlap and the ones overlapping a
+	// given range are found from the last range starting before it.
+	typedef std::map<long long, range_lock> ranges_t;
+	ranges_t ranges;
+	// Number of ranges, read without the lock so that reads and writes of a
+	// file without locks do not take it.
+	std::atomic<size_t> range_count;
+
 	void add_file_unlocked(impl_file_handle *file);
 	int lock_file(impl_file_handle *file, long long start, long long len, bool mark=true);
 	int unlock_file(impl_file_handle *file, long long start, long long len);
 public:
-	impl_file_lock(impl_file_locks* _locks, const std::string& name): name_(name), locks(_locks), first(nullptr) { InitializeCriticalSection(&lock); }
+	impl_file_lock(impl_file_locks* _locks, const std::string& name): name_(name), locks(_locks), first(nullptr), range_count(0) { InitializeCriticalSection(&lock); }
 	~impl_file_lock() { DeleteCriticalSection(&lock); };
 	impl_file_lock(impl_file_lock &other) = delete;
 	impl_file_lock &operator=(const impl_file_lock &other) = delete;
@@ -232,6 +308,7 @@ class impl_file_handle
 	impl_file_handle *next_file;
 	impl_file_lock *file_lock;
 	DWORD shared_mode_;
+	// Ranges locked by this handle (start, len), also indexed in file_lock
 	typedef std::map<long long, long long> locks_t;
 	locks_t locks;
 	impl_file_handle(bool is_dir, DWORD shared_mode);
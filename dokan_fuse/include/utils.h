@@ -24,6 +24,8 @@ bool is_filetime_set(const FILETIME *ft);
 std::string wchar_to_utf8_cstr(const wchar_t *str);
 
 std::string unixify(const std::string &str);
+// Same as unixify(wchar_to_utf8_cstr(str)) in a single pass.
+std::string wchar_to_unix_path(const wchar_t *str);
 std::string extract_file_name(const std::string &str);
 std::string extract_dir_name(const std::string &str);
 
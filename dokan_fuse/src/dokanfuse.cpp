@@ -492,7 +492,9 @@ int do_fuse_loop(struct fuse *fs, bool mt) {
 
   impl_fuse_context impl(&fs->ops, fs->user_data, fs->conf.debug != 0,
                          fileumask, dirumask, fs->conf.fsname,
-                         fs->conf.volname, fs->conf.uncname);
+                         fs->conf.volname, fs->conf.uncname,
+                         fs->conf.entry_timeout, fs->conf.attr_timeout,
+                         fs->conf.negative_timeout);
 
   // Parse Dokan options
   PDOKAN_OPTIONS dokanOptions = static_cast<PDOKAN_OPTIONS>(malloc(sizeof(DOKAN_OPTIONS)));
@@ -609,6 +611,9 @@ static const struct fuse_opt fuse_lib_opts[] = {
     FUSE_LIB_OPT("daemon_timeout=%d", timeoutInSec, 0),
     FUSE_LIB_OPT("alloc_unit_size=%lu", allocationUnitSize, 0),
     FUSE_LIB_OPT("sector_size=%lu", sectorSize, 0),
+    FUSE_LIB_OPT("entry_timeout=%lf", entry_timeout, 0),
+    FUSE_LIB_OPT("attr_timeout=%lf", attr_timeout, 0),
+    FUSE_LIB_OPT("negative_timeout=%lf", negative_timeout, 0),
     FUSE_LIB_OPT("-n", networkDrive, 1),
     FUSE_LIB_OPT("-m", mountManager, 1),
     FUSE_LIB_OPT("-p", removableDrive, 1),
@@ -627,6 +632,9 @@ static void fuse_lib_help(void) {
       "    -o daemon_timeout=M    set timeout in seconds\n"
       "    -o alloc_unit_size=M   set allocation unit size\n"
       "    -o sector_size=M       set sector size\n"
+      "    -o entry_timeout=T     cache timeout for names (0)\n"
+      "    -o attr_timeout=T      cache timeout for attributes (0)\n"
+      "    -o negative_timeout=T  cache timeout for deleted names (0)\n"
       "    -n                     use network drive\n"
       "    -m                     use mount manager\n"
       "    -p                     use removable drive\n"
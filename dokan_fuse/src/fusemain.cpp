@@ -73,10 +73,13 @@ impl_fuse_context::impl_fuse_context(const struct fuse_operations *ops,
                                      void *user_data, bool debug,
                                      unsigned int filemask,
                                      unsigned int dirmask, const char *fsname,
-                                     const char *volname, const char *uncname)
+                                     const char *volname, const char *uncname,
+                                     double entry_timeout, double attr_timeout,
+                                     double negative_timeout)
     : ops_(*ops), user_data_(user_data), debug_(debug), filemask_(filemask),
       dirmask_(dirmask), fsname_(fsname),
-      volname_(volname), uncname_(uncname) // Use current user data
+      volname_(volname), uncname_(uncname), // Use current user data
+      stat_cache(entry_timeout, attr_timeout, negative_timeout)
 {
   // Reset connection info
   memset(&conn_info_, 0, sizeof(fuse_conn_info));
@@ -84,6 +87,7 @@ impl_fuse_context::impl_fuse_context(const struct fuse_operations *ops,
   conn_info_.max_readahead = UINT_MAX;
   conn_info_.proto_major = FUSE_MAJOR_VERSION;
   conn_info_.proto_minor = FUSE_MINOR_VERSION;
+  conn_info_.capable = FUSE_CAP_READDIRPLUS;
 
   if (ops_.init) {
     // Create a special FUSE frame
@@ -106,7 +110,7 @@ int impl_fuse_context::cast_from_longlong(LONGLONG src, FUSE_OFF_T *res) {
 int impl_fuse_context::do_open_dir(LPCWSTR FileName,
                                    PDOKAN_FILE_INFO DokanFileInfo) {
   if (ops_.opendir) {
-    std::string fname = unixify(wchar_to_utf8_cstr(FileName));
+    std::string fname = wchar_to_unix_path(FileName);
     std::unique_ptr<impl_file_handle> file;
     // TODO access_mode
     CHECKED(file_locks.get_file(
@@ -130,7 +134,7 @@ int impl_fuse_context::do_open_file(LPCWSTR FileName, DWORD share_mode,
                                     PDOKAN_FILE_INFO DokanFileInfo) {
   if (!ops_.open)
     return -EINVAL;
-  std::string fname = unixify(wchar_to_utf8_cstr(FileName));
+  std::string fname = wchar_to_unix_path(FileName);
   CHECKED(check_and_resolve(&fname));
 
   std::unique_ptr<impl_file_handle> file;
@@ -148,7 +152,7 @@ int impl_fuse_context::do_open_file(LPCWSTR FileName, DWORD share_mode,
 
 int impl_fuse_context::do_delete_directory(LPCWSTR file_name,
                                            PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
 
   if (!ops_.rmdir || !ops_.getattr)
     return -EINVAL;
@@ -163,12 +167,17 @@ int impl_fuse_context::do_delete_directory(LPCWSTR file_name,
 
   // A special case: symlinks are deleted by unlink, not rmdir
   struct FUSE_STAT stbuf = {0};
-  CHECKED(ops_.getattr(fname.c_str(), &stbuf));
-  if (S_ISLNK(stbuf.st_mode) && ops_.unlink)
-    return ops_.unlink(fname.c_str());
+  CHECKED(cached_getattr(fname, &stbuf, true));
+  if (S_ISLNK(stbuf.st_mode) && ops_.unlink) {
+    CHECKED(ops_.unlink(fname.c_str()));
+    stat_cache.invalidate(fname);
+    return 0;
+  }
 
   // Ok, try to rmdir it.
-  return ops_.rmdir(fname.c_str());
+  CHECKED(ops_.rmdir(fname.c_str()));
+  stat_cache.invalidate_tree(fname);
+  return 0;
 }
 
 int impl_fuse_context::do_delete_file(LPCWSTR file_name,
@@ -177,8 +186,10 @@ int impl_fuse_context::do_delete_file(LPCWSTR file_name,
     return -EINVAL;
 
   // Note: we do not try to resolve symlink target
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
-  return ops_.unlink(fname.c_str());
+  std::string fname = wchar_to_unix_path(file_name);
+  CHECKED(ops_.unlink(fname.c_str()));
+  stat_cache.invalidate(fname);
+  return 0;
 }
 
 int impl_fuse_context::do_create_file(LPCWSTR FileName, DWORD Disposition,
@@ -189,7 +200,7 @@ int impl_fuse_context::do_create_file(LPCWSTR FileName, DWORD Disposition,
 // Flags = DesiredAccess
 // share_mode = ShareAccess
 {
-  std::string fname = unixify(wchar_to_utf8_cstr(FileName));
+  std::string fname = wchar_to_unix_path(FileName);
 
   // Create file?
   if (Disposition != FILE_CREATE && Disposition != FILE_SUPERSEDE &&
@@ -203,6 +214,7 @@ int impl_fuse_context::do_create_file(LPCWSTR FileName, DWORD Disposition,
       return -EINVAL;
 
     CHECKED(ops_.mknod(fname.c_str(), filemask_, 0));
+    stat_cache.invalidate(fname);
 
     return do_open_file(FileName, share_mode, Flags, DokanFileInfo);
   }
@@ -216,6 +228,7 @@ int impl_fuse_context::do_create_file(LPCWSTR FileName, DWORD Disposition,
       convert_flags(Flags); // TODO: these flags should be OK for new files?
 
   CHECKED(ops_.create(fname.c_str(), filemask_, &finfo));
+  stat_cache.invalidate(fname);
 
   file->set_finfo(finfo);
   DokanFileInfo->Context = reinterpret_cast<ULONG64>(file.release());
@@ -254,7 +267,7 @@ int impl_fuse_context::check_and_resolve(std::string *name) {
     return -EINVAL;
 
   struct FUSE_STAT stat = {0};
-  CHECKED(ops_.getattr(name->c_str(), &stat));
+  CHECKED(cached_getattr(*name, &stat, true));
   if (S_ISLNK(stat.st_mode)) {
     CHECKED(resolve_symlink(*name, name));
   }
@@ -262,6 +275,22 @@ int impl_fuse_context::check_and_resolve(std::string *name) {
   return 0;
 }
 
+int impl_fuse_context::cached_getattr(const std::string &name,
+                                      struct FUSE_STAT *stbuf,
+                                      bool lookup_only) {
+  if (!stat_cache.enabled())
+    return ops_.getattr(name.c_str(), stbuf);
+
+  int res;
+  if (stat_cache.get(name, lookup_only, &res, stbuf))
+    return res;
+
+  ULONGLONG generation = stat_cache.generation();
+  res = ops_.getattr(name.c_str(), stbuf);
+  stat_cache.put(name, generation, res, stbuf);
+  return res;
+}
+
 int impl_fuse_context::walk_directory(void *buf, const char *name,
                                       const struct FUSE_STAT *stbuf,
                                       FUSE_OFF_T off) {
@@ -286,26 +315,34 @@ int impl_fuse_context::walk_directory(void *buf, const char *name,
     utf8_to_wchar_buf_old(name, find_data.cFileName, MAX_PATH);
     std::string new_name = wchar_to_utf8_cstr(find_data.cFileName);
     if (ctx->ops_.getattr && ctx->ops_.rename && new_name.length() &&
-        ctx->ops_.getattr(new_name.c_str(), &stbuf) == -ENOENT)
+        ctx->ops_.getattr(new_name.c_str(), &stbuf) == -ENOENT) {
       ctx->ops_.rename(name, new_name.c_str());
+      ctx->stat_cache.invalidate_tree(name);
+      ctx->stat_cache.invalidate_tree(new_name);
+    }
   }
   memset(find_data.cAlternateFileName, 0, sizeof(find_data.cAlternateFileName));
 
   struct FUSE_STAT stat = {0};
 
   // stat (*stbuf) has only st_ino and st_mode -> request other info with getattr
+  // unless the filesystem asked for readdirplus and gives complete attributes.
   if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {// Special entries
     stat.st_mode |= S_IFDIR; // TODO: fill directory params here!!!
   }
+  else if (stbuf && (ctx->conn_info_.want & FUSE_CAP_READDIRPLUS)) {
+    stat = *stbuf;
+    ctx->stat_cache.put(dirname + name, wd->cache_generation, 0, &stat);
+  }
   else if (ctx->ops_.getattr) {
-    CHECKED(ctx->ops_.getattr((dirname + name).c_str(), &stat));
+    CHECKED(ctx->cached_getattr(dirname + name, &stat));
   }
 
   if (S_ISLNK(stat.st_mode)
       && ctx->ops_.getattr) {
     std::string resolved;
     CHECKED(ctx->resolve_symlink(dirname + name, &resolved));
-    CHECKED(ctx->ops_.getattr(resolved.c_str(), &stat));
+    CHECKED(ctx->cached_getattr(resolved, &stat));
   }
 
   convertStatlikeBuf(&stat, name, &find_data);
@@ -333,7 +370,7 @@ int impl_fuse_context::find_files(LPCWSTR file_name,
   if ((!ops_.readdir && !ops_.getdir) || !ops_.getattr)
     return -EINVAL;
 
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
   CHECKED(check_and_resolve(&fname));
 
   walk_data wd;
@@ -344,6 +381,7 @@ int impl_fuse_context::find_files(LPCWSTR file_name,
   wd.delegate = fill_find_data;
   wd.delegateSetFuseContext = walk_set_fuse_context;
   wd.DokanFileInfo = dokan_file_info;
+  wd.cache_generation = stat_cache.generation();
 
   if (ops_.readdir) {
     impl_file_handle *hndl =
@@ -374,7 +412,7 @@ int impl_fuse_context::find_files(LPCWSTR file_name,
 
 int impl_fuse_context::open_directory(LPCWSTR file_name,
                                       PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
 
   if (ops_.opendir)
     return do_open_dir(file_name, dokan_file_info);
@@ -382,11 +420,11 @@ int impl_fuse_context::open_directory(LPCWSTR file_name,
   // We don't have opendir(), so the most we can do is make sure
   // that the target is indeed a directory
   struct FUSE_STAT st = {0};
-  CHECKED(ops_.getattr(fname.c_str(), &st));
+  CHECKED(cached_getattr(fname, &st, true));
   if (S_ISLNK(st.st_mode)) {
     std::string resolved;
     CHECKED(resolve_symlink(fname, &resolved));
-    CHECKED(ops_.getattr(resolved.c_str(), &st));
+    CHECKED(cached_getattr(resolved, &st, true));
   }
 
   // Not a directory
@@ -427,12 +465,14 @@ int impl_fuse_context::cleanup(LPCWSTR file_name,
 
 int impl_fuse_context::create_directory(LPCWSTR file_name,
                                         PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
 
   if (!ops_.mkdir)
     return -EINVAL;
 
-  return ops_.mkdir(fname.c_str(), dirmask_);
+  CHECKED(ops_.mkdir(fname.c_str(), dirmask_));
+  stat_cache.invalidate(fname);
+  return 0;
 }
 
 int impl_fuse_context::readdir_filler_set_has_files(void *buf, const char *name,
@@ -459,12 +499,12 @@ int impl_fuse_context::getdir_filler_set_has_files(fuse_dirh_t hndl, const char
 
 int impl_fuse_context::delete_directory(LPCWSTR file_name,
                                         PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
   if (!ops_.getattr || !ops_.rmdir || (!ops_.readdir && !ops_.getdir))
     return -EINVAL;
 
   struct FUSE_STAT stbuf = {0};
-  int ret = ops_.getattr(fname.c_str(), &stbuf);
+  int ret = cached_getattr(fname, &stbuf, true);
 
   /* TODO: Should we check if the parent-dir is writable and return -EACCESS?
    * (by using ops_.access or alternatively other means such as getattr)
@@ -504,7 +544,7 @@ win_error impl_fuse_context::create_file(LPCWSTR file_name, DWORD access_mode,
                                          DWORD flags_and_attributes,
                                          ULONG CreateOptions,
                                          PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
   dokan_file_info->Context = 0;
 
   if (!ops_.getattr)
@@ -512,7 +552,7 @@ win_error impl_fuse_context::create_file(LPCWSTR file_name, DWORD access_mode,
 
   struct FUSE_STAT stbuf = {0};
   // Check if the target file/directory exists
-  if (ops_.getattr(fname.c_str(), &stbuf) < 0) {
+  if (cached_getattr(fname, &stbuf, true) < 0) {
     // Nope.
     if (dokan_file_info->IsDirectory)
       return -EINVAL; // We can't create directories using CreateFile
@@ -522,7 +562,7 @@ win_error impl_fuse_context::create_file(LPCWSTR file_name, DWORD access_mode,
     if (S_ISLNK(stbuf.st_mode)) {
       // Get link's target
       CHECKED(resolve_symlink(fname, &fname));
-      CHECKED(ops_.getattr(fname.c_str(), &stbuf));
+      CHECKED(cached_getattr(fname, &stbuf, true));
     }
 
     if ((stbuf.st_mode & S_IFDIR) == S_IFDIR) {
@@ -540,6 +580,7 @@ win_error impl_fuse_context::create_file(LPCWSTR file_name, DWORD access_mode,
         if (!ops_.unlink)
           return -EINVAL;
         CHECKED(ops_.unlink(fname.c_str())); // Delete file
+        stat_cache.invalidate(fname);
         // And create it!
         return do_create_file(file_name, creation_disposition, share_mode,
                               access_mode, dokan_file_info);
@@ -548,6 +589,7 @@ win_error impl_fuse_context::create_file(LPCWSTR file_name, DWORD access_mode,
         if (!ops_.truncate)
           return -EINVAL;
         CHECKED(ops_.truncate(fname.c_str(), 0));
+        stat_cache.invalidate(fname);
       } else if (creation_disposition == FILE_CREATE) {
         return win_error(STATUS_OBJECT_NAME_COLLISION, true);
       }
@@ -650,7 +692,7 @@ int impl_fuse_context::write_file(LPCWSTR /*file_name*/, LPCVOID buffer,
 
   if (offset < 0) {
 	  struct FUSE_STAT stat;
-	  if (0 == ops_.getattr(hndl->get_name().c_str(), &stat)) {
+	  if (0 == cached_getattr(hndl->get_name(), &stat)) {
 		  offset = stat.st_size;
 	  }
   }
@@ -668,6 +710,7 @@ int impl_fuse_context::write_file(LPCWSTR /*file_name*/, LPCVOID buffer,
   fuse_file_info finfo(hndl->make_finfo());
   int res = ops_.write(hndl->get_name().c_str(), static_cast<const char *>(buffer),
                        num_bytes_to_write, off, &finfo);
+  stat_cache.invalidate(hndl->get_name());
   if (res < 0)
     return res; // Error
 
@@ -701,17 +744,17 @@ int impl_fuse_context::flush_file_buffers(LPCWSTR /*file_name*/,
 int impl_fuse_context::get_file_information(
     LPCWSTR file_name, LPBY_HANDLE_FILE_INFORMATION handle_file_information,
     PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
 
   if (!ops_.getattr)
     return -EINVAL;
 
   struct FUSE_STAT st = {0};
-  CHECKED(ops_.getattr(fname.c_str(), &st));
+  CHECKED(cached_getattr(fname, &st));
   if (S_ISLNK(st.st_mode)) {
     std::string resolved;
     CHECKED(resolve_symlink(fname, &resolved));
-    CHECKED(ops_.getattr(resolved.c_str(), &st));
+    CHECKED(cached_getattr(resolved, &st));
   }
 
   handle_file_information->nNumberOfLinks = st.st_nlink;
@@ -730,13 +773,13 @@ int impl_fuse_context::get_file_information(
 
 int impl_fuse_context::delete_file(LPCWSTR file_name,
                                    PDOKAN_FILE_INFO dokan_file_info) {
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
 
   if (!ops_.getattr)
     return -EINVAL;
 
   struct FUSE_STAT stbuf = {0};
-  return ops_.getattr(fname.c_str(), &stbuf);
+  return cached_getattr(fname, &stbuf, true);
 }
 
 int impl_fuse_context::move_file(LPCWSTR file_name, LPCWSTR new_file_name,
@@ -745,11 +788,11 @@ int impl_fuse_context::move_file(LPCWSTR file_name, LPCWSTR new_file_name,
   if (!ops_.rename || !ops_.getattr)
     return -EINVAL;
 
-  std::string name = unixify(wchar_to_utf8_cstr(file_name));
-  std::string new_name = unixify(wchar_to_utf8_cstr(new_file_name));
+  std::string name = wchar_to_unix_path(file_name);
+  std::string new_name = wchar_to_unix_path(new_file_name);
 
   struct FUSE_STAT stbuf = {0};
-  if (ops_.getattr(new_name.c_str(), &stbuf) != -ENOENT) {
+  if (cached_getattr(new_name, &stbuf, true) != -ENOENT) {
     if (!replace_existing)
       return -EEXIST;
 
@@ -759,6 +802,7 @@ int impl_fuse_context::move_file(LPCWSTR file_name, LPCWSTR new_file_name,
     if (!ops_.unlink)
       return -EINVAL;
     CHECKED(ops_.unlink(new_name.c_str()));
+    stat_cache.invalidate(new_name);
   }
 
   // this can happen cause DeleteFile in Windows can return success even if
@@ -768,6 +812,8 @@ int impl_fuse_context::move_file(LPCWSTR file_name, LPCWSTR new_file_name,
   }
 
   CHECKED(ops_.rename(name.c_str(), new_name.c_str()));
+  stat_cache.invalidate_tree(name);
+  stat_cache.invalidate_tree(new_name);
   file_locks.renamed_file(name, new_name);
   return 0;
 }
@@ -832,19 +878,23 @@ int impl_fuse_context::set_end_of_file(LPCWSTR file_name, LONGLONG byte_offset,
                                        PDOKAN_FILE_INFO dokan_file_info) {
   FUSE_OFF_T off;
   CHECKED(cast_from_longlong(byte_offset, &off));
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
   CHECKED(check_and_resolve(&fname));
 
   impl_file_handle *hndl =
       reinterpret_cast<impl_file_handle *>(dokan_file_info->Context);
   if (hndl && ops_.ftruncate) {
     fuse_file_info finfo(hndl->make_finfo());
-    return ops_.ftruncate(hndl->get_name().c_str(), off, &finfo);
+    CHECKED(ops_.ftruncate(hndl->get_name().c_str(), off, &finfo));
+    stat_cache.invalidate(hndl->get_name());
+    return 0;
   }
 
   if (!ops_.truncate)
     return -EINVAL;
-  return ops_.truncate(fname.c_str(), off);
+  CHECKED(ops_.truncate(fname.c_str(), off));
+  stat_cache.invalidate(fname);
+  return 0;
 }
 
 int impl_fuse_context::set_file_attributes(LPCWSTR file_name,
@@ -858,9 +908,10 @@ int impl_fuse_context::set_file_attributes(LPCWSTR file_name,
   // time
   // setting from FAR Manager.
   if (ops_.win_set_attributes) {
-    std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+    std::string fname = wchar_to_unix_path(file_name);
     CHECKED(check_and_resolve(&fname));
-    return ops_.win_set_attributes(fname.c_str(), file_attributes);
+    CHECKED(ops_.win_set_attributes(fname.c_str(), file_attributes));
+    stat_cache.invalidate(fname);
   }
   return 0;
 }
@@ -887,32 +938,37 @@ int impl_fuse_context::set_file_time(PCWSTR file_name,
     return -EINVAL;
 
   if (ops_.win_set_times) {
-    std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+    std::string fname = wchar_to_unix_path(file_name);
     CHECKED(check_and_resolve(&fname));
 
     impl_file_handle *hndl =
         reinterpret_cast<impl_file_handle *>(dokan_file_info->Context);
-    if (!hndl)
-      return ops_.win_set_times(fname.c_str(), nullptr, creation_time,
-                                last_access_time, last_write_time);
+    if (!hndl) {
+      CHECKED(ops_.win_set_times(fname.c_str(), nullptr, creation_time,
+                                 last_access_time, last_write_time));
+      stat_cache.invalidate(fname);
+      return 0;
+    }
 
     if (hndl->is_dir())
       return -EACCES;
 
     fuse_file_info finfo(hndl->make_finfo());
 
-    return ops_.win_set_times(fname.c_str(), &finfo, creation_time,
-                              last_access_time, last_write_time);
+    CHECKED(ops_.win_set_times(fname.c_str(), &finfo, creation_time,
+                               last_access_time, last_write_time));
+    stat_cache.invalidate(fname);
+    return 0;
   }
 
   if (!ops_.getattr)
     return -EINVAL;
 
-  std::string fname = unixify(wchar_to_utf8_cstr(file_name));
+  std::string fname = wchar_to_unix_path(file_name);
   CHECKED(check_and_resolve(&fname));
 
   struct FUSE_STAT st = {0};
-  CHECKED(ops_.getattr(fname.c_str(), &st));
+  CHECKED(cached_getattr(fname, &st));
 
   if (ops_.utimens) {
     struct timespec tv[2] = {0};
@@ -924,7 +980,7 @@ int impl_fuse_context::set_file_time(PCWSTR file_name,
     CHECKED(helper_set_time_struct(last_write_time, st.st_mtim.tv_sec,
                                    &(tv[1].tv_sec)));
 
-    return ops_.utimens(fname.c_str(), tv);
+    CHECKED(ops_.utimens(fname.c_str(), tv));
   } else {
     struct utimbuf ut = {0};
     // Access time
@@ -934,8 +990,10 @@ int impl_fuse_context::set_file_time(PCWSTR file_name,
     CHECKED(helper_set_time_struct(last_write_time, st.st_mtim.tv_sec,
                                    &(ut.modtime)));
 
-    return ops_.utime(fname.c_str(), &ut);
+    CHECKED(ops_.utime(fname.c_str(), &ut));
   }
+  stat_cache.invalidate(fname);
+  return 0;
 }
 
 int impl_fuse_context::get_disk_free_space(PULONGLONG free_bytes_available,
@@ -996,6 +1054,129 @@ int impl_fuse_context::unmounted(PDOKAN_FILE_INFO DokanFileInfo) {
   return 0;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////
+////// Stat cache
+///////////////////////////////////////////////////////////////////////////////////////
+
+// Beyond this count, expired entries are dropped and, if that is not enough,
+// the whole cache.
+#define STAT_CACHE_MAX_ENTRIES 65536
+
+static ULONGLONG timeout_to_ms(double timeout) {
+  return timeout > 0 ? static_cast<ULONGLONG>(timeout * 1000) : 0;
+}
+
+impl_stat_cache::impl_stat_cache(double entry_timeout, double attr_timeout,
+                                 double negative_timeout)
+    : entry_timeout_(timeout_to_ms(entry_timeout)),
+      attr_timeout_(timeout_to_ms(attr_timeout)),
+      negative_timeout_(timeout_to_ms(negative_timeout)), generation_(0) {
+  InitializeSRWLock(&lock);
+}
+
+bool impl_stat_cache::get(const std::string &name, bool lookup_only, int *res,
+                          struct FUSE_STAT *stat) {
+  if (!enabled())
+    return false;
+
+  ULONGLONG now = GetTickCount64();
+  bool found = false;
+  AcquireSRWLockShared(&lock);
+  entries_t::const_iterator i = entries.find(name);
+  if (i != entries.end()) {
+    // Fresh attributes also tell that the entry exists.
+    ULONGLONG timeout = attr_timeout_;
+    if (i->second.res)
+      timeout = negative_timeout_;
+    else if (lookup_only && entry_timeout_ > timeout)
+      timeout = entry_timeout_;
+    if (now - i->second.time < timeout) {
+      *res = i->second.res;
+      if (!*res)
+        *stat = i->second.stat;
+      found = true;
+    }
+  }
+  ReleaseSRWLockShared(&lock);
+  return found;
+}
+
+ULONGLONG impl_stat_cache::generation() {
+  AcquireSRWLockShared(&lock);
+  ULONGLONG generation = generation_;
+  ReleaseSRWLockShared(&lock);
+  return generation;
+}
+
+void impl_stat_cache::put(const std::string &name, ULONGLONG generation,
+                          int res, const struct FUSE_STAT *stat) {
+  // Other errors can be transient
+  if (res != 0 && res != -ENOENT)
+    return;
+  if (res ? !negative_timeout_ : !entry_timeout_ && !attr_timeout_)
+    return;
+
+  ULONGLONG now = GetTickCount64();
+  AcquireSRWLockExclusive(&lock);
+  // Invalidated while getattr was running, the result can be stale.
+  if (generation == generation_) {
+    if (entries.size() >= STAT_CACHE_MAX_ENTRIES) {
+      ULONGLONG max_timeout = entry_timeout_;
+      if (attr_timeout_ > max_timeout)
+        max_timeout = attr_timeout_;
+      if (negative_timeout_ > max_timeout)
+        max_timeout = negative_timeout_;
+      for (entries_t::iterator i = entries.begin(); i != entries.end();) {
+        if (now - i->second.time >= max_timeout)
+          i = entries.erase(i);
+        else
+          ++i;
+      }
+      if (entries.size() >= STAT_CACHE_MAX_ENTRIES)
+        entries.clear();
+    }
+    entry &e = entries[name];
+    e.time = now;
+    e.res = res;
+    if (!res)
+      e.stat = *stat;
+  }
+  ReleaseSRWLockExclusive(&lock);
+}
+
+void impl_stat_cache::invalidate_unlocked(const std::string &name) {
+  ++generation_;
+  entries.erase(name);
+  size_t pos = name.find_last_of('/');
+  if (pos != std::string::npos)
+    entries.erase(pos ? name.substr(0, pos) : std::string("/"));
+}
+
+void impl_stat_cache::invalidate(const std::string &name) {
+  if (!enabled())
+    return;
+
+  AcquireSRWLockExclusive(&lock);
+  invalidate_unlocked(name);
+  ReleaseSRWLockExclusive(&lock);
+}
+
+void impl_stat_cache::invalidate_tree(const std::string &name) {
+  if (!enabled())
+    return;
+
+  std::string prefix = name;
+  if (prefix.empty() || *prefix.rbegin() != '/')
+    prefix.append("/");
+
+  AcquireSRWLockExclusive(&lock);
+  invalidate_unlocked(name);
+  entries_t::iterator i = entries.lower_bound(prefix);
+  while (i != entries.end() && i->first.compare(0, prefix.size(), prefix) == 0)
+    i = entries.erase(i);
+  ReleaseSRWLockExclusive(&lock);
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////
 ////// File lock
 ///////////////////////////////////////////////////////////////////////////////////////
@@ -1020,20 +1201,21 @@ int impl_file_locks::get_file(const std::string &name, bool is_dir,
 
   // check previous files with same names
   impl_file_lock *lock, *old_lock = nullptr;
-  EnterCriticalSection(&this->lock);
-  file_locks_t::iterator i = file_locks.find(name);
-  if (i != file_locks.end()) {
+  shard &s = shards[shard_index(name)];
+  EnterCriticalSection(&s.lock);
+  file_locks_t::iterator i = s.file_locks.find(name);
+  if (i != s.file_locks.end()) {
     old_lock = lock = i->second;
     EnterCriticalSection(&lock->lock);
   } else {
     lock = new impl_file_lock(this, name);
-    file_locks[name] = lock;
+    s.file_locks[name] = lock;
     lock->add_file_unlocked(file.get());
   }
   file->file_lock = lock;
 
   if (!old_lock) {
-    LeaveCriticalSection(&this->lock);
+    LeaveCriticalSection(&s.lock);
     return res;
   }
 
@@ -1050,7 +1232,7 @@ int impl_file_locks::get_file(const std::string &name, bool is_dir,
     lock->add_file_unlocked(file.get());
   }
   LeaveCriticalSection(&lock->lock);
-  LeaveCriticalSection(&this->lock);
+  LeaveCriticalSection(&s.lock);
   return res;
 }
 
@@ -1062,6 +1244,9 @@ void impl_file_lock::add_file_unlocked(impl_file_handle *file) {
 void impl_file_lock::remove_file(impl_file_handle *file) {
   impl_file_handle *first_locked;
 
+  // Once the lock is left, another thread may reopen and close the file and
+  // delete this object, so keep what is needed to remove it afterwards.
+  impl_file_locks *owner = locks;
   EnterCriticalSection(&lock);
   impl_file_handle **p = &first;
   while (*p != nullptr) {
@@ -1072,7 +1257,14 @@ void impl_file_lock::remove_file(impl_file_handle *file) {
     }
     p = &(*p)->next_file;
   }
+  // Release the ranges still locked by the handle
+  for (impl_file_handle::locks_t::iterator i = file->locks.begin();
+       i != file->locks.end(); ++i)
+    ranges.erase(i->first);
+  range_count -= file->locks.size();
+  file->locks.clear();
   first_locked = first;
+  std::string name = first_locked ? std::string() : name_;
   // avoid dead lock
   LeaveCriticalSection(&lock);
 
@@ -1080,18 +1272,24 @@ void impl_file_lock::remove_file(impl_file_handle *file) {
   if (first_locked)
     return;
 
-  locks->remove_file(name_);
+  owner->remove_file(name);
 }
 
 void impl_file_locks::remove_file(const std::string &name) {
-  EnterCriticalSection(&lock);
-  file_locks_t::iterator i = file_locks.find(name);
-  if (i != file_locks.end() && !i->second->first) {
-    if (i->second)
+  shard &s = shards[shard_index(name)];
+  EnterCriticalSection(&s.lock);
+  file_locks_t::iterator i = s.file_locks.find(name);
+  if (i != s.file_locks.end()) {
+    // The file may have been reopened meanwhile
+    EnterCriticalSection(&i->second->lock);
+    bool empty = !i->second->first;
+    LeaveCriticalSection(&i->second->lock);
+    if (empty) {
       delete i->second;
-    file_locks.erase(i);
+      s.file_locks.erase(i);
+    }
   }
-  LeaveCriticalSection(&lock);
+  LeaveCriticalSection(&s.lock);
 }
 
 void impl_file_locks::renamed_file(const std::string &name,
@@ -1099,18 +1297,24 @@ void impl_file_locks::renamed_file(const std::string &name,
   if (name == new_name)
     return;
 
-  EnterCriticalSection(&lock);
+  // Take both shards in index order to not dead lock with another rename
+  size_t from = shard_index(name), to = shard_index(new_name);
+  EnterCriticalSection(&shards[from < to ? from : to].lock);
+  if (from != to)
+    EnterCriticalSection(&shards[from < to ? to : from].lock);
   // TODO what happen if new_name exists ??
-  file_locks_t::iterator i = file_locks.find(name);
-  if (i != file_locks.end()) {
+  file_locks_t::iterator i = shards[from].file_locks.find(name);
+  if (i != shards[from].file_locks.end()) {
     impl_file_lock *lock = i->second;
     EnterCriticalSection(&lock->lock);
     lock->name_ = new_name;
     LeaveCriticalSection(&lock->lock);
-    file_locks[new_name] = lock;
-    file_locks.erase(i);
+    shards[to].file_locks[new_name] = lock;
+    shards[from].file_locks.erase(i);
   }
-  LeaveCriticalSection(&lock);
+  if (from != to)
+    LeaveCriticalSection(&shards[from < to ? to : from].lock);
+  LeaveCriticalSection(&shards[from < to ? from : to].lock);
 }
 
 int impl_file_lock::lock_file(impl_file_handle *file, long long start,
@@ -1118,32 +1322,30 @@ int impl_file_lock::lock_file(impl_file_handle *file, long long start,
   if (start < 0 || len <= 0)
     return -EINVAL;
 
+  // Nothing to check against
+  if (!mark && range_count == 0)
+    return 0;
+
   bool locked = false;
   EnterCriticalSection(&lock);
   // multiple locks are not allowed
-  for (impl_file_handle *i = first; i; i = i->next_file) {
-    if (!mark && i == file)
-      continue;
-    impl_file_handle::locks_t::iterator j = i->locks.lower_bound(start);
-    if (j != i->locks.end()) {
-      // we found a range which start after our start
-      if (len > j->first - start)
-        locked = true;
-      // check previous not override
-      if (j != i->locks.begin()) {
-        --j;
-        if (j->second > start - j->first)
-          locked = true;
-      }
-    } else {
-      // check last
-      impl_file_handle::locks_t::reverse_iterator p = i->locks.rbegin();
-      if (p != i->locks.rend() && start - p->first < p->second)
-        locked = true;
+  ranges_t::iterator i = ranges.upper_bound(start);
+  if (i != ranges.begin())
+    --i;
+  for (; i != ranges.end() && i->first - start < len; ++i) {
+    if (i->first < start && start - i->first >= i->second.len)
+      continue; // ends before our start
+    if (mark || i->second.owner != file) {
+      locked = true;
+      break;
     }
   }
-  if (!locked & mark)
+  if (!locked && mark) {
+    range_lock range = {len, file};
+    ranges[start] = range;
     file->locks[start] = len;
+    ++range_count;
+  }
   LeaveCriticalSection(&lock);
   return locked ? -EACCES : 0;
 }
@@ -1158,11 +1360,13 @@ int impl_file_lock::unlock_file(impl_file_handle *file, long long start,
 
   EnterCriticalSection(&lock);
   bool locked = false;
-  impl_file_handle::locks_t::iterator i = file->locks.find(start);
-  if (i != file->locks.end()) {
+  ranges_t::iterator i = ranges.find(start);
+  if (i != ranges.end()) {
     // we found a range which start as our, is our ??
-    if (i->second == len) {
-      file->locks.erase(i);
+    if (i->second.owner == file && i->second.len == len) {
+      ranges.erase(i);
+      file->locks.erase(start);
+      --range_count;
       locked = true;
     }
   }
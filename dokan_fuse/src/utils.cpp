@@ -6,190 +6,175 @@
 #include <sys/stat.h>
 #include "utils.h"
 
-typedef unsigned int ICONV_CHAR;
-
-#if defined(__GNUC__) && __GNUC__ >= 3
-#define unlikely(x) __builtin_expect(!!(x), 0)
-#else
-#define unlikely(x) (x)
+// SSE2 is part of x64 and of the default x86 target of MSVC
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) ||            \
+    defined(__SSE2__)
+#include <emmintrin.h>
+#define UTILS_SSE2
 #endif
 
-#define GET_A2(p) (*((unsigned short *)(p)))
-#define PUT_A2(buf, c)                                                         \
-  do {                                                                         \
-    *((unsigned short *)(buf)) = (c);                                          \
-  } while (0)
-
-static const unsigned char utf8_lengths[256] = {
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
-    4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 0, 0,
-};
-
-static const unsigned char utf8_masks[7] = {0,    0x7f, 0x1f, 0x0f,
-                                            0x07, 0x03, 0x01};
-
-static size_t get_utf8(const unsigned char *p, size_t len, ICONV_CHAR *out) {
-  ICONV_CHAR uc;
-  size_t l;
-
-  l = utf8_lengths[p[0]];
-  if (unlikely(l == 0))
-    return -EILSEQ;
-  if (unlikely(len < l))
-    return -EINVAL;
-
-  len = l;
-  uc = *p++ & utf8_masks[l];
-  while (--l)
-    uc = (uc << 6) | (*p++ & 0x3f);
-  *out = uc;
-  return len;
-}
-
-#define MASK(n) ((0xffffffffu << (n)) & 0xffffffffu)
-
-static size_t put_utf8(unsigned char *buf, ICONV_CHAR c) {
-  size_t o_len;
-  unsigned mask;
-
-  if ((c & MASK(7)) == 0) {
-    *buf = static_cast<unsigned char>(c);
-    return 1;
-  }
-
-  o_len = 2;
-  for (;;) {
-    if ((c & MASK(11)) == 0)
-      break;
-    ++o_len;
-    if ((c & MASK(16)) == 0)
-      break;
-    ++o_len;
-    if ((c & MASK(21)) == 0)
-      break;
-    ++o_len;
-    if ((c & MASK(26)) == 0)
+// Convert len UTF-16 code units of src to UTF-8 in a single pass, replacing
+// backslashes with slashes when unix_path is set. dest must have room for 3
+// bytes per code unit. Unpaired surrogates are encoded as they are so the name
+// can be converted back. Return the number of bytes written.
+static size_t utf16_to_utf8(const wchar_t *src, size_t len, char *dest,
+                            bool unix_path) {
+  const wchar_t *end = src + len;
+  char *out = dest;
+
+  while (src < end) {
+#ifdef UTILS_SSE2
+    // ASCII fast path: 8 code units at a time
+    while (end - src >= 8) {
+      __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+      __m128i high = _mm_and_si128(units, _mm_set1_epi16(-0x80));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) !=
+          0xffff)
+        break;
+      __m128i bytes = _mm_packus_epi16(units, units);
+      if (unix_path) {
+        __m128i backslashes = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'));
+        bytes = _mm_xor_si128(
+            bytes, _mm_and_si128(backslashes, _mm_set1_epi8('\\' ^ '/')));
+      }
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out), bytes);
+      src += 8;
+      out += 8;
+    }
+    if (src == end)
       break;
-    ++o_len;
-    if ((c & MASK(31)) != 0)
-      return -EINVAL;
-  }
-
-  buf += o_len;
-  mask = 0xff80;
-  auto tmp_len = o_len;
-  while (--tmp_len) {
-    *--buf = 0x80 | (c & 0x3f);
-    c >>= 6;
-    mask >>= 1;
-  }
-  *--buf = mask | c;
-  return o_len;
-}
-
-static size_t get_utf16(const unsigned char *p, size_t len, ICONV_CHAR *out) {
-  ICONV_CHAR c;
-
-  if (len < 2)
-    return -EINVAL;
-  c = GET_A2(p);
-  if ((c & 0xfc00) == 0xd800 && len >= 4) {
-    ICONV_CHAR c2 = GET_A2(p + 2);
-    if ((c2 & 0xfc00) == 0xdc00) {
-      *out = (c << 10) + c2 - ((0xd800 << 10) + 0xdc00 - 0x10000);
-      return 4;
+#endif
+    unsigned int c = static_cast<unsigned short>(*src++);
+    if (c < 0x80) {
+      *out++ = (unix_path && c == '\\') ? '/' : static_cast<char>(c);
+    } else if (c < 0x800) {
+      *out++ = static_cast<char>(0xc0 | (c >> 6));
+      *out++ = static_cast<char>(0x80 | (c & 0x3f));
+    } else if ((c & 0xfc00) == 0xd800 && src < end &&
+               (*src & 0xfc00) == 0xdc00) {
+      c = 0x10000 + ((c - 0xd800) << 10) +
+          (static_cast<unsigned short>(*src++) - 0xdc00);
+      *out++ = static_cast<char>(0xf0 | (c >> 18));
+      *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      *out++ = static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+      *out++ = static_cast<char>(0xe0 | (c >> 12));
+      *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      *out++ = static_cast<char>(0x80 | (c & 0x3f));
     }
   }
-  *out = c;
-  return 2;
-}
-
-static size_t put_utf16(unsigned char *buf, ICONV_CHAR c) {
-  if (c >= 0x110000u)
-    return -EILSEQ;
-  if (c < 0x10000u) {
-    PUT_A2(buf, c);
-    return 2;
-  }
-  c -= 0x10000u;
-  PUT_A2(buf, 0xd800 + (c >> 10));
-  PUT_A2(buf + 2, 0xdc00 + (c & 0x3ffu));
-  return 4;
+  return out - dest;
 }
 
-typedef size_t (*get_conver_t)(const unsigned char *p, size_t len,
-                               ICONV_CHAR *out);
-typedef size_t (*put_convert_t)(unsigned char *buf, ICONV_CHAR c);
-
-static size_t convert_char(get_conver_t get_func, put_convert_t put_func,
-                           const void *src, size_t src_len, void *dest) {
-  size_t il = src_len;
-  const unsigned char *ib = static_cast<const unsigned char *>(src);
-  unsigned char *ob = static_cast<unsigned char *>(dest);
-  size_t total = 0;
-
-  while (il) {
-    ICONV_CHAR out_c = 0;
-    size_t readed = get_func(ib, il, &out_c);
-    if (unlikely(readed < 0))
-      return -1;
-    il -= readed;
-    ib += readed;
-
-    unsigned char dummy[8] = {0};
-    size_t written = put_func(ob ? ob : dummy, out_c);
-    if (unlikely(written < 0))
+// Convert len bytes of UTF-8 src to UTF-16 in a single pass. At most
+// dest_len code units are written. Return the number of code units written
+// or -1 if src is not valid UTF-8 or does not fit.
+static size_t utf8_to_utf16(const char *src, size_t len, wchar_t *dest,
+                            size_t dest_len) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(src);
+  const unsigned char *end = p + len;
+  wchar_t *out = dest;
+  wchar_t *out_end = dest + dest_len;
+
+  while (p < end) {
+#ifdef UTILS_SSE2
+    // ASCII fast path: 16 bytes at a time
+    while (end - p >= 16 && out_end - out >= 16) {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      if (_mm_movemask_epi8(bytes))
+        break;
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                       _mm_unpacklo_epi8(bytes, _mm_setzero_si128()));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8),
+                       _mm_unpackhi_epi8(bytes, _mm_setzero_si128()));
+      p += 16;
+      out += 16;
+    }
+    if (p == end)
+      break;
+#endif
+    if (out == out_end)
       return -1;
-
-    if (ob)
-      ob += written;
-    total += written;
+    unsigned int c = *p++;
+    if (c >= 0x80) {
+      size_t trail;
+      unsigned int min;
+      if ((c & 0xe0) == 0xc0) {
+        trail = 1;
+        c &= 0x1f;
+        min = 0x80;
+      } else if ((c & 0xf0) == 0xe0) {
+        trail = 2;
+        c &= 0x0f;
+        min = 0x800;
+      } else if ((c & 0xf8) == 0xf0) {
+        trail = 3;
+        c &= 0x07;
+        min = 0x10000;
+      } else {
+        return -1;
+      }
+      if (static_cast<size_t>(end - p) < trail)
+        return -1;
+      for (; trail; --trail) {
+        if ((*p & 0xc0) != 0x80)
+          return -1;
+        c = (c << 6) | (*p++ & 0x3f);
+      }
+      // Overlong forms could hide a slash or a null
+      if (c < min || c >= 0x110000)
+        return -1;
+      if (c >= 0x10000) {
+        if (out_end - out < 2)
+          return -1;
+        c -= 0x10000;
+        *out++ = static_cast<wchar_t>(0xd800 + (c >> 10));
+        c = 0xdc00 + (c & 0x3ff);
+      }
+    }
+    *out++ = static_cast<wchar_t>(c);
   }
-  return total;
+  return out - dest;
 }
 
 static char *wchar_to_utf8(const wchar_t *str) {
   if (str == nullptr)
     return nullptr;
 
-  // Determine required length
-  size_t ln = convert_char(get_utf16, put_utf8, str,
-                           (wcslen(str) + 1) * sizeof(wchar_t), nullptr);
-  if (ln <= 0)
-    return nullptr;
-  auto res = static_cast<char *>(malloc(sizeof(char) * ln));
+  size_t len = wcslen(str);
+  auto res = static_cast<char *>(malloc(len * 3 + 1));
   if (res == nullptr)
     return nullptr;
+  res[utf16_to_utf8(str, len, res, false)] = '\0';
+  return res;
+}
+
+static std::string wchar_to_utf8_string(const wchar_t *str, bool unix_path) {
+  std::string res;
+  if (str == nullptr)
+    return res;
 
-  // Convert to Unicode
-  convert_char(get_utf16, put_utf8, str, (wcslen(str) + 1) * sizeof(wchar_t),
-               res);
+  // Convert in place in the result, sized for the worst case then shrunk,
+  // so the only allocation is the result one.
+  size_t len = wcslen(str);
+  res.resize(len * 3);
+  res.resize(utf16_to_utf8(str, len, &res[0], unix_path));
   return res;
 }
 
 size_t utf8_to_wchar_buf(const char *src, wchar_t *res, int maxlen) {
-  if (res == nullptr || maxlen == 0)
+  if (res == nullptr || maxlen <= 0)
     return -1;
 
-  size_t ln = convert_char(get_utf8, put_utf16, src, strlen(src) + 1,
-                           nullptr); /* | raise_w32_error()*/
-  ;
-  if (ln <= 0 || ln / sizeof(wchar_t) > static_cast<size_t>(maxlen)) {
+  // Keep room for the null terminator
+  size_t ln = utf8_to_utf16(src, strlen(src), res, maxlen - 1);
+  if (ln == static_cast<size_t>(-1)) {
     *res = L'\0';
     return -1;
   }
-  return convert_char(get_utf8, put_utf16, src, strlen(src) + 1,
-               res); /* | raise_w32_error()*/
-  ;
+  res[ln] = L'\0';
+  return (ln + 1) * sizeof(wchar_t);
 }
 
 void utf8_to_wchar_buf_old(const char *src, wchar_t *res, int maxlen) {
@@ -207,9 +192,14 @@ void utf8_to_wchar_buf_old(const char *src, wchar_t *res, int maxlen) {
 }
 
 std::string wchar_to_utf8_cstr(const wchar_t *str) {
-  char *utf = wchar_to_utf8(str);
-  std::string res(utf);
-  free(utf);
+  return wchar_to_utf8_string(str, false);
+}
+
+std::string wchar_to_unix_path(const wchar_t *str) {
+  std::string res = wchar_to_utf8_string(str, true);
+  // Remove the trailing slash
+  if (res.size() > 1 && res[res.size() - 1] == '/')
+    res.resize(res.size() - 1);
   return res;
 }
 
@@ -311,15 +301,70 @@ static const struct errentry errtable[] = {
 };
 const int errtable_size = sizeof(errtable) / sizeof(errtable[0]);
 
+// errtable is scanned once to build constant time lookup tables: errno values
+// index the NTSTATUS table and the NTSTATUS codes are perfect hashed. When a
+// value is listed several times, its first entry wins like with the former
+// linear scans.
+#define ERRNO_TABLE_SIZE 256
+#define NTSTATUS_HASH_BITS 8
+// Number of multipliers tried before giving up. With the current errtable
+// about one multiplier in 85 gives distinct slots.
+#define NTSTATUS_HASH_MAX_TRIES 65536
+
+struct error_tables {
+  long errno_to_ntstatus[ERRNO_TABLE_SIZE];
+  // Empty slots have the key STATUS_SUCCESS which is never looked up
+  NTSTATUS ntstatus_keys[1 << NTSTATUS_HASH_BITS];
+  int ntstatus_to_errno[1 << NTSTATUS_HASH_BITS];
+  unsigned int multiplier;
+
+  error_tables() {
+    for (auto f = 0; f < ERRNO_TABLE_SIZE; ++f)
+      errno_to_ntstatus[f] = STATUS_NOT_IMPLEMENTED;
+    for (auto f = errtable_size - 1; f >= 0; --f)
+      if (errtable[f].errnocode < ERRNO_TABLE_SIZE)
+        errno_to_ntstatus[errtable[f].errnocode] = errtable[f].oscode;
+
+    // Search a multiplier giving a distinct slot to each code
+    multiplier = 0x9e3779b1u;
+    for (auto tries = 0;; ++tries, multiplier += 2) {
+      if (tries == NTSTATUS_HASH_MAX_TRIES)
+        abort(); //"errtable cannot be hashed, raise NTSTATUS_HASH_BITS"
+      memset(ntstatus_keys, 0, sizeof(ntstatus_keys));
+      bool collision = false;
+      for (auto f = 0; f < errtable_size && !collision; ++f) {
+        unsigned int h = hash(errtable[f].oscode);
+        if (ntstatus_keys[h] == 0) {
+          ntstatus_keys[h] = errtable[f].oscode;
+          ntstatus_to_errno[h] = errtable[f].errnocode;
+        } else if (ntstatus_keys[h] != errtable[f].oscode) {
+          collision = true;
+        }
+      }
+      if (!collision)
+        break;
+    }
+  }
+
+  unsigned int hash(long status) const {
+    return (static_cast<unsigned int>(status) * multiplier) >>
+           (32 - NTSTATUS_HASH_BITS);
+  }
+};
+
+static const error_tables &get_error_tables() {
+  static const error_tables tables;
+  return tables;
+}
+
 extern "C" int ntstatus_error_to_errno(long win_res) {
   if (win_res == 0)
     return 0; // No error
 
-  if (win_res < 0)
-    win_res = -win_res;
-  for (auto f = 0; f < errtable_size; ++f)
-    if (errtable[f].oscode == win_res)
-      return errtable[f].errnocode;
+  const error_tables &tables = get_error_tables();
+  unsigned int h = tables.hash(win_res);
+  if (tables.ntstatus_keys[h] == win_res)
+    return tables.ntstatus_to_errno[h];
   return EINVAL;
 }
 
@@ -329,10 +374,9 @@ extern "C" long errno_to_ntstatus_error(int err) {
 
   if (err < 0)
     err = -err;
-  for (auto f = 0; f < errtable_size; ++f)
-    if (errtable[f].errnocode == err)
-      return errtable[f].oscode;
-  return STATUS_NOT_IMPLEMENTED;
+  if (err >= ERRNO_TABLE_SIZE)
+    return STATUS_NOT_IMPLEMENTED;
+  return get_error_tables().errno_to_ntstatus[err];
 }
 
 extern "C" char **convert_args(int argc, wchar_t *argv[]) {
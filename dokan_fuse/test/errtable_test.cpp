@@ -0,0 +1,143 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the errno and NTSTATUS lookup tables of utils.cpp against linear
+// scans of errtable, the former implementation, and measures both.
+//
+//   errtable_test [random codes] [benchmark iterations]
+
+// Included rather than linked to reach errtable and the tables.
+#include "../src/utils.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+int scan_ntstatus_to_errno(long win_res) {
+  if (win_res == 0)
+    return 0;
+  for (auto f = 0; f < errtable_size; ++f)
+    if (errtable[f].oscode == win_res)
+      return errtable[f].errnocode;
+  return EINVAL;
+}
+
+long scan_errno_to_ntstatus(int err) {
+  if (err == 0)
+    return 0;
+  if (err < 0)
+    err = -err;
+  for (auto f = 0; f < errtable_size; ++f)
+    if (errtable[f].errnocode == err)
+      return errtable[f].oscode;
+  return STATUS_NOT_IMPLEMENTED;
+}
+
+void test_multiplier() {
+  const error_tables &tables = get_error_tables();
+  CHECK((tables.multiplier - 0x9e3779b1u) / 2 < NTSTATUS_HASH_MAX_TRIES);
+  for (auto f = 0; f < errtable_size; ++f)
+    CHECK(tables.ntstatus_keys[tables.hash(errtable[f].oscode)] ==
+          errtable[f].oscode);
+}
+
+void test_errno_to_ntstatus() {
+  for (int err = -2 * ERRNO_TABLE_SIZE; err <= 2 * ERRNO_TABLE_SIZE; ++err)
+    CHECK(errno_to_ntstatus_error(err) == scan_errno_to_ntstatus(err));
+  CHECK(errno_to_ntstatus_error(INT32_MAX) == STATUS_NOT_IMPLEMENTED);
+  CHECK(errno_to_ntstatus_error(-INT32_MAX) == STATUS_NOT_IMPLEMENTED);
+}
+
+void test_ntstatus_to_errno(int random_codes) {
+  for (auto f = 0; f < errtable_size; ++f) {
+    const long status = errtable[f].oscode;
+    CHECK(ntstatus_error_to_errno(status) == scan_ntstatus_to_errno(status));
+    // Each errno of the table comes back from its NTSTATUS
+    const int err = errtable[f].errnocode;
+    CHECK(ntstatus_error_to_errno(errno_to_ntstatus_error(err)) == err);
+    CHECK(ntstatus_error_to_errno(errno_to_ntstatus_error(-err)) == err);
+  }
+  CHECK(ntstatus_error_to_errno(STATUS_SUCCESS) == 0);
+
+  // Codes absent from the table but landing in used slots
+  std::mt19937 rng(1);
+  for (int f = 0; f < random_codes; ++f) {
+    const long status = static_cast<NTSTATUS>(rng());
+    CHECK(ntstatus_error_to_errno(status) == scan_ntstatus_to_errno(status));
+  }
+}
+
+void benchmark(int iterations) {
+  using clock = std::chrono::steady_clock;
+  volatile long sink = 0;
+  auto measure = [&](auto lookup) {
+    const auto start = clock::now();
+    for (int f = 0; f < iterations; ++f)
+      sink = sink + lookup(f);
+    return std::chrono::duration<double, std::nano>(clock::now() - start)
+               .count() /
+           iterations;
+  };
+  // Early and late entries of the table
+  const double scan_errno = measure([](int f) {
+    return scan_errno_to_ntstatus(f & 1 ? ENOENT : ENOTEMPTY);
+  });
+  const double table_errno = measure([](int f) {
+    return errno_to_ntstatus_error(f & 1 ? ENOENT : ENOTEMPTY);
+  });
+  const double scan_status = measure([](int f) {
+    return scan_ntstatus_to_errno(f & 1 ? STATUS_OBJECT_NAME_NOT_FOUND
+                                        : STATUS_QUOTA_EXCEEDED);
+  });
+  const double table_status = measure([](int f) {
+    return ntstatus_error_to_errno(f & 1 ? STATUS_OBJECT_NAME_NOT_FOUND
+                                         : STATUS_QUOTA_EXCEEDED);
+  });
+  printf("errno to NTSTATUS: scan %.2f ns, table %.2f ns\n", scan_errno,
+         table_errno);
+  printf("NTSTATUS to errno: scan %.2f ns, hash %.2f ns\n", scan_status,
+         table_status);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int random_codes = argc > 1 ? atoi(argv[1]) : 10000000;
+  const int iterations = argc > 2 ? atoi(argv[2]) : 50000000;
+
+  test_multiplier();
+  test_errno_to_ntstatus();
+  test_ntstatus_to_errno(random_codes);
+  printf("errtable_test passed, multiplier %#x\n",
+         get_error_tables().multiplier);
+  benchmark(iterations);
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Cost of the byte range lock checks done by each read and write, and of
+// opening and closing files from several threads.
+//
+//   file_locks_benchmark [handles] [locks per handle] [threads] [operations]
+
+#include "fusemain.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const DWORD share_all = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+
+typedef std::unique_ptr<impl_file_handle> handle_t;
+typedef std::chrono::steady_clock clock_type;
+
+double elapsed_ns(clock_type::time_point start, long long operations) {
+  return std::chrono::duration<double, std::nano>(clock_type::now() - start)
+             .count() /
+         operations;
+}
+
+// check_lock of 512 bytes spread over the file, from every handle.
+void benchmark_check_lock(int handles, int locks_per_handle, int operations) {
+  impl_file_locks locks;
+  std::vector<handle_t> files(handles);
+  for (auto &file : files)
+    locks.get_file("/file", false, 0, share_all, file);
+
+  const long long ranges = static_cast<long long>(handles) * locks_per_handle;
+  for (int with_locks = 0; with_locks < 2; ++with_locks) {
+    if (with_locks)
+      for (int h = 0; h < handles; ++h)
+        for (int l = 0; l < locks_per_handle; ++l)
+          files[h]->lock((static_cast<long long>(h) * locks_per_handle + l) *
+                             4096,
+                         4096);
+    long long refused = 0;
+    const auto start = clock_type::now();
+    for (int f = 0; f < operations; ++f)
+      refused += files[f % handles]->check_lock(
+                     static_cast<long long>(f) * 7919 % ranges * 4096 + 100,
+                     512) != 0;
+    printf("check_lock %s: %.1f ns (%lld refused)\n",
+           with_locks ? "with locks" : "without locks",
+           elapsed_ns(start, operations), refused);
+  }
+}
+
+// Each thread opens and closes its own files.
+void benchmark_open_close(int threads, int operations) {
+  impl_file_locks locks;
+  std::vector<std::thread> workers;
+  const auto start = clock_type::now();
+  for (int t = 0; t < threads; ++t)
+    workers.emplace_back([&locks, t, operations] {
+      std::vector<std::string> names;
+      for (int f = 0; f < 64; ++f)
+        names.push_back("/dir/file" + std::to_string(t) + "_" +
+                        std::to_string(f));
+      handle_t file;
+      for (int f = 0; f < operations; ++f) {
+        locks.get_file(names[f % names.size()], false, 0, share_all, file);
+        file.reset();
+      }
+    });
+  for (auto &w : workers)
+    w.join();
+  printf("open/close from %d threads: %.1f ns\n", threads,
+         elapsed_ns(start, static_cast<long long>(threads) * operations));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int handles = argc > 1 ? atoi(argv[1]) : 64;
+  const int locks_per_handle = argc > 2 ? atoi(argv[2]) : 64;
+  const int threads = argc > 3 ? atoi(argv[3]) : 8;
+  const int operations = argc > 4 ? atoi(argv[4]) : 2000000;
+
+  benchmark_check_lock(handles, locks_per_handle, operations);
+  benchmark_open_close(threads, operations / 10);
+  return 0;
+}
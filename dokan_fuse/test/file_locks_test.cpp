@@ -0,0 +1,201 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Byte range locks of impl_file_lock against a brute force model, and their
+// use from several threads.
+//
+//   file_locks_test [operations]
+
+#include "fusemain.h"
+
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+const DWORD share_all = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+
+typedef std::unique_ptr<impl_file_handle> handle_t;
+
+// The former implementation: every lock of every handle in a list.
+struct model {
+  struct range {
+    long long start, len;
+    int owner;
+  };
+  std::vector<range> ranges;
+
+  static bool overlap(const range &r, long long start, long long len) {
+    return r.start < start + len && start < r.start + r.len;
+  }
+
+  int lock(int owner, long long start, long long len) {
+    if (start < 0 || len <= 0)
+      return -EINVAL;
+    for (const auto &r : ranges)
+      if (overlap(r, start, len))
+        return -EACCES;
+    ranges.push_back({start, len, owner});
+    return 0;
+  }
+
+  int check_lock(int owner, long long start, long long len) const {
+    if (start < 0 || len <= 0)
+      return -EINVAL;
+    for (const auto &r : ranges)
+      if (r.owner != owner && overlap(r, start, len))
+        return -EACCES;
+    return 0;
+  }
+
+  int unlock(int owner, long long start, long long len) {
+    if (len == 0)
+      return 0;
+    if (start < 0 || len < 0)
+      return -EINVAL;
+    for (auto i = ranges.begin(); i != ranges.end(); ++i)
+      if (i->owner == owner && i->start == start && i->len == len) {
+        ranges.erase(i);
+        return 0;
+      }
+    return -EACCES;
+  }
+
+  void close(int owner) {
+    for (size_t f = 0; f < ranges.size();)
+      if (ranges[f].owner == owner)
+        ranges.erase(ranges.begin() + f);
+      else
+        ++f;
+  }
+};
+
+// Random lock, check and unlock calls on a few handles of the same file, with
+// handles closed while holding locks now and then.
+void test_model(int operations) {
+  impl_file_locks locks;
+  std::vector<handle_t> handles(6);
+  for (auto &h : handles)
+    CHECK(locks.get_file("/file", false, 0, share_all, h) == 0);
+
+  model expected;
+  std::mt19937_64 rng(1);
+  for (int f = 0; f < operations; ++f) {
+    int owner = rng() % handles.size();
+    long long start = rng() % 200 - 2;
+    long long len = rng() % 20 - 2;
+    switch (rng() % 3) {
+    case 0:
+      CHECK(handles[owner]->lock(start, len) ==
+            expected.lock(owner, start, len));
+      break;
+    case 1:
+      CHECK(handles[owner]->check_lock(start, len) ==
+            expected.check_lock(owner, start, len));
+      break;
+    default:
+      // Mostly unlock ranges that are locked
+      if (!expected.ranges.empty() && rng() % 2) {
+        const auto &r = expected.ranges[rng() % expected.ranges.size()];
+        owner = r.owner;
+        start = r.start;
+        len = r.len;
+      }
+      CHECK(handles[owner]->unlock(start, len) ==
+            expected.unlock(owner, start, len));
+      break;
+    }
+
+    if (rng() % 5000 == 0) {
+      owner = rng() % handles.size();
+      handles[owner].reset();
+      expected.close(owner);
+      CHECK(locks.get_file("/file", false, 0, share_all, handles[owner]) ==
+            0);
+    }
+  }
+}
+
+// Locks of a closed file do not outlive it.
+void test_close() {
+  impl_file_locks locks;
+  handle_t first, second;
+  CHECK(locks.get_file("/file", false, 0, share_all, first) == 0);
+  CHECK(locks.get_file("/file", false, 0, share_all, second) == 0);
+  CHECK(first->lock(0, 100) == 0);
+  CHECK(second->check_lock(50, 10) == -EACCES);
+  first.reset();
+  CHECK(second->check_lock(50, 10) == 0);
+  CHECK(second->lock(50, 10) == 0);
+
+  // Nor once the file is reopened after all its handles are closed.
+  second.reset();
+  CHECK(locks.get_file("/file", false, 0, share_all, first) == 0);
+  CHECK(locks.get_file("/file", false, 0, share_all, second) == 0);
+  CHECK(second->check_lock(50, 10) == 0);
+}
+
+// Each thread opens the same files, locks its own ranges and checks the
+// others, while reads of files without locks go through the range_count fast
+// path. Meant for ThreadSanitizer.
+void test_threads() {
+  impl_file_locks locks;
+  const int threads = 4;
+  const int rounds = 2000;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t)
+    workers.emplace_back([&locks, t] {
+      handle_t locked, unlocked;
+      for (int f = 0; f < rounds; ++f) {
+        CHECK(locks.get_file("/locked" + std::to_string(f % 3), false, 0,
+                             share_all, locked) == 0);
+        CHECK(locks.get_file("/unlocked", false, 0, share_all, unlocked) ==
+              0);
+        CHECK(locked->lock(t * 100, 100) == 0);
+        CHECK(locked->check_lock(t * 100 + 10, 10) == 0);
+        CHECK(unlocked->check_lock(0, 4096) == 0);
+        CHECK(locked->unlock(t * 100, 100) == 0);
+      }
+    });
+  for (auto &w : workers)
+    w.join();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int operations = argc > 1 ? atoi(argv[1]) : 400000;
+  test_model(operations);
+  test_close();
+  test_threads();
+  printf("file_locks_test passed\n");
+  return 0;
+}
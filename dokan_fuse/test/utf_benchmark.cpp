@@ -0,0 +1,95 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Time per path of the UTF-16 and UTF-8 conversions of utils.cpp and of the
+// former ones.
+//
+//   utf_benchmark [conversions]
+
+#include <windows.h>
+
+#include "utils.h"
+#include "utf_reference.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+const wchar_t *wide(const std::u16string &str) {
+  return reinterpret_cast<const wchar_t *>(str.c_str());
+}
+
+void benchmark(const char *label, const std::vector<std::u16string> &paths,
+               int conversions) {
+  std::vector<std::string> utf8;
+  for (const auto &path : paths)
+    utf8.push_back(wchar_to_utf8_cstr(wide(path)));
+  const int rounds = conversions / static_cast<int>(paths.size());
+  const double count = static_cast<double>(rounds) * paths.size();
+  size_t sink = 0;
+  wchar_t buffer[300];
+
+  auto measure = [&](auto convert) {
+    const auto start = clock_type::now();
+    for (int r = 0; r < rounds; ++r)
+      for (size_t f = 0; f < paths.size(); ++f)
+        sink += convert(f);
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start)
+               .count() /
+           count;
+  };
+  const double reference_utf8 = measure([&](size_t f) {
+    return reference::unixify(reference::wchar_to_utf8_cstr(wide(paths[f])))
+        .size();
+  });
+  const double utf8_time = measure(
+      [&](size_t f) { return wchar_to_unix_path(wide(paths[f])).size(); });
+  const double reference_utf16 = measure([&](size_t f) {
+    return reference::utf8_to_wchar_buf(utf8[f].c_str(), buffer, 300);
+  });
+  const double utf16_time = measure([&](size_t f) {
+    return utf8_to_wchar_buf(utf8[f].c_str(), buffer, 300);
+  });
+  printf("%-6s to unix path %6.1f -> %6.1f ns, to UTF-16 %6.1f -> %6.1f ns "
+         "(%zu)\n",
+         label, reference_utf8, utf8_time, reference_utf16, utf16_time,
+         sink & 1);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int conversions = argc > 1 ? atoi(argv[1]) : 2000000;
+  benchmark("short", {u"\\a.txt", u"\\dir\\b", u"\\x"}, conversions);
+  benchmark("ascii",
+            {u"\\Users\\someone\\Documents\\projects\\dokany\\samples\\"
+             u"dokan_memfs\\filenode.cpp",
+             u"\\a\\fairly\\typical\\windows\\path\\name.docx"},
+            conversions);
+  benchmark("mixed",
+            {u"\\Dokumente\\Übersicht\\Grüße aus München.txt",
+             u"\\中文\\文件夹\\测试文档.txt"},
+            conversions);
+  return 0;
+}
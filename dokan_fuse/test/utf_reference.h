@@ -0,0 +1,245 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The UTF-16 and UTF-8 conversions of utils.cpp before they were rewritten as
+// single pass loops, kept as the reference the current ones are checked and
+// measured against.
+
+#ifndef DOKANFUSE_TEST_UTF_REFERENCE_H_
+#define DOKANFUSE_TEST_UTF_REFERENCE_H_
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace reference {
+
+typedef unsigned int ICONV_CHAR;
+
+#if defined(__GNUC__) && __GNUC__ >= 3
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#else
+#define unlikely(x) (x)
+#endif
+
+#define GET_A2(p) (*((unsigned short *)(p)))
+#define PUT_A2(buf, c)                                                         \
+  do {                                                                         \
+    *((unsigned short *)(buf)) = (c);                                          \
+  } while (0)
+
+static const unsigned char utf8_lengths[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 0, 0,
+};
+
+static const unsigned char utf8_masks[7] = {0,    0x7f, 0x1f, 0x0f,
+                                            0x07, 0x03, 0x01};
+
+static size_t get_utf8(const unsigned char *p, size_t len, ICONV_CHAR *out) {
+  ICONV_CHAR uc;
+  size_t l;
+
+  l = utf8_lengths[p[0]];
+  if (unlikely(l == 0))
+    return -EILSEQ;
+  if (unlikely(len < l))
+    return -EINVAL;
+
+  len = l;
+  uc = *p++ & utf8_masks[l];
+  while (--l)
+    uc = (uc << 6) | (*p++ & 0x3f);
+  *out = uc;
+  return len;
+}
+
+#define MASK(n) ((0xffffffffu << (n)) & 0xffffffffu)
+
+static size_t put_utf8(unsigned char *buf, ICONV_CHAR c) {
+  size_t o_len;
+  unsigned mask;
+
+  if ((c & MASK(7)) == 0) {
+    *buf = static_cast<unsigned char>(c);
+    return 1;
+  }
+
+  o_len = 2;
+  for (;;) {
+    if ((c & MASK(11)) == 0)
+      break;
+    ++o_len;
+    if ((c & MASK(16)) == 0)
+      break;
+    ++o_len;
+    if ((c & MASK(21)) == 0)
+      break;
+    ++o_len;
+    if ((c & MASK(26)) == 0)
+      break;
+    ++o_len;
+    if ((c & MASK(31)) != 0)
+      return -EINVAL;
+  }
+
+  buf += o_len;
+  mask = 0xff80;
+  auto tmp_len = o_len;
+  while (--tmp_len) {
+    *--buf = 0x80 | (c & 0x3f);
+    c >>= 6;
+    mask >>= 1;
+  }
+  *--buf = mask | c;
+  return o_len;
+}
+
+static size_t get_utf16(const unsigned char *p, size_t len, ICONV_CHAR *out) {
+  ICONV_CHAR c;
+
+  if (len < 2)
+    return -EINVAL;
+  c = GET_A2(p);
+  if ((c & 0xfc00) == 0xd800 && len >= 4) {
+    ICONV_CHAR c2 = GET_A2(p + 2);
+    if ((c2 & 0xfc00) == 0xdc00) {
+      *out = (c << 10) + c2 - ((0xd800 << 10) + 0xdc00 - 0x10000);
+      return 4;
+    }
+  }
+  *out = c;
+  return 2;
+}
+
+static size_t put_utf16(unsigned char *buf, ICONV_CHAR c) {
+  if (c >= 0x110000u)
+    return -EILSEQ;
+  if (c < 0x10000u) {
+    PUT_A2(buf, c);
+    return 2;
+  }
+  c -= 0x10000u;
+  PUT_A2(buf, 0xd800 + (c >> 10));
+  PUT_A2(buf + 2, 0xdc00 + (c & 0x3ffu));
+  return 4;
+}
+
+typedef size_t (*get_conver_t)(const unsigned char *p, size_t len,
+                               ICONV_CHAR *out);
+typedef size_t (*put_convert_t)(unsigned char *buf, ICONV_CHAR c);
+
+static size_t convert_char(get_conver_t get_func, put_convert_t put_func,
+                           const void *src, size_t src_len, void *dest) {
+  size_t il = src_len;
+  const unsigned char *ib = static_cast<const unsigned char *>(src);
+  unsigned char *ob = static_cast<unsigned char *>(dest);
+  size_t total = 0;
+
+  while (il) {
+    ICONV_CHAR out_c = 0;
+    size_t readed = get_func(ib, il, &out_c);
+    if (unlikely(readed < 0))
+      return -1;
+    il -= readed;
+    ib += readed;
+
+    unsigned char dummy[8] = {0};
+    size_t written = put_func(ob ? ob : dummy, out_c);
+    if (unlikely(written < 0))
+      return -1;
+
+    if (ob)
+      ob += written;
+    total += written;
+  }
+  return total;
+}
+
+static char *wchar_to_utf8(const wchar_t *str) {
+  if (str == nullptr)
+    return nullptr;
+
+  // Determine required length
+  size_t ln = convert_char(get_utf16, put_utf8, str,
+                           (wcslen(str) + 1) * sizeof(wchar_t), nullptr);
+  if (ln <= 0)
+    return nullptr;
+  auto res = static_cast<char *>(malloc(sizeof(char) * ln));
+  if (res == nullptr)
+    return nullptr;
+
+  // Convert to Unicode
+  convert_char(get_utf16, put_utf8, str, (wcslen(str) + 1) * sizeof(wchar_t),
+               res);
+  return res;
+}
+
+inline size_t utf8_to_wchar_buf(const char *src, wchar_t *res, int maxlen) {
+  if (res == nullptr || maxlen == 0)
+    return -1;
+
+  size_t ln = convert_char(get_utf8, put_utf16, src, strlen(src) + 1,
+                           nullptr); /* | raise_w32_error()*/
+  ;
+  if (ln <= 0 || ln / sizeof(wchar_t) > static_cast<size_t>(maxlen)) {
+    *res = L'\0';
+    return -1;
+  }
+  return convert_char(get_utf8, put_utf16, src, strlen(src) + 1,
+               res); /* | raise_w32_error()*/
+  ;
+}
+
+inline std::string wchar_to_utf8_cstr(const wchar_t *str) {
+  char *utf = wchar_to_utf8(str);
+  std::string res(utf);
+  free(utf);
+  return res;
+}
+
+inline std::string unixify(const std::string &str) {
+  // Replace slashes
+  std::string res = str;
+  for (size_t f = 0; f < res.size(); ++f) {
+    auto ch = res[f];
+    if (ch == '\\')
+      res[f] = '/';
+  }
+  // Remove the trailing slash
+  if (res.size() > 1 && res[res.size() - 1] == '/')
+    res.resize(res.size() - 1);
+
+  return res;
+}
+
+} // namespace reference
+
+#endif // DOKANFUSE_TEST_UTF_REFERENCE_H_
@@ -0,0 +1,130 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Checks the UTF-16 and UTF-8 conversions of utils.cpp against the former
+// ones on random paths, and their handling of invalid UTF-8 and short
+// buffers.
+//
+//   utf_test [paths]
+
+#include <windows.h>
+
+#include "utils.h"
+#include "utf_reference.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+static_assert(sizeof(wchar_t) == sizeof(char16_t), "build with -fshort-wchar");
+
+const wchar_t *wide(const std::u16string &str) {
+  return reinterpret_cast<const wchar_t *>(str.c_str());
+}
+
+// Paths mixing ASCII, both separators, 2 and 3 bytes characters and
+// surrogate pairs, some of them unpaired.
+std::vector<std::u16string> random_paths(int count) {
+  std::vector<std::u16string> paths = {
+      u"", u"\\", u"\\a\\b\\", u"\\dir\\file.txt", u"\\x\\é中\U0001F508z\\",
+      u"\\long\\path\\with\\many\\ascii\\segments\\and\\a\\file_name.txt"};
+  std::mt19937 rng(1);
+  for (int f = 0; f < count; ++f) {
+    std::u16string path;
+    const int len = rng() % 70;
+    for (int c = 0; c < len; ++c) {
+      const int kind = rng() % 10;
+      if (kind < 6) {
+        path += u"abcXYZ\\/._"[rng() % 10];
+      } else if (kind < 8) {
+        path += static_cast<char16_t>(0x80 + rng() % 0x780);
+      } else if (kind < 9) {
+        char16_t unit = static_cast<char16_t>(0x800 + rng() % 0xf000);
+        path += (unit >= 0xd800 && unit < 0xe000) ? u'q' : unit;
+      } else {
+        const uint32_t code_point = 0x10000 + rng() % 0xfffff;
+        path += static_cast<char16_t>(0xd800 + ((code_point - 0x10000) >> 10));
+        if (rng() % 8)
+          path += static_cast<char16_t>(0xdc00 + (code_point & 0x3ff));
+      }
+    }
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+void test_paths(int count) {
+  for (const auto &path : random_paths(count)) {
+    const std::string utf8 = wchar_to_utf8_cstr(wide(path));
+    CHECK(utf8 == reference::wchar_to_utf8_cstr(wide(path)));
+    CHECK(wchar_to_unix_path(wide(path)) == reference::unixify(utf8));
+
+    // Back to UTF-16, unpaired surrogates included
+    wchar_t converted[300], expected[300];
+    const size_t size = utf8_to_wchar_buf(utf8.c_str(), converted, 300);
+    CHECK(size == reference::utf8_to_wchar_buf(utf8.c_str(), expected, 300));
+    CHECK(!memcmp(converted, expected, size));
+    CHECK(std::u16string(reinterpret_cast<char16_t *>(converted)) == path);
+
+    // The null terminator must fit
+    const size_t len = path.size();
+    if (len) {
+      CHECK(utf8_to_wchar_buf(utf8.c_str(), converted, len) ==
+            static_cast<size_t>(-1));
+      CHECK(converted[0] == L'\0');
+      CHECK(utf8_to_wchar_buf(utf8.c_str(), converted, len + 1) ==
+            (len + 1) * sizeof(wchar_t));
+    }
+  }
+}
+
+// Overlong, truncated, out of range and stray continuation bytes.
+void test_invalid_utf8() {
+  for (const char *invalid :
+       {"\xc0\xaf", "\xe0\x80\xaf", "\x80", "\xc3", "a\xe4\xb8",
+        "\xf8\x88\x80\x80\x80", "\xf4\x90\x80\x80", "\xc3("}) {
+    wchar_t converted[10];
+    converted[0] = L'x';
+    CHECK(utf8_to_wchar_buf(invalid, converted, 10) ==
+          static_cast<size_t>(-1));
+    CHECK(converted[0] == L'\0');
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const int paths = argc > 1 ? atoi(argv[1]) : 20000;
+  test_paths(paths);
+  test_invalid_utf8();
+  printf("utf_test passed\n");
+  return 0;
+}
@@ -0,0 +1,124 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "compressed_chunk.h"
+
+#include <WinBase.h>
+#include <compressapi.h>
+
+#include <cstring>
+#include <vector>
+
+namespace memfs {
+namespace {
+// Compression API handles cannot be used by several threads at once, each
+// thread keeps its own.
+class codec {
+ public:
+  codec() {
+    // Raw mode has no header, the uncompressed size is known by the caller.
+    const DWORD algorithm = COMPRESS_ALGORITHM_XPRESS | COMPRESS_RAW;
+    if (!CreateCompressor(algorithm, NULL, &_compressor)) _compressor = NULL;
+    if (!CreateDecompressor(algorithm, NULL, &_decompressor))
+      _decompressor = NULL;
+  }
+
+  ~codec() {
+    if (_compressor) CloseCompressor(_compressor);
+    if (_decompressor) CloseDecompressor(_decompressor);
+  }
+
+  static codec& get() {
+    thread_local codec instance;
+    return instance;
+  }
+
+  // Return the compressed size, 0 if it does not fit in out_size.
+  size_t compress(const uint8_t* data, size_t size, uint8_t* out,
+                  size_t out_size) {
+    SIZE_T compressed_size = 0;
+    if (!_compressor ||
+        !Compress(_compressor, data, size, out, out_size, &compressed_size))
+      return 0;
+    return compressed_size;
+  }
+
+  bool decompress(const uint8_t* data, size_t size, uint8_t* out,
+                  size_t out_size) {
+    SIZE_T decompressed_size = 0;
+    return _decompressor &&
+           Decompress(_decompressor, data, size, out, out_size,
+                      &decompressed_size) &&
+           decompressed_size == out_size;
+  }
+
+ private:
+  COMPRESSOR_HANDLE _compressor = NULL;
+  DECOMPRESSOR_HANDLE _decompressor = NULL;
+};
+}  // namespace
+
+std::shared_ptr<const compressed_chunk> compressed_chunk::compress(
+    const uint8_t* data, size_t size, std::shared_ptr<memory_usage> usage) {
+  // Below 1/8 saved, the decompression cost is not worth the memory.
+  const size_t max_size = size - size / 8;
+  thread_local std::vector<uint8_t> buffer;
+  buffer.resize(max_size);
+  const size_t compressed_size =
+      codec::get().compress(data, size, buffer.data(), max_size);
+  if (!compressed_size) return nullptr;
+
+  // Keep only the bytes used.
+  auto compressed = std::unique_ptr<uint8_t[]>(new uint8_t[compressed_size]);
+  memcpy(compressed.get(), buffer.data(), compressed_size);
+  return std::shared_ptr<const compressed_chunk>(new compressed_chunk(
+      std::move(compressed), compressed_size, size, std::move(usage)));
+}
+
+compressed_chunk::compressed_chunk(std::unique_ptr<uint8_t[]> data,
+                                   size_t compressed_size, size_t size,
+                                   std::shared_ptr<memory_usage> usage)
+    : _data(std::move(data)),
+      _compressed_size(compressed_size),
+      _size(size),
+      _usage(std::move(usage)) {
+  if (!_usage) return;
+  // Compressing only frees memory, it cannot fail on the capacity.
+  _usage->charge(_compressed_size);
+  _usage->count_compressed_chunk(_size, _compressed_size);
+}
+
+compressed_chunk::~compressed_chunk() {
+  if (!_usage) return;
+  _usage->release(_compressed_size);
+  _usage->count_compressed_chunk_free(_size, _compressed_size);
+}
+
+bool compressed_chunk::decompress(uint8_t* out) const {
+  return codec::get().decompress(_data.get(), _compressed_size, out, _size);
+}
+}  // namespace memfs
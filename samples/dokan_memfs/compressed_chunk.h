@@ -0,0 +1,69 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef COMPRESSED_CHUNK_H_
+#define COMPRESSED_CHUNK_H_
+
+#include "memory_usage.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace memfs {
+// Compressed content of a cold file chunk.
+// Chunks not accessed for a while are compressed with XPRESS, a fast codec of
+// the Windows compression API, and decompressed when accessed again.
+// The compressed bytes are accounted in the memory_usage until freed.
+class compressed_chunk {
+ public:
+  // Return data of size bytes compressed, or nullptr when it does not shrink
+  // enough to be worth it.
+  static std::shared_ptr<const compressed_chunk> compress(
+      const uint8_t* data, size_t size, std::shared_ptr<memory_usage> usage);
+
+  compressed_chunk(const compressed_chunk&) = delete;
+  compressed_chunk& operator=(const compressed_chunk&) = delete;
+  ~compressed_chunk();
+
+  // Write the uncompressed content into out, of the size given to compress.
+  // Return false if it cannot be decompressed.
+  bool decompress(uint8_t* out) const;
+
+  size_t size() const { return _compressed_size; }
+
+ private:
+  compressed_chunk(std::unique_ptr<uint8_t[]> data, size_t compressed_size,
+                   size_t size, std::shared_ptr<memory_usage> usage);
+
+  std::unique_ptr<uint8_t[]> _data;
+  const size_t _compressed_size;
+  const size_t _size;
+  std::shared_ptr<memory_usage> _usage;
+};
+}  // namespace memfs
+
+#endif  // COMPRESSED_CHUNK_H_
@@ -0,0 +1,293 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "filedata.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace memfs {
+namespace {
+bool is_zero_chunk(const uint8_t* data) {
+  for (size_t i = 0; i < filedata::chunk_size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    if (word) return false;
+  }
+  return true;
+}
+}  // namespace
+
+size_t filedata::read(void* buffer, size_t length, uint64_t offset) const {
+  if (offset >= _size) return 0;
+  length = static_cast<size_t>(std::min<uint64_t>(length, _size - offset));
+
+  const uint32_t now = current_time();
+  std::unique_ptr<uint8_t[]> decompressed;
+  auto out = static_cast<uint8_t*>(buffer);
+  size_t done = 0;
+  while (done < length) {
+    const uint64_t position = offset + done;
+    const uint64_t index = position / chunk_size;
+    const size_t chunk_offset = static_cast<size_t>(position % chunk_size);
+    const size_t count = std::min(length - done, chunk_size - chunk_offset);
+    auto chunk = _chunks.find(index);
+    if (chunk == _chunks.end()) {
+      memset(out + done, 0, count);  // Hole
+    } else if (chunk->second.data) {
+      chunk->second.last_access.touch(now);
+      memcpy(out + done, chunk->second.data.get() + chunk_offset, count);
+    } else {
+      if (!decompressed) decompressed.reset(new uint8_t[chunk_size]);
+      if (!chunk->second.compressed->decompress(decompressed.get()))
+        memset(decompressed.get(), 0, chunk_size);
+      memcpy(out + done, decompressed.get() + chunk_offset, count);
+    }
+    done += count;
+  }
+  return length;
+}
+
+bool filedata::write(const void* buffer, size_t length, uint64_t offset,
+                     chunk_pool* pool) {
+  // Reserve the whole write at once so it either fully succeeds or changes
+  // nothing. A chunk shared when counted can meanwhile be released by its
+  // other owners and finally not need a copy, the difference is given back.
+  const uint64_t reserved = _usage ? allocation_size(offset, length) : 0;
+  if (reserved && !_usage->reserve(reserved)) return false;
+
+  uint64_t allocated = 0;
+  auto in = static_cast<const uint8_t*>(buffer);
+  size_t done = 0;
+  while (done < length) {
+    const uint64_t position = offset + done;
+    const uint64_t index = position / chunk_size;
+    const size_t chunk_offset = static_cast<size_t>(position % chunk_size);
+    const size_t count = std::min(length - done, chunk_size - chunk_offset);
+    memcpy(get_writable_chunk(index, allocated) + chunk_offset, in + done,
+           count);
+    if (pool && count == chunk_size) dedupe_chunk(*pool, index);
+    done += count;
+  }
+  _size = std::max<uint64_t>(_size, offset + length);
+  if (reserved > allocated) _usage->release(reserved - allocated);
+  return true;
+}
+
+uint64_t filedata::allocation_size(uint64_t offset, size_t length) const {
+  if (!length) return 0;
+  uint64_t size = 0;
+  const uint64_t last = (offset + length - 1) / chunk_size;
+  auto chunk = _chunks.lower_bound(offset / chunk_size);
+  for (uint64_t index = offset / chunk_size; index <= last; ++index) {
+    if (chunk == _chunks.end() || chunk->first != index) {
+      size += chunk_size;  // Hole
+      continue;
+    }
+    if (chunk->second.read_only || chunk->second.data.use_count() != 1)
+      size += chunk_size;
+    ++chunk;
+  }
+  return size;
+}
+
+void filedata::resize(uint64_t size) {
+  if (size < _size) {
+    // Release the chunks fully beyond the new end.
+    const uint64_t first_unused = (size + chunk_size - 1) / chunk_size;
+    auto first = _chunks.lower_bound(first_unused);
+    if (_compressed_chunks) {
+      for (auto chunk = first; chunk != _chunks.end(); ++chunk)
+        if (chunk->second.compressed) --_compressed_chunks;
+    }
+    _chunks.erase(first, _chunks.end());
+    // Zero the tail of the last chunk.
+    const size_t tail_offset = static_cast<size_t>(size % chunk_size);
+    if (tail_offset && _chunks.count(size / chunk_size)) {
+      uint64_t allocated = 0;
+      memset(get_writable_chunk(size / chunk_size, allocated) + tail_offset, 0,
+             chunk_size - tail_offset);
+      // Truncating must not fail, the copy of a shared chunk can go beyond
+      // the capacity.
+      if (_usage) _usage->charge(allocated);
+    }
+  }
+  _size = size;
+}
+
+void filedata::set_chunk(uint64_t index, std::shared_ptr<uint8_t[]> data,
+                         bool read_only) {
+  auto& chunk = _chunks[index];
+  if (chunk.compressed) --_compressed_chunks;
+  chunk = {std::move(data), read_only, nullptr, access_time()};
+}
+
+void filedata::clone(const filedata& source) {
+  // Sharing raise the use count of every chunk, they are copied before the
+  // next write of both files.
+  _chunks = source._chunks;
+  _compressed_chunks = source._compressed_chunks;
+  _size = source._size;
+}
+
+uint8_t* filedata::get_writable_chunk(uint64_t index, uint64_t& allocated) {
+  auto& chunk = _chunks[index];
+  if (chunk.compressed) {
+    decompress_chunk(chunk, allocated);
+  } else if (!chunk.data) {
+    // The new chunk is zeroed, the part not written now must read as a hole.
+    chunk.data = allocate_chunk(true);
+    allocated += chunk_size;
+  } else if (chunk.read_only || chunk.data.use_count() != 1) {
+    // Shared chunk, get our own copy before modifying it.
+    auto copy = allocate_chunk(false);
+    memcpy(copy.get(), chunk.data.get(), chunk_size);
+    chunk.data = std::move(copy);
+    chunk.read_only = false;
+    allocated += chunk_size;
+  }
+  chunk.last_access.touch(current_time());
+  return chunk.data.get();
+}
+
+void filedata::decompress_chunk(chunk& chunk, uint64_t& allocated) {
+  auto data = allocate_chunk(false);
+  // Decompressing our own output only fails on a memory corruption, the
+  // chunk then reads as zeros.
+  if (!chunk.compressed->decompress(data.get()))
+    memset(data.get(), 0, chunk_size);
+  chunk.data = std::move(data);
+  chunk.read_only = false;
+  chunk.compressed.reset();
+  chunk.last_access.touch(current_time());
+  --_compressed_chunks;
+  allocated += chunk_size;
+  if (_usage) _usage->count_decompression();
+}
+
+uint32_t filedata::current_time() {
+  return static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+std::vector<filedata::cold_chunk> filedata::get_cold_chunks(
+    uint32_t cold_time) const {
+  std::vector<cold_chunk> cold_chunks;
+  for (const auto& [index, chunk] : _chunks) {
+    // Read only and shared chunks stay uncompressed, their memory is either
+    // mapped or still used by the other owners.
+    const uint32_t last_access = chunk.last_access.load();
+    if (chunk.data && !chunk.read_only && chunk.data.use_count() == 1 &&
+        last_access < cold_time)
+      cold_chunks.push_back({index, chunk.data, last_access});
+  }
+  return cold_chunks;
+}
+
+bool filedata::set_compressed(
+    const cold_chunk& cold,
+    std::shared_ptr<const compressed_chunk> compressed) {
+  auto chunk = _chunks.find(cold.index);
+  // A written chunk was copied and an accessed one has a new time. A chunk
+  // shared since, by a clone, would not be freed.
+  if (chunk == _chunks.end() || chunk->second.data != cold.data ||
+      chunk->second.data.use_count() != 2 ||
+      chunk->second.last_access.load() != cold.last_access)
+    return false;
+  if (!compressed) {
+    // Incompressible, only retried once cold again.
+    chunk->second.last_access.touch(current_time());
+    return false;
+  }
+  chunk->second.data.reset();
+  chunk->second.compressed = std::move(compressed);
+  ++_compressed_chunks;
+  return true;
+}
+
+bool filedata::is_compressed(uint64_t offset, size_t length) const {
+  if (!_compressed_chunks || !length) return false;
+  const uint64_t last = (offset + length - 1) / chunk_size;
+  for (auto chunk = _chunks.lower_bound(offset / chunk_size);
+       chunk != _chunks.end() && chunk->first <= last; ++chunk) {
+    if (chunk->second.compressed) return true;
+  }
+  return false;
+}
+
+void filedata::decompress(uint64_t offset, size_t length) {
+  if (!_compressed_chunks || !length) return;
+  uint64_t allocated = 0;
+  const uint64_t last = (offset + length - 1) / chunk_size;
+  for (auto chunk = _chunks.lower_bound(offset / chunk_size);
+       chunk != _chunks.end() && chunk->first <= last; ++chunk) {
+    if (chunk->second.compressed) decompress_chunk(chunk->second, allocated);
+  }
+  if (_usage) _usage->charge(allocated);
+}
+
+std::shared_ptr<uint8_t[]> filedata::allocate_chunk(bool zero) const {
+  // Value initialization zero the chunk.
+  auto data = zero ? new uint8_t[chunk_size]() : new uint8_t[chunk_size];
+  if (!_usage) return std::shared_ptr<uint8_t[]>(data);
+
+  _usage->count_chunk_allocation(chunk_size);
+  // The chunk can outlive this filedata when shared, the deleter keeps the
+  // accounting alive.
+  return std::shared_ptr<uint8_t[]>(data, [usage = _usage](uint8_t* data) {
+    delete[] data;
+    usage->count_chunk_free(chunk_size);
+    usage->release(chunk_size);
+  });
+}
+
+void filedata::dedupe_chunk(chunk_pool& pool, uint64_t index) {
+  auto chunk = _chunks.find(index);
+  if (is_zero_chunk(chunk->second.data.get())) {
+    _chunks.erase(chunk);  // Back to a hole
+    return;
+  }
+  chunk->second.data = pool.intern(chunk->second.data);
+  chunk->second.read_only = true;
+}
+
+std::shared_ptr<uint8_t[]> chunk_pool::intern(
+    const std::shared_ptr<uint8_t[]>& chunk) {
+  auto pooled = _chunks.intern(
+      content_hash(chunk.get(), filedata::chunk_size),
+      [&](const std::shared_ptr<uint8_t[]>& pooled) {
+        return pooled == chunk ||
+               !memcmp(pooled.get(), chunk.get(), filedata::chunk_size);
+      },
+      [&] { return chunk; });
+  if (pooled != chunk) ++_deduplicated_chunks;
+  return pooled;
+}
+}  // namespace memfs
@@ -0,0 +1,206 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef FILEDATA_H_
+#define FILEDATA_H_
+
+#include "compressed_chunk.h"
+#include "intern_pool.h"
+#include "memory_usage.h"
+
+#include <cstdint>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace memfs {
+// Memfs file content storage
+// The content is split in fixed size chunks stored in a page table indexed by
+// chunk number. Chunks are only allocated when written, ranges never written
+// (holes) read as zeros. Growing or truncating a file therefore only touches
+// the chunks at the boundary and resident memory follows the written data,
+// not the file size.
+// Chunks are reference counted and can be shared, for example with the
+// mapping of a memfs image, a cloned file or the chunk_pool. A chunk is copied
+// before being modified when it is not exclusively owned or is read only.
+// Once a memory_usage is set, the chunks allocated are accounted in it until
+// they are freed.
+// Chunks keep the time they were last accessed so the cold ones can be
+// compressed, they are decompressed when accessed again.
+// filedata is not thread safe, the owner need to serialize the access.
+class chunk_pool;
+class filedata {
+ public:
+  static constexpr size_t chunk_size = 64 * 1024;
+
+  filedata() = default;
+  filedata(const filedata&) = delete;
+  filedata& operator=(const filedata&) = delete;
+
+  // Copy length bytes at offset into buffer. Reading past size() is
+  // truncated, the number of bytes copied is returned.
+  // Compressed chunks are decompressed on the fly and stay compressed, call
+  // decompress first to keep them decompressed.
+  size_t read(void* buffer, size_t length, uint64_t offset) const;
+
+  // Write length bytes at offset. The file grows if the write ends past
+  // size(), the gap between the previous end and offset stays a hole.
+  // When a pool is given, the chunks fully written are deduplicated with it.
+  // Return false, without writing anything, if the chunks to allocate do not
+  // fit in the memory_usage capacity.
+  bool write(const void* buffer, size_t length, uint64_t offset,
+             chunk_pool* pool = nullptr);
+
+  // Set the file size. Chunks beyond the new size are released and the tail
+  // of the last chunk is zeroed so a later extension reads zeros.
+  // Growing the file allocates nothing, the extension is a hole.
+  void resize(uint64_t size);
+
+  void set_memory_usage(std::shared_ptr<memory_usage> usage) {
+    _usage = std::move(usage);
+  }
+  const std::shared_ptr<memory_usage>& get_memory_usage() const {
+    return _usage;
+  }
+
+  uint64_t size() const { return _size; }
+
+  // Coarse time in seconds used to find the cold chunks.
+  static uint32_t current_time();
+
+  // Relaxed atomic time, updated by concurrent readers holding the owner lock
+  // shared and copied with its chunk.
+  struct access_time {
+    access_time(uint32_t time = 0) : value(time) {}
+    access_time(const access_time& other) : value(other.load()) {}
+    access_time& operator=(const access_time& other) {
+      value.store(other.load(), std::memory_order_relaxed);
+      return *this;
+    }
+    uint32_t load() const { return value.load(std::memory_order_relaxed); }
+    void touch(uint32_t time) const {
+      if (load() != time) value.store(time, std::memory_order_relaxed);
+    }
+
+    mutable std::atomic<uint32_t> value;
+  };
+
+  struct chunk {
+    // Null while the chunk is compressed.
+    std::shared_ptr<uint8_t[]> data;
+    // The content can be read concurrently by someone not holding our owner
+    // lock (chunk_pool, memfs image) and must never be modified in place.
+    bool read_only = false;
+    // Content of a cold chunk, set in place of data.
+    std::shared_ptr<const compressed_chunk> compressed;
+    access_time last_access;
+  };
+
+  // Direct access to the chunks, used to save and restore memfs images.
+  // set_chunk does not change the file size.
+  const std::map<uint64_t, chunk>& chunks() const { return _chunks; }
+  void set_chunk(uint64_t index, std::shared_ptr<uint8_t[]> data,
+                 bool read_only);
+
+  // Share all the chunks of source, the content is copied on the first write
+  // of each chunk in either file.
+  void clone(const filedata& source);
+
+  // Number of bytes of chunks currently allocated.
+  uint64_t allocated_size() const { return _chunks.size() * chunk_size; }
+
+  // A chunk content taken to be compressed without holding the owner lock.
+  struct cold_chunk {
+    uint64_t index;
+    std::shared_ptr<uint8_t[]> data;
+    uint32_t last_access;
+  };
+
+  // Return the chunks not accessed since cold_time that only this file uses.
+  // The reference held on their data keeps writers from modifying them in
+  // place while they are compressed.
+  std::vector<cold_chunk> get_cold_chunks(uint32_t cold_time) const;
+
+  // Replace the cold chunk by its compressed content unless it was accessed
+  // or modified since get_cold_chunks. Return whether it was replaced.
+  bool set_compressed(const cold_chunk& cold,
+                      std::shared_ptr<const compressed_chunk> compressed);
+
+  // Return whether a chunk of the range is compressed.
+  bool is_compressed(uint64_t offset, size_t length) const;
+
+  // Decompress the compressed chunks of the range. The memory is charged
+  // even beyond the capacity since reading cannot fail.
+  void decompress(uint64_t offset, size_t length);
+
+ private:
+  // Return the chunk to modify, allocated if it is a hole and copied if it is
+  // shared. allocated is increased by the bytes allocated.
+  uint8_t* get_writable_chunk(uint64_t index, uint64_t& allocated);
+
+  // Allocate a chunk accounted in _usage until it is freed.
+  std::shared_ptr<uint8_t[]> allocate_chunk(bool zero) const;
+
+  // Bytes get_writable_chunk will allocate to write length bytes at offset.
+  uint64_t allocation_size(uint64_t offset, size_t length) const;
+
+  // Replace the chunk by an identical one of the pool or release it when it
+  // only contains zeros.
+  void dedupe_chunk(chunk_pool& pool, uint64_t index);
+
+  // Replace the compressed content of chunk by a newly allocated chunk.
+  // allocated is increased by the bytes allocated.
+  void decompress_chunk(chunk& chunk, uint64_t& allocated);
+
+  uint64_t _size = 0;
+  // Chunk number / chunk content. Missing chunks are holes.
+  std::map<uint64_t, chunk> _chunks;
+  // Number of compressed chunks, lets the accesses skip the check when none.
+  size_t _compressed_chunks = 0;
+  std::shared_ptr<memory_usage> _usage;
+};
+
+// Index of the chunks by content used to share identical chunks between files.
+// An entry is released with the last file using its chunk, see intern_pool.
+// Chunks given to the pool must no longer be modified.
+class chunk_pool {
+ public:
+  // Return a chunk of the pool with the same content or add chunk to the pool
+  // and return it.
+  std::shared_ptr<uint8_t[]> intern(const std::shared_ptr<uint8_t[]>& chunk);
+
+  // Number of chunks that were replaced by a chunk of the pool.
+  uint64_t deduplicated_chunks() const { return _deduplicated_chunks; }
+
+ private:
+  intern_pool<uint8_t[]> _chunks;
+  std::atomic<uint64_t> _deduplicated_chunks = 0;
+};
+}  // namespace memfs
+
+#endif  // FILEDATA_H_
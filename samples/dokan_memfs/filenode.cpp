@@ -26,83 +26,192 @@ THE SOFTWARE.
 */
 
 #include "filenode.h"
+#include "memfs_log.h"
 
 #include <spdlog/spdlog.h>
+#include <algorithm>
 
 namespace memfs {
 filenode::filenode(const std::wstring& filename, bool is_directory,
                    DWORD file_attr,
                    const PDOKAN_IO_SECURITY_CONTEXT security_context)
-    : is_directory(is_directory), attributes(file_attr), _fileName(filename) {
-  // No lock need, FileNode is still not in a directory
+    : is_directory(is_directory), attributes(file_attr) {
+  // No lock need, FileNode is still not in a directory.
+  // Name and parent are set by fs_filenodes when it is added.
   times.reset();
 
   if (security_context && security_context->AccessState.SecurityDescriptor) {
-    spdlog::info(L"{} : Attach SecurityDescriptor", filename);
+    MEMFS_LOG_INFO(L"{} : Attach SecurityDescriptor", filename);
     security.SetDescriptor(security_context->AccessState.SecurityDescriptor);
   }
 }
 
+filenode::~filenode() { DokanDeleteRangeLocks(_range_locks); }
+
+PDOKAN_RANGE_LOCKS filenode::get_range_locks(bool create) {
+  auto range_locks = _range_locks.load();
+  if (range_locks || !create) return range_locks;
+  auto new_range_locks = DokanCreateRangeLocks();
+  if (!new_range_locks) return nullptr;
+  // Another handle can lock the file at the same time, the first created
+  // is kept.
+  if (!_range_locks.compare_exchange_strong(range_locks, new_range_locks)) {
+    DokanDeleteRangeLocks(new_range_locks);
+    return range_locks;
+  }
+  return new_range_locks;
+}
+
 DWORD filenode::read(LPVOID buffer, DWORD bufferlength, LONGLONG offset) {
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  if (static_cast<size_t>(offset + bufferlength) > _data.size())
-    bufferlength = (_data.size() > static_cast<size_t>(offset))
-                       ? static_cast<DWORD>(_data.size() - offset)
-                       : 0;
-  if (bufferlength)
-    memcpy(buffer, &_data[static_cast<size_t>(offset)], bufferlength);
-  spdlog::info(L"Read {} : BufferLength {} Offset {}", get_filename(),
-               bufferlength, offset);
+  std::shared_lock<std::shared_mutex> lock(_data_mutex);
+  if (_data.is_compressed(static_cast<uint64_t>(offset), bufferlength)) {
+    // Cold chunks read again are decompressed once instead of on each read.
+    lock.unlock();
+    {
+      std::unique_lock<std::shared_mutex> write_lock(_data_mutex);
+      _data.decompress(static_cast<uint64_t>(offset), bufferlength);
+    }
+    lock.lock();
+  }
+  bufferlength = static_cast<DWORD>(
+      _data.read(buffer, bufferlength, static_cast<uint64_t>(offset)));
+  MEMFS_LOG_INFO(L"Read {} : BufferLength {} Offset {}", get_filename(),
+                 bufferlength, offset);
   return bufferlength;
 }
 
 DWORD filenode::write(LPCVOID buffer, DWORD number_of_bytes_to_write,
-                      LONGLONG offset) {
+                      LONGLONG offset, chunk_pool* pool) {
   if (!number_of_bytes_to_write) return 0;
 
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  if (static_cast<size_t>(offset + number_of_bytes_to_write) > _data.size())
-    _data.resize(static_cast<size_t>(offset + number_of_bytes_to_write));
-
-  spdlog::info(L"Write {} : NumberOfBytesToWrite {} Offset {}", get_filename(),
-               number_of_bytes_to_write, offset);
-  memcpy(&_data[static_cast<size_t>(offset)], buffer, number_of_bytes_to_write);
+  std::unique_lock<std::shared_mutex> lock(_data_mutex);
+  MEMFS_LOG_INFO(L"Write {} : NumberOfBytesToWrite {} Offset {}",
+                 get_filename(), number_of_bytes_to_write, offset);
+  if (!_data.write(buffer, number_of_bytes_to_write,
+                   static_cast<uint64_t>(offset), pool))
+    return 0;
+  _filesize = static_cast<LONGLONG>(_data.size());
   return number_of_bytes_to_write;
 }
 
-const LONGLONG filenode::get_filesize() {
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  return static_cast<LONGLONG>(_data.size());
-}
+LONGLONG filenode::get_filesize() const { return _filesize; }
 
 void filenode::set_endoffile(const LONGLONG& byte_offset) {
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  _data.resize(static_cast<size_t>(byte_offset));
+  std::unique_lock<std::shared_mutex> lock(_data_mutex);
+  _data.resize(static_cast<uint64_t>(byte_offset));
+  _filesize = byte_offset;
+}
+
+size_t filenode::compress_cold_chunks(uint32_t cold_time) {
+  std::vector<filedata::cold_chunk> cold_chunks;
+  std::shared_ptr<memory_usage> usage;
+  {
+    std::shared_lock<std::shared_mutex> lock(_data_mutex);
+    cold_chunks = _data.get_cold_chunks(cold_time);
+    usage = _data.get_memory_usage();
+  }
+
+  // Chunks are compressed without holding the lock and swapped in by small
+  // batches, so the file stays accessible and the memory freed as we go.
+  constexpr size_t batch_size = 64;
+  std::vector<std::shared_ptr<const compressed_chunk>> compressed;
+  size_t count = 0;
+  for (size_t first = 0; first < cold_chunks.size(); first += batch_size) {
+    const size_t last = std::min(first + batch_size, cold_chunks.size());
+    compressed.clear();
+    for (size_t i = first; i < last; ++i)
+      compressed.push_back(compressed_chunk::compress(
+          cold_chunks[i].data.get(), filedata::chunk_size, usage));
+    {
+      std::unique_lock<std::shared_mutex> lock(_data_mutex);
+      for (size_t i = first; i < last; ++i) {
+        if (_data.set_compressed(cold_chunks[i],
+                                 std::move(compressed[i - first])))
+          ++count;
+      }
+    }
+    // Release the uncompressed content outside of the lock.
+    for (size_t i = first; i < last; ++i) cold_chunks[i].data.reset();
+  }
+  return count;
+}
+
+void filenode::read_data(const std::function<void(const filedata&)>& f) {
+  std::shared_lock<std::shared_mutex> lock(_data_mutex);
+  f(_data);
+}
+
+void filenode::write_data(const std::function<void(filedata&)>& f) {
+  std::unique_lock<std::shared_mutex> lock(_data_mutex);
+  f(_data);
+  _filesize = static_cast<LONGLONG>(_data.size());
 }
 
 const std::wstring filenode::get_filename() {
+  if (main_stream) return main_stream->get_filename() + L":" + get_name();
+
+  std::wstring filename;
+  // Hold the parent we walk through alive, it can be removed meanwhile.
+  std::shared_ptr<filenode> node;
+  filenode* current = this;
+  while (current) {
+    std::shared_ptr<filenode> parent;
+    {
+      std::lock_guard<std::mutex> lock(current->_fileName_mutex);
+      if (current->_name.empty()) break;  // Root
+      filename.insert(0, current->_name);
+      filename.insert(0, 1, L'\\');
+      parent = current->_parent.lock();
+    }
+    node = std::move(parent);
+    current = node.get();
+  }
+  return filename.empty() ? L"\\" : filename;
+}
+
+const std::wstring filenode::get_name() {
   std::lock_guard<std::mutex> lock(_fileName_mutex);
-  return _fileName;
+  return _name;
 }
 
-void filenode::set_filename(const std::wstring& f) {
+std::shared_ptr<filenode> filenode::get_parent() {
   std::lock_guard<std::mutex> lock(_fileName_mutex);
-  _fileName = f;
+  return _parent.lock();
+}
+
+const std::wstring filenode::get_key() {
+  std::lock_guard<std::mutex> lock(_fileName_mutex);
+  return _key.empty() ? _name : _key;
+}
+
+void filenode::set_link(const std::shared_ptr<filenode>& parent,
+                        const std::wstring& name, const std::wstring& key) {
+  std::lock_guard<std::mutex> lock(_fileName_mutex);
+  _parent = parent;
+  _name = name;
+  _key = (key != name) ? key : std::wstring();
 }
 
 void filenode::add_stream(const std::shared_ptr<filenode>& stream) {
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  _streams[stream->get_filename()] = stream;
+  std::lock_guard<std::mutex> lock(_streams_mutex);
+  _streams[stream->get_key()] = stream;
 }
 
 void filenode::remove_stream(const std::shared_ptr<filenode>& stream) {
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  _streams.erase(stream->get_filename());
+  std::lock_guard<std::mutex> lock(_streams_mutex);
+  _streams.erase(stream->get_key());
+}
+
+std::shared_ptr<filenode> filenode::find_stream(
+    const std::wstring& stream_key) {
+  std::lock_guard<std::mutex> lock(_streams_mutex);
+  auto stream = _streams.find(stream_key);
+  return (stream != _streams.end()) ? stream->second : nullptr;
 }
 
 std::unordered_map<std::wstring, std::shared_ptr<filenode> >
 filenode::get_streams() {
-  std::lock_guard<std::mutex> lock(_data_mutex);
+  std::lock_guard<std::mutex> lock(_streams_mutex);
   return _streams;
 }
 }  // namespace memfs
\ No newline at end of file
@@ -31,30 +31,37 @@ THE SOFTWARE.
 #include <dokan/dokan.h>
 #include <dokan/fileinfo.h>
 
+#include "filedata.h"
 #include "memfs_helper.h"
+#include "security_descriptor.h"
 
 #include <WinBase.h>
 #include <atomic>
 #include <filesystem>
+#include <functional>
+#include <map>
 #include <mutex>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace memfs {
 struct security_informations : std::mutex {
-  std::unique_ptr<byte[]> descriptor = nullptr;
-  DWORD descriptor_size = 0;
+  // Shared with the other filenodes having the same descriptor once interned
+  // by fs_filenodes. Replaced, never modified.
+  std::shared_ptr<const security_descriptor> descriptor;
 
   security_informations() = default;
   security_informations(const security_informations &) = delete;
   security_informations &operator=(const security_informations &) = delete;
 
+  // Set a private copy of securitydescriptor, interned when the filenode is
+  // added to fs_filenodes.
   void SetDescriptor(PSECURITY_DESCRIPTOR securitydescriptor) {
     if (!securitydescriptor) return;
-    descriptor_size = GetSecurityDescriptorLength(securitydescriptor);
-    descriptor = std::make_unique<byte[]>(descriptor_size);
-    memcpy(descriptor.get(), securitydescriptor, descriptor_size);
+    descriptor = std::make_shared<security_descriptor>(securitydescriptor);
   }
 };
 
@@ -80,51 +87,108 @@ struct filetimes {
 
 // Memfs file context
 // Each file/directory on the memfs has his own filenode instance
+// linked to its parent directory under its name.
 // Alternated streams are also filenode where the main stream \myfile::$DATA
 // has all the alternated streams (e.g. \myfile:foo:$DATA) attached to him
-// and the alternated has main_stream assigned to the main stream filenode.
+// by stream name and the alternated has main_stream assigned to the main
+// stream filenode.
 class filenode {
  public:
   filenode(const std::wstring &filename, bool is_directory, DWORD file_attr,
            const PDOKAN_IO_SECURITY_CONTEXT security_context);
 
   filenode(const filenode& f) = delete;
+  ~filenode();
 
   DWORD read(LPVOID buffer, DWORD bufferlength, LONGLONG offset);
-  DWORD write(LPCVOID buffer, DWORD number_of_bytes_to_write, LONGLONG offset);
-
-  const LONGLONG get_filesize();
+  // Full chunks written are deduplicated with pool when one is given.
+  // Return 0 when the data does not fit in the volume capacity.
+  DWORD write(LPCVOID buffer, DWORD number_of_bytes_to_write, LONGLONG offset,
+              chunk_pool* pool = nullptr);
+
+  // Lock free, the size is kept in sync with the data by write and
+  // set_endoffile.
+  LONGLONG get_filesize() const;
   void set_endoffile(const LONGLONG& byte_offset);
 
-  // Filename can during a move so we need to protect it behind a lock
+  // Run f with the file content under the data lock, shared for read_data
+  // and exclusive for write_data.
+  void read_data(const std::function<void(const filedata&)>& f);
+  void write_data(const std::function<void(filedata&)>& f);
+
+  // Compress the chunks not accessed since cold_time (see
+  // filedata::current_time). Return the number of chunks compressed.
+  size_t compress_cold_chunks(uint32_t cold_time);
+
+  // Name and parent can change during a move so we need to protect them
+  // behind a lock.
+  // Return the full path by walking up the parents.
   const std::wstring get_filename();
-  void set_filename(const std::wstring& filename);
+  // Return the name in the parent directory, the stream name for alternated
+  // streams and an empty name for the root.
+  const std::wstring get_name();
+  // Same as get_name without copy nor taking the name lock. Links only
+  // change under fs_filenodes _filesnodes_mutex exclusive, so it need to be
+  // aquired (shared is enough) while the name is used.
+  std::wstring_view get_name_locked() const { return _name; }
+  // Return the key of the name in the parent directory (or stream map).
+  // The key is the upcased name on case insensitive filesystem, the name
+  // otherwise.
+  const std::wstring get_key();
+  std::shared_ptr<filenode> get_parent();
+  // Link the filenode under parent with name and key. An empty key means the
+  // key is the name. Only used by fs_filenodes.
+  void set_link(const std::shared_ptr<filenode>& parent,
+                const std::wstring& name, const std::wstring& key);
 
   // Alternated streams
   void add_stream(const std::shared_ptr<filenode>& stream);
   void remove_stream(const std::shared_ptr<filenode>& stream);
+  std::shared_ptr<filenode> find_stream(const std::wstring& stream_key);
   std::unordered_map<std::wstring, std::shared_ptr<filenode> > get_streams();
 
+  // Byte range locks of the handles opened on the file. They are only created
+  // on the first lock when create is set, nullptr is returned before.
+  PDOKAN_RANGE_LOCKS get_range_locks(bool create);
+
   // No lock needed above
   std::atomic<bool> is_directory = false;
   std::atomic<DWORD> attributes = 0;
   LONGLONG fileindex = 0;
   std::shared_ptr<filenode> main_stream;
+  // Bytes of metadata accounted in the volume memory usage while the filenode
+  // is linked. fs_filenodes _filesnodes_mutex need to be aquired.
+  uint64_t metadata_size = 0;
 
   filetimes times;
   security_informations security;
 
+  // Directory content ordered by key (see get_key).
+  // Transparent comparator so lookups can use a std::wstring_view.
+  // fs_filenodes _filesnodes_mutex need to be aquired.
+  std::map<std::wstring, std::shared_ptr<filenode>, std::less<> > children;
+
  private:
   filenode() = default;
 
-  std::mutex _data_mutex;
+  // Readers take _data_mutex shared so concurrent reads of a same file do not
+  // serialize, write and set_endoffile take it exclusive.
+  std::shared_mutex _data_mutex;
   // _data_mutex need to be aquired
-  std::vector<uint8_t> _data;
+  filedata _data;
+  std::atomic<LONGLONG> _filesize = 0;
+
+  std::mutex _streams_mutex;
+  // _streams_mutex need to be aquired
   std::unordered_map<std::wstring, std::shared_ptr<filenode> > _streams;
 
   std::mutex _fileName_mutex;
   // _fileName_mutex need to be aquired
-  std::wstring _fileName;
+  std::wstring _name;
+  std::wstring _key;
+  std::weak_ptr<filenode> _parent;
+
+  std::atomic<PDOKAN_RANGE_LOCKS> _range_locks = nullptr;
 };
 }  // namespace memfs
 
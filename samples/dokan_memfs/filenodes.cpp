@@ -26,12 +26,19 @@ THE SOFTWARE.
 */
 
 #include "filenodes.h"
+#include "memfs_image.h"
+#include "memfs_log.h"
 
 #include <sddl.h>
 #include <spdlog/spdlog.h>
+#include <cstring>
 
 namespace memfs {
-fs_filenodes::fs_filenodes() {
+fs_filenodes::fs_filenodes(bool case_sensitive, bool dedupe, uint64_t capacity)
+    : _case_sensitive(case_sensitive),
+      _chunk_pool(dedupe ? std::make_unique<chunk_pool>() : nullptr),
+      _usage(std::make_shared<memory_usage>(capacity)),
+      _descriptors(_usage) {
   WCHAR buffer[1024];
   WCHAR final_buffer[2048];
   PTOKEN_USER user_token = NULL;
@@ -88,178 +95,518 @@ fs_filenodes::fs_filenodes() {
 
   auto fileNode = std::make_shared<filenode>(L"\\", true,
                                              FILE_ATTRIBUTE_DIRECTORY, nullptr);
-  fileNode->security.SetDescriptor(security_descriptor);
+  fileNode->security.descriptor = _descriptors.intern(security_descriptor);
   LocalFree(security_descriptor);
 
-  _filenodes[L"\\"] = fileNode;
-  _directoryPaths.emplace(L"\\", std::set<std::shared_ptr<filenode>>());
+  _root = fileNode;
 }
 
-NTSTATUS fs_filenodes::add(const std::shared_ptr<filenode>& f) {
-  std::lock_guard<std::recursive_mutex> lock(_filesnodes_mutex);
+NTSTATUS fs_filenodes::add(const std::wstring& filename,
+                           const std::shared_ptr<filenode>& f) {
+  std::unique_lock<std::shared_mutex> lock(_filesnodes_mutex);
+  return add_locked(filename, f);
+}
 
+NTSTATUS fs_filenodes::add_locked(const std::wstring& filename,
+                                  const std::shared_ptr<filenode>& f) {
   if (f->fileindex == 0)  // previous init
     f->fileindex = _fs_fileindex_count++;
-  const auto filename = f->get_filename();
-  const auto parent_path =
-      std::filesystem::path(filename).parent_path().wstring();
 
   // Does target folder exist
-  if (!_directoryPaths.count(parent_path)) {
-    spdlog::warn(L"Add: No directory: {} exist FilePath: {}", parent_path,
-                 filename);
+  std::wstring name;
+  auto parent = find_parent_locked(filename, name);
+  if (!parent) {
+    MEMFS_LOG_WARN(L"Add: No directory exist for FilePath: {}", filename);
     return STATUS_OBJECT_PATH_NOT_FOUND;
   }
 
-  auto stream_names = memfs_helper::GetStreamNames(filename);
-  if (!stream_names.second.empty()) {
-    spdlog::info(
+  auto stream_pos = name.find(L':');
+  if (stream_pos != std::wstring::npos) {
+    const auto stream_name = name.substr(stream_pos + 1);
+    name.resize(stream_pos);
+    MEMFS_LOG_INFO(
         L"Add file: {} is an alternate stream {} and has {} as main stream",
-        filename, stream_names.second, stream_names.first);
-    auto main_stream_name =
-        memfs_helper::GetFileName(filename, stream_names);
-    auto main_f = find(main_stream_name);
-    if (!main_f) return STATUS_OBJECT_PATH_NOT_FOUND;
-    main_f->add_stream(f);
-    f->main_stream = main_f;
-    f->fileindex = main_f->fileindex;
+        filename, stream_name, name);
+    auto main_f = parent->children.find(get_key(name));
+    if (main_f == parent->children.end()) return STATUS_OBJECT_PATH_NOT_FOUND;
+    const auto stream_key = get_key(stream_name);
+    const auto metadata_size = get_metadata_size(stream_name, stream_key);
+    if (!_usage->reserve(metadata_size)) return STATUS_DISK_FULL;
+    f->metadata_size = metadata_size;
+    f->write_data([&](filedata& data) { data.set_memory_usage(_usage); });
+    intern_security_descriptor(f);
+    // A stream replaced (CREATE_ALWAYS) is released.
+    auto previous_f = main_f->second->find_stream(stream_key);
+    if (previous_f && previous_f != f) remove_locked(previous_f);
+    f->set_link(nullptr, stream_name, stream_key);
+    f->main_stream = main_f->second;
+    f->fileindex = main_f->second->fileindex;
+    main_f->second->add_stream(f);
+    return STATUS_SUCCESS;
   }
 
-  // If we have a folder, we add it to our directoryPaths
-  if (f->is_directory && !_directoryPaths.count(filename))
-    _directoryPaths.emplace(filename, std::set<std::shared_ptr<filenode>>());
-
-  // Add our file to the fileNodes and directoryPaths
-  _filenodes[filename] = f;
-  _directoryPaths[parent_path].insert(f);
+  // Add our file to the parent directory
+  auto key = get_key(name);
+  const auto metadata_size = get_metadata_size(name, key);
+  if (!_usage->reserve(metadata_size)) return STATUS_DISK_FULL;
+  f->metadata_size = metadata_size;
+  f->write_data([&](filedata& data) { data.set_memory_usage(_usage); });
+  intern_security_descriptor(f);
+  // A file replaced (CREATE_ALWAYS) is released with its streams.
+  auto previous_f = parent->children.find(key);
+  if (previous_f != parent->children.end() && previous_f->second != f) {
+    // Copied, remove_locked erase the entry.
+    const auto previous = previous_f->second;
+    remove_locked(previous);
+  }
+  f->set_link(parent, name, key);
+  parent->children[key] = f;
 
-  spdlog::info(L"Add file: {} in folder: {}", filename, parent_path);
+  MEMFS_LOG_INFO(L"Add file: {} in folder: {}", name, parent->get_filename());
   return STATUS_SUCCESS;
 }
 
 std::shared_ptr<filenode> fs_filenodes::find(const std::wstring& filename) {
-  std::lock_guard<std::recursive_mutex> lock(_filesnodes_mutex);
-  auto fileNode = _filenodes.find(filename);
-  return (fileNode != _filenodes.end()) ? fileNode->second : nullptr;
+  std::shared_lock<std::shared_mutex> lock(_filesnodes_mutex);
+  return find_locked(filename);
 }
 
-std::set<std::shared_ptr<filenode>> fs_filenodes::list_folder(
-    const std::wstring& fileName) {
-  std::lock_guard<std::recursive_mutex> lock(_filesnodes_mutex);
+std::shared_ptr<filenode> fs_filenodes::find_locked(
+    const std::wstring& filename) {
+  // Upcase the whole path once, components are then looked up without
+  // any allocation.
+  std::wstring upcased_filename;
+  if (!_case_sensitive) {
+    upcased_filename = filename;
+    memfs_helper::Upcase(upcased_filename);
+  }
+  const std::wstring_view path =
+      _case_sensitive ? filename : upcased_filename;
+
+  auto node = _root;
+  size_t begin = 0;
+  while (true) {
+    while (begin < path.length() && path[begin] == L'\\') ++begin;
+    if (begin >= path.length()) return node;
+    if (!node->is_directory) return nullptr;
+
+    auto end = path.find(L'\\', begin);
+    if (end == std::wstring_view::npos) end = path.length();
+    auto key = path.substr(begin, end - begin);
+
+    // Only the last component can be an alternated stream foo:bar
+    std::wstring_view stream_key;
+    auto stream_pos = key.find(L':');
+    if (stream_pos != std::wstring_view::npos) {
+      if (end != path.length()) return nullptr;
+      stream_key = key.substr(stream_pos + 1);
+      key = key.substr(0, stream_pos);
+    }
 
-  auto it = _directoryPaths.find(fileName);
-  return (it != _directoryPaths.end()) ? it->second
-                                       : std::set<std::shared_ptr<filenode>>();
+    auto child = node->children.find(key);
+    if (child == node->children.end()) return nullptr;
+    node = child->second;
+    if (!stream_key.empty()) return node->find_stream(std::wstring(stream_key));
+    begin = end;
+  }
 }
 
-void fs_filenodes::remove(const std::wstring& filename) {
-  return remove(find(filename));
+std::wstring fs_filenodes::get_key(const std::wstring& name) const {
+  if (_case_sensitive) return name;
+  auto key = name;
+  memfs_helper::Upcase(key);
+  return key;
 }
 
-void fs_filenodes::remove(const std::shared_ptr<filenode>& f) {
-  if (!f) return;
+std::shared_ptr<filenode> fs_filenodes::find_parent_locked(
+    const std::wstring& filename, std::wstring& name) {
+  auto separator = filename.rfind(L'\\');
+  if (separator == std::wstring::npos) return nullptr;
+  name = filename.substr(separator + 1);
+  if (name.empty()) return nullptr;
+  auto parent = find_locked(filename.substr(0, separator));
+  return (parent && parent->is_directory) ? parent : nullptr;
+}
 
-  std::lock_guard<std::recursive_mutex> lock(_filesnodes_mutex);
-  auto fileName = f->get_filename();
-  spdlog::info(L"Remove: {}", fileName);
+bool fs_filenodes::list_folder(
+    const std::wstring& fileName, const std::wstring& start_after,
+    const std::function<bool(const std::shared_ptr<filenode>&,
+                             std::wstring_view name)>& callback) {
+  std::shared_lock<std::shared_mutex> lock(_filesnodes_mutex);
+
+  auto f = find_locked(fileName);
+  if (!f || !f->is_directory) return false;
+
+  auto child = start_after.empty()
+                   ? f->children.begin()
+                   : f->children.upper_bound(get_key(start_after));
+  for (; child != f->children.end(); ++child)
+    if (!callback(child->second, child->second->get_name_locked())) break;
+  return true;
+}
 
-  // Remove node from fileNodes and directoryPaths
-  _filenodes.erase(fileName);
-  _directoryPaths[std::filesystem::path(fileName).parent_path()].erase(f);
+void fs_filenodes::remove(const std::wstring& filename) {
+  std::unique_lock<std::shared_mutex> lock(_filesnodes_mutex);
+  remove_locked(find_locked(filename));
+}
 
-  // if it was a directory we need to remove it from directoryPaths
-  if (f->is_directory) {
-    // but first we need to remove the directory content by looking recursively
-    // into it
-    auto files = list_folder(fileName);
-    for (const auto& file : files) remove(file);
+void fs_filenodes::remove(const std::shared_ptr<filenode>& f) {
+  std::unique_lock<std::shared_mutex> lock(_filesnodes_mutex);
+  remove_locked(f);
+}
 
-    _directoryPaths.erase(fileName);
-  }
+void fs_filenodes::remove_locked(const std::shared_ptr<filenode>& f) {
+  if (!f) return;
+
+  MEMFS_LOG_INFO(L"Remove: {}", f->get_filename());
 
-  // Cleanup streams
   if (f->main_stream) {
     // Is an alternate stream
+    if (f->main_stream->find_stream(f->get_key()) != f) return;  // Removed
     f->main_stream->remove_stream(f);
-  } else {
-    // Is a main stream
-    // Remove possible alternate stream
-    for (const auto& [stream_name, node] : f->get_streams())
-      remove(stream_name);
+    _usage->release(f->metadata_size);
+    return;
+  }
+
+  // Unlink the node from its parent. Its alternated streams and, for a
+  // directory, its whole content go away with it.
+  auto parent = f->get_parent();
+  if (!parent) return;  // Root
+  auto child = parent->children.find(f->get_key());
+  if (child == parent->children.end() || child->second != f) return;  // Removed
+  parent->children.erase(child);
+  release_locked(f);
+}
+
+void fs_filenodes::release_locked(const std::shared_ptr<filenode>& f) {
+  for (const auto& [stream_key, stream] : f->get_streams()) {
+    f->remove_stream(stream);
+    _usage->release(stream->metadata_size);
   }
+  for (const auto& [key, child] : f->children) release_locked(child);
+  _usage->release(f->metadata_size);
+}
+
+uint64_t fs_filenodes::get_metadata_size(const std::wstring& name,
+                                         const std::wstring& key) {
+  // The key is only stored when it differs from the name.
+  uint64_t size = sizeof(filenode) + name.size() * sizeof(WCHAR);
+  if (key != name) size += key.size() * sizeof(WCHAR);
+  return size;
+}
+
+void fs_filenodes::intern_security_descriptor(
+    const std::shared_ptr<filenode>& f) {
+  std::lock_guard<std::mutex> securityLock(f->security);
+  if (f->security.descriptor)
+    f->security.descriptor = _descriptors.intern(f->security.descriptor->get());
 }
 
 NTSTATUS fs_filenodes::move(const std::wstring& old_filename,
                             const std::wstring& new_filename,
                             BOOL replace_if_existing) {
-  auto f = find(old_filename);
-  auto new_f = find(new_filename);
+  // The whole move, including the checks, happens under the exclusive lock so
+  // no one can observe or race with a partially moved hierarchy.
+  std::unique_lock<std::shared_mutex> lock(_filesnodes_mutex);
+  return move_locked(old_filename, new_filename, replace_if_existing);
+}
+
+NTSTATUS fs_filenodes::move_locked(const std::wstring& old_filename,
+                                   const std::wstring& new_filename,
+                                   BOOL replace_if_existing) {
+  auto f = find_locked(old_filename);
+  auto new_f = find_locked(new_filename);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
-  // Cannot move to an existing destination without replace flag
-  if (!replace_if_existing && new_f) return STATUS_OBJECT_NAME_COLLISION;
+  // Cannot move the root
+  if (f == _root) return STATUS_ACCESS_DENIED;
+
+  // Cannot move to an existing destination without replace flag.
+  // The destination can be the file itself when only the case of its name
+  // change on a case insensitive filesystem.
+  if (!replace_if_existing && new_f && new_f != f)
+    return STATUS_OBJECT_NAME_COLLISION;
 
   // Cannot replace read only destination
-  if (new_f && new_f->attributes & FILE_ATTRIBUTE_READONLY)
+  if (new_f && new_f != f && new_f->attributes & FILE_ATTRIBUTE_READONLY)
     return STATUS_ACCESS_DENIED;
 
   // If destination exist - Cannot move directory or replace a directory
-  if (new_f && (f->is_directory || new_f->is_directory))
+  if (new_f && new_f != f && (f->is_directory || new_f->is_directory))
     return STATUS_ACCESS_DENIED;
 
-  auto newParent_path =
-      std::filesystem::path(new_filename).parent_path().wstring();
-
-  std::lock_guard<std::recursive_mutex> lock(_filesnodes_mutex);
-  if (!_directoryPaths.count(newParent_path)) {
-    spdlog::warn(L"Move: No directory: {} exist FilePath: {}", newParent_path,
-                 new_filename);
+  std::wstring new_name;
+  auto new_parent = find_parent_locked(new_filename, new_name);
+  if (!new_parent) {
+    MEMFS_LOG_WARN(L"Move: No directory exist for FilePath: {}", new_filename);
     return STATUS_OBJECT_PATH_NOT_FOUND;
   }
 
-  // Remove destination
-  remove(new_f);
-
-  // Update current node with new data
-  const auto fileName = f->get_filename();
-  auto oldParentPath = std::filesystem::path(fileName).parent_path();
-  f->set_filename(new_filename);
-
-  // Move fileNode
-  // 1 - by removing current not with oldName as key
-  add(f);
-
-  // 2 - If fileNode is a Dir we move content to destination
-  if (f->is_directory) {
-    // recurse remove sub folders/files
-    auto files = list_folder(old_filename);
-    for (const auto& file : files) {
-      const auto sub_fileName = file->get_filename();
-      auto newSubFileName =
-          std::filesystem::path(new_filename)
-              .append(std::filesystem::path(sub_fileName).filename().wstring())
-              .wstring();
-      auto n = move(sub_fileName, newSubFileName, replace_if_existing);
-      if (n != STATUS_SUCCESS) {
-        spdlog::warn(
-            L"Move: Subfolder file move {} to {} replaceIfExisting {} failed: "
-            L"{}",
-            sub_fileName, newSubFileName, replace_if_existing, n);
-        return n;  // That's bad...we have not done a full move
-      }
+  auto stream_pos = new_name.find(L':');
+  if (f->main_stream) {
+    // An alternated stream can only be renamed within its main stream
+    if (stream_pos == std::wstring::npos) return STATUS_INVALID_PARAMETER;
+    auto main_f =
+        new_parent->children.find(get_key(new_name.substr(0, stream_pos)));
+    if (main_f == new_parent->children.end() ||
+        main_f->second != f->main_stream)
+      return STATUS_INVALID_PARAMETER;
+
+    if (new_f != f) remove_locked(new_f);
+    f->main_stream->remove_stream(f);
+    const auto new_stream_name = new_name.substr(stream_pos + 1);
+    const auto new_stream_key = get_key(new_stream_name);
+    // A rename cannot fail on the capacity, a longer name is only charged.
+    _usage->release(f->metadata_size);
+    f->metadata_size = get_metadata_size(new_stream_name, new_stream_key);
+    _usage->charge(f->metadata_size);
+    f->set_link(nullptr, new_stream_name, new_stream_key);
+    f->main_stream->add_stream(f);
+  } else {
+    if (stream_pos != std::wstring::npos) return STATUS_INVALID_PARAMETER;
+
+    // Cannot move a directory into its own subtree
+    for (auto p = new_parent; p; p = p->get_parent())
+      if (p == f) return STATUS_INVALID_PARAMETER;
+
+    // Remove destination
+    if (new_f != f) remove_locked(new_f);
+
+    // Relink the node, its content follow it.
+    auto old_parent = f->get_parent();
+    if (old_parent) old_parent->children.erase(f->get_key());
+    auto new_key = get_key(new_name);
+    _usage->release(f->metadata_size);
+    f->metadata_size = get_metadata_size(new_name, new_key);
+    _usage->charge(f->metadata_size);
+    f->set_link(new_parent, new_name, new_key);
+    new_parent->children[new_key] = f;
+  }
+
+  MEMFS_LOG_INFO(L"Move file: {} to folder: {}", old_filename, new_filename);
+  return STATUS_SUCCESS;
+}
+
+NTSTATUS fs_filenodes::clone(const std::wstring& source,
+                             const std::wstring& destination) {
+  std::unique_lock<std::shared_mutex> lock(_filesnodes_mutex);
+  auto f = find_locked(source);
+  if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
+  if (f->is_directory) return STATUS_FILE_IS_A_DIRECTORY;
+  if (find_locked(destination)) return STATUS_OBJECT_NAME_COLLISION;
+
+  auto new_f = std::make_shared<filenode>(destination, false, f->attributes,
+                                          nullptr);
+  {
+    std::lock_guard<std::mutex> securityLock(f->security);
+    new_f->security.descriptor = f->security.descriptor;
+  }
+  // The clone is filled before being linked so it is never visible empty.
+  f->read_data([&](const filedata& data) {
+    new_f->write_data([&](filedata& new_data) { new_data.clone(data); });
+  });
+
+  MEMFS_LOG_INFO(L"Clone file: {} to: {}", source, destination);
+  return add_locked(destination, new_f);
+}
+void fs_filenodes::compress_cold_chunks(uint32_t cold_seconds) {
+  const uint32_t now = filedata::current_time();
+  if (now <= cold_seconds) return;
+
+  // Only the hierarchy walk holds the lock, the files are compressed after.
+  std::vector<std::shared_ptr<filenode>> filenodes;
+  {
+    std::shared_lock<std::shared_mutex> lock(_filesnodes_mutex);
+    std::vector<std::shared_ptr<filenode>> pending = {_root};
+    while (!pending.empty()) {
+      auto f = std::move(pending.back());
+      pending.pop_back();
+      for (const auto& [stream_key, stream] : f->get_streams())
+        filenodes.push_back(stream);
+      for (const auto& [key, child] : f->children) pending.push_back(child);
+      filenodes.push_back(std::move(f));
     }
+  }
+
+  size_t count = 0;
+  for (const auto& f : filenodes)
+    count += f->compress_cold_chunks(now - cold_seconds);
+  MEMFS_LOG_INFO(
+      L"Compressed {} cold chunks, {} bytes of content compressed in {} bytes",
+      count, _usage->uncompressed_bytes(), _usage->compressed_bytes());
+}
+
+bool fs_filenodes::save(const std::wstring& path) {
+  std::shared_lock<std::shared_mutex> lock(_filesnodes_mutex);
+
+  image_writer writer(filedata::chunk_size);
+  if (!writer.open(path)) {
+    spdlog::error(L"Save: Failed to create image {}", path);
+    return false;
+  }
 
-    // remove folder from directories
-    _directoryPaths.erase(old_filename);
+  // Nodes are written in tree order so a parent is always before its
+  // children and a main stream before its alternated streams.
+  std::function<void(const std::shared_ptr<filenode>&, uint64_t)> save_node =
+      [&](const std::shared_ptr<filenode>& f, uint64_t parent) {
+        image_node node;
+        node.parent = parent;
+        node.is_directory = f->is_directory;
+        node.is_stream = f->main_stream != nullptr;
+        node.attributes = f->attributes;
+        node.creation = f->times.creation;
+        node.lastaccess = f->times.lastaccess;
+        node.lastwrite = f->times.lastwrite;
+        node.name = f->get_name();
+        {
+          std::lock_guard<std::mutex> securityLock(f->security);
+          if (f->security.descriptor)
+            node.descriptor = writer.add_descriptor(
+                f->security.descriptor->get(), f->security.descriptor->size());
+        }
+
+        uint64_t index = 0;
+        f->read_data([&](const filedata& data) {
+          node.file_size = data.size();
+          // Compressed chunks are saved decompressed.
+          std::vector<std::unique_ptr<uint8_t[]>> decompressed;
+          for (const auto& [chunk_index, chunk] : data.chunks()) {
+            const uint8_t* content = chunk.data.get();
+            if (chunk.compressed) {
+              decompressed.emplace_back(new uint8_t[filedata::chunk_size]);
+              if (!chunk.compressed->decompress(decompressed.back().get()))
+                memset(decompressed.back().get(), 0, filedata::chunk_size);
+              content = decompressed.back().get();
+            }
+            node.chunks.emplace_back(chunk_index, content);
+          }
+          index = writer.add_node(node);
+        });
+
+        for (const auto& [stream_key, stream] : f->get_streams())
+          save_node(stream, index);
+        for (const auto& [key, child] : f->children) save_node(child, index);
+      };
+  save_node(_root, image_node::no_parent);
+
+  if (!writer.close()) {
+    spdlog::error(L"Save: Failed to write image {}", path);
+    return false;
   }
+  MEMFS_LOG_INFO(L"Save: image {} saved", path);
+  return true;
+}
 
-  // 3 - Remove fileNode link with oldFilename
-  _filenodes.erase(old_filename);
-  if (oldParentPath != newParent_path)  // Same folder destination
-    _directoryPaths[oldParentPath].erase(f);
+bool fs_filenodes::load(const std::wstring& path) {
+  std::unique_lock<std::shared_mutex> lock(_filesnodes_mutex);
 
-  spdlog::info(L"Move file: {} to folder: {}", old_filename, new_filename);
-  return STATUS_SUCCESS;
+  HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    spdlog::error(L"Load: Failed to open image {}", path);
+    return false;
+  }
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart)
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (!mapping) {
+    spdlog::error(L"Load: Failed to map image {}", path);
+    return false;
+  }
+  // The view keep the mapping alive, pages are read from the image file on
+  // first access.
+  auto view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!view) {
+    spdlog::error(L"Load: Failed to map image {}", path);
+    return false;
+  }
+  _image = std::shared_ptr<const uint8_t>(
+      static_cast<const uint8_t*>(view),
+      [](const uint8_t* v) { UnmapViewOfFile(v); });
+
+  image_reader reader(_image.get(), static_cast<uint64_t>(size.QuadPart));
+  std::vector<std::pair<const uint8_t*, uint32_t>> descriptors;
+  if (!reader.open(filedata::chunk_size) ||
+      !reader.read_descriptors(descriptors)) {
+    spdlog::error(L"Load: Invalid image {}", path);
+    return false;
+  }
+
+  std::vector<std::shared_ptr<filenode>> nodes;
+  // Each descriptor of the image is interned once for all its filenodes.
+  std::vector<std::shared_ptr<const security_descriptor>> interned_descriptors(
+      descriptors.size());
+  auto result = reader.read_nodes([&](uint64_t index, const image_node& node) {
+    std::shared_ptr<filenode> f;
+    if (index == 0) {
+      if (!node.is_directory || node.is_stream) return false;
+      f = _root;
+    } else {
+      const auto& parent = nodes[static_cast<size_t>(node.parent)];
+      if (node.name.empty() ||
+          (node.is_stream ? parent->main_stream != nullptr || node.is_directory
+                          : !parent->is_directory))
+        return false;
+      f = std::make_shared<filenode>(node.name, node.is_directory,
+                                     node.attributes, nullptr);
+      auto key = get_key(node.name);
+      f->set_link(node.is_stream ? nullptr : parent, node.name, key);
+      if (node.is_stream) {
+        f->main_stream = parent;
+        f->fileindex = parent->fileindex;
+        parent->add_stream(f);
+      } else {
+        f->fileindex = _fs_fileindex_count++;
+        parent->children[key] = f;
+      }
+    }
+
+    f->attributes = node.attributes;
+    f->times.creation = node.creation;
+    f->times.lastaccess = node.lastaccess;
+    f->times.lastwrite = node.lastwrite;
+    if (node.descriptor != image_node::no_descriptor) {
+      auto& interned = interned_descriptors[node.descriptor];
+      if (!interned) {
+        auto [descriptor, descriptor_size] = descriptors[node.descriptor];
+        auto security_descriptor = const_cast<uint8_t*>(descriptor);
+        if (GetSecurityDescriptorLength(security_descriptor) != descriptor_size)
+          return false;
+        interned = _descriptors.intern(security_descriptor);
+      }
+      std::lock_guard<std::mutex> securityLock(f->security);
+      f->security.descriptor = interned;
+    }
+    if (f != _root) {
+      // Loading happens before mounting and is not limited by the capacity.
+      f->metadata_size = get_metadata_size(node.name, get_key(node.name));
+      _usage->charge(f->metadata_size);
+    }
+    f->write_data([&](filedata& data) {
+      data.set_memory_usage(_usage);
+      // Chunks share the ownership of the image mapping. They are backed by
+      // the image file and only accounted once copied on write.
+      for (const auto& [chunk_index, chunk] : node.chunks)
+        data.set_chunk(chunk_index,
+                       std::shared_ptr<uint8_t[]>(
+                           _image, const_cast<uint8_t*>(chunk)),
+                       true);
+      data.resize(node.file_size);
+    });
+
+    nodes.push_back(f);
+    return true;
+  });
+  if (!result) {
+    spdlog::error(L"Load: Invalid image {}", path);
+    return false;
+  }
+
+  MEMFS_LOG_INFO(L"Load: image {} loaded with {} nodes", path, nodes.size());
+  return true;
 }
-}  // namespace memfs
\ No newline at end of file
+}  // namespace memfs
@@ -29,36 +29,75 @@ THE SOFTWARE.
 #define FILENODES_H_
 
 #include "filenode.h"
+#include "memory_usage.h"
 
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 
+#include <functional>
 #include <iostream>
-#include <set>
-#include <unordered_map>
 
 namespace memfs {
 // Memfs filenode storage
 // There is only one instance of fs_filenodes per dokan mount
 // as fs_filenodes describre the whole filesystem hierarchy context.
+// The hierarchy is a tree starting at the root directory where each directory
+// filenode owns its children by name and each filenode is linked to its
+// parent. Paths are resolved by walking their components from the root and a
+// move only relink a single filenode whatever the size of its subtree.
+// On a case insensitive filesystem, names keep their case but are indexed by
+// their upcased key computed once when the filenode is linked, a lookup only
+// upcase the path requested once.
+// With dedupe, identical chunks written by different files are stored once.
+// The memory used by the file contents and the linked filenodes is accounted
+// in a memory_usage, creating a filenode or writing data beyond its capacity
+// fails with STATUS_DISK_FULL.
 class fs_filenodes {
  public:
-  fs_filenodes();
+  // A capacity of 0 means unlimited.
+  explicit fs_filenodes(bool case_sensitive = true, bool dedupe = false,
+                        uint64_t capacity = 0);
 
-  // Add a new filenode to the filesystem hierarchy.
+  bool is_case_sensitive() const { return _case_sensitive; }
+
+  // Pool to give to filenode::write, null when dedupe is disabled.
+  chunk_pool* get_chunk_pool() { return _chunk_pool.get(); }
+
+  const memory_usage& get_memory_usage() const { return *_usage; }
+
+  // Return the shared instance of descriptor to assign to a filenode.
+  std::shared_ptr<const security_descriptor> intern_security_descriptor(
+      PSECURITY_DESCRIPTOR descriptor) {
+    return _descriptors.intern(descriptor);
+  }
+
+  // Add a new filenode to the filesystem hierarchy at filename.
   // The file will directly be visible on the filesystem.
-  NTSTATUS add(const std::shared_ptr<filenode>& filenode);
+  NTSTATUS add(const std::wstring& filename,
+               const std::shared_ptr<filenode>& filenode);
 
   // Return the filenode linked to the filename if present.
   std::shared_ptr<filenode> find(const std::wstring& filename);
 
-  // Return all filenode of the directory scope give in param.
-  std::set<std::shared_ptr<filenode>> list_folder(const std::wstring& filename);
+  // Call callback for each filenode of the directory scope give in param in
+  // name order, without copying the directory content. The listing starts
+  // after the name start_after, or at the beginning when it is empty, so a
+  // listing can be resumed where a previous one stopped. It stops as soon as
+  // callback return false.
+  // callback receives the name of the filenode in the directory. It is only
+  // valid during the call but is not copied, so a listing does not allocate
+  // per entry.
+  // The hierarchy is locked while callback run, it must not modify it.
+  // Return false if filename is not a directory.
+  bool list_folder(const std::wstring& filename,
+                   const std::wstring& start_after,
+                   const std::function<bool(const std::shared_ptr<filenode>&,
+                                            std::wstring_view name)>& callback);
 
   // Remove filenode from the filesystem hierarchy.
-  // If the filenode has alternated streams attached, they will also be removed.
-  // If the filenode is a directory not empty, all sub filenode will be removed
-  // recursively.
+  // Alternated streams attached and the content of a not empty directory
+  // are removed with it.
   void remove(const std::wstring& filename);
   void remove(const std::shared_ptr<filenode>& filenode);
 
@@ -67,27 +106,80 @@ class fs_filenodes {
   NTSTATUS move(const std::wstring& old_filename,
                 const std::wstring& new_filename, BOOL replace_if_existing);
 
-  // Help - return a pair containing for example for \foo:bar
-  // first: filename: foo
-  // second: alternated stream name: bar
-  // If the filename do not contain an alternated stream, second is empty.
-  static std::pair<std::wstring, std::wstring> get_stream_names(
-      std::wstring real_filename);
+  // Create the file destination sharing the content of the file source
+  // (reflink). Content is only copied, chunk by chunk, when one of them is
+  // modified.
+  NTSTATUS clone(const std::wstring& source, const std::wstring& destination);
+
+  // Compress the file content not accessed for cold_seconds, it is
+  // decompressed when accessed again.
+  void compress_cold_chunks(uint32_t cold_seconds);
+
+  // Save the whole filesystem into an image file (see memfs_image.h).
+  bool save(const std::wstring& path);
+
+  // Populate the filesystem from an image file before it is mounted.
+  // The image stays mapped in memory for the filesystem lifetime, file
+  // content is paged in on first access and copied when modified.
+  bool load(const std::wstring& path);
 
  private:
+  // Same as their public counterpart but expect _filesnodes_mutex to be
+  // already aquired by the caller.
+  NTSTATUS add_locked(const std::wstring& filename,
+                      const std::shared_ptr<filenode>& filenode);
+  std::shared_ptr<filenode> find_locked(const std::wstring& filename);
+  void remove_locked(const std::shared_ptr<filenode>& filenode);
+  NTSTATUS move_locked(const std::wstring& old_filename,
+                       const std::wstring& new_filename,
+                       BOOL replace_if_existing);
+
+  // Detach the alternated streams of filenode and of its directory content
+  // and release the metadata accounted for all of them.
+  // Alternated streams keep their main stream alive and would otherwise
+  // never be released once removed.
+  void release_locked(const std::shared_ptr<filenode>& filenode);
+
+  // Bytes of metadata of a filenode once linked with name and key. Its
+  // security descriptor is accounted by _descriptors.
+  uint64_t get_metadata_size(const std::wstring& name,
+                             const std::wstring& key);
+
+  // Replace the descriptor of filenode by its shared instance.
+  void intern_security_descriptor(const std::shared_ptr<filenode>& filenode);
+
+  // Return the key of name.
+  std::wstring get_key(const std::wstring& name) const;
+
+  // Return the directory filenode that is the parent of filename and
+  // set name to the last path component.
+  std::shared_ptr<filenode> find_parent_locked(const std::wstring& filename,
+                                               std::wstring& name);
+
   // Global FS FileIndex count.
   // Note: Alternated stream and main stream share the same FileIndex.
   std::atomic<LONGLONG> _fs_fileindex_count = 1;
 
-  // Mutex need to be aquired when using fileNodes / directoryPaths.
-  std::recursive_mutex _filesnodes_mutex;
-  // Global map of filename / filenode for all the filesystem.
-  std::unordered_map<std::wstring, std::shared_ptr<filenode>> _filenodes;
-  // Directory map of directoryname / sub filenodes in the scope.
-  // A directory \foo with 2 files bar and coco will have one entry:
-  // first: foo - second: set filenode { bar, coco }
-  std::unordered_map<std::wstring, std::set<std::shared_ptr<filenode>>>
-      _directoryPaths;
+  // Mutex need to be aquired when using the hierarchy (filenode children and
+  // links). Lookups (find / list_folder) only take it shared so that
+  // concurrent callbacks do not serialize, changes of the hierarchy take it
+  // exclusive so add / remove / move stay atomic.
+  std::shared_mutex _filesnodes_mutex;
+  // Root directory of the filesystem.
+  std::shared_ptr<filenode> _root;
+
+  const bool _case_sensitive;
+
+  std::unique_ptr<chunk_pool> _chunk_pool;
+
+  // Shared with the chunks allocated, they can outlive fs_filenodes.
+  std::shared_ptr<memory_usage> _usage;
+
+  // Security descriptors of all the filenodes, identical ones are shared.
+  security_descriptor_pool _descriptors;
+
+  // Mapping of the image loaded, file chunks point into it.
+  std::shared_ptr<const uint8_t> _image;
 };
 }  // namespace memfs
 
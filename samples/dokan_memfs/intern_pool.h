@@ -0,0 +1,100 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef INTERN_POOL_H_
+#define INTERN_POOL_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace memfs {
+// FNV-1a, on 64 bits words then on the remaining bytes. Only used to find
+// candidates, the contents are compared before being shared.
+inline uint64_t content_hash(const void* data, size_t size) {
+  const auto bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = 14695981039346656037ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  for (; i < size; ++i) hash = (hash ^ bytes[i]) * 1099511628211ULL;
+  return hash;
+}
+
+// Thread safe pool of immutable values indexed by content hash.
+// The pool only keeps weak references, a value leaves it with its last user.
+template <class T>
+class intern_pool {
+ public:
+  // Return the value of the pool with this hash for which equal returns
+  // true, or add the value returned by make and return it.
+  template <class Equal, class Make>
+  std::shared_ptr<T> intern(uint64_t hash, Equal equal, Make make) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto range = _values.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+      auto pooled = it->second.lock();
+      if (!pooled) {
+        it = _values.erase(it);
+        continue;
+      }
+      if (equal(pooled)) return pooled;
+      ++it;
+    }
+    std::shared_ptr<T> value = make();
+    _values.emplace(hash, value);
+
+    // Entries whose hash is never seen again are only released by a sweep,
+    // done each time the pool doubles to keep the cost amortized.
+    if (_values.size() >= _sweep_size) {
+      for (auto it = _values.begin(); it != _values.end();) {
+        if (it->second.expired())
+          it = _values.erase(it);
+        else
+          ++it;
+      }
+      _sweep_size = std::max<size_t>(1024, _values.size() * 2);
+    }
+    return value;
+  }
+
+ private:
+  std::mutex _mutex;
+  // Different contents can have the same hash.
+  std::unordered_multimap<uint64_t, std::weak_ptr<T>> _values;
+  // Pool size from which the expired entries are swept.
+  size_t _sweep_size = 1024;
+};
+}  // namespace memfs
+
+#endif  // INTERN_POOL_H_
@@ -38,9 +38,17 @@ void show_usage() {
                 "  /n (use network drive)\t\t\t Show device as network device.\n"
                 "  /u (UNC provider name ex. \\localhost\\myfs)\t UNC name used for network volume.\n"
                 "  /t ThreadCount (ex. /t 5)\t\t\t Number of threads to be used internally by Dokan library.\n\t\t\t\t\t\t More threads will handle more event at the same time.\n"
+                "  /f (user mode lock)\t\t\t Handle byte range locks in memfs instead of the kernel.\n"
+                "  /e (deduplicate)\t\t\t\t Store identical 64KB blocks of file content only once.\n"
                 "  /d (enable debug output)\t\t\t Enable debug output to an attached debugger.\n"
+                "  /b (asynchronous debug output)\t\t Write the debug output from a background thread through a ring buffer.\n"
                 "  /i (Timeout in Milliseconds ex. /i 30000)\t Timeout until a running operation is aborted and the device is unmounted.\n"
                 "  /x (network unmount)\t\t\t Allows unmounting network drive from file explorer\n"
+                "  /o Seconds (ex. /o 300)\t\t\t Compress in the background the file content not accessed for Seconds.\n"
+                "  /q Capacity (ex. /q 1024)\t\t\t Maximum memory in MB used by the volume, writes beyond it fail with disk full.\n"
+                "  /r ImagePath (ex. /r C:\\memfs.img)\t\t Populate the filesystem from an image saved with /w. The image is mapped and read on demand.\n"
+                "  /w ImagePath (ex. /w C:\\memfs.img)\t\t Save the filesystem into an image when it is unmounted.\n"
+                "  /z (case insensitive)\t\t\t Mount as a case insensitive and case preserving filesystem.\n"
                 "Examples:\n"
                 "\tmemfs.exe \t\t\t# Mount as a local filesystem into a drive of letter M:\\.\n"
                 "\tmemfs.exe /l P:\t\t\t# Mount as a local filesystem into a drive of letter P:\\.\n"
@@ -67,8 +75,17 @@ int __cdecl wmain(ULONG argc, PWCHAR argv[]) {
         dokan_memfs->current_session = true;
       } else if (arg == L"/d") {
         dokan_memfs->debug_log = true;
+      } else if (arg == L"/b") {
+        dokan_memfs->debug_log = true;
+        dokan_memfs->async_log = true;
       } else if (arg == L"/x") {
         dokan_memfs->enable_network_unmount = true;
+      } else if (arg == L"/e") {
+        dokan_memfs->dedupe = true;
+      } else if (arg == L"/f") {
+        dokan_memfs->user_mode_lock = true;
+      } else if (arg == L"/z") {
+        dokan_memfs->case_insensitive = true;
       } else {
         if (i + 1 >= argc) {
           show_usage();
@@ -87,6 +104,18 @@ int __cdecl wmain(ULONG argc, PWCHAR argv[]) {
                    extra_arg.c_str());
         } else if (arg == L"/t") {
           dokan_memfs->thread_number = std::stoi(extra_arg);
+        } else if (arg == L"/o") {
+          dokan_memfs->compress_after = std::stoul(extra_arg);
+        } else if (arg == L"/q") {
+          dokan_memfs->capacity = std::stoull(extra_arg) * 1024 * 1024;
+        } else if (arg == L"/r") {
+          wcscpy_s(dokan_memfs->load_image,
+                   sizeof(dokan_memfs->load_image) / sizeof(WCHAR),
+                   extra_arg.c_str());
+        } else if (arg == L"/w") {
+          wcscpy_s(dokan_memfs->save_image,
+                   sizeof(dokan_memfs->save_image) / sizeof(WCHAR),
+                   extra_arg.c_str());
         }
       }
     }
@@ -27,19 +27,39 @@ THE SOFTWARE.
 
 #include "memfs.h"
 
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace memfs {
 void memfs::run() {
-  fs_filenodes = std::make_unique<::memfs::fs_filenodes>();
+  fs_filenodes =
+      std::make_unique<::memfs::fs_filenodes>(!case_insensitive, dedupe,
+                                              capacity);
+  if (load_image[0] && !fs_filenodes->load(load_image))
+    throw std::runtime_error("Failed to load image");
 
   DOKAN_OPTIONS dokan_options;
   ZeroMemory(&dokan_options, sizeof(DOKAN_OPTIONS));
   dokan_options.Version = DOKAN_VERSION;
-  dokan_options.Options = DOKAN_OPTION_ALT_STREAM | DOKAN_OPTION_CASE_SENSITIVE;
+  dokan_options.Options = DOKAN_OPTION_ALT_STREAM;
+  if (!case_insensitive) dokan_options.Options |= DOKAN_OPTION_CASE_SENSITIVE;
+  if (user_mode_lock) dokan_options.Options |= DOKAN_OPTION_FILELOCK_USER_MODE;
   dokan_options.MountPoint = mount_point;
   if (debug_log) {
     dokan_options.Options |= DOKAN_OPTION_STDERR | DOKAN_OPTION_DEBUG;
+    if (async_log) {
+      // Format and print the logs from a background thread. When the ring
+      // buffer is full the oldest messages are dropped so the callbacks never
+      // wait on the console.
+      spdlog::init_thread_pool(8192, 1);
+      spdlog::set_default_logger(
+          spdlog::create_async_nb<spdlog::sinks::stdout_color_sink_mt>(
+              "memfs"));
+    }
   } else {
     spdlog::set_level(spdlog::level::err);
   }
@@ -67,7 +87,33 @@ void memfs::run() {
   dokan_options.Timeout = timeout;
   dokan_options.GlobalContext = reinterpret_cast<ULONG64>(fs_filenodes.get());
 
+  // Compress the cold file content in the background while mounted.
+  std::mutex compressor_mutex;
+  std::condition_variable compressor_stop;
+  bool unmounted = false;
+  std::thread compressor;
+  if (compress_after) {
+    compressor = std::thread([&] {
+      std::unique_lock<std::mutex> lock(compressor_mutex);
+      while (!compressor_stop.wait_for(lock,
+                                       std::chrono::seconds(compress_after),
+                                       [&] { return unmounted; })) {
+        lock.unlock();
+        fs_filenodes->compress_cold_chunks(compress_after);
+        lock.lock();
+      }
+    });
+  }
+
   NTSTATUS status = DokanMain(&dokan_options, &memfs_operations);
+  if (compressor.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(compressor_mutex);
+      unmounted = true;
+    }
+    compressor_stop.notify_one();
+    compressor.join();
+  }
   switch (status) {
     case DOKAN_SUCCESS:
       break;
@@ -89,7 +135,14 @@ void memfs::run() {
       spdlog::error(L"DokanMain failed with {}", status);
       throw std::runtime_error("Unknown error"); // add error status
   }
+
+  if (save_image[0] && !fs_filenodes->save(save_image))
+    throw std::runtime_error("Failed to save image");
 }
 
-memfs::~memfs() { DokanRemoveMountPoint(mount_point); }
+memfs::~memfs() {
+  DokanRemoveMountPoint(mount_point);
+  // Flush the pending asynchronous logs.
+  if (async_log) spdlog::shutdown();
+}
 }  // namespace memfs
@@ -54,8 +54,24 @@ class memfs {
   bool removable_drive = false;
   bool current_session = false;
   bool debug_log = false;
+  // Debug logs go through a ring buffer written by a background thread.
+  bool async_log = false;
   bool enable_network_unmount = false;
+  bool case_insensitive = false;
+  // Handle LockFile/UnlockFile with memfs byte range locks.
+  bool user_mode_lock = false;
+  // Store identical file chunks once.
+  bool dedupe = false;
+  // Maximum bytes of memory used by the volume, 0 for unlimited.
+  ULONGLONG capacity = 0;
+  // Seconds without access after which file content is compressed, 0 to
+  // never compress.
+  ULONG compress_after = 0;
   ULONG timeout = 0;
+  // Image to populate the filesystem from before mounting.
+  WCHAR load_image[MAX_PATH] = L"";
+  // Image where the filesystem is saved once unmounted.
+  WCHAR save_image[MAX_PATH] = L"";
 
   // FileSystem context runtime
   std::unique_ptr<fs_filenodes> fs_filenodes;
@@ -55,6 +55,12 @@ class memfs_helper {
     low = static_cast<DWORD>(v);
   }
 
+  // Upcase the string in place.
+  // Used to build the keys of a case insensitive filesystem.
+  static inline void Upcase(std::wstring& s) {
+    if (!s.empty()) CharUpperBuffW(s.data(), static_cast<DWORD>(s.length()));
+  }
+
   static const std::wstring DataStreamNameStr;
   // Remove the stream type from the filename
   // Stream type are not supported so we ignore / remove them.
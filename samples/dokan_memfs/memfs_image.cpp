@@ -0,0 +1,204 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "memfs_image.h"
+
+#include <cstring>
+
+namespace memfs {
+namespace {
+const char image_magic[8] = {'M', 'E', 'M', 'F', 'S', 'I', 'M', 'G'};
+const uint32_t image_version = 1;
+
+// magic, version, chunk size, descriptors offset and count, nodes offset and
+// count.
+const uint64_t image_header_size = 8 + 4 + 4 + 8 + 8 + 8 + 8;
+
+enum image_node_flags : uint8_t {
+  image_node_directory = 1,
+  image_node_stream = 2,
+};
+
+template <typename T>
+void put(std::string& buffer, T value) {
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+}  // namespace
+
+bool image_writer::open(const std::filesystem::path& path) {
+  _file.open(path, std::ios::binary | std::ios::trunc);
+  if (!_file) return false;
+  // The header is written by close, chunks start at the first aligned offset.
+  const std::string header_area(_chunk_size, '\0');
+  _file.write(header_area.data(), header_area.size());
+  _data_end = _chunk_size;
+  return !_file.fail();
+}
+
+uint32_t image_writer::add_descriptor(const void* descriptor, uint32_t size) {
+  std::string content(static_cast<const char*>(descriptor), size);
+  auto it = _descriptors_index.find(content);
+  if (it != _descriptors_index.end()) return it->second;
+
+  put<uint32_t>(_descriptors, size);
+  _descriptors.append(content);
+  _descriptors_index.emplace(std::move(content), _descriptor_count);
+  return _descriptor_count++;
+}
+
+uint64_t image_writer::add_node(const image_node& node) {
+  put<uint64_t>(_nodes, node.parent);
+  put<uint8_t>(_nodes, (node.is_directory ? image_node_directory : 0) |
+                           (node.is_stream ? image_node_stream : 0));
+  put<uint32_t>(_nodes, node.attributes);
+  put<int64_t>(_nodes, node.creation);
+  put<int64_t>(_nodes, node.lastaccess);
+  put<int64_t>(_nodes, node.lastwrite);
+  put<uint64_t>(_nodes, node.file_size);
+  put<uint32_t>(_nodes, node.descriptor);
+  put<uint32_t>(_nodes, static_cast<uint32_t>(node.name.length()));
+  for (auto c : node.name) put<uint16_t>(_nodes, static_cast<uint16_t>(c));
+  put<uint64_t>(_nodes, node.chunks.size());
+  for (const auto& [index, chunk] : node.chunks) {
+    put<uint64_t>(_nodes, index);
+    put<uint64_t>(_nodes, _data_end);
+    _file.write(reinterpret_cast<const char*>(chunk), _chunk_size);
+    _data_end += _chunk_size;
+  }
+  return _node_count++;
+}
+
+bool image_writer::close() {
+  const uint64_t descriptors_offset = _data_end;
+  const uint64_t nodes_offset = descriptors_offset + _descriptors.size();
+  _file.write(_descriptors.data(), _descriptors.size());
+  _file.write(_nodes.data(), _nodes.size());
+
+  std::string header(image_magic, sizeof(image_magic));
+  put<uint32_t>(header, image_version);
+  put<uint32_t>(header, _chunk_size);
+  put<uint64_t>(header, descriptors_offset);
+  put<uint64_t>(header, _descriptor_count);
+  put<uint64_t>(header, nodes_offset);
+  put<uint64_t>(header, _node_count);
+  _file.seekp(0);
+  _file.write(header.data(), header.size());
+  _file.close();
+  return !_file.fail();
+}
+
+template <typename T>
+bool image_reader::get(uint64_t& position, T& value) {
+  if (position > _size || _size - position < sizeof(T)) return false;
+  memcpy(&value, _image + position, sizeof(T));
+  position += sizeof(T);
+  return true;
+}
+
+bool image_reader::open(uint32_t chunk_size) {
+  if (_size < image_header_size ||
+      memcmp(_image, image_magic, sizeof(image_magic)))
+    return false;
+
+  uint64_t position = sizeof(image_magic);
+  uint32_t version;
+  get(position, version);
+  get(position, _chunk_size);
+  get(position, _descriptors_offset);
+  get(position, _descriptor_count);
+  get(position, _nodes_offset);
+  get(position, _node_count);
+  return version == image_version && _chunk_size == chunk_size &&
+         _descriptors_offset <= _nodes_offset && _nodes_offset <= _size;
+}
+
+bool image_reader::read_descriptors(
+    std::vector<std::pair<const uint8_t*, uint32_t>>& descriptors) {
+  uint64_t position = _descriptors_offset;
+  descriptors.clear();
+  for (uint64_t i = 0; i < _descriptor_count; ++i) {
+    uint32_t size;
+    if (!get(position, size) || position + size > _nodes_offset) return false;
+    descriptors.emplace_back(_image + position, size);
+    position += size;
+  }
+  return true;
+}
+
+bool image_reader::read_nodes(
+    const std::function<bool(uint64_t, const image_node&)>& callback) {
+  uint64_t position = _nodes_offset;
+  image_node node;
+  for (uint64_t i = 0; i < _node_count; ++i) {
+    uint8_t flags;
+    uint32_t name_length;
+    uint64_t chunk_count;
+    if (!get(position, node.parent) || !get(position, flags) ||
+        !get(position, node.attributes) || !get(position, node.creation) ||
+        !get(position, node.lastaccess) || !get(position, node.lastwrite) ||
+        !get(position, node.file_size) || !get(position, node.descriptor) ||
+        !get(position, name_length))
+      return false;
+    node.is_directory = flags & image_node_directory;
+    node.is_stream = flags & image_node_stream;
+    // Only the root has no parent and it is the first node.
+    if ((i == 0) != (node.parent == image_node::no_parent) ||
+        (i && node.parent >= i))
+      return false;
+    if (node.descriptor != image_node::no_descriptor &&
+        node.descriptor >= _descriptor_count)
+      return false;
+
+    if (name_length > (_size - position) / sizeof(uint16_t)) return false;
+    node.name.resize(name_length);
+    for (auto& c : node.name) {
+      uint16_t unit = 0;
+      get(position, unit);
+      c = static_cast<wchar_t>(unit);
+    }
+
+    if (!get(position, chunk_count) ||
+        chunk_count > (_size - position) / (2 * sizeof(uint64_t)))
+      return false;
+    node.chunks.resize(static_cast<size_t>(chunk_count));
+    for (auto& [index, chunk] : node.chunks) {
+      uint64_t offset = 0;
+      get(position, index);
+      get(position, offset);
+      // Chunks are aligned and stored before the tables.
+      if (offset % _chunk_size || offset < _chunk_size ||
+          offset > _descriptors_offset ||
+          _descriptors_offset - offset < _chunk_size)
+        return false;
+      chunk = _image + offset;
+    }
+
+    if (!callback(i, node)) return false;
+  }
+  return true;
+}
+}  // namespace memfs
@@ -0,0 +1,134 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef MEMFS_IMAGE_H_
+#define MEMFS_IMAGE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace memfs {
+// Memfs image
+// An image is a snapshot of a whole memfs volume that can be mounted back by
+// mapping it in memory: the file content is not read when mounting but paged
+// in on first access.
+// Layout, all values are little endian:
+//   header       magic, version, chunk size and tables position.
+//   chunks       file content, each chunk is chunk_size bytes at a chunk_size
+//                aligned offset so it can be used directly from the mapping.
+//   descriptors  security descriptors, stored once and shared by the nodes.
+//   nodes        nodes in tree order, a parent always comes before its
+//                children and a main stream before its alternated streams.
+// The image reader and writer only depend on the standard library.
+struct image_node {
+  static constexpr uint64_t no_parent = UINT64_MAX;
+  static constexpr uint32_t no_descriptor = UINT32_MAX;
+
+  // Index of the parent directory, or of the main stream for an alternated
+  // stream. no_parent for the root.
+  uint64_t parent = no_parent;
+  bool is_directory = false;
+  bool is_stream = false;
+  uint32_t attributes = 0;
+  int64_t creation = 0;
+  int64_t lastaccess = 0;
+  int64_t lastwrite = 0;
+  uint64_t file_size = 0;
+  uint32_t descriptor = no_descriptor;
+  // Name in the parent directory, stream name for alternated streams.
+  // Stored as UTF-16.
+  std::wstring name;
+  // Chunk number / chunk content of chunk_size bytes.
+  std::vector<std::pair<uint64_t, const uint8_t*>> chunks;
+};
+
+class image_writer {
+ public:
+  explicit image_writer(uint32_t chunk_size) : _chunk_size(chunk_size) {}
+
+  bool open(const std::filesystem::path& path);
+
+  // Return the index of the descriptor. Identical descriptors are stored once.
+  uint32_t add_descriptor(const void* descriptor, uint32_t size);
+
+  // Write the node and its content. Return its index.
+  uint64_t add_node(const image_node& node);
+
+  // Write the tables and the header. Return false if any write failed.
+  bool close();
+
+ private:
+  const uint32_t _chunk_size;
+  std::ofstream _file;
+  uint64_t _data_end = 0;
+  std::map<std::string, uint32_t> _descriptors_index;
+  std::string _descriptors;
+  uint32_t _descriptor_count = 0;
+  std::string _nodes;
+  uint64_t _node_count = 0;
+};
+
+class image_reader {
+ public:
+  // image need to stay valid while the descriptors and chunks returned are
+  // used.
+  image_reader(const uint8_t* image, uint64_t size)
+      : _image(image), _size(size) {}
+
+  // Validate the header. chunk_size is the size expected by the caller.
+  bool open(uint32_t chunk_size);
+
+  // Return the descriptors in index order, false if the table is corrupted.
+  bool read_descriptors(
+      std::vector<std::pair<const uint8_t*, uint32_t>>& descriptors);
+
+  // Call callback for each node in image order with its index.
+  // Stop and return false if the table is corrupted or callback return false.
+  bool read_nodes(
+      const std::function<bool(uint64_t, const image_node&)>& callback);
+
+ private:
+  template <typename T>
+  bool get(uint64_t& position, T& value);
+
+  const uint8_t* _image;
+  const uint64_t _size;
+  uint32_t _chunk_size = 0;
+  uint64_t _descriptors_offset = 0;
+  uint64_t _descriptor_count = 0;
+  uint64_t _nodes_offset = 0;
+  uint64_t _node_count = 0;
+};
+}  // namespace memfs
+
+#endif  // MEMFS_IMAGE_H_
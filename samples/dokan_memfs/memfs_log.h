@@ -0,0 +1,57 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef MEMFS_LOG_H_
+#define MEMFS_LOG_H_
+
+#include <spdlog/spdlog.h>
+
+// Memfs logging
+// spdlog::info evaluates its arguments before checking the log level, so a
+// get_filename() in a disabled message still lock and copy the name.
+// MEMFS_LOG_* check the level first and only evaluate the arguments when the
+// message is logged. Levels below SPDLOG_ACTIVE_LEVEL are compiled out.
+#define MEMFS_LOG(level, ...)                                                  \
+  do {                                                                         \
+    auto memfs_logger = spdlog::default_logger_raw();                          \
+    if (memfs_logger->should_log(level))                                       \
+      memfs_logger->log(level, __VA_ARGS__);                                   \
+  } while (0)
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define MEMFS_LOG_INFO(...) MEMFS_LOG(spdlog::level::info, __VA_ARGS__)
+#else
+#define MEMFS_LOG_INFO(...) (void)0
+#endif
+
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_WARN
+#define MEMFS_LOG_WARN(...) MEMFS_LOG(spdlog::level::warn, __VA_ARGS__)
+#else
+#define MEMFS_LOG_WARN(...) (void)0
+#endif
+
+#endif  // MEMFS_LOG_H_
@@ -27,8 +27,8 @@ THE SOFTWARE.
 
 #include "memfs_operations.h"
 #include "memfs_helper.h"
+#include "memfs_log.h"
 
-#include <sddl.h>
 #include <spdlog/spdlog.h>
 #include <iostream>
 #include <mutex>
@@ -47,19 +47,55 @@ static NTSTATUS create_main_stream(
   // the main stream exist otherwise we create it.
   auto main_stream_name = memfs_helper::GetFileName(filename, stream_names);
   if (!fs_filenodes->find(main_stream_name)) {
-    spdlog::info(L"create_main_stream: we create the maing stream {}", main_stream_name);
-    auto n = fs_filenodes->add(std::make_shared<filenode>(
-        main_stream_name, false, file_attributes_and_flags, security_context));
+    MEMFS_LOG_INFO(L"create_main_stream: we create the maing stream {}",
+                   main_stream_name);
+    auto n = fs_filenodes->add(
+        main_stream_name,
+        std::make_shared<filenode>(main_stream_name, false,
+                                   file_attributes_and_flags,
+                                   security_context));
     if (n != STATUS_SUCCESS) return n;
   }
   return STATUS_SUCCESS;
 }
 
-static NTSTATUS DOKAN_CALLBACK
-memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
-                 ACCESS_MASK desiredaccess, ULONG fileattributes,
-                 ULONG /*shareaccess*/, ULONG createdisposition,
-                 ULONG createoptions, PDOKAN_FILE_INFO dokanfileinfo) {
+// The filenode opened is pinned in the handle context by memfs_createfile so
+// the operations on the handle do not resolve the filename again. The pinned
+// filenode follows the renames and stays usable once deleted until the handle
+// is closed, like on NTFS. The reference is released by memfs_closeFile.
+static void pin_filenode(PDOKAN_FILE_INFO dokanfileinfo,
+                         const std::shared_ptr<filenode>& f) {
+  dokanfileinfo->Context =
+      reinterpret_cast<ULONG64>(new std::shared_ptr<filenode>(f));
+}
+
+static void unpin_filenode(PDOKAN_FILE_INFO dokanfileinfo) {
+  delete reinterpret_cast<std::shared_ptr<filenode>*>(dokanfileinfo->Context);
+  dokanfileinfo->Context = 0;
+}
+
+// Return the filenode pinned by the handle or resolve filename for a handle
+// without one.
+static std::shared_ptr<filenode> get_filenode(fs_filenodes* fs_filenodes,
+                                              LPCWSTR filename,
+                                              PDOKAN_FILE_INFO dokanfileinfo) {
+  if (dokanfileinfo->Context)
+    return *reinterpret_cast<std::shared_ptr<filenode>*>(
+        dokanfileinfo->Context);
+  return fs_filenodes->find(filename);
+}
+
+// Byte range locks are owned by the handle that took them.
+static PVOID get_lock_owner(PDOKAN_FILE_INFO dokanfileinfo) {
+  return reinterpret_cast<PVOID>(dokanfileinfo->DokanContext);
+}
+
+static NTSTATUS create_file(LPCWSTR filename,
+                            PDOKAN_IO_SECURITY_CONTEXT security_context,
+                            ACCESS_MASK desiredaccess, ULONG fileattributes,
+                            ULONG createdisposition, ULONG createoptions,
+                            PDOKAN_FILE_INFO dokanfileinfo,
+                            std::shared_ptr<filenode>& opened) {
   auto filenodes = GET_FS_INSTANCE;
   ACCESS_MASK generic_desiredaccess;
   DWORD creation_disposition;
@@ -74,9 +110,10 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
   memfs_helper::RemoveStreamType(filename_str);
 
   auto f = filenodes->find(filename_str);
+  opened = f;
   auto stream_names = memfs_helper::GetStreamNames(filename_str);
 
-  spdlog::info(L"CreateFile: {} with node: {}", filename_str, (f != nullptr));
+  MEMFS_LOG_INFO(L"CreateFile: {} with node: {}", filename_str, (f != nullptr));
 
   // We only support filename length under 255.
   // See GetVolumeInformation - MaximumComponentLength
@@ -98,27 +135,27 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
   // TODO Use AccessCheck to check security rights
 
   if (dokanfileinfo->IsDirectory) {
-    spdlog::info(L"CreateFile: {} is a Directory", filename_str);
+    MEMFS_LOG_INFO(L"CreateFile: {} is a Directory", filename_str);
 
     if (creation_disposition == CREATE_NEW ||
         creation_disposition == OPEN_ALWAYS) {
-      spdlog::info(L"CreateFile: {} create Directory", filename_str);
+      MEMFS_LOG_INFO(L"CreateFile: {} create Directory", filename_str);
       // Cannot create a stream as directory.
       if (!stream_names.second.empty()) return STATUS_NOT_A_DIRECTORY;
 
       if (f) return STATUS_OBJECT_NAME_COLLISION;
 
-      auto newfileNode = std::make_shared<filenode>(
+      opened = std::make_shared<filenode>(
           filename_str, true, FILE_ATTRIBUTE_DIRECTORY, security_context);
-      return filenodes->add(newfileNode);
+      return filenodes->add(filename_str, opened);
     }
 
     if (f && !f->is_directory) return STATUS_NOT_A_DIRECTORY;
     if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
-    spdlog::info(L"CreateFile: {} open Directory", filename_str);
+    MEMFS_LOG_INFO(L"CreateFile: {} open Directory", filename_str);
   } else {
-    spdlog::info(L"CreateFile: {} is a File", filename_str);
+    MEMFS_LOG_INFO(L"CreateFile: {} is a File", filename_str);
 
     // Cannot overwrite an hidden or system file.
     if (f && (((!(file_attributes_and_flags & FILE_ATTRIBUTE_HIDDEN) &&
@@ -130,7 +167,7 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
       return STATUS_ACCESS_DENIED;
 
     // Cannot delete a file with readonly attributes.
-    if ((f && (f->attributes & FILE_ATTRIBUTE_READONLY) ||
+    if (((f && (f->attributes & FILE_ATTRIBUTE_READONLY)) ||
          (file_attributes_and_flags & FILE_ATTRIBUTE_READONLY)) &&
         (file_attributes_and_flags & FILE_FLAG_DELETE_ON_CLOSE))
       return STATUS_CANNOT_DELETE;
@@ -170,7 +207,7 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
 
     switch (creation_disposition) {
       case CREATE_ALWAYS: {
-        spdlog::info(L"CreateFile: {} CREATE_ALWAYS", filename_str);
+        MEMFS_LOG_INFO(L"CreateFile: {} CREATE_ALWAYS", filename_str);
         /*
          * Creates a new file, always.
          *
@@ -178,6 +215,22 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
          * by DokanMapKernelToUserCreateFileFlags.
          */
 
+        if (f) {
+          /*
+           * If the specified file exists and is writable, the function
+           * overwrites the file, the function succeeds, and last-error code is
+           * set to ERROR_ALREADY_EXISTS.
+           * The node is overwritten in place so the other handles opened on it
+           * keep seeing the file.
+           */
+          f->set_endoffile(0);
+          f->times.lastaccess = f->times.lastwrite =
+              filetimes::get_currenttime();
+          f->attributes = file_attributes_and_flags;
+          opened = f;
+          return STATUS_OBJECT_NAME_COLLISION;
+        }
+
         if (!stream_names.second.empty()) {
           // The createfile is a alternate stream,
           // we need to be sure main stream exist
@@ -187,19 +240,14 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
           if (n != STATUS_SUCCESS) return n;
         }
 
-        auto n = filenodes->add(std::make_shared<filenode>(
-            filename_str, false, file_attributes_and_flags, security_context));
+        opened = std::make_shared<filenode>(filename_str, false,
+                                            file_attributes_and_flags,
+                                            security_context);
+        auto n = filenodes->add(filename_str, opened);
         if (n != STATUS_SUCCESS) return n;
-
-        /*
-         * If the specified file exists and is writable, the function overwrites
-         * the file, the function succeeds, and last-error code is set to
-         * ERROR_ALREADY_EXISTS
-         */
-        if (f) return STATUS_OBJECT_NAME_COLLISION;
       } break;
       case CREATE_NEW: {
-        spdlog::info(L"CreateFile: {} CREATE_ALWAYS", filename_str);
+        MEMFS_LOG_INFO(L"CreateFile: {} CREATE_ALWAYS", filename_str);
         /*
          * Creates a new file, only if it does not already exist.
          */
@@ -214,20 +262,23 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
           if (n != STATUS_SUCCESS) return n;
         }
 
-        auto n = filenodes->add(std::make_shared<filenode>(
-            filename_str, false, file_attributes_and_flags, security_context));
+        opened = std::make_shared<filenode>(filename_str, false,
+                                            file_attributes_and_flags,
+                                            security_context);
+        auto n = filenodes->add(filename_str, opened);
         if (n != STATUS_SUCCESS) return n;
       } break;
       case OPEN_ALWAYS: {
-        spdlog::info(L"CreateFile: {} OPEN_ALWAYS", filename_str);
+        MEMFS_LOG_INFO(L"CreateFile: {} OPEN_ALWAYS", filename_str);
         /*
          * Opens a file, always.
          */
 
         if (!f) {
-          auto n = filenodes->add(std::make_shared<filenode>(
-              filename_str, false, file_attributes_and_flags,
-              security_context));
+          opened = std::make_shared<filenode>(filename_str, false,
+                                              file_attributes_and_flags,
+                                              security_context);
+          auto n = filenodes->add(filename_str, opened);
           if (n != STATUS_SUCCESS) return n;
         } else {
           if (desiredaccess & FILE_EXECUTE) {
@@ -236,7 +287,7 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
         }
       } break;
       case OPEN_EXISTING: {
-        spdlog::info(L"CreateFile: {} OPEN_EXISTING", filename_str);
+        MEMFS_LOG_INFO(L"CreateFile: {} OPEN_EXISTING", filename_str);
         /*
          * Opens a file or device, only if it exists.
          * If the specified file or device does not exist, the function fails
@@ -249,7 +300,7 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
         }
       } break;
       case TRUNCATE_EXISTING: {
-        spdlog::info(L"CreateFile: {} TRUNCATE_EXISTING", filename_str);
+        MEMFS_LOG_INFO(L"CreateFile: {} TRUNCATE_EXISTING", filename_str);
         /*
          * Opens a file and truncates it so that its size is zero bytes, only if
          * it exists. If the specified file does not exist, the function fails
@@ -262,8 +313,8 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
         f->attributes = file_attributes_and_flags;
       } break;
       default:
-        spdlog::info(L"CreateFile: {} Unknown CreationDisposition {}",
-                     filename_str, creation_disposition);
+        MEMFS_LOG_INFO(L"CreateFile: {} Unknown CreationDisposition {}",
+                       filename_str, creation_disposition);
         break;
     }
   }
@@ -280,23 +331,49 @@ memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
   return STATUS_SUCCESS;
 }
 
+static NTSTATUS DOKAN_CALLBACK
+memfs_createfile(LPCWSTR filename, PDOKAN_IO_SECURITY_CONTEXT security_context,
+                 ACCESS_MASK desiredaccess, ULONG fileattributes,
+                 ULONG /*shareaccess*/, ULONG createdisposition,
+                 ULONG createoptions, PDOKAN_FILE_INFO dokanfileinfo) {
+  std::shared_ptr<filenode> f;
+  auto status =
+      create_file(filename, security_context, desiredaccess, fileattributes,
+                  createdisposition, createoptions, dokanfileinfo, f);
+  // Dokan opens the handle, and will close it, on success and on
+  // STATUS_OBJECT_NAME_COLLISION when an existing file is opened or
+  // overwritten.
+  if (f && (NT_SUCCESS(status) ||
+            (status == STATUS_OBJECT_NAME_COLLISION &&
+             (createdisposition == FILE_OPEN_IF ||
+              createdisposition == FILE_SUPERSEDE ||
+              createdisposition == FILE_OVERWRITE_IF))))
+    pin_filenode(dokanfileinfo, f);
+  return status;
+}
+
 static void DOKAN_CALLBACK memfs_cleanup(LPCWSTR filename,
                                          PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
-  auto filename_str = std::wstring(filename);
-  spdlog::info(L"Cleanup: {}", filename_str);
+  MEMFS_LOG_INFO(L"Cleanup: {}", filename);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  if (!f) return;
+  // The byte range locks of the handle are released with it.
+  auto range_locks = f->get_range_locks(false);
+  if (range_locks)
+    DokanUnlockAllRanges(range_locks, get_lock_owner(dokanfileinfo));
   if (dokanfileinfo->DeleteOnClose) {
     // Delete happens during cleanup and not in close event.
-    spdlog::info(L"\tDeleteOnClose: {}", filename_str);
-    filenodes->remove(filename_str);
+    MEMFS_LOG_INFO(L"\tDeleteOnClose: {}", filename);
+    // Remove the file opened, whatever now has its name.
+    filenodes->remove(f);
   }
 }
 
 static void DOKAN_CALLBACK memfs_closeFile(LPCWSTR filename,
-                                           PDOKAN_FILE_INFO /*dokanfileinfo*/) {
-  auto filename_str = std::wstring(filename);
-  // Here we should release all resources from the createfile context if we had.
-  spdlog::info(L"CloseFile: {}", filename_str);
+                                           PDOKAN_FILE_INFO dokanfileinfo) {
+  MEMFS_LOG_INFO(L"CloseFile: {}", filename);
+  unpin_filenode(dokanfileinfo);
 }
 
 static NTSTATUS DOKAN_CALLBACK memfs_readfile(LPCWSTR filename, LPVOID buffer,
@@ -305,14 +382,20 @@ static NTSTATUS DOKAN_CALLBACK memfs_readfile(LPCWSTR filename, LPVOID buffer,
                                               LONGLONG offset,
                                               PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
-  auto filename_str = std::wstring(filename);
-  spdlog::info(L"ReadFile: {}", filename_str);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"ReadFile: {}", filename);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
+  // Paging IO comes from the cache manager and is not subject to locks.
+  auto range_locks = f->get_range_locks(false);
+  if (range_locks && !dokanfileinfo->PagingIo &&
+      !DokanCheckRangeAccess(range_locks, get_lock_owner(dokanfileinfo),
+                             offset, bufferlength, FALSE))
+    return STATUS_FILE_LOCK_CONFLICT;
+
   *readlength = f->read(buffer, bufferlength, offset);
-  spdlog::info(L"\tBufferLength: {} offset: {} readlength: {}", bufferlength,
-               offset, *readlength);
+  MEMFS_LOG_INFO(L"\tBufferLength: {} offset: {} readlength: {}", bufferlength,
+                 offset, *readlength);
   return STATUS_SUCCESS;
 }
 
@@ -322,9 +405,8 @@ static NTSTATUS DOKAN_CALLBACK memfs_writefile(LPCWSTR filename, LPCVOID buffer,
                                                LONGLONG offset,
                                                PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
-  auto filename_str = std::wstring(filename);
-  spdlog::info(L"WriteFile: {}", filename_str);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"WriteFile: {}", filename);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
   auto file_size = f->get_filesize();
@@ -333,13 +415,19 @@ static NTSTATUS DOKAN_CALLBACK memfs_writefile(LPCWSTR filename, LPCVOID buffer,
   // and we need to write at the end of the file.
   if (offset == -1) offset = file_size;
 
+  auto range_locks = f->get_range_locks(false);
+  if (range_locks && !dokanfileinfo->PagingIo &&
+      !DokanCheckRangeAccess(range_locks, get_lock_owner(dokanfileinfo),
+                             offset, number_of_bytes_to_write, TRUE))
+    return STATUS_FILE_LOCK_CONFLICT;
+
   if (dokanfileinfo->PagingIo) {
     // PagingIo cannot extend file size.
     // We return STATUS_SUCCESS when offset is beyond fileSize
     // and write the maximum we are allowed to.
     if (offset >= file_size) {
-      spdlog::info(L"\tPagingIo Outside offset: {} FileSize: {}", offset,
-                   file_size);
+      MEMFS_LOG_INFO(L"\tPagingIo Outside offset: {} FileSize: {}", offset,
+                     file_size);
       *number_of_bytes_written = 0;
       return STATUS_SUCCESS;
     }
@@ -353,13 +441,16 @@ static NTSTATUS DOKAN_CALLBACK memfs_writefile(LPCWSTR filename, LPCVOID buffer,
         number_of_bytes_to_write = static_cast<DWORD>(bytes);
       }
     }
-    spdlog::info(L"\tPagingIo number_of_bytes_to_write: {}",
-                 number_of_bytes_to_write);
+    MEMFS_LOG_INFO(L"\tPagingIo number_of_bytes_to_write: {}",
+                   number_of_bytes_to_write);
   }
 
-  *number_of_bytes_written = f->write(buffer, number_of_bytes_to_write, offset);
+  *number_of_bytes_written = f->write(buffer, number_of_bytes_to_write, offset,
+                                     filenodes->get_chunk_pool());
+  if (number_of_bytes_to_write && !*number_of_bytes_written)
+    return STATUS_DISK_FULL;
 
-  spdlog::info(
+  MEMFS_LOG_INFO(
       L"\tNumberOfBytesToWrite {} offset: {} number_of_bytes_written: {}",
       number_of_bytes_to_write, offset, *number_of_bytes_written);
   return STATUS_SUCCESS;
@@ -369,8 +460,9 @@ static NTSTATUS DOKAN_CALLBACK
 memfs_flushfilebuffers(LPCWSTR filename, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"FlushFileBuffers: {}", filename_str);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"FlushFileBuffers: {}", filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
   // Nothing to flush, we directly write the content into our buffer.
 
   if (f->main_stream) f = f->main_stream;
@@ -384,8 +476,8 @@ memfs_getfileInformation(LPCWSTR filename, LPBY_HANDLE_FILE_INFORMATION buffer,
                          PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"GetFileInformation: {}", filename_str);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"GetFileInformation: {}", filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
   buffer->dwFileAttributes = f->attributes;
   memfs_helper::LlongToFileTime(f->times.creation, buffer->ftCreationTime);
@@ -400,7 +492,7 @@ memfs_getfileInformation(LPCWSTR filename, LPBY_HANDLE_FILE_INFORMATION buffer,
   buffer->nNumberOfLinks = 1;
   buffer->dwVolumeSerialNumber = g_volumserial;
 
-  spdlog::info(
+  MEMFS_LOG_INFO(
       L"GetFileInformation: {} Attributes: {:x} Times: Creation {:x} "
       L"LastAccess {:x} LastWrite {:x} FileSize {} NumberOfLinks {} "
       L"VolumeSerialNumber {:x}",
@@ -416,17 +508,15 @@ static NTSTATUS DOKAN_CALLBACK memfs_findfiles(LPCWSTR filename,
                                                PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  auto files = filenodes->list_folder(filename_str);
   WIN32_FIND_DATAW findData;
-  spdlog::info(L"FindFiles: {}", filename_str);
+  MEMFS_LOG_INFO(L"FindFiles: {}", filename_str);
   ZeroMemory(&findData, sizeof(WIN32_FIND_DATAW));
-  for (const auto& f : files) {
-    if (f->main_stream) continue; // Do not list File Streams
-    const auto fileNodeName = f->get_filename();
-    auto fileName = std::filesystem::path(fileNodeName).filename().wstring();
-    if (fileName.length() > MAX_PATH) continue;
-    std::copy(fileName.begin(), fileName.end(), std::begin(findData.cFileName));
-    findData.cFileName[fileName.length()] = '\0';
+  filenodes->list_folder(filename_str, std::wstring(), [&](const auto& f,
+                                                          auto name) {
+    // cFileName also holds the null terminator.
+    if (name.length() >= MAX_PATH) return true;
+    name.copy(findData.cFileName, name.length());
+    findData.cFileName[name.length()] = L'\0';
     findData.dwFileAttributes = f->attributes;
     memfs_helper::LlongToFileTime(f->times.creation, findData.ftCreationTime);
     memfs_helper::LlongToFileTime(f->times.lastaccess,
@@ -435,13 +525,14 @@ static NTSTATUS DOKAN_CALLBACK memfs_findfiles(LPCWSTR filename,
     auto file_size = f->get_filesize();
     memfs_helper::LlongToDwLowHigh(file_size, findData.nFileSizeLow,
                                    findData.nFileSizeHigh);
-    spdlog::info(
+    MEMFS_LOG_INFO(
         L"FindFiles: {} fileNode: {} Attributes: {} Times: Creation {} "
         L"LastAccess {} LastWrite {} FileSize {}",
-        filename_str, fileNodeName, findData.dwFileAttributes,
+        filename_str, name, findData.dwFileAttributes,
         f->times.creation, f->times.lastaccess, f->times.lastwrite, file_size);
     fill_finddata(&findData, dokanfileinfo);
-  }
+    return true;
+  });
   return STATUS_SUCCESS;
 }
 
@@ -449,9 +540,9 @@ static NTSTATUS DOKAN_CALLBACK memfs_setfileattributes(
     LPCWSTR filename, DWORD fileattributes, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  auto f = filenodes->find(filename_str);
-  spdlog::info(L"SetFileAttributes: {} fileattributes {}", filename_str,
-               fileattributes);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  MEMFS_LOG_INFO(L"SetFileAttributes: {} fileattributes {}", filename_str,
+                 fileattributes);
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
   // No attributes need to be changed
@@ -472,8 +563,8 @@ memfs_setfiletime(LPCWSTR filename, CONST FILETIME* creationtime,
                   PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  auto f = filenodes->find(filename_str);
-  spdlog::info(L"SetFileTime: {}", filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  MEMFS_LOG_INFO(L"SetFileTime: {}", filename_str);
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
   if (creationtime && !filetimes::empty(creationtime))
     f->times.creation = memfs_helper::FileTimeToLlong(*creationtime);
@@ -489,8 +580,8 @@ static NTSTATUS DOKAN_CALLBACK
 memfs_deletefile(LPCWSTR filename, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  auto f = filenodes->find(filename_str);
-  spdlog::info(L"DeleteFile: {}", filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  MEMFS_LOG_INFO(L"DeleteFile: {}", filename_str);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
@@ -506,10 +597,14 @@ static NTSTATUS DOKAN_CALLBACK
 memfs_deletedirectory(LPCWSTR filename, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"DeleteDirectory: {}", filename_str);
+  MEMFS_LOG_INFO(L"DeleteDirectory: {}", filename_str);
 
-  if (filenodes->list_folder(filename_str).size())
-    return STATUS_DIRECTORY_NOT_EMPTY;
+  bool empty = true;
+  filenodes->list_folder(filename_str, std::wstring(), [&](const auto&, auto) {
+    empty = false;
+    return false;
+  });
+  if (!empty) return STATUS_DIRECTORY_NOT_EMPTY;
 
   // Here prepare and check if the directory can be deleted
   // or if delete is canceled when dokanfileinfo->DeleteOnClose false
@@ -524,7 +619,7 @@ static NTSTATUS DOKAN_CALLBACK memfs_movefile(LPCWSTR filename,
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
   auto new_filename_str = std::wstring(new_filename);
-  spdlog::info(L"MoveFile: {} to {}", filename_str, new_filename_str);
+  MEMFS_LOG_INFO(L"MoveFile: {} to {}", filename_str, new_filename_str);
   memfs_helper::RemoveStreamType(new_filename_str);
   auto new_stream_names = memfs_helper::GetStreamNames(new_filename_str);
   if (new_stream_names.first.empty()) {
@@ -535,7 +630,7 @@ static NTSTATUS DOKAN_CALLBACK memfs_movefile(LPCWSTR filename,
     new_filename_str = memfs_helper::GetFileName(filename, stream_names) +
                        L":" + new_stream_names.second;
   }
-  spdlog::info(L"MoveFile: after {} to {}", filename_str, new_filename_str);
+  MEMFS_LOG_INFO(L"MoveFile: after {} to {}", filename_str, new_filename_str);
   return filenodes->move(filename_str, new_filename_str, replace_if_existing);
 }
 
@@ -543,8 +638,8 @@ static NTSTATUS DOKAN_CALLBACK memfs_setendoffile(
     LPCWSTR filename, LONGLONG ByteOffset, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"SetEndOfFile: {} ByteOffset {}", filename_str, ByteOffset);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"SetEndOfFile: {} ByteOffset {}", filename_str, ByteOffset);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
   f->set_endoffile(ByteOffset);
@@ -555,8 +650,9 @@ static NTSTATUS DOKAN_CALLBACK memfs_setallocationsize(
     LPCWSTR filename, LONGLONG alloc_size, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"SetAllocationSize: {} AllocSize {}", filename_str, alloc_size);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"SetAllocationSize: {} AllocSize {}", filename_str,
+                 alloc_size);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
   f->set_endoffile(alloc_size);
@@ -567,28 +663,59 @@ static NTSTATUS DOKAN_CALLBACK memfs_lockfile(LPCWSTR filename,
                                               LONGLONG byte_offset,
                                               LONGLONG length,
                                               PDOKAN_FILE_INFO dokanfileinfo) {
+  auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"LockFile: {} ByteOffset {} Length {}", filename_str,
-               byte_offset, length);
-  return STATUS_NOT_IMPLEMENTED;
+  MEMFS_LOG_INFO(L"LockFile: {} ByteOffset {} Length {}", filename_str,
+                 byte_offset, length);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
+
+  auto range_locks = f->get_range_locks(true);
+  if (!range_locks) return STATUS_INSUFFICIENT_RESOURCES;
+  // Dokan does not forward whether the lock requested is shared so they are
+  // all taken exclusive.
+  return DokanLockRange(range_locks, get_lock_owner(dokanfileinfo),
+                        byte_offset, length, TRUE);
 }
 
 static NTSTATUS DOKAN_CALLBACK
 memfs_unlockfile(LPCWSTR filename, LONGLONG byte_offset, LONGLONG length,
                  PDOKAN_FILE_INFO dokanfileinfo) {
+  auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"UnlockFile: {} ByteOffset {} Length {}", filename_str,
-               byte_offset, length);
-  return STATUS_NOT_IMPLEMENTED;
+  MEMFS_LOG_INFO(L"UnlockFile: {} ByteOffset {} Length {}", filename_str,
+                 byte_offset, length);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
+  if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
+
+  auto range_locks = f->get_range_locks(false);
+  if (!range_locks) return STATUS_RANGE_NOT_LOCKED;
+  return DokanUnlockRange(range_locks, get_lock_owner(dokanfileinfo),
+                          byte_offset, length);
 }
 
 static NTSTATUS DOKAN_CALLBACK memfs_getdiskfreespace(
     PULONGLONG free_bytes_available, PULONGLONG total_number_of_bytes,
     PULONGLONG total_number_of_free_bytes, PDOKAN_FILE_INFO dokanfileinfo) {
-  spdlog::info(L"GetDiskFreeSpace");
-  *free_bytes_available = (ULONGLONG)(512 * 1024 * 1024);
-  *total_number_of_bytes = MAXLONGLONG;
-  *total_number_of_free_bytes = MAXLONGLONG;
+  auto filenodes = GET_FS_INSTANCE;
+  MEMFS_LOG_INFO(L"GetDiskFreeSpace");
+  const auto& usage = filenodes->get_memory_usage();
+  ULONGLONG total = usage.capacity();
+  ULONGLONG available = MAXULONGLONG;
+  MEMORYSTATUSEX memory_status;
+  memory_status.dwLength = sizeof(memory_status);
+  if (GlobalMemoryStatusEx(&memory_status)) {
+    // Without capacity the volume is only limited by the memory of the host.
+    if (!total) total = memory_status.ullTotalPhys;
+    available = memory_status.ullAvailPhys;
+  }
+  if (!total) total = MAXLONGLONG;
+  const ULONGLONG used = usage.used();
+  ULONGLONG free_bytes = (total > used) ? total - used : 0;
+  if (free_bytes > available) free_bytes = available;
+  *free_bytes_available = free_bytes;
+  *total_number_of_bytes = total;
+  *total_number_of_free_bytes = free_bytes;
   return STATUS_SUCCESS;
 }
 
@@ -596,14 +723,16 @@ static NTSTATUS DOKAN_CALLBACK memfs_getvolumeinformation(
     LPWSTR volumename_buffer, DWORD volumename_size,
     LPDWORD volume_serialnumber, LPDWORD maximum_component_length,
     LPDWORD filesystem_flags, LPWSTR filesystem_name_buffer,
-    DWORD filesystem_name_size, PDOKAN_FILE_INFO /*dokanfileinfo*/) {
-  spdlog::info(L"GetVolumeInformation");
+    DWORD filesystem_name_size, PDOKAN_FILE_INFO dokanfileinfo) {
+  auto filenodes = GET_FS_INSTANCE;
+  MEMFS_LOG_INFO(L"GetVolumeInformation");
   wcscpy_s(volumename_buffer, volumename_size, L"Dokan MemFS");
   *volume_serialnumber = g_volumserial;
   *maximum_component_length = 255;
-  *filesystem_flags = FILE_CASE_SENSITIVE_SEARCH | FILE_CASE_PRESERVED_NAMES |
-                      FILE_SUPPORTS_REMOTE_STORAGE | FILE_UNICODE_ON_DISK |
-                      FILE_NAMED_STREAMS;
+  *filesystem_flags = FILE_CASE_PRESERVED_NAMES | FILE_SUPPORTS_REMOTE_STORAGE |
+                      FILE_UNICODE_ON_DISK | FILE_NAMED_STREAMS;
+  if (filenodes->is_case_sensitive())
+    *filesystem_flags |= FILE_CASE_SENSITIVE_SEARCH;
 
   wcscpy_s(filesystem_name_buffer, filesystem_name_size, L"NTFS");
   return STATUS_SUCCESS;
@@ -611,13 +740,24 @@ static NTSTATUS DOKAN_CALLBACK memfs_getvolumeinformation(
 
 static NTSTATUS DOKAN_CALLBACK
 memfs_mounted(PDOKAN_FILE_INFO /*dokanfileinfo*/) {
-  spdlog::info(L"Mounted");
+  MEMFS_LOG_INFO(L"Mounted");
   return STATUS_SUCCESS;
 }
 
 static NTSTATUS DOKAN_CALLBACK
-memfs_unmounted(PDOKAN_FILE_INFO /*dokanfileinfo*/) {
-  spdlog::info(L"Unmounted");
+memfs_unmounted(PDOKAN_FILE_INFO dokanfileinfo) {
+  auto filenodes = GET_FS_INSTANCE;
+  const auto& usage = filenodes->get_memory_usage();
+  MEMFS_LOG_INFO(
+      L"Unmounted: {} bytes used, {} chunk bytes, {} chunk allocations, {} "
+      L"chunk frees",
+      usage.used(), usage.chunk_bytes(), usage.chunk_allocations(),
+      usage.chunk_frees());
+  MEMFS_LOG_INFO(
+      L"Unmounted: {} bytes of content compressed in {} bytes, {} "
+      L"compressions, {} decompressions",
+      usage.uncompressed_bytes(), usage.compressed_bytes(),
+      usage.compressions(), usage.decompressions());
   return STATUS_SUCCESS;
 }
 
@@ -627,47 +767,26 @@ static NTSTATUS DOKAN_CALLBACK memfs_getfilesecurity(
     PULONG length_needed, PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"GetFileSecurity: {}", filename_str);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"GetFileSecurity: {}", filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
-  std::lock_guard<std::mutex> lockFile(f->security);
-
-  // This will make dokan library return a default security descriptor
-  if (!f->security.descriptor) return STATUS_NOT_IMPLEMENTED;
-
-  // We have a Security Descriptor but we need to extract only informations
-  // requested 1 - Convert the Security Descriptor to SDDL string with the
-  // informations requested
-  LPTSTR pStringBuffer = NULL;
-  if (!ConvertSecurityDescriptorToStringSecurityDescriptor(
-          f->security.descriptor.get(), SDDL_REVISION_1, *security_information,
-          &pStringBuffer, NULL)) {
-    return STATUS_NOT_IMPLEMENTED;
-  }
-
-  // 2 - Convert the SDDL string back to Security Descriptor
-  PSECURITY_DESCRIPTOR SecurityDescriptorTmp = NULL;
-  ULONG Size = 0;
-  if (!ConvertStringSecurityDescriptorToSecurityDescriptor(
-          pStringBuffer, SDDL_REVISION_1, &SecurityDescriptorTmp, &Size)) {
-    LocalFree(pStringBuffer);
-    return STATUS_NOT_IMPLEMENTED;
+  // The descriptor is immutable, it is replaced and not modified by
+  // SetFileSecurity so we only need the lock to take a reference.
+  std::shared_ptr<const memfs::security_descriptor> descriptor;
+  {
+    std::lock_guard<std::mutex> securityLock(f->security);
+    descriptor = f->security.descriptor;
   }
-  LocalFree(pStringBuffer);
 
-  *length_needed = Size;
-  if (Size > bufferlength) {
-    LocalFree(SecurityDescriptorTmp);
-    return STATUS_BUFFER_OVERFLOW;
-  }
-
-  // 3 - Copy the new SecurityDescriptor to destination
-  memcpy(security_descriptor, SecurityDescriptorTmp, Size);
-  LocalFree(SecurityDescriptorTmp);
+  // This will make dokan library return a default security descriptor
+  if (!descriptor) return STATUS_NOT_IMPLEMENTED;
 
-  return STATUS_SUCCESS;
+  // Only return the informations requested
+  return descriptor->get_information(*security_information,
+                                     security_descriptor, bufferlength,
+                                     length_needed);
 }
 
 static NTSTATUS DOKAN_CALLBACK memfs_setfilesecurity(
@@ -676,15 +795,16 @@ static NTSTATUS DOKAN_CALLBACK memfs_setfilesecurity(
     PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"SetFileSecurity: {}", filename_str);
+  MEMFS_LOG_INFO(L"SetFileSecurity: {}", filename_str);
   static GENERIC_MAPPING memfs_mapping = {FILE_GENERIC_READ, FILE_GENERIC_WRITE,
                                           FILE_GENERIC_EXECUTE,
                                           FILE_ALL_ACCESS};
-  auto f = filenodes->find(filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
   std::lock_guard<std::mutex> securityLock(f->security);
+  if (!f->security.descriptor) return STATUS_NOT_IMPLEMENTED;
 
   // SetPrivateObjectSecurity - ObjectsSecurityDescriptor
   // The memory for the security descriptor must be allocated from the process
@@ -692,11 +812,11 @@ static NTSTATUS DOKAN_CALLBACK memfs_setfilesecurity(
   // https://devblogs.microsoft.com/oldnewthing/20170727-00/?p=96705
   HANDLE pHeap = GetProcessHeap();
   PSECURITY_DESCRIPTOR heapSecurityDescriptor =
-      HeapAlloc(pHeap, 0, f->security.descriptor_size);
+      HeapAlloc(pHeap, 0, f->security.descriptor->size());
   if (!heapSecurityDescriptor) return STATUS_INSUFFICIENT_RESOURCES;
   // Copy our current descriptor into heap memory
-  memcpy(heapSecurityDescriptor, f->security.descriptor.get(),
-         f->security.descriptor_size);
+  memcpy(heapSecurityDescriptor, f->security.descriptor->get(),
+         f->security.descriptor->size());
 
   if (!SetPrivateObjectSecurity(*security_information, security_descriptor,
                                 &heapSecurityDescriptor, &memfs_mapping, 0)) {
@@ -704,7 +824,10 @@ static NTSTATUS DOKAN_CALLBACK memfs_setfilesecurity(
     return DokanNtStatusFromWin32(GetLastError());
   }
 
-  f->security.SetDescriptor(heapSecurityDescriptor);
+  // The shared descriptor is replaced, the other filenodes keep the previous
+  // one.
+  f->security.descriptor =
+      filenodes->intern_security_descriptor(heapSecurityDescriptor);
   HeapFree(pHeap, 0, heapSecurityDescriptor);
 
   return STATUS_SUCCESS;
@@ -715,8 +838,8 @@ memfs_findstreams(LPCWSTR filename, PFillFindStreamData fill_findstreamdata,
                   PDOKAN_FILE_INFO dokanfileinfo) {
   auto filenodes = GET_FS_INSTANCE;
   auto filename_str = std::wstring(filename);
-  spdlog::info(L"FindStreams: {}", filename_str);
-  auto f = filenodes->find(filename_str);
+  MEMFS_LOG_INFO(L"FindStreams: {}", filename_str);
+  auto f = get_filenode(filenodes, filename, dokanfileinfo);
 
   if (!f) return STATUS_OBJECT_NAME_NOT_FOUND;
 
@@ -741,26 +864,24 @@ memfs_findstreams(LPCWSTR filename, PFillFindStreamData fill_findstreamdata,
 
   // Add the alternated stream attached
   // for \foo:bar we need to return in the form of bar:$DATA
-  for (const auto& stream : streams) {
-    auto stream_names = memfs_helper::GetStreamNames(stream.first);
-    if (stream_names.second.length() + memfs_helper::DataStreamNameStr.length() +
-            1 >
+  for (const auto& [stream_key, stream] : streams) {
+    const auto stream_name = stream->get_name();
+    if (stream_name.length() + memfs_helper::DataStreamNameStr.length() + 1 >
         sizeof(stream_data.cStreamName))
       continue;
-    // Copy the filename foo
-    std::copy(stream_names.second.begin(), stream_names.second.end(),
+    // Copy the stream name bar
+    std::copy(stream_name.begin(), stream_name.end(),
               std::begin(stream_data.cStreamName) + 1);
     // Concat :$DATA
-    std::copy(
-        memfs_helper::DataStreamNameStr.begin(),
-        memfs_helper::DataStreamNameStr.end(),
-        std::begin(stream_data.cStreamName) + stream_names.second.length() + 1);
+    std::copy(memfs_helper::DataStreamNameStr.begin(),
+              memfs_helper::DataStreamNameStr.end(),
+              std::begin(stream_data.cStreamName) + stream_name.length() + 1);
     stream_data.cStreamName[0] = ':';
-    stream_data.cStreamName[stream_names.second.length() +
+    stream_data.cStreamName[stream_name.length() +
                             memfs_helper::DataStreamNameStr.length() + 1] = L'\0';
-    stream_data.StreamSize.QuadPart = stream.second->get_filesize();
-    spdlog::info(L"FindStreams: {} StreamName: {} Size: {:x}", filename_str,
-                 stream_names.second, stream_data.StreamSize.QuadPart);
+    stream_data.StreamSize.QuadPart = stream->get_filesize();
+    MEMFS_LOG_INFO(L"FindStreams: {} StreamName: {} Size: {:x}", filename_str,
+                   stream_name, stream_data.StreamSize.QuadPart);
     fill_findstreamdata(&stream_data, dokanfileinfo);
   }
   return STATUS_SUCCESS;
@@ -0,0 +1,116 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef MEMORY_USAGE_H_
+#define MEMORY_USAGE_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace memfs {
+// Memfs volume memory accounting
+// Bytes used by the file content chunks and by the filenodes metadata (names,
+// alternated streams, security descriptors) are tracked with atomic counters
+// so the volume can enforce a capacity and report its real free space.
+// A chunk shared by several files is only counted once.
+// The chunk and compression counters are informative, they can be read while
+// the volume is running to profile the allocations.
+class memory_usage {
+ public:
+  // A capacity of 0 means unlimited.
+  explicit memory_usage(uint64_t capacity = 0) : _capacity(capacity) {}
+
+  memory_usage(const memory_usage&) = delete;
+  memory_usage& operator=(const memory_usage&) = delete;
+
+  uint64_t capacity() const { return _capacity; }
+  uint64_t used() const { return _used; }
+
+  // Account bytes only if they fit in the capacity.
+  bool reserve(uint64_t bytes) {
+    uint64_t used = _used.load(std::memory_order_relaxed);
+    do {
+      if (_capacity && (bytes > _capacity || used > _capacity - bytes))
+        return false;
+    } while (!_used.compare_exchange_weak(used, used + bytes,
+                                          std::memory_order_relaxed));
+    return true;
+  }
+
+  // Account bytes even beyond the capacity, for changes that cannot fail like
+  // a truncation or a rename.
+  void charge(uint64_t bytes) { _used += bytes; }
+
+  void release(uint64_t bytes) { _used -= bytes; }
+
+  // Chunk allocations, counted when the chunk memory is allocated and freed.
+  void count_chunk_allocation(uint64_t bytes) {
+    ++_chunk_allocations;
+    _chunk_bytes += bytes;
+  }
+  void count_chunk_free(uint64_t bytes) {
+    ++_chunk_frees;
+    _chunk_bytes -= bytes;
+  }
+  uint64_t chunk_allocations() const { return _chunk_allocations; }
+  uint64_t chunk_frees() const { return _chunk_frees; }
+  uint64_t chunk_bytes() const { return _chunk_bytes; }
+
+  // Cold chunks compressed, counted when the compressed copy is created and
+  // freed. uncompressed_bytes is the content size of the chunks currently
+  // compressed and compressed_bytes the memory they use.
+  void count_compressed_chunk(uint64_t bytes, uint64_t compressed_bytes) {
+    ++_compressions;
+    _uncompressed_bytes += bytes;
+    _compressed_bytes += compressed_bytes;
+  }
+  void count_compressed_chunk_free(uint64_t bytes, uint64_t compressed_bytes) {
+    _uncompressed_bytes -= bytes;
+    _compressed_bytes -= compressed_bytes;
+  }
+  void count_decompression() { ++_decompressions; }
+  uint64_t compressions() const { return _compressions; }
+  uint64_t decompressions() const { return _decompressions; }
+  uint64_t uncompressed_bytes() const { return _uncompressed_bytes; }
+  uint64_t compressed_bytes() const { return _compressed_bytes; }
+
+ private:
+  const uint64_t _capacity;
+  std::atomic<uint64_t> _used = 0;
+
+  std::atomic<uint64_t> _chunk_allocations = 0;
+  std::atomic<uint64_t> _chunk_frees = 0;
+  std::atomic<uint64_t> _chunk_bytes = 0;
+
+  std::atomic<uint64_t> _compressions = 0;
+  std::atomic<uint64_t> _decompressions = 0;
+  std::atomic<uint64_t> _uncompressed_bytes = 0;
+  std::atomic<uint64_t> _compressed_bytes = 0;
+};
+}  // namespace memfs
+
+#endif  // MEMORY_USAGE_H_
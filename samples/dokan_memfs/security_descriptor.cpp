@@ -0,0 +1,134 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "security_descriptor.h"
+
+#include <vector>
+
+namespace memfs {
+security_descriptor::security_descriptor(PSECURITY_DESCRIPTOR descriptor)
+    : _size(GetSecurityDescriptorLength(descriptor)) {
+  _descriptor = std::make_unique<byte[]>(_size);
+  memcpy(_descriptor.get(), descriptor, _size);
+  _hash = content_hash(_descriptor.get(), _size);
+}
+
+NTSTATUS security_descriptor::get_information(
+    SECURITY_INFORMATION security_information, PSECURITY_DESCRIPTOR buffer,
+    ULONG buffer_length, PULONG length_needed) const {
+  // Build an absolute descriptor pointing into our descriptor with only the
+  // parts requested, MakeSelfRelativeSD then writes it directly in buffer.
+  SECURITY_DESCRIPTOR absolute;
+  if (!InitializeSecurityDescriptor(&absolute, SECURITY_DESCRIPTOR_REVISION))
+    return DokanNtStatusFromWin32(GetLastError());
+
+  PSID sid = nullptr;
+  BOOL defaulted = FALSE;
+  if ((security_information & OWNER_SECURITY_INFORMATION) &&
+      GetSecurityDescriptorOwner(get(), &sid, &defaulted))
+    SetSecurityDescriptorOwner(&absolute, sid, defaulted);
+  if ((security_information & GROUP_SECURITY_INFORMATION) &&
+      GetSecurityDescriptorGroup(get(), &sid, &defaulted))
+    SetSecurityDescriptorGroup(&absolute, sid, defaulted);
+
+  SECURITY_DESCRIPTOR_CONTROL control = 0;
+  DWORD revision;
+  GetSecurityDescriptorControl(get(), &control, &revision);
+
+  PACL acl = nullptr;
+  BOOL present = FALSE;
+  if ((security_information & DACL_SECURITY_INFORMATION) &&
+      GetSecurityDescriptorDacl(get(), &present, &acl, &defaulted) &&
+      present) {
+    SetSecurityDescriptorDacl(&absolute, TRUE, acl, defaulted);
+    SetSecurityDescriptorControl(
+        &absolute,
+        SE_DACL_AUTO_INHERIT_REQ | SE_DACL_AUTO_INHERITED | SE_DACL_PROTECTED,
+        control & (SE_DACL_AUTO_INHERIT_REQ | SE_DACL_AUTO_INHERITED |
+                   SE_DACL_PROTECTED));
+  }
+
+  // The mandatory label is stored in the SACL. When only the label is
+  // requested, the other SACL entries are filtered out.
+  std::vector<byte> label_acl;
+  if ((security_information &
+       (SACL_SECURITY_INFORMATION | LABEL_SECURITY_INFORMATION)) &&
+      GetSecurityDescriptorSacl(get(), &present, &acl, &defaulted) &&
+      present) {
+    if (!(security_information & SACL_SECURITY_INFORMATION) && acl) {
+      label_acl.resize(acl->AclSize);
+      auto filtered = reinterpret_cast<PACL>(label_acl.data());
+      InitializeAcl(filtered, acl->AclSize, acl->AclRevision);
+      for (DWORD i = 0; i < acl->AceCount; ++i) {
+        PACE_HEADER ace;
+        if (GetAce(acl, i, reinterpret_cast<LPVOID*>(&ace)) &&
+            ace->AceType == SYSTEM_MANDATORY_LABEL_ACE_TYPE)
+          AddAce(filtered, acl->AclRevision, MAXDWORD, ace, ace->AceSize);
+      }
+      acl = filtered;
+    }
+    SetSecurityDescriptorSacl(&absolute, TRUE, acl, defaulted);
+    SetSecurityDescriptorControl(
+        &absolute,
+        SE_SACL_AUTO_INHERIT_REQ | SE_SACL_AUTO_INHERITED | SE_SACL_PROTECTED,
+        control & (SE_SACL_AUTO_INHERIT_REQ | SE_SACL_AUTO_INHERITED |
+                   SE_SACL_PROTECTED));
+  }
+
+  DWORD size = buffer_length;
+  if (!MakeSelfRelativeSD(&absolute, buffer, &size)) {
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+      return DokanNtStatusFromWin32(GetLastError());
+    *length_needed = size;
+    return STATUS_BUFFER_OVERFLOW;
+  }
+  *length_needed = GetSecurityDescriptorLength(buffer);
+  return STATUS_SUCCESS;
+}
+
+std::shared_ptr<const security_descriptor> security_descriptor_pool::intern(
+    PSECURITY_DESCRIPTOR descriptor) {
+  const DWORD size = GetSecurityDescriptorLength(descriptor);
+  return _descriptors.intern(
+      content_hash(descriptor, size),
+      [&](const std::shared_ptr<const security_descriptor>& pooled) {
+        return pooled->size() == size &&
+               !memcmp(pooled->get(), descriptor, size);
+      },
+      [&] {
+        // The descriptor memory is accounted until the last filenode using
+        // it is released.
+        _usage->charge(size);
+        return std::shared_ptr<const security_descriptor>(
+            new security_descriptor(descriptor),
+            [usage = _usage](const security_descriptor* descriptor) {
+              usage->release(descriptor->size());
+              delete descriptor;
+            });
+      });
+}
+}  // namespace memfs
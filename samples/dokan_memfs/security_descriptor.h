@@ -0,0 +1,86 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2019 Adrien J. <liryna.stark@gmail.com>
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef SECURITY_DESCRIPTOR_H_
+#define SECURITY_DESCRIPTOR_H_
+
+#include <dokan/dokan.h>
+
+#include "intern_pool.h"
+#include "memory_usage.h"
+
+#include <WinBase.h>
+#include <memory>
+
+namespace memfs {
+// Immutable copy of a self-relative security descriptor.
+// Filenodes with the same descriptor share a single instance interned by
+// security_descriptor_pool.
+class security_descriptor {
+ public:
+  explicit security_descriptor(PSECURITY_DESCRIPTOR descriptor);
+
+  security_descriptor(const security_descriptor&) = delete;
+  security_descriptor& operator=(const security_descriptor&) = delete;
+
+  PSECURITY_DESCRIPTOR get() const { return _descriptor.get(); }
+  DWORD size() const { return _size; }
+  uint64_t hash() const { return _hash; }
+
+  // Write into buffer the self-relative descriptor holding only the parts
+  // requested by security_information. The parts are taken directly from the
+  // binary descriptor. Return STATUS_BUFFER_OVERFLOW with length_needed set
+  // when buffer is too small.
+  NTSTATUS get_information(SECURITY_INFORMATION security_information,
+                           PSECURITY_DESCRIPTOR buffer, ULONG buffer_length,
+                           PULONG length_needed) const;
+
+ private:
+  std::unique_ptr<byte[]> _descriptor;
+  DWORD _size;
+  uint64_t _hash;
+};
+
+// Refcounted pool of the security descriptors indexed by content.
+// A descriptor is released with the last filenode using it, see intern_pool,
+// and its size is accounted in the memory_usage meanwhile.
+class security_descriptor_pool {
+ public:
+  explicit security_descriptor_pool(std::shared_ptr<memory_usage> usage)
+      : _usage(std::move(usage)) {}
+
+  // Return the descriptor of the pool equal to descriptor, added if missing.
+  std::shared_ptr<const security_descriptor> intern(
+      PSECURITY_DESCRIPTOR descriptor);
+
+ private:
+  intern_pool<const security_descriptor> _descriptors;
+  std::shared_ptr<memory_usage> _usage;
+};
+}  // namespace memfs
+
+#endif  // SECURITY_DESCRIPTOR_H_
@@ -0,0 +1,180 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Throughput of memfs lookups and reads run from several threads at once,
+// with and without a thread modifying the volume at the same time. Every result is
+// checked so the benchmark also catches races.
+//
+//   concurrency_benchmark [seconds_per_run] [max_threads]
+
+#include "../filenodes.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace memfs;
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+double seconds_per_run = 1;
+size_t max_threads = 8;
+
+// Run operation on each of threads threads for seconds_per_run, with
+// background running on its own thread meanwhile when given. Return the
+// number of operations per second of all threads.
+double run(size_t threads, const std::function<void(size_t, uint64_t)>& operation,
+           const std::function<void(uint64_t)>& background = nullptr) {
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> total{0};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed)) operation(t, count++);
+      total += count;
+    });
+  }
+  std::thread background_thread;
+  if (background) {
+    background_thread = std::thread([&] {
+      for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); ++i)
+        background(i);
+    });
+  }
+  const auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds_per_run));
+  stop = true;
+  for (auto& worker : workers) worker.join();
+  if (background_thread.joinable()) background_thread.join();
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return total / elapsed.count();
+}
+
+// Lookups of existing files spread over a hierarchy, while a thread renames
+// files of another directory back and forth.
+void benchmark_find() {
+  const size_t directories = 100;
+  const size_t files_per_directory = 100;
+  fs_filenodes filenodes(false, false, 0);
+  std::vector<std::wstring> paths;
+  std::vector<std::shared_ptr<filenode>> nodes;
+  for (size_t d = 0; d < directories; ++d) {
+    const std::wstring directory = L"\\directory" + std::to_wstring(d);
+    CHECK(filenodes.add(directory, std::make_shared<filenode>(
+                                       directory, true,
+                                       FILE_ATTRIBUTE_DIRECTORY, nullptr)) ==
+          STATUS_SUCCESS);
+    for (size_t f = 0; f < files_per_directory; ++f) {
+      const std::wstring path = directory + L"\\file" + std::to_wstring(f);
+      nodes.push_back(std::make_shared<filenode>(path, false, 0, nullptr));
+      CHECK(filenodes.add(path, nodes.back()) == STATUS_SUCCESS);
+      paths.push_back(path);
+    }
+  }
+  CHECK(filenodes.add(L"\\moving", std::make_shared<filenode>(
+                                       L"\\moving", true,
+                                       FILE_ATTRIBUTE_DIRECTORY, nullptr)) ==
+        STATUS_SUCCESS);
+  CHECK(filenodes.add(L"\\moving\\a", std::make_shared<filenode>(
+                                          L"\\moving\\a", false, 0,
+                                          nullptr)) == STATUS_SUCCESS);
+
+  auto lookup = [&](size_t thread, uint64_t i) {
+    // Threads walk the paths with different strides to not share a cache
+    // line pattern.
+    const size_t index = (thread * 7919 + i * (2 * thread + 1)) % paths.size();
+    CHECK(filenodes.find(paths[index]) == nodes[index]);
+  };
+  bool moved = false;
+  auto rename = [&](uint64_t) {
+    CHECK(filenodes.move(moved ? L"\\moving\\b" : L"\\moving\\a",
+                         moved ? L"\\moving\\a" : L"\\moving\\b",
+                         FALSE) == STATUS_SUCCESS);
+    moved = !moved;
+  };
+
+  printf("find, %zu files\n", paths.size());
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf("  %2zu threads: %12.0f lookups/s, %12.0f with a rename loop\n",
+           threads, run(threads, lookup), run(threads, lookup, rename));
+  }
+}
+
+// Reads of one file from all threads, while a thread rewrites the file with
+// the same content and another one queries its streams.
+void benchmark_read() {
+  const DWORD file_size = 4 * 1024 * 1024;
+  const DWORD read_size = 4096;
+  fs_filenodes filenodes(false, false, 0);
+  auto file = std::make_shared<filenode>(L"\\file", false, 0, nullptr);
+  CHECK(filenodes.add(L"\\file", file) == STATUS_SUCCESS);
+  std::vector<uint8_t> content(file_size);
+  for (DWORD i = 0; i < file_size; ++i) content[i] = static_cast<uint8_t>(i % 251);
+  CHECK(file->write(content.data(), file_size, 0) == file_size);
+
+  auto read = [&](size_t thread, uint64_t i) {
+    thread_local std::vector<uint8_t> buffer(read_size);
+    const LONGLONG offset =
+        ((thread * 7919 + i * 104729) % (file_size / read_size)) * read_size;
+    CHECK(file->read(buffer.data(), read_size, offset) == read_size);
+    CHECK(buffer[0] == content[offset] &&
+          buffer[read_size - 1] == content[offset + read_size - 1]);
+  };
+  auto rewrite = [&](uint64_t i) {
+    const LONGLONG offset = (i * 7919 % (file_size / read_size)) * read_size;
+    CHECK(file->write(content.data() + offset, read_size, offset) ==
+          read_size);
+    CHECK(file->get_filesize() == file_size);
+    file->get_streams();
+  };
+
+  printf("read of %u bytes in a %u bytes file\n", read_size, file_size);
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    printf("  %2zu threads: %12.0f reads/s, %12.0f with a write loop\n",
+           threads, run(threads, read), run(threads, read, rewrite));
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) seconds_per_run = strtod(argv[1], nullptr);
+  if (argc > 2) max_threads = strtoul(argv[2], nullptr, 10);
+  printf("%u hardware threads\n", std::thread::hardware_concurrency());
+  benchmark_find();
+  benchmark_read();
+  return 0;
+}
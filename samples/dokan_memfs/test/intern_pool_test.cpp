@@ -0,0 +1,109 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// intern_pool, shared by the chunk and security descriptor pools: equal
+// contents are shared, colliding hashes are told apart by their content and
+// values leave the pool with their last user.
+
+#include "../filedata.h"
+#include "../intern_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace memfs;
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+std::shared_ptr<const std::string> intern(intern_pool<const std::string>& pool,
+                                          const std::string& value,
+                                          uint64_t hash) {
+  return pool.intern(
+      hash, [&](const std::shared_ptr<const std::string>& pooled) {
+        return *pooled == value;
+      },
+      [&] { return std::make_shared<const std::string>(value); });
+}
+
+void test_content_hash() {
+  const std::string text = "0123456789abcdefXYZ";
+  // The tail after the last whole word is hashed too.
+  CHECK(content_hash(text.data(), text.size()) !=
+        content_hash(text.data(), text.size() - 1));
+  CHECK(content_hash(text.data(), 16) != content_hash(text.data(), 8));
+  CHECK(content_hash(text.data(), text.size()) ==
+        content_hash(std::string(text).data(), text.size()));
+}
+
+void test_collisions_and_release() {
+  intern_pool<const std::string> pool;
+  auto a = intern(pool, "a", 1);
+  CHECK(intern(pool, "a", 1) == a);
+  // Same hash, other content.
+  auto b = intern(pool, "b", 1);
+  CHECK(b != a && *b == "b");
+  CHECK(intern(pool, "b", 1) == b);
+
+  std::weak_ptr<const std::string> released = a;
+  a.reset();
+  CHECK(released.expired());
+  auto again = intern(pool, "a", 1);
+  CHECK(*again == "a" && intern(pool, "a", 1) == again);
+
+  // Expired entries of hashes never seen again are swept as the pool grows.
+  for (uint64_t f = 0; f < 10000; ++f) intern(pool, std::to_string(f), f + 2);
+  CHECK(intern(pool, "b", 1) == b);
+}
+
+void test_chunk_pool() {
+  chunk_pool pool;
+  std::shared_ptr<uint8_t[]> first(new uint8_t[filedata::chunk_size]());
+  std::shared_ptr<uint8_t[]> second(new uint8_t[filedata::chunk_size]());
+  std::shared_ptr<uint8_t[]> other(new uint8_t[filedata::chunk_size]());
+  other[100] = 1;
+  CHECK(pool.intern(first) == first);
+  CHECK(pool.intern(first) == first);
+  CHECK(pool.deduplicated_chunks() == 0);
+  CHECK(pool.intern(second) == first);
+  CHECK(pool.deduplicated_chunks() == 1);
+  CHECK(pool.intern(other) == other);
+  CHECK(pool.deduplicated_chunks() == 1);
+}
+
+}  // namespace
+
+int main() {
+  test_content_hash();
+  test_collisions_and_release();
+  test_chunk_pool();
+  printf("intern_pool_test passed\n");
+  return 0;
+}
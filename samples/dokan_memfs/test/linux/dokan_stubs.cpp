@@ -0,0 +1,90 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// dokan.dll exports used by memfs. Only the part of their behavior memfs
+// relies on is implemented.
+
+#include <dokan/dokan.h>
+
+void DOKANAPI DokanMapKernelToUserCreateFileFlags(
+    ACCESS_MASK DesiredAccess, ULONG FileAttributes, ULONG CreateOptions,
+    ULONG CreateDisposition, ACCESS_MASK* outDesiredAccess,
+    DWORD* outFileAttributesAndFlags, DWORD* outCreationDisposition) {
+  if (outFileAttributesAndFlags) {
+    *outFileAttributesAndFlags = FileAttributes;
+    if (CreateOptions & FILE_DELETE_ON_CLOSE)
+      *outFileAttributesAndFlags |= FILE_FLAG_DELETE_ON_CLOSE;
+  }
+
+  if (outCreationDisposition) {
+    switch (CreateDisposition) {
+      case FILE_CREATE:
+        *outCreationDisposition = CREATE_NEW;
+        break;
+      case FILE_OPEN:
+        *outCreationDisposition = OPEN_EXISTING;
+        break;
+      case FILE_OPEN_IF:
+        *outCreationDisposition = OPEN_ALWAYS;
+        break;
+      case FILE_OVERWRITE:
+        *outCreationDisposition = TRUNCATE_EXISTING;
+        break;
+      case FILE_SUPERSEDE:
+      case FILE_OVERWRITE_IF:
+        *outCreationDisposition = CREATE_ALWAYS;
+        break;
+      default:
+        *outCreationDisposition = 0;
+        break;
+    }
+  }
+
+  if (outDesiredAccess) *outDesiredAccess = DesiredAccess;
+}
+
+NTSTATUS DOKANAPI DokanNtStatusFromWin32(DWORD Error) {
+  return Error == ERROR_INSUFFICIENT_BUFFER ? STATUS_BUFFER_OVERFLOW
+                                            : STATUS_ACCESS_DENIED;
+}
+
+// Byte range locks are not exercised by the tests, files simply never get a
+// lock table.
+
+PDOKAN_RANGE_LOCKS DOKANAPI DokanCreateRangeLocks() { return NULL; }
+
+VOID DOKANAPI DokanDeleteRangeLocks(PDOKAN_RANGE_LOCKS) {}
+
+NTSTATUS DOKANAPI DokanLockRange(PDOKAN_RANGE_LOCKS, PVOID, LONGLONG,
+                                 LONGLONG, BOOL) {
+  return STATUS_NOT_IMPLEMENTED;
+}
+
+NTSTATUS DOKANAPI DokanUnlockRange(PDOKAN_RANGE_LOCKS, PVOID, LONGLONG,
+                                   LONGLONG) {
+  return STATUS_RANGE_NOT_LOCKED;
+}
+
+VOID DOKANAPI DokanUnlockAllRanges(PDOKAN_RANGE_LOCKS, PVOID) {}
+
+BOOL DOKANAPI DokanCheckRangeAccess(PDOKAN_RANGE_LOCKS, PVOID, LONGLONG,
+                                    LONGLONG, BOOL) {
+  return TRUE;
+}
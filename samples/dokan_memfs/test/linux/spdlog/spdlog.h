@@ -0,0 +1,39 @@
+// Silent stand-in for the spdlog submodule, see CMakeLists.txt.
+
+#ifndef MEMFS_TEST_SPDLOG_H_
+#define MEMFS_TEST_SPDLOG_H_
+
+#define SPDLOG_LEVEL_DEBUG 1
+#define SPDLOG_LEVEL_INFO 2
+#define SPDLOG_LEVEL_WARN 3
+
+#ifndef SPDLOG_ACTIVE_LEVEL
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#endif
+
+namespace spdlog {
+namespace level {
+enum level_enum { debug, info, warn, err };
+}  // namespace level
+
+class logger {
+ public:
+  bool should_log(level::level_enum) const { return false; }
+  template <class... Args>
+  void log(level::level_enum, const Args&...) {}
+};
+
+inline logger* default_logger_raw() {
+  static logger default_logger;
+  return &default_logger;
+}
+
+template <class... Args>
+void info(const Args&...) {}
+template <class... Args>
+void warn(const Args&...) {}
+template <class... Args>
+void error(const Args&...) {}
+}  // namespace spdlog
+
+#endif  // MEMFS_TEST_SPDLOG_H_
@@ -0,0 +1,327 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Linux implementation of the Win32 functions memfs uses, declared in the
+// shared test/linux/windows.h.
+//
+// Security descriptors are opaque to memfs: they are stored as a DWORD size
+// followed by the SDDL string they were made from, so the size can be read
+// back and descriptors compared byte wise. Files and mappings map onto POSIX
+// descriptors, which is all the image loader needs.
+
+#include <windows.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ctime>
+#include <map>
+#include <mutex>
+
+namespace {
+
+thread_local DWORD last_error = 0;
+
+// Token and process handles are never dereferenced, they only need to be
+// told apart from file descriptors by CloseHandle.
+char process_handle;
+char token_handle;
+
+// File and mapping handles are the POSIX descriptor plus one so that 0 is
+// never a valid handle.
+HANDLE to_handle(int fd) { return reinterpret_cast<HANDLE>(fd + 1LL); }
+int to_fd(HANDLE h) { return static_cast<int>(reinterpret_cast<LONG_PTR>(h) - 1); }
+
+std::mutex views_mutex;
+std::map<LPCVOID, size_t> views;
+
+PSECURITY_DESCRIPTOR make_descriptor(const wchar_t* sddl) {
+  const DWORD size =
+      static_cast<DWORD>(sizeof(DWORD) + (wcslen(sddl) + 1) * sizeof(wchar_t));
+  auto descriptor = static_cast<BYTE*>(malloc(size));
+  memcpy(descriptor, &size, sizeof(size));
+  memcpy(descriptor + sizeof(size), sddl, size - sizeof(size));
+  return descriptor;
+}
+
+}  // namespace
+
+DWORD GetLastError() { return last_error; }
+
+void GetSystemTimeAsFileTime(LPFILETIME lpSystemTimeAsFileTime) {
+  // 100ns intervals between 1601-01-01 and 1970-01-01.
+  const ULONGLONG epoch_offset = 116444736000000000ULL;
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  ULONGLONG t = epoch_offset + now.tv_sec * 10000000ULL + now.tv_nsec / 100;
+  lpSystemTimeAsFileTime->dwLowDateTime = static_cast<DWORD>(t);
+  lpSystemTimeAsFileTime->dwHighDateTime = static_cast<DWORD>(t >> 32);
+}
+
+BOOL GlobalMemoryStatusEx(LPMEMORYSTATUSEX lpBuffer) {
+  const ULONGLONG page = sysconf(_SC_PAGESIZE);
+  lpBuffer->ullTotalPhys = page * sysconf(_SC_PHYS_PAGES);
+  lpBuffer->ullAvailPhys = page * sysconf(_SC_AVPHYS_PAGES);
+  return TRUE;
+}
+
+HANDLE GetProcessHeap() { return &process_handle; }
+
+LPVOID HeapAlloc(HANDLE, DWORD dwFlags, SIZE_T dwBytes) {
+  return (dwFlags & HEAP_ZERO_MEMORY) ? calloc(1, dwBytes) : malloc(dwBytes);
+}
+
+BOOL HeapFree(HANDLE, DWORD, LPVOID lpMem) {
+  free(lpMem);
+  return TRUE;
+}
+
+void* LocalFree(void* hMem) {
+  free(hMem);
+  return nullptr;
+}
+
+BOOL CloseHandle(HANDLE hObject) {
+  if (hObject == &process_handle || hObject == &token_handle) return TRUE;
+  return close(to_fd(hObject)) == 0;
+}
+
+HANDLE CreateFile(LPCWSTR lpFileName, DWORD, DWORD, void*, DWORD, DWORD,
+                  HANDLE) {
+  std::string path;
+  for (; *lpFileName; ++lpFileName) path += static_cast<char>(*lpFileName);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return INVALID_HANDLE_VALUE;
+  return to_handle(fd);
+}
+
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize) {
+  struct stat st;
+  if (fstat(to_fd(hFile), &st) != 0) return FALSE;
+  lpFileSize->QuadPart = st.st_size;
+  return TRUE;
+}
+
+HANDLE CreateFileMapping(HANDLE hFile, void*, DWORD, DWORD, DWORD, LPCWSTR) {
+  int fd = dup(to_fd(hFile));
+  return fd < 0 ? nullptr : to_handle(fd);
+}
+
+LPVOID MapViewOfFile(HANDLE hFileMappingObject, DWORD, DWORD, DWORD, SIZE_T) {
+  struct stat st;
+  int fd = to_fd(hFileMappingObject);
+  if (fstat(fd, &st) != 0) return nullptr;
+  void* view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (view == MAP_FAILED) return nullptr;
+  std::lock_guard<std::mutex> lock(views_mutex);
+  views[view] = st.st_size;
+  return view;
+}
+
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress) {
+  std::lock_guard<std::mutex> lock(views_mutex);
+  auto view = views.find(lpBaseAddress);
+  if (view == views.end()) return FALSE;
+  munmap(const_cast<void*>(lpBaseAddress), view->second);
+  views.erase(view);
+  return TRUE;
+}
+
+HANDLE GetCurrentProcess() { return &process_handle; }
+
+BOOL OpenProcessToken(HANDLE, DWORD, HANDLE* TokenHandle) {
+  *TokenHandle = &token_handle;
+  return TRUE;
+}
+
+BOOL GetTokenInformation(HANDLE, TOKEN_INFORMATION_CLASS TokenInformationClass,
+                         LPVOID TokenInformation, DWORD, PDWORD ReturnLength) {
+  if (TokenInformationClass == TokenUser) {
+    auto user = static_cast<PTOKEN_USER>(TokenInformation);
+    user->User.Sid = &token_handle;
+    user->User.Attributes = 0;
+    *ReturnLength = sizeof(TOKEN_USER);
+  } else {
+    auto groups = static_cast<PTOKEN_GROUPS>(TokenInformation);
+    groups->GroupCount = 0;
+    *ReturnLength = sizeof(TOKEN_GROUPS);
+  }
+  return TRUE;
+}
+
+BOOL ConvertSidToStringSid(PSID, LPWSTR* StringSid) {
+  *StringSid = wcsdup(L"S-1-5-21-1000");
+  return TRUE;
+}
+
+BOOL ConvertStringSecurityDescriptorToSecurityDescriptor(
+    LPCWSTR StringSecurityDescriptor, DWORD,
+    PSECURITY_DESCRIPTOR* SecurityDescriptor,
+    PULONG SecurityDescriptorSize) {
+  *SecurityDescriptor = make_descriptor(StringSecurityDescriptor);
+  if (SecurityDescriptorSize)
+    *SecurityDescriptorSize = GetSecurityDescriptorLength(*SecurityDescriptor);
+  return TRUE;
+}
+
+BOOL ConvertSecurityDescriptorToStringSecurityDescriptor(
+    PSECURITY_DESCRIPTOR SecurityDescriptor, DWORD, SECURITY_INFORMATION,
+    LPWSTR* StringSecurityDescriptor, PULONG StringSecurityDescriptorLen) {
+  auto sddl = reinterpret_cast<const wchar_t*>(
+      static_cast<BYTE*>(SecurityDescriptor) + sizeof(DWORD));
+  *StringSecurityDescriptor = wcsdup(sddl);
+  if (StringSecurityDescriptorLen)
+    *StringSecurityDescriptorLen = static_cast<ULONG>(wcslen(sddl) + 1);
+  return TRUE;
+}
+
+BOOL SetPrivateObjectSecurity(SECURITY_INFORMATION,
+                              PSECURITY_DESCRIPTOR ModificationDescriptor,
+                              PSECURITY_DESCRIPTOR* ObjectsSecurityDescriptor,
+                              PGENERIC_MAPPING, HANDLE) {
+  const DWORD size = GetSecurityDescriptorLength(ModificationDescriptor);
+  auto descriptor = HeapAlloc(GetProcessHeap(), 0, size);
+  memcpy(descriptor, ModificationDescriptor, size);
+  HeapFree(GetProcessHeap(), 0, *ObjectsSecurityDescriptor);
+  *ObjectsSecurityDescriptor = descriptor;
+  return TRUE;
+}
+
+BOOL IsValidSecurityDescriptor(PSECURITY_DESCRIPTOR pSecurityDescriptor) {
+  return pSecurityDescriptor != nullptr &&
+         GetSecurityDescriptorLength(pSecurityDescriptor) > sizeof(DWORD);
+}
+
+DWORD GetSecurityDescriptorLength(PSECURITY_DESCRIPTOR pSecurityDescriptor) {
+  DWORD size;
+  memcpy(&size, pSecurityDescriptor, sizeof(size));
+  return size;
+}
+
+BOOL InitializeSecurityDescriptor(SECURITY_DESCRIPTOR* pSecurityDescriptor,
+                                  DWORD dwRevision) {
+  memset(pSecurityDescriptor, 0, sizeof(*pSecurityDescriptor));
+  pSecurityDescriptor->Revision = static_cast<BYTE>(dwRevision);
+  return TRUE;
+}
+
+// The descriptors built from SDDL carry no owner, group or ACL for memfs to
+// filter, so the absolute descriptor it rebuilds is always empty.
+
+BOOL GetSecurityDescriptorOwner(PSECURITY_DESCRIPTOR, PSID* pOwner,
+                                PBOOL lpbOwnerDefaulted) {
+  *pOwner = nullptr;
+  *lpbOwnerDefaulted = FALSE;
+  return TRUE;
+}
+
+BOOL GetSecurityDescriptorGroup(PSECURITY_DESCRIPTOR, PSID* pGroup,
+                                PBOOL lpbGroupDefaulted) {
+  *pGroup = nullptr;
+  *lpbGroupDefaulted = FALSE;
+  return TRUE;
+}
+
+BOOL GetSecurityDescriptorDacl(PSECURITY_DESCRIPTOR, PBOOL lpbDaclPresent,
+                               PACL* pDacl, PBOOL lpbDaclDefaulted) {
+  *lpbDaclPresent = FALSE;
+  *pDacl = nullptr;
+  *lpbDaclDefaulted = FALSE;
+  return TRUE;
+}
+
+BOOL GetSecurityDescriptorSacl(PSECURITY_DESCRIPTOR, PBOOL lpbSaclPresent,
+                               PACL* pSacl, PBOOL lpbSaclDefaulted) {
+  *lpbSaclPresent = FALSE;
+  *pSacl = nullptr;
+  *lpbSaclDefaulted = FALSE;
+  return TRUE;
+}
+
+BOOL GetSecurityDescriptorControl(PSECURITY_DESCRIPTOR,
+                                  PSECURITY_DESCRIPTOR_CONTROL pControl,
+                                  LPDWORD lpdwRevision) {
+  *pControl = 0;
+  *lpdwRevision = SECURITY_DESCRIPTOR_REVISION;
+  return TRUE;
+}
+
+BOOL SetSecurityDescriptorOwner(SECURITY_DESCRIPTOR* pSecurityDescriptor,
+                                PSID pOwner, BOOL) {
+  pSecurityDescriptor->Owner = pOwner;
+  return TRUE;
+}
+
+BOOL SetSecurityDescriptorGroup(SECURITY_DESCRIPTOR* pSecurityDescriptor,
+                                PSID pGroup, BOOL) {
+  pSecurityDescriptor->Group = pGroup;
+  return TRUE;
+}
+
+BOOL SetSecurityDescriptorDacl(SECURITY_DESCRIPTOR* pSecurityDescriptor,
+                               BOOL, PACL pDacl, BOOL) {
+  pSecurityDescriptor->Dacl = pDacl;
+  return TRUE;
+}
+
+BOOL SetSecurityDescriptorSacl(SECURITY_DESCRIPTOR* pSecurityDescriptor,
+                               BOOL, PACL pSacl, BOOL) {
+  pSecurityDescriptor->Sacl = pSacl;
+  return TRUE;
+}
+
+BOOL SetSecurityDescriptorControl(SECURITY_DESCRIPTOR* pSecurityDescriptor,
+                                  SECURITY_DESCRIPTOR_CONTROL
+                                      ControlBitsOfInterest,
+                                  SECURITY_DESCRIPTOR_CONTROL ControlBitsToSet) {
+  pSecurityDescriptor->Control =
+      (pSecurityDescriptor->Control & ~ControlBitsOfInterest) |
+      (ControlBitsToSet & ControlBitsOfInterest);
+  return TRUE;
+}
+
+BOOL MakeSelfRelativeSD(SECURITY_DESCRIPTOR*,
+                        PSECURITY_DESCRIPTOR pSelfRelativeSecurityDescriptor,
+                        LPDWORD lpdwBufferLength) {
+  static const wchar_t empty[] = L"";
+  const DWORD size = sizeof(DWORD) + sizeof(empty);
+  if (*lpdwBufferLength < size) {
+    *lpdwBufferLength = size;
+    last_error = ERROR_INSUFFICIENT_BUFFER;
+    return FALSE;
+  }
+  memcpy(pSelfRelativeSecurityDescriptor, &size, sizeof(size));
+  memcpy(static_cast<BYTE*>(pSelfRelativeSecurityDescriptor) + sizeof(size),
+         empty, sizeof(empty));
+  return TRUE;
+}
+
+BOOL InitializeAcl(PACL pAcl, DWORD nAclLength, DWORD dwAclRevision) {
+  memset(pAcl, 0, sizeof(*pAcl));
+  pAcl->AclRevision = static_cast<BYTE>(dwAclRevision);
+  pAcl->AclSize = static_cast<WORD>(nAclLength);
+  return TRUE;
+}
+
+BOOL GetAce(PACL, DWORD, LPVOID*) { return FALSE; }
+
+BOOL AddAce(PACL, DWORD, DWORD, LPVOID, DWORD) { return FALSE; }
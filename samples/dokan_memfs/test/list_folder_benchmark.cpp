@@ -0,0 +1,136 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Time and count the allocations of listing a directory of 1k to 1M entries,
+// directly with fs_filenodes::list_folder and through FindFiles like Dokan
+// does. Listing must not allocate per entry.
+//
+//   list_folder_benchmark [max_entries] [max_allocations_per_entry]
+//
+// With max_allocations_per_entry the run fails when a listing allocates more,
+// which is how ctest runs it.
+
+#include "../memfs_operations.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+using namespace memfs;
+
+namespace {
+std::atomic<size_t> allocations{0};
+}  // namespace
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+size_t listed = 0;
+
+int WINAPI fill_finddata(PWIN32_FIND_DATAW find_data, PDOKAN_FILE_INFO) {
+  listed += find_data->cFileName[0] != L'\0';
+  return 0;
+}
+
+struct measure {
+  double ns_per_entry;
+  double allocations_per_entry;
+};
+
+template <typename F>
+measure run(size_t entries, F listing) {
+  listed = 0;
+  const size_t allocations_before = allocations.load();
+  const auto start = std::chrono::steady_clock::now();
+  listing();
+  const auto end = std::chrono::steady_clock::now();
+  const size_t allocated = allocations.load() - allocations_before;
+  if (listed != entries) {
+    fprintf(stderr, "listed %zu entries out of %zu\n", listed, entries);
+    exit(1);
+  }
+  return {std::chrono::duration<double, std::nano>(end - start).count() /
+              entries,
+          static_cast<double>(allocated) / entries};
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const size_t max_entries = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+  const double max_allocations = argc > 2 ? strtod(argv[2], nullptr) : -1;
+
+  for (size_t entries = 1000; entries <= max_entries; entries *= 10) {
+    fs_filenodes filenodes(false, false, 0);
+    DOKAN_OPTIONS options;
+    ZeroMemory(&options, sizeof(options));
+    options.GlobalContext = reinterpret_cast<ULONG64>(&filenodes);
+    DOKAN_FILE_INFO info;
+    ZeroMemory(&info, sizeof(info));
+    info.DokanOptions = &options;
+
+    const std::wstring directory = L"\\directory";
+    filenodes.add(directory, std::make_shared<filenode>(
+                                 directory, true, FILE_ATTRIBUTE_DIRECTORY,
+                                 nullptr));
+    for (size_t i = 0; i < entries; ++i) {
+      const std::wstring filename =
+          directory + L"\\file_with_a_longer_name_" + std::to_wstring(i);
+      filenodes.add(filename,
+                    std::make_shared<filenode>(filename, false, 0, nullptr));
+    }
+
+    const measure direct = run(entries, [&] {
+      filenodes.list_folder(directory, std::wstring(),
+                            [&](const auto&, auto name) {
+                              listed += !name.empty();
+                              return true;
+                            });
+    });
+    const measure find_files = run(entries, [&] {
+      memfs_operations.FindFiles(directory.c_str(), fill_finddata, &info);
+    });
+
+    printf(
+        "%8zu entries: list_folder %6.1f ns/entry %5.3f allocs/entry | "
+        "FindFiles %6.1f ns/entry %5.3f allocs/entry\n",
+        entries, direct.ns_per_entry, direct.allocations_per_entry,
+        find_files.ns_per_entry, find_files.allocations_per_entry);
+    if (max_allocations >= 0 &&
+        (direct.allocations_per_entry > max_allocations ||
+         find_files.allocations_per_entry > max_allocations)) {
+      fprintf(stderr, "more than %g allocations per entry\n",
+              max_allocations);
+      return 1;
+    }
+  }
+  return 0;
+}
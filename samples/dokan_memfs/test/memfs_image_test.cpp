@@ -0,0 +1,319 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Round trip of memfs images and rejection of corrupted ones. memfs_image
+// only depends on the standard library so this test does not need the Win32
+// surface of linux/.
+
+#include "../memfs_image.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+using namespace memfs;
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+const uint32_t chunk_size = 512;
+
+// Offsets in the header, see memfs_image.cpp.
+const size_t header_version = 8;
+const size_t header_chunk_size = 12;
+const size_t header_descriptors_offset = 16;
+const size_t header_nodes_offset = 32;
+
+// Offsets in a node record.
+const size_t node_parent = 0;
+const size_t node_descriptor = 1 + 4 + 3 * 8 + 8 + 8;
+const size_t node_name_length = node_descriptor + 4;
+
+template <typename T>
+T peek(const std::vector<uint8_t>& image, size_t position) {
+  T value;
+  memcpy(&value, image.data() + position, sizeof(T));
+  return value;
+}
+
+template <typename T>
+void poke(std::vector<uint8_t>& image, size_t position, T value) {
+  memcpy(image.data() + position, &value, sizeof(T));
+}
+
+struct image_content {
+  std::vector<std::pair<const uint8_t*, uint32_t>> descriptors;
+  std::vector<image_node> nodes;
+};
+
+// Read the whole image, return false if it is rejected.
+bool read_image(const std::vector<uint8_t>& image, size_t size,
+                image_content& content) {
+  image_reader reader(image.data(), size);
+  content = {};
+  return reader.open(chunk_size) &&
+         reader.read_descriptors(content.descriptors) &&
+         reader.read_nodes([&](uint64_t index, const image_node& node) {
+           CHECK(index == content.nodes.size());
+           content.nodes.push_back(node);
+           return true;
+         });
+}
+
+class test_image {
+ public:
+  test_image()
+      : _path(std::filesystem::temp_directory_path() /
+              ("memfs_image_test_" + std::to_string(rand()) + ".img")),
+        _first(chunk_size, 0x11),
+        _second(chunk_size, 0x22) {
+    _first[0] = 0xF1;
+    _second[chunk_size - 1] = 0xF2;
+
+    image_writer writer(chunk_size);
+    CHECK(writer.open(_path));
+    const uint32_t owner = writer.add_descriptor("owner", 5);
+    const uint32_t other = writer.add_descriptor("other", 5);
+    // Identical descriptors are stored once.
+    CHECK(writer.add_descriptor("owner", 5) == owner);
+    CHECK(other != owner);
+
+    image_node root;
+    root.is_directory = true;
+    root.attributes = 0x10;
+    root.descriptor = owner;
+    CHECK(writer.add_node(root) == 0);
+
+    image_node file;
+    file.parent = 0;
+    file.name = L"file é中";
+    file.attributes = 0x20;
+    file.creation = 1;
+    file.lastaccess = -2;
+    file.lastwrite = INT64_MAX;
+    file.file_size = 3 * chunk_size - 7;
+    file.descriptor = other;
+    // Chunks absent from the list are holes.
+    file.chunks = {{0, _first.data()}, {2, _second.data()}};
+    CHECK(writer.add_node(file) == 1);
+
+    image_node stream;
+    stream.parent = 1;
+    stream.is_stream = true;
+    stream.name = L"stream";
+    CHECK(writer.add_node(stream) == 2);
+
+    CHECK(writer.close());
+
+    std::ifstream in(_path, std::ios::binary);
+    _image.assign(std::istreambuf_iterator<char>(in), {});
+    CHECK(!_image.empty());
+  }
+
+  ~test_image() { std::filesystem::remove(_path); }
+
+  std::vector<uint8_t> image() const { return _image; }
+  const std::vector<uint8_t>& first() const { return _first; }
+  const std::vector<uint8_t>& second() const { return _second; }
+
+  // Position of the node record of the given index.
+  size_t node_position(uint64_t index) const {
+    size_t position = peek<uint64_t>(_image, header_nodes_offset);
+    for (uint64_t i = 0; i < index; ++i) {
+      const uint32_t name_length =
+          peek<uint32_t>(_image, position + node_name_length);
+      position += node_name_length + 4 + name_length * 2;
+      const uint64_t chunk_count = peek<uint64_t>(_image, position);
+      position += 8 + chunk_count * 16;
+    }
+    return position;
+  }
+
+  // Position of the offset of the given chunk of the file node.
+  size_t chunk_offset_position(size_t chunk) const {
+    const size_t position = node_position(1);
+    const uint32_t name_length =
+        peek<uint32_t>(_image, position + node_name_length);
+    return position + node_name_length + 4 + name_length * 2 + 8 +
+           chunk * 16 + 8;
+  }
+
+ private:
+  std::filesystem::path _path;
+  std::vector<uint8_t> _first;
+  std::vector<uint8_t> _second;
+  std::vector<uint8_t> _image;
+};
+
+void test_round_trip(const test_image& test) {
+  const auto image = test.image();
+  image_content content;
+  CHECK(read_image(image, image.size(), content));
+
+  CHECK(content.descriptors.size() == 2);
+  CHECK(content.descriptors[0].second == 5);
+  CHECK(!memcmp(content.descriptors[0].first, "owner", 5));
+  CHECK(!memcmp(content.descriptors[1].first, "other", 5));
+
+  CHECK(content.nodes.size() == 3);
+  const auto& root = content.nodes[0];
+  CHECK(root.parent == image_node::no_parent);
+  CHECK(root.is_directory && !root.is_stream);
+  CHECK(root.attributes == 0x10);
+  CHECK(root.descriptor == 0);
+  CHECK(root.chunks.empty());
+
+  const auto& file = content.nodes[1];
+  CHECK(file.parent == 0);
+  CHECK(!file.is_directory && !file.is_stream);
+  CHECK(file.name == L"file é中");
+  CHECK(file.attributes == 0x20);
+  CHECK(file.creation == 1);
+  CHECK(file.lastaccess == -2);
+  CHECK(file.lastwrite == INT64_MAX);
+  CHECK(file.file_size == 3 * chunk_size - 7);
+  CHECK(file.descriptor == 1);
+  CHECK(file.chunks.size() == 2);
+  CHECK(file.chunks[0].first == 0 && file.chunks[1].first == 2);
+  // Chunks are used in place and aligned in the image.
+  for (const auto& chunk : file.chunks) {
+    CHECK(chunk.second > image.data() &&
+          chunk.second + chunk_size <= image.data() + image.size());
+    CHECK((chunk.second - image.data()) % chunk_size == 0);
+  }
+  CHECK(!memcmp(file.chunks[0].second, test.first().data(), chunk_size));
+  CHECK(!memcmp(file.chunks[1].second, test.second().data(), chunk_size));
+
+  const auto& stream = content.nodes[2];
+  CHECK(stream.parent == 1);
+  CHECK(stream.is_stream);
+  CHECK(stream.name == L"stream");
+  CHECK(stream.descriptor == image_node::no_descriptor);
+}
+
+void test_corrupted_header(const test_image& test) {
+  image_content content;
+  auto image = test.image();
+
+  image[0] = 'X';
+  CHECK(!read_image(image, image.size(), content));
+
+  image = test.image();
+  poke<uint32_t>(image, header_version, 2);
+  CHECK(!read_image(image, image.size(), content));
+
+  // The image must be mounted with the chunk size it was written with.
+  image = test.image();
+  CHECK(!image_reader(image.data(), image.size()).open(chunk_size * 2));
+  poke<uint32_t>(image, header_chunk_size, chunk_size / 2);
+  CHECK(!read_image(image, image.size(), content));
+
+  image = test.image();
+  poke<uint64_t>(image, header_nodes_offset, image.size() + 1);
+  CHECK(!read_image(image, image.size(), content));
+
+  image = test.image();
+  poke<uint64_t>(image, header_descriptors_offset,
+                 peek<uint64_t>(image, header_nodes_offset) + 1);
+  CHECK(!read_image(image, image.size(), content));
+}
+
+void test_bad_offsets(const test_image& test) {
+  image_content content;
+  const auto original = test.image();
+  const uint64_t descriptors_offset =
+      peek<uint64_t>(original, header_descriptors_offset);
+  const size_t chunk_position = test.chunk_offset_position(1);
+  CHECK(peek<uint64_t>(original, chunk_position) % chunk_size == 0);
+
+  // Unaligned, inside the header area, overlapping or past the tables.
+  for (uint64_t offset :
+       {peek<uint64_t>(original, chunk_position) + 1, uint64_t(0),
+        descriptors_offset - chunk_size + 1, descriptors_offset,
+        uint64_t(UINT64_MAX - chunk_size + 1)}) {
+    auto image = original;
+    poke<uint64_t>(image, chunk_position, offset);
+    CHECK(!read_image(image, image.size(), content));
+  }
+
+  // A descriptor running into the node table.
+  auto image = original;
+  poke<uint32_t>(image, descriptors_offset, UINT32_MAX);
+  CHECK(!read_image(image, image.size(), content));
+
+  // Nodes referencing a parent not read yet, a missing descriptor or
+  // announcing more name or chunks than the image holds.
+  image = original;
+  poke<uint64_t>(image, test.node_position(1) + node_parent, 1);
+  CHECK(!read_image(image, image.size(), content));
+
+  image = original;
+  poke<uint64_t>(image, test.node_position(2) + node_parent,
+                 image_node::no_parent);
+  CHECK(!read_image(image, image.size(), content));
+
+  image = original;
+  poke<uint32_t>(image, test.node_position(1) + node_descriptor, 2);
+  CHECK(!read_image(image, image.size(), content));
+
+  image = original;
+  poke<uint32_t>(image, test.node_position(2) + node_name_length, UINT32_MAX);
+  CHECK(!read_image(image, image.size(), content));
+
+  // Chunk count, before the two (index, offset) pairs.
+  image = original;
+  poke<uint64_t>(image, chunk_position - 8 - 16 - 8, UINT64_MAX);
+  CHECK(!read_image(image, image.size(), content));
+}
+
+// Any truncated image is either rejected or read without going past its end.
+void test_truncated(const test_image& test) {
+  const auto image = test.image();
+  const size_t tables = peek<uint64_t>(image, header_descriptors_offset);
+  image_content content;
+  for (size_t size = 0; size < image.size(); ++size) {
+    // Copy so that reading past the end is caught by sanitizers.
+    std::vector<uint8_t> truncated(image.begin(), image.begin() + size);
+    const bool read = read_image(truncated, truncated.size(), content);
+    CHECK(!read || size >= tables);
+  }
+}
+
+}  // namespace
+
+int main() {
+  test_image test;
+  test_round_trip(test);
+  test_corrupted_header(test);
+  test_bad_offsets(test);
+  test_truncated(test);
+  printf("memfs_image_test passed\n");
+  return 0;
+}
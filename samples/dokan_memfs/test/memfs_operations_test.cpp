@@ -0,0 +1,181 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Drives memfs_operations the way the Dokan library does, with several handles
+// opened on the same files.
+
+#include "../memfs_operations.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace memfs;
+
+#define CHECK(expr)                                                    \
+  do {                                                                 \
+    if (!(expr)) {                                                     \
+      fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, \
+              #expr);                                                  \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace {
+
+class handle {
+ public:
+  handle(DOKAN_OPTIONS* options, LPCWSTR filename)
+      : _filename(filename) {
+    ZeroMemory(&_info, sizeof(_info));
+    _info.DokanOptions = options;
+    _info.DokanContext = reinterpret_cast<ULONG64>(this);
+  }
+
+  ~handle() {
+    if (_opened) close();
+  }
+
+  NTSTATUS create(ULONG createdisposition, ULONG fileattributes = 0) {
+    NTSTATUS status = memfs_operations.ZwCreateFile(
+        _filename.c_str(), nullptr, FILE_GENERIC_READ | FILE_GENERIC_WRITE,
+        fileattributes, FILE_SHARE_READ | FILE_SHARE_WRITE, createdisposition,
+        FILE_NON_DIRECTORY_FILE, &_info);
+    // Like the library, a collision on an open or overwrite still opens the
+    // handle.
+    _opened = NT_SUCCESS(status) ||
+              (status == STATUS_OBJECT_NAME_COLLISION &&
+               createdisposition != FILE_CREATE);
+    return status;
+  }
+
+  void close() {
+    memfs_operations.Cleanup(_filename.c_str(), &_info);
+    memfs_operations.CloseFile(_filename.c_str(), &_info);
+    _opened = false;
+  }
+
+  std::string read(DWORD length = 64, LONGLONG offset = 0) {
+    std::string buffer(length, '\0');
+    DWORD read_length = 0;
+    CHECK(memfs_operations.ReadFile(_filename.c_str(), &buffer[0], length,
+                                    &read_length, offset,
+                                    &_info) == STATUS_SUCCESS);
+    buffer.resize(read_length);
+    return buffer;
+  }
+
+  void write(const std::string& data, LONGLONG offset = 0) {
+    DWORD written = 0;
+    CHECK(memfs_operations.WriteFile(
+              _filename.c_str(), data.data(), static_cast<DWORD>(data.size()),
+              &written, offset, &_info) == STATUS_SUCCESS);
+    CHECK(written == data.size());
+  }
+
+  DWORD attributes() {
+    BY_HANDLE_FILE_INFORMATION information;
+    CHECK(memfs_operations.GetFileInformation(_filename.c_str(), &information,
+                                              &_info) == STATUS_SUCCESS);
+    return information.dwFileAttributes;
+  }
+
+ private:
+  std::wstring _filename;
+  DOKAN_FILE_INFO _info;
+  bool _opened = false;
+};
+
+// An overwrite through one handle is seen by the handles already opened on
+// the file: they keep working on the same, now empty, file.
+void test_overwrite_shared_with_open_handle(DOKAN_OPTIONS* options,
+                                            LPCWSTR filename,
+                                            ULONG createdisposition) {
+  handle writer(options, filename);
+  CHECK(writer.create(FILE_CREATE) == STATUS_SUCCESS);
+  writer.write("previous content");
+
+  handle overwriter(options, filename);
+  CHECK(overwriter.create(createdisposition) == STATUS_OBJECT_NAME_COLLISION);
+  CHECK(overwriter.read().empty());
+  CHECK(writer.read().empty());
+
+  writer.write("new");
+  CHECK(overwriter.read() == "new");
+  overwriter.write("NEW!");
+  CHECK(writer.read() == "NEW!");
+
+  // A handle opened afterwards finds the same file.
+  handle reader(options, filename);
+  CHECK(reader.create(FILE_OPEN) == STATUS_SUCCESS);
+  CHECK(reader.read() == "NEW!");
+}
+
+// FILE_OVERWRITE_IF merges the attributes with the existing ones while
+// FILE_SUPERSEDE replaces them.
+void test_overwrite_attributes(DOKAN_OPTIONS* options) {
+  handle creator(options, L"\\attributes");
+  CHECK(creator.create(FILE_CREATE, FILE_ATTRIBUTE_HIDDEN) == STATUS_SUCCESS);
+  CHECK(creator.attributes() & FILE_ATTRIBUTE_HIDDEN);
+
+  handle overwriter(options, L"\\attributes");
+  CHECK(overwriter.create(FILE_OVERWRITE_IF, FILE_ATTRIBUTE_HIDDEN |
+                                                 FILE_ATTRIBUTE_SYSTEM) ==
+        STATUS_OBJECT_NAME_COLLISION);
+  CHECK(creator.attributes() & FILE_ATTRIBUTE_HIDDEN);
+  CHECK(creator.attributes() & FILE_ATTRIBUTE_SYSTEM);
+
+  handle superseder(options, L"\\attributes");
+  CHECK(superseder.create(FILE_SUPERSEDE, FILE_ATTRIBUTE_HIDDEN |
+                                              FILE_ATTRIBUTE_SYSTEM) ==
+        STATUS_OBJECT_NAME_COLLISION);
+  CHECK(creator.attributes() & FILE_ATTRIBUTE_HIDDEN);
+  CHECK(creator.attributes() & FILE_ATTRIBUTE_SYSTEM);
+  CHECK(creator.attributes() & FILE_ATTRIBUTE_ARCHIVE);
+}
+
+// Without an existing file the overwrite dispositions create one.
+void test_overwrite_creates_missing_file(DOKAN_OPTIONS* options) {
+  handle creator(options, L"\\missing");
+  CHECK(creator.create(FILE_OVERWRITE_IF) == STATUS_SUCCESS);
+  creator.write("created");
+
+  handle reader(options, L"\\missing");
+  CHECK(reader.create(FILE_OPEN) == STATUS_SUCCESS);
+  CHECK(reader.read() == "created");
+}
+
+}  // namespace
+
+int main() {
+  fs_filenodes filenodes(false, false, 0);
+  DOKAN_OPTIONS options;
+  ZeroMemory(&options, sizeof(options));
+  options.GlobalContext = reinterpret_cast<ULONG64>(&filenodes);
+
+  test_overwrite_shared_with_open_handle(&options, L"\\overwrite_if",
+                                         FILE_OVERWRITE_IF);
+  test_overwrite_shared_with_open_handle(&options, L"\\supersede",
+                                         FILE_SUPERSEDE);
+  test_overwrite_attributes(&options);
+  test_overwrite_creates_missing_file(&options);
+  printf("memfs_operations_test passed\n");
+  return 0;
+}
@@ -139,6 +139,7 @@ Return Value:
     eventContext->Operation.Close.FileNameLength = fcb->FileName.Length;
     RtlCopyMemory(eventContext->Operation.Close.FileName, fcb->FileName.Buffer,
                   fcb->FileName.Length);
+    DokanAttachEventSequence(eventContext, ccb, /*BulkLane=*/FALSE);
 
     DDbgPrint("   Free CCB:%p\n", ccb);
     DokanFreeCCB(ccb);
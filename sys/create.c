@@ -58,6 +58,11 @@ PDokanCCB DokanAllocateCCB(__in PDokanDCB Dcb, __in PDokanFCB Fcb) {
   ccb->MountId = Dcb->MountId;
   ccb->ProcessId = PsGetCurrentProcessId();
 
+  ccb->EventSequence = DokanAllocZero(sizeof(DokanEventSequence));
+  if (ccb->EventSequence != NULL) {
+    ccb->EventSequence->RefCount = 1;
+  }
+
   InterlockedIncrement(&Fcb->Vcb->CcbAllocated);
   return ccb;
 }
@@ -107,6 +112,10 @@ DokanFreeCCB(__in PDokanCCB ccb) {
     ExFreePool(ccb->SearchPattern);
   }
 
+  if (ccb->EventSequence) {
+    DokanReleaseEventSequence(ccb->EventSequence);
+  }
+
   ExFreeToLookasideListEx(&g_DokanCCBLookasideList, ccb);
   InterlockedIncrement(&fcb->Vcb->CcbFreed);
 
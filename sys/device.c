@@ -844,8 +844,9 @@ Return Value:
 
     controlCode = irpSp->Parameters.DeviceIoControl.IoControlCode;
 
-    if (controlCode != IOCTL_EVENT_WAIT && controlCode != IOCTL_EVENT_INFO &&
-        controlCode != IOCTL_KEEPALIVE) {
+    if (controlCode != IOCTL_EVENT_WAIT &&
+        controlCode != IOCTL_EVENT_WAIT_BULK &&
+        controlCode != IOCTL_EVENT_INFO && controlCode != IOCTL_KEEPALIVE) {
 
       DDbgPrint("==> DokanDispatchIoControl\n");
       DDbgPrint("  ProcessId %lu\n", IoGetRequestorProcessId(Irp));
@@ -878,6 +879,10 @@ Return Value:
       status = DokanRegisterPendingIrpForEvent(DeviceObject, Irp);
       break;
 
+    case IOCTL_EVENT_WAIT_BULK:
+      status = DokanRegisterPendingIrpForBulkEvent(DeviceObject, Irp);
+      break;
+
     case IOCTL_EVENT_INFO:
       // DDbgPrint("  IOCTL_EVENT_INFO\n");
       status = DokanCompleteIrp(DeviceObject, Irp);
@@ -960,8 +965,9 @@ Return Value:
       DokanCompleteIrpRequest(Irp, status, Irp->IoStatus.Information);
     }
 
-    if (controlCode != IOCTL_EVENT_WAIT && controlCode != IOCTL_EVENT_INFO &&
-        controlCode != IOCTL_KEEPALIVE) {
+    if (controlCode != IOCTL_EVENT_WAIT &&
+        controlCode != IOCTL_EVENT_WAIT_BULK &&
+        controlCode != IOCTL_EVENT_INFO && controlCode != IOCTL_KEEPALIVE) {
 
       DokanPrintNTStatus(status);
       DDbgPrint("<== DokanDispatchIoControl\n");
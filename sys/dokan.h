@@ -229,6 +229,10 @@ typedef struct _DokanDiskControlBlock {
   IRP_LIST PendingIrp;
   IRP_LIST PendingEvent;
   IRP_LIST NotifyEvent;
+  // Same as PendingEvent and NotifyEvent for the read, write and flush events
+  // when the volume is mounted with DOKAN_EVENT_PRIORITY_LANES.
+  IRP_LIST PendingBulkEvent;
+  IRP_LIST NotifyBulkEvent;
   // IRPs that need to be retried in kernel mode, e.g. due to oplock breaks
   // asynchronously requested on an earlier try. These are IRPs that have never
   // yet been dispatched to user mode. The IRPs are supposed to be added here at
@@ -657,6 +661,18 @@ BOOLEAN DokanVCBTryLockRW(PDokanVCB vcb);
       DokanResourceUnlock(&(vcb)->Resource);                     \
     }
 
+// Numbers the events of a CCB in the order they are sent to user mode, see
+// EVENT_CONTEXT.OpenSequence. Each notify list has its own sequence. Shared by
+// the CCB and its events waiting in a notify list, which can outlive the CCB.
+typedef struct _DokanEventSequence {
+  // Locking: Interlocked.
+  LONG RefCount;
+  // Locking: ListLock of NotifyEvent. Last OpenSequence sent from it.
+  ULONG Last;
+  // Locking: ListLock of NotifyBulkEvent. Last OpenSequence sent from it.
+  ULONG LastBulk;
+} DokanEventSequence, *PDokanEventSequence;
+
 typedef struct _DokanContextControlBlock {
   // Locking: Read only field. No locking needed.
   FSD_IDENTIFIER Identifier;
@@ -691,6 +707,10 @@ typedef struct _DokanContextControlBlock {
 
   // The process that created the CCB, for debugging purposes.
   HANDLE ProcessId;
+
+  // Locking: Read only field. Numbers the events of this CCB, NULL when it
+  // could not be allocated.
+  PDokanEventSequence EventSequence;
 } DokanCCB, *PDokanCCB;
 
 //
@@ -740,6 +760,11 @@ typedef struct _DEVICE_ENTRY {
 typedef struct _DRIVER_EVENT_CONTEXT {
   LIST_ENTRY ListEntry;
   PKEVENT Completed;
+  // Sequence the OpenSequence is taken from when the event is sent to user
+  // mode, see DokanAttachEventSequence.
+  PDokanEventSequence Sequence;
+  // The event is queued in NotifyBulkEvent.
+  BOOLEAN BulkLane;
   EVENT_CONTEXT EventContext;
 } DRIVER_EVENT_CONTEXT, *PDRIVER_EVENT_CONTEXT;
 
@@ -855,6 +880,8 @@ VOID DokanPrePostIrp(IN PVOID Context, IN PIRP Irp);
 
 DRIVER_DISPATCH DokanRegisterPendingIrpForEvent;
 
+DRIVER_DISPATCH DokanRegisterPendingIrpForBulkEvent;
+
 DRIVER_DISPATCH DokanRegisterPendingIrpForService;
 
 DRIVER_DISPATCH DokanCompleteIrp;
@@ -915,6 +942,14 @@ DokanRegisterAsyncCreateFailure(__in PDEVICE_OBJECT DeviceObject,
 VOID DokanEventNotification(__in PIRP_LIST NotifyEvent,
                             __in PEVENT_CONTEXT EventContext);
 
+VOID DokanAttachEventSequence(__in PEVENT_CONTEXT EventContext,
+                              __in_opt PDokanCCB Ccb, __in BOOLEAN BulkLane);
+
+VOID DokanReleaseEventSequence(__in PDokanEventSequence Sequence);
+
+PIRP_LIST
+DokanGetNotifyEventList(__in PDokanDCB Dcb, __in PEVENT_CONTEXT EventContext);
+
 VOID DokanCompleteDirectoryControl(__in PIRP_ENTRY IrpEntry,
                                    __in PEVENT_INFORMATION EventInfo);
 
@@ -1029,6 +1064,10 @@ NTSTATUS DokanNotifyReportChange0(__in PDokanFCB Fcb,
 NTSTATUS DokanNotifyReportChange(__in PDokanFCB Fcb, __in ULONG FilterMatch,
                                  __in ULONG Action);
 
+// Reports the records of a FSCTL_NOTIFY_PATHS request with
+// DokanNotifyReportChange0. Returns the last failure, if any.
+NTSTATUS DokanNotifyPaths(__in PDokanFCB Fcb, __in PIRP Irp);
+
 // Ends all pending waits for directory change notifications.
 VOID DokanCleanupAllChangeNotificationWaiters(__in PDokanVCB Vcb);
 
@@ -257,10 +257,30 @@ RegisterPendingIrpMain(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
   return STATUS_PENDING;
 }
 
+// Returns the list in which the given event has to be queued for user mode.
+// With DOKAN_EVENT_PRIORITY_LANES, read, write and flush events go into the
+// bulk lane so a burst of data transfers cannot hold back metadata requests.
+PIRP_LIST
+DokanGetNotifyEventList(__in PDokanDCB Dcb, __in PEVENT_CONTEXT EventContext) {
+  if (Dcb->MountOptions & DOKAN_EVENT_PRIORITY_LANES) {
+    switch (EventContext->MajorFunction) {
+    case IRP_MJ_READ:
+    case IRP_MJ_WRITE:
+    case IRP_MJ_FLUSH_BUFFERS:
+      return &Dcb->NotifyBulkEvent;
+    default:
+      break;
+    }
+  }
+  return &Dcb->NotifyEvent;
+}
+
 NTSTATUS
 DokanRegisterPendingIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
                         __in PEVENT_CONTEXT EventContext, __in ULONG Flags) {
   PDokanVCB vcb = DeviceObject->DeviceExtension;
+  PIRP_LIST notifyEvent;
+  PFILE_OBJECT fileObject;
   NTSTATUS status;
   DOKAN_INIT_LOGGER(logger, DeviceObject->DriverObject, 0);
 
@@ -271,6 +291,15 @@ DokanRegisterPendingIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
     return STATUS_INVALID_PARAMETER;
   }
 
+  // Done before the IRP is registered, as its FileObject and CCB can go away
+  // as soon as it is canceled.
+  notifyEvent = DokanGetNotifyEventList(vcb->Dcb, EventContext);
+  fileObject = IoGetCurrentIrpStackLocation(Irp)->FileObject;
+  if (fileObject != NULL) {
+    DokanAttachEventSequence(EventContext, fileObject->FsContext2,
+                             notifyEvent == &vcb->Dcb->NotifyBulkEvent);
+  }
+
   // We check if we will have the space to sent the event before registering it
   // to the pending IRPs. Write is an exception as it has a special workflow for
   // large buffer that will request userland to allocate a specific buffer size
@@ -291,7 +320,7 @@ DokanRegisterPendingIrp(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp,
   }
 
   if (status == STATUS_PENDING) {
-    DokanEventNotification(&vcb->Dcb->NotifyEvent, EventContext);
+    DokanEventNotification(notifyEvent, EventContext);
   } else {
     DokanFreeEventContext(EventContext);
   }
@@ -362,6 +391,37 @@ DokanRegisterPendingIrpForEvent(__in PDEVICE_OBJECT DeviceObject,
                                 /*CurrentStatus=*/STATUS_SUCCESS);
 }
 
+NTSTATUS
+DokanRegisterPendingIrpForBulkEvent(__in PDEVICE_OBJECT DeviceObject,
+                                    _Inout_ PIRP Irp) {
+  PDokanVCB vcb = DeviceObject->DeviceExtension;
+
+  if (GetIdentifierType(vcb) != VCB) {
+    DDbgPrint("  IdentifierType is not VCB\n");
+    return STATUS_INVALID_PARAMETER;
+  }
+
+  if (IsUnmountPendingVcb(vcb)) {
+    DDbgPrint("  Volume is dismounted\n");
+    return STATUS_NO_SUCH_DEVICE;
+  }
+
+  // Nothing would ever be queued in the bulk lane.
+  if (!(vcb->Dcb->MountOptions & DOKAN_EVENT_PRIORITY_LANES)) {
+    DDbgPrint("  Priority lanes are not enabled\n");
+    return STATUS_INVALID_DEVICE_REQUEST;
+  }
+
+  vcb->HasEventWait = TRUE;
+
+  return RegisterPendingIrpMain(DeviceObject, Irp,
+                                0, // SerialNumber
+                                &vcb->Dcb->PendingBulkEvent,
+                                0, // Flags
+                                TRUE,
+                                /*CurrentStatus=*/STATUS_SUCCESS);
+}
+
 NTSTATUS
 DokanRegisterPendingIrpForService(__in PDEVICE_OBJECT DeviceObject,
                                   _Inout_ PIRP Irp) {
@@ -696,6 +756,9 @@ DokanEventStart(__in PDEVICE_OBJECT DeviceObject, _Inout_ PIRP Irp) {
   if (eventStart->Flags & DOKAN_EVENT_ENABLE_NETWORK_UNMOUNT) {
     DDbgPrint("  Network unmount enabled\n");
   }
+  if (eventStart->Flags & DOKAN_EVENT_PRIORITY_LANES) {
+    DDbgPrint("  Priority lanes enabled\n");
+  }
 
   KeEnterCriticalRegion();
   ExAcquireResourceExclusiveLite(&dokanGlobal->Resource, TRUE);
@@ -325,6 +325,59 @@ NTSTATUS DokanOplockRequest(__in PIRP *pIrp) {
   return Status;
 }
 
+NTSTATUS DokanNotifyPaths(__in PDokanFCB Fcb, __in PIRP Irp) {
+  NTSTATUS status = STATUS_SUCCESS;
+  NTSTATUS recordStatus;
+  PDOKAN_NOTIFY_PATH_INTERMEDIATE pNotifyPath;
+  UNICODE_STRING receivedBuffer;
+  BOOLEAN cleanupWaiters = FALSE;
+  ULONG bufferLen = GetProvidedInputSize(Irp);
+  PCHAR buffer = GetInputBuffer(Irp);
+  ULONG offset = 0;
+  ULONG count = 0;
+
+  if (buffer == NULL || bufferLen == 0) {
+    return STATUS_BUFFER_TOO_SMALL;
+  }
+
+  DokanFCBLockRO(Fcb);
+  while (offset < bufferLen) {
+    pNotifyPath = (PDOKAN_NOTIFY_PATH_INTERMEDIATE)(buffer + offset);
+    if (bufferLen - offset <
+            (ULONG)FIELD_OFFSET(DOKAN_NOTIFY_PATH_INTERMEDIATE, Buffer[0]) ||
+        bufferLen - offset <
+            (ULONG)FIELD_OFFSET(DOKAN_NOTIFY_PATH_INTERMEDIATE, Buffer[0]) +
+                pNotifyPath->Length) {
+      DDbgPrint("  Invalid notify path record at offset %lu\n", offset);
+      status = STATUS_BUFFER_TOO_SMALL;
+      break;
+    }
+
+    receivedBuffer.Length = pNotifyPath->Length;
+    receivedBuffer.MaximumLength = pNotifyPath->Length;
+    receivedBuffer.Buffer = pNotifyPath->Buffer;
+    recordStatus = DokanNotifyReportChange0(Fcb, &receivedBuffer,
+                                            pNotifyPath->CompletionFilter,
+                                            pNotifyPath->Action);
+    if (recordStatus == STATUS_OBJECT_NAME_INVALID) {
+      cleanupWaiters = TRUE;
+    }
+    if (!NT_SUCCESS(recordStatus)) {
+      status = recordStatus;
+    }
+    offset += DOKAN_NOTIFY_PATH_RECORD_SIZE(pNotifyPath->Length);
+    ++count;
+  }
+  DokanFCBUnlock(Fcb);
+
+  DDbgPrint("Received FSCTL_NOTIFY_PATHS, %lu records, status 0x%x\n", count,
+            status);
+  if (cleanupWaiters) {
+    DokanCleanupAllChangeNotificationWaiters(Fcb->Vcb);
+  }
+  return status;
+}
+
 NTSTATUS
 DokanUserFsRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP *pIrp) {
   NTSTATUS status = STATUS_INVALID_DEVICE_REQUEST;
@@ -387,9 +440,13 @@ DokanUserFsRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP *pIrp) {
     status = STATUS_SUCCESS;
     break;
 
-  case FSCTL_NOTIFY_PATH: {
+  case FSCTL_NOTIFY_PATH:
+  case FSCTL_NOTIFY_PATHS: {
     PDOKAN_NOTIFY_PATH_INTERMEDIATE pNotifyPath = NULL;
-    GET_IRP_NOTIFY_PATH_INTERMEDIATE_OR_RETURN(*pIrp, pNotifyPath)
+    if (irpSp->Parameters.FileSystemControl.FsControlCode ==
+        FSCTL_NOTIFY_PATH) {
+      GET_IRP_NOTIFY_PATH_INTERMEDIATE_OR_RETURN(*pIrp, pNotifyPath)
+    }
 
     irpSp = IoGetCurrentIrpStackLocation(*pIrp);
     fileObject = irpSp->FileObject;
@@ -413,6 +470,10 @@ DokanUserFsRequest(__in PDEVICE_OBJECT DeviceObject, __in PIRP *pIrp) {
           STATUS_INVALID_PARAMETER,
           L"Received FSCTL_NOTIFY_PATH with no FCB.");
     }
+    if (pNotifyPath == NULL) {
+      status = DokanNotifyPaths(fcb, *pIrp);
+      break;
+    }
     UNICODE_STRING receivedBuffer;
     receivedBuffer.Length = pNotifyPath->Length;
     receivedBuffer.MaximumLength = pNotifyPath->Length;
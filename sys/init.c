@@ -1012,6 +1012,8 @@ DokanCreateDiskDevice(__in PDRIVER_OBJECT DriverObject, __in ULONG MountId,
     DokanInitIrpList(&dcb->PendingIrp);
     DokanInitIrpList(&dcb->PendingEvent);
     DokanInitIrpList(&dcb->NotifyEvent);
+    DokanInitIrpList(&dcb->PendingBulkEvent);
+    DokanInitIrpList(&dcb->NotifyBulkEvent);
     DokanInitIrpList(&dcb->PendingRetryIrp);
 
     KeInitializeEvent(&dcb->ReleaseEvent, NotificationEvent, FALSE);
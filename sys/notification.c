@@ -36,6 +36,10 @@ DokanStartEventNotificationThread
     NotificationLoop(Dcb->Global->PendingService,
                           &Dcb->Global->NotifyService);
 
+    # with DOKAN_EVENT_PRIORITY_LANES, read/write/flush events are in
+    # NotifyBulkEvent and served by PendingBulkEvent (IOCTL_EVENT_WAIT_BULK)
+    NotificationLoop(&Dcb->PendingBulkEvent, &Dcb->NotifyBulkEvent);
+
 IOCTL_EVENT_RELEASE:
 DokanStopEventNotificationThread
 
@@ -44,14 +48,19 @@ DokanDispatchRead
   DokanRegisterPendingIrp
     # add IRP_MJ_READ to PendingIrp list
     DokanRegisterPendingIrpMain(PendingIrp)
-        # put MJ_READ event into NotifyEvent
-    DokanEventNotification(NotifyEvent, EventContext)
+        # put MJ_READ event into NotifyEvent (or NotifyBulkEvent)
+    DokanEventNotification(DokanGetNotifyEventList(), EventContext)
 
 IOCTL_EVENT_WAIT:
   DokanRegisterPendingIrpForEvent
     # add this irp to PendingEvent list
     DokanRegisterPendingIrpMain(PendingEvent)
 
+IOCTL_EVENT_WAIT_BULK:
+  DokanRegisterPendingIrpForBulkEvent
+    # add this irp to PendingBulkEvent list
+    DokanRegisterPendingIrpMain(PendingBulkEvent)
+
 IOCTL_EVENT_INFO:
   DokanCompleteIrp
     DokanCompleteRead
@@ -121,10 +130,53 @@ AllocateEventContext(__in PDokanDCB Dcb, __in PIRP Irp,
   return eventContext;
 }
 
+VOID DokanReleaseEventSequence(__in PDokanEventSequence Sequence) {
+  if (InterlockedDecrement(&Sequence->RefCount) == 0) {
+    ExFreePool(Sequence);
+  }
+}
+
+VOID FreeDriverEventContext(__in PDRIVER_EVENT_CONTEXT DriverEventContext) {
+  if (DriverEventContext->Sequence != NULL) {
+    DokanReleaseEventSequence(DriverEventContext->Sequence);
+  }
+  ExFreePool(DriverEventContext);
+}
+
 VOID DokanFreeEventContext(__in PEVENT_CONTEXT EventContext) {
+  FreeDriverEventContext(
+      CONTAINING_RECORD(EventContext, DRIVER_EVENT_CONTEXT, EventContext));
+}
+
+// Lets the event take the next OpenSequence of the CCB when NotificationLoop
+// sends it to user mode, which holds back the events of an open until the
+// ones before them are dispatched. Numbering the events only once they are
+// sent leaves no gap for those that never reach user mode. BulkLane tells
+// whether the event will be queued in NotifyBulkEvent.
+VOID DokanAttachEventSequence(__in PEVENT_CONTEXT EventContext,
+                              __in_opt PDokanCCB Ccb, __in BOOLEAN BulkLane) {
   PDRIVER_EVENT_CONTEXT driverEventContext =
       CONTAINING_RECORD(EventContext, DRIVER_EVENT_CONTEXT, EventContext);
-  ExFreePool(driverEventContext);
+
+  if (Ccb == NULL || Ccb->Identifier.Type != CCB ||
+      Ccb->EventSequence == NULL || EventContext->Context == 0 ||
+      driverEventContext->Sequence != NULL) {
+    return;
+  }
+  InterlockedIncrement(&Ccb->EventSequence->RefCount);
+  driverEventContext->Sequence = Ccb->EventSequence;
+  driverEventContext->BulkLane = BulkLane;
+}
+
+// Must be called with the ListLock of the notify list the event comes from.
+VOID StampEventSequence(__in PDRIVER_EVENT_CONTEXT DriverEventContext) {
+  PDokanEventSequence sequence = DriverEventContext->Sequence;
+
+  if (sequence == NULL) {
+    return;
+  }
+  DriverEventContext->EventContext.OpenSequence =
+      DriverEventContext->BulkLane ? ++sequence->LastBulk : ++sequence->Last;
 }
 
 VOID DokanEventNotification(__in PIRP_LIST NotifyEvent,
@@ -212,7 +264,7 @@ VOID ReleaseNotifyEvent(__in PIRP_LIST NotifyEvent) {
     listHead = RemoveHeadList(&NotifyEvent->ListHead);
     driverEventContext =
         CONTAINING_RECORD(listHead, DRIVER_EVENT_CONTEXT, ListEntry);
-    ExFreePool(driverEventContext);
+    FreeDriverEventContext(driverEventContext);
   }
 
   KeClearEvent(&NotifyEvent->NotEmpty);
@@ -310,6 +362,7 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
       // marks as STATUS_INSUFFICIENT_RESOURCES
       irpEntry->SerialNumber = 0;
     } else {
+      StampEventSequence(driverEventContext);
       // let's copy EVENT_CONTEXT
       RtlCopyMemory(buffer, &driverEventContext->EventContext, eventLen);
       // save event length
@@ -318,7 +371,7 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
       if (driverEventContext->Completed) {
         KeSetEvent(driverEventContext->Completed, IO_NO_INCREMENT, FALSE);
       }
-      ExFreePool(driverEventContext);
+      FreeDriverEventContext(driverEventContext);
     }
     InsertTailList(&completeList, &irpEntry->ListEntry);
   }
@@ -356,26 +409,30 @@ VOID NotificationLoop(__in PIRP_LIST PendingIrp, __in PIRP_LIST NotifyEvent) {
 
 KSTART_ROUTINE NotificationThread;
 VOID NotificationThread(__in PVOID pDcb) {
-  PKEVENT events[6];
+  PKEVENT events[8];
   PKWAIT_BLOCK waitBlock;
   NTSTATUS status;
   PDokanDCB Dcb = pDcb;
 
   DDbgPrint("==> NotificationThread\n");
 
-  waitBlock = DokanAlloc(sizeof(KWAIT_BLOCK) * 6);
+  waitBlock = DokanAlloc(sizeof(KWAIT_BLOCK) * 8);
   if (waitBlock == NULL) {
     DDbgPrint("  Can't allocate WAIT_BLOCK\n");
     return;
   }
+  // KeWaitForMultipleObjects reports the lowest signaled index, so the bulk
+  // lane is placed after the metadata lane to serve the latter first.
   events[0] = &Dcb->ReleaseEvent;
   events[1] = &Dcb->NotifyEvent.NotEmpty;
   events[2] = &Dcb->PendingEvent.NotEmpty;
   events[3] = &Dcb->Global->PendingService.NotEmpty;
   events[4] = &Dcb->Global->NotifyService.NotEmpty;
   events[5] = &Dcb->PendingRetryIrp.NotEmpty;
+  events[6] = &Dcb->NotifyBulkEvent.NotEmpty;
+  events[7] = &Dcb->PendingBulkEvent.NotEmpty;
   do {
-    status = KeWaitForMultipleObjects(6, events, WaitAny, Executive, KernelMode,
+    status = KeWaitForMultipleObjects(8, events, WaitAny, Executive, KernelMode,
                                       FALSE, NULL, waitBlock);
 
     if (status != STATUS_WAIT_0) {
@@ -384,8 +441,10 @@ VOID NotificationThread(__in PVOID pDcb) {
       } else if (status == STATUS_WAIT_0 + 3 || status == STATUS_WAIT_0 + 4) {
         NotificationLoop(&Dcb->Global->PendingService,
                          &Dcb->Global->NotifyService);
-      } else {
+      } else if (status == STATUS_WAIT_0 + 5) {
         RetryIrps(&Dcb->PendingRetryIrp);
+      } else {
+        NotificationLoop(&Dcb->PendingBulkEvent, &Dcb->NotifyBulkEvent);
       }
     }
   } while (status != STATUS_WAIT_0);
@@ -507,6 +566,7 @@ NTSTATUS DokanEventRelease(__in PDEVICE_OBJECT DeviceObject, __in PIRP Irp) {
 
   ReleasePendingIrp(&dcb->PendingIrp);
   ReleasePendingIrp(&dcb->PendingEvent);
+  ReleasePendingIrp(&dcb->PendingBulkEvent);
   ReleasePendingIrp(&dcb->PendingRetryIrp);
   DokanStopCheckThread(dcb);
   DokanStopEventNotificationThread(dcb);
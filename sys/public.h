@@ -28,7 +28,7 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <minwindef.h>
 #endif
 
-#define DOKAN_DRIVER_VERSION 0x0000190
+#define DOKAN_DRIVER_VERSION 0x0000191
 
 #define EVENT_CONTEXT_MAX_SIZE (1024 * 32)
 
@@ -85,6 +85,17 @@ with this program. If not, see <http://www.gnu.org/licenses/>.
 #define IOCTL_GET_VOLUME_METRICS                                               \
   CTL_CODE(FILE_DEVICE_UNKNOWN, 0x811, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
+// Same as IOCTL_EVENT_WAIT but only receives the read, write and flush events
+// when the volume is mounted with DOKAN_EVENT_PRIORITY_LANES.
+#define IOCTL_EVENT_WAIT_BULK                                                  \
+  CTL_CODE(FILE_DEVICE_UNKNOWN, 0x812, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+// DeviceIoControl code to send many path notification requests at once. The
+// input is a sequence of DOKAN_NOTIFY_PATH_INTERMEDIATE records, each one
+// starting at a ULONG aligned offset, see DOKAN_NOTIFY_PATH_RECORD_SIZE.
+#define FSCTL_NOTIFY_PATHS                                                     \
+  CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x813, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
 #define DRIVER_FUNC_INSTALL 0x01
 #define DRIVER_FUNC_REMOVE 0x02
 
@@ -150,6 +161,12 @@ typedef struct _DOKAN_NOTIFY_PATH_INTERMEDIATE {
   WCHAR Buffer[1];
 } DOKAN_NOTIFY_PATH_INTERMEDIATE, *PDOKAN_NOTIFY_PATH_INTERMEDIATE;
 
+// Space taken by a DOKAN_NOTIFY_PATH_INTERMEDIATE of the given path Length
+// in a FSCTL_NOTIFY_PATHS buffer.
+#define DOKAN_NOTIFY_PATH_RECORD_SIZE(Length)                                  \
+  ((FIELD_OFFSET(DOKAN_NOTIFY_PATH_INTERMEDIATE, Buffer[0]) + (Length) +       \
+    sizeof(ULONG) - 1) & ~(sizeof(ULONG) - 1))
+
 /*
  * This structure is used for copying ACCESS_STATE from the kernel mode driver
  * into the user mode driver.
@@ -322,6 +339,11 @@ typedef struct _EVENT_CONTEXT {
   UCHAR MinorFunction;
   ULONG Flags;
   ULONG FileFlags;
+  // Position of the event among the events of the same open sent to user mode
+  // through the same lane, starting at 1. 0 when the event is not for an open
+  // known by user mode. Fills what was padding before Context so the layout
+  // is unchanged.
+  ULONG OpenSequence;
   ULONG64 Context;
   union {
     DIRECTORY_CONTEXT Directory;
@@ -416,6 +438,9 @@ typedef struct _EVENT_INFORMATION {
 #define DOKAN_EVENT_CASE_SENSITIVE                                  (1 << 8)
 // Enables unmounting of network drives via file explorer
 #define DOKAN_EVENT_ENABLE_NETWORK_UNMOUNT                           (1 << 9)
+// Queue read, write and flush events in a bulk lane that is only served by
+// IOCTL_EVENT_WAIT_BULK so they cannot delay the other (metadata) events.
+#define DOKAN_EVENT_PRIORITY_LANES                                  (1 << 10)
 
 typedef struct _EVENT_DRIVER_INFO {
   ULONG DriverVersion;
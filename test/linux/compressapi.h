@@ -0,0 +1,64 @@
+// Compression API used by memfs compressed_chunk.cpp, see windows.h.
+// XPRESS is replaced by a byte run-length encoding: the tests only need data
+// to round trip and repeated bytes to shrink.
+
+#ifndef DOKAN_TEST_COMPRESSAPI_H_
+#define DOKAN_TEST_COMPRESSAPI_H_
+
+#include <windows.h>
+
+typedef void* COMPRESSOR_HANDLE;
+typedef void* DECOMPRESSOR_HANDLE;
+
+#define COMPRESS_ALGORITHM_XPRESS 3
+#define COMPRESS_RAW (1 << 29)
+
+inline BOOL CreateCompressor(DWORD, void*, COMPRESSOR_HANDLE* handle) {
+  *handle = handle;
+  return TRUE;
+}
+
+inline BOOL CreateDecompressor(DWORD, void*, DECOMPRESSOR_HANDLE* handle) {
+  *handle = handle;
+  return TRUE;
+}
+
+inline BOOL CloseCompressor(COMPRESSOR_HANDLE) { return TRUE; }
+
+inline BOOL CloseDecompressor(DECOMPRESSOR_HANDLE) { return TRUE; }
+
+// Output is (count, byte) pairs.
+inline BOOL Compress(COMPRESSOR_HANDLE, LPCVOID data, SIZE_T size,
+                     PVOID buffer, SIZE_T buffer_size,
+                     PSIZE_T compressed_size) {
+  auto in = static_cast<const BYTE*>(data);
+  auto out = static_cast<BYTE*>(buffer);
+  SIZE_T written = 0;
+  for (SIZE_T i = 0; i < size;) {
+    SIZE_T count = 1;
+    while (i + count < size && count < 255 && in[i + count] == in[i]) ++count;
+    if (written + 2 > buffer_size) return FALSE;
+    out[written++] = static_cast<BYTE>(count);
+    out[written++] = in[i];
+    i += count;
+  }
+  *compressed_size = written;
+  return TRUE;
+}
+
+inline BOOL Decompress(DECOMPRESSOR_HANDLE, LPCVOID data, SIZE_T size,
+                       PVOID buffer, SIZE_T buffer_size,
+                       PSIZE_T uncompressed_size) {
+  auto in = static_cast<const BYTE*>(data);
+  auto out = static_cast<BYTE*>(buffer);
+  SIZE_T written = 0;
+  for (SIZE_T i = 0; i + 1 < size; i += 2) {
+    if (written + in[i] > buffer_size) return FALSE;
+    memset(out + written, in[i + 1], in[i]);
+    written += in[i];
+  }
+  *uncompressed_size = written;
+  return TRUE;
+}
+
+#endif  // DOKAN_TEST_COMPRESSAPI_H_
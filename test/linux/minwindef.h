@@ -0,0 +1 @@
+// Nothing needed, see windows.h.
@@ -0,0 +1,4 @@
+// Windows CRT header, see windows.h. struct statvfs comes from fuse.h on
+// Cygwin and from fuse_win.h with MSVC, neither applies here.
+#include <utime.h>
+#include <sys/statvfs.h>
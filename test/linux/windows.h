@@ -0,0 +1,542 @@
+/*
+  Dokan : user-mode file system library for Windows
+
+  Copyright (C) 2020 Google, Inc.
+
+  http://dokan-dev.github.io
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the Free
+Software Foundation; either version 3 of the License, or (at your option) any
+later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Minimal Win32 surface needed to build the dokan library, dokan_fuse and
+// memfs sources on Linux for their tests, in C and C++. Only the types and
+// functions used by the sources under test are declared. Each test project
+// implements the functions that are not inline for its own needs, in its
+// linux/ directory: events in dokan/test, files and security descriptors in
+// samples/dokan_memfs/test. CancelSynchronousIo is left to the tests.
+//
+// dokan_fuse is built with -fshort-wchar so that wchar_t is UTF-16 like on
+// Windows, and with _WIN32 defined like the Cygwin -mwin32 build.
+
+#ifndef DOKAN_TEST_WINDOWS_H_
+#define DOKAN_TEST_WINDOWS_H_
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+#include <wctype.h>
+
+// <cwchar> undefines wcslen, so it and <string> come before the override
+// below.
+#ifdef __cplusplus
+#include <cwchar>
+#include <string>
+#endif
+
+#define WINAPI
+#define __stdcall
+#define __declspec(x)
+#define CONST const
+#define VOID void
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+#define ANYSIZE_ARRAY 1
+
+typedef void *PVOID, *LPVOID, *HANDLE, *PSID, *PSECURITY_DESCRIPTOR;
+typedef const void *LPCVOID;
+typedef int BOOL, *PBOOL;
+typedef unsigned char BOOLEAN, UCHAR, BYTE, *PUCHAR;
+typedef char CHAR, *PCHAR;
+typedef uint16_t USHORT, WORD;
+typedef int16_t SHORT;
+typedef uint32_t ULONG, DWORD, UINT, *PULONG, *LPDWORD, *PDWORD;
+typedef int32_t LONG, NTSTATUS, *PLONG;
+typedef int64_t LONGLONG, LONG64;
+typedef uint64_t ULONGLONG, ULONG64, DWORDLONG, *PULONGLONG, *PULONG64;
+typedef uintptr_t ULONG_PTR, UINT_PTR, SIZE_T, *PSIZE_T;
+typedef intptr_t LONG_PTR;
+typedef wchar_t WCHAR, *PWCHAR, *LPWSTR, *PWSTR, *LPTSTR;
+typedef const wchar_t *LPCWSTR, *PCWSTR, *LPCTSTR;
+typedef DWORD ACCESS_MASK, *PACCESS_MASK, SECURITY_INFORMATION,
+    *PSECURITY_INFORMATION;
+
+typedef union _LARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  };
+  LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _FILETIME {
+  DWORD dwLowDateTime;
+  DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef struct _GUID {
+  uint32_t Data1;
+  uint16_t Data2;
+  uint16_t Data3;
+  uint8_t Data4[8];
+} GUID;
+
+typedef char CCHAR;
+
+typedef struct _FILE_ID_128 {
+  BYTE Identifier[16];
+} FILE_ID_128, *PFILE_ID_128;
+
+typedef struct _BY_HANDLE_FILE_INFORMATION {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD dwVolumeSerialNumber;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD nNumberOfLinks;
+  DWORD nFileIndexHigh;
+  DWORD nFileIndexLow;
+} BY_HANDLE_FILE_INFORMATION, *LPBY_HANDLE_FILE_INFORMATION;
+
+typedef struct _WIN32_FIND_DATAW {
+  DWORD dwFileAttributes;
+  FILETIME ftCreationTime;
+  FILETIME ftLastAccessTime;
+  FILETIME ftLastWriteTime;
+  DWORD nFileSizeHigh;
+  DWORD nFileSizeLow;
+  DWORD dwReserved0;
+  DWORD dwReserved1;
+  WCHAR cFileName[MAX_PATH];
+  WCHAR cAlternateFileName[14];
+} WIN32_FIND_DATAW, *PWIN32_FIND_DATAW, *LPWIN32_FIND_DATAW;
+
+typedef struct _WIN32_FIND_STREAM_DATA {
+  LARGE_INTEGER StreamSize;
+  WCHAR cStreamName[MAX_PATH + 36];
+} WIN32_FIND_STREAM_DATA, *PWIN32_FIND_STREAM_DATA;
+
+#include <ntstatus.h>
+
+typedef const char *LPCSTR;
+typedef size_t rsize_t;
+typedef HANDLE SC_HANDLE;
+typedef unsigned char byte;
+typedef struct timespec timestruc_t;
+
+typedef struct _LIST_ENTRY {
+  struct _LIST_ENTRY *Flink;
+  struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _SINGLE_LIST_ENTRY {
+  struct _SINGLE_LIST_ENTRY *Next;
+} SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+typedef USHORT SECURITY_DESCRIPTOR_CONTROL, *PSECURITY_DESCRIPTOR_CONTROL;
+
+typedef struct _ACL {
+  BYTE AclRevision;
+  BYTE Sbz1;
+  WORD AclSize;
+  WORD AceCount;
+  WORD Sbz2;
+} ACL, *PACL;
+
+typedef struct _ACE_HEADER {
+  BYTE AceType;
+  BYTE AceFlags;
+  WORD AceSize;
+} ACE_HEADER, *PACE_HEADER;
+
+typedef struct _SECURITY_DESCRIPTOR {
+  BYTE Revision;
+  BYTE Sbz1;
+  SECURITY_DESCRIPTOR_CONTROL Control;
+  PSID Owner;
+  PSID Group;
+  PACL Sacl;
+  PACL Dacl;
+} SECURITY_DESCRIPTOR;
+
+typedef struct _GENERIC_MAPPING {
+  ACCESS_MASK GenericRead;
+  ACCESS_MASK GenericWrite;
+  ACCESS_MASK GenericExecute;
+  ACCESS_MASK GenericAll;
+} GENERIC_MAPPING, *PGENERIC_MAPPING;
+
+typedef struct _SID_AND_ATTRIBUTES {
+  PSID Sid;
+  DWORD Attributes;
+} SID_AND_ATTRIBUTES;
+
+typedef struct _TOKEN_USER {
+  SID_AND_ATTRIBUTES User;
+} TOKEN_USER, *PTOKEN_USER;
+
+typedef struct _TOKEN_GROUPS {
+  DWORD GroupCount;
+  SID_AND_ATTRIBUTES Groups[ANYSIZE_ARRAY];
+} TOKEN_GROUPS, *PTOKEN_GROUPS;
+
+typedef enum _TOKEN_INFORMATION_CLASS {
+  TokenUser = 1,
+  TokenGroups
+} TOKEN_INFORMATION_CLASS;
+
+typedef struct _MEMORYSTATUSEX {
+  DWORD dwLength;
+  DWORD dwMemoryLoad;
+  DWORDLONG ullTotalPhys;
+  DWORDLONG ullAvailPhys;
+  DWORDLONG ullTotalPageFile;
+  DWORDLONG ullAvailPageFile;
+  DWORDLONG ullTotalVirtual;
+  DWORDLONG ullAvailVirtual;
+  DWORDLONG ullAvailExtendedVirtual;
+} MEMORYSTATUSEX, *LPMEMORYSTATUSEX;
+
+typedef struct _CRITICAL_SECTION {
+  pthread_mutex_t Mutex;
+} CRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+#define MAXDWORD 0xffffffff
+#define MAXLONGLONG 0x7fffffffffffffffLL
+#define MAXULONGLONG 0xffffffffffffffffULL
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+
+#define ERROR_INSUFFICIENT_BUFFER 122L
+
+#define DELETE 0x00010000L
+#define READ_CONTROL 0x00020000L
+#define SYNCHRONIZE 0x00100000L
+#define GENERIC_READ 0x80000000L
+#define GENERIC_WRITE 0x40000000L
+#define GENERIC_EXECUTE 0x20000000L
+#define GENERIC_ALL 0x10000000L
+#define FILE_READ_DATA 0x0001
+#define FILE_LIST_DIRECTORY 0x0001
+#define FILE_WRITE_DATA 0x0002
+#define FILE_APPEND_DATA 0x0004
+#define FILE_READ_EA 0x0008
+#define FILE_WRITE_EA 0x0010
+#define FILE_EXECUTE 0x0020
+#define FILE_READ_ATTRIBUTES 0x0080
+#define FILE_WRITE_ATTRIBUTES 0x0100
+#define FILE_ALL_ACCESS 0x001F01FFL
+#define FILE_GENERIC_READ 0x00120089L
+#define FILE_GENERIC_WRITE 0x00120116L
+#define FILE_GENERIC_EXECUTE 0x001200A0L
+#define TOKEN_READ 0x00020008L
+
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_WRITE 0x00000002
+#define FILE_SHARE_DELETE 0x00000004
+
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+
+#define FILE_ATTRIBUTE_READONLY 0x00000001
+#define FILE_ATTRIBUTE_HIDDEN 0x00000002
+#define FILE_ATTRIBUTE_SYSTEM 0x00000004
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_ARCHIVE 0x00000020
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define FILE_ATTRIBUTE_STRICTLY_SEQUENTIAL 0x20000000
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_RANDOM_ACCESS 0x10000000
+#define FILE_FLAG_NO_BUFFERING 0x20000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_FLAG_DELETE_ON_CLOSE 0x04000000
+#define FILE_FLAG_BACKUP_SEMANTICS 0x02000000
+#define FILE_FLAG_OPEN_REPARSE_POINT 0x00200000
+
+#define STANDARD_RIGHTS_READ READ_CONTROL
+#define STANDARD_RIGHTS_EXECUTE READ_CONTROL
+#define WRITE_DAC 0x00040000L
+#define WRITE_OWNER 0x00080000L
+#define FILE_ADD_FILE 0x0002
+#define FILE_ADD_SUBDIRECTORY 0x0004
+
+#define FILE_CASE_SENSITIVE_SEARCH 0x00000001
+#define FILE_CASE_PRESERVED_NAMES 0x00000002
+#define FILE_UNICODE_ON_DISK 0x00000004
+#define FILE_SUPPORTS_REMOTE_STORAGE 0x00000100
+#define FILE_NAMED_STREAMS 0x00040000
+
+#define PAGE_READONLY 0x02
+#define FILE_MAP_READ 0x0004
+#define HEAP_ZERO_MEMORY 0x00000008
+
+#define SDDL_REVISION_1 1
+#define SECURITY_DESCRIPTOR_REVISION 1
+#define OWNER_SECURITY_INFORMATION 0x00000001L
+#define GROUP_SECURITY_INFORMATION 0x00000002L
+#define DACL_SECURITY_INFORMATION 0x00000004L
+#define SACL_SECURITY_INFORMATION 0x00000008L
+#define LABEL_SECURITY_INFORMATION 0x00000010L
+#define SYSTEM_MANDATORY_LABEL_ACE_TYPE 0x11
+#define SE_DACL_AUTO_INHERIT_REQ 0x0100
+#define SE_SACL_AUTO_INHERIT_REQ 0x0200
+#define SE_DACL_AUTO_INHERITED 0x0400
+#define SE_SACL_AUTO_INHERITED 0x0800
+#define SE_DACL_PROTECTED 0x1000
+#define SE_SACL_PROTECTED 0x2000
+
+#define CP_ACP 0
+
+#define Int32x32To64(a, b) ((LONGLONG)(int32_t)(a) * (LONGLONG)(int32_t)(b))
+
+#define FORCEINLINE static inline
+
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define ZeroMemory RtlZeroMemory
+#define CONTAINING_RECORD(address, type, field)                              \
+  ((type *)((char *)(address) - offsetof(type, field)))
+
+#define _malloca(size) malloc(size)
+#define _freea(memory) free(memory)
+#define _vscprintf(format, argp) vsnprintf(NULL, 0, (format), (argp))
+#define vsprintf_s(buffer, size, format, argp)                               \
+  vsnprintf((buffer), (size), (format), (argp))
+#define _vscwprintf(format, argp) (-1)
+#define vswprintf_s(buffer, size, format, argp)                              \
+  vswprintf((buffer), (size), (format), (argp))
+#define OutputDebugStringA(str) fputs((str), stderr)
+#define OutputDebugStringW(str) fputws((str), stderr)
+
+typedef struct _SRWLOCK {
+  pthread_rwlock_t Lock;
+} SRWLOCK, *PSRWLOCK;
+
+static inline VOID InitializeSRWLock(PSRWLOCK SRWLock) {
+  pthread_rwlock_init(&SRWLock->Lock, NULL);
+}
+
+static inline VOID AcquireSRWLockShared(PSRWLOCK SRWLock) {
+  pthread_rwlock_rdlock(&SRWLock->Lock);
+}
+
+static inline VOID ReleaseSRWLockShared(PSRWLOCK SRWLock) {
+  pthread_rwlock_unlock(&SRWLock->Lock);
+}
+
+static inline VOID AcquireSRWLockExclusive(PSRWLOCK SRWLock) {
+  pthread_rwlock_wrlock(&SRWLock->Lock);
+}
+
+static inline VOID ReleaseSRWLockExclusive(PSRWLOCK SRWLock) {
+  pthread_rwlock_unlock(&SRWLock->Lock);
+}
+
+// Critical sections are recursive like on Windows.
+static inline BOOL
+InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION CriticalSection,
+                                      DWORD SpinCount) {
+  pthread_mutexattr_t attributes;
+  (void)SpinCount;
+  pthread_mutexattr_init(&attributes);
+  pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&CriticalSection->Mutex, &attributes);
+  pthread_mutexattr_destroy(&attributes);
+  return TRUE;
+}
+
+static inline VOID
+InitializeCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  InitializeCriticalSectionAndSpinCount(CriticalSection, 0);
+}
+
+static inline VOID DeleteCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutex_destroy(&CriticalSection->Mutex);
+}
+
+static inline VOID EnterCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutex_lock(&CriticalSection->Mutex);
+}
+
+static inline VOID LeaveCriticalSection(LPCRITICAL_SECTION CriticalSection) {
+  pthread_mutex_unlock(&CriticalSection->Mutex);
+}
+
+static inline ULONGLONG GetTickCount64(VOID) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (ULONGLONG)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+#if __SIZEOF_WCHAR_T__ == 2
+// The C library wide string functions expect a 4 bytes wchar_t.
+static inline size_t dokan_test_wcslen(const wchar_t *str) {
+  size_t len = 0;
+  while (str[len])
+    ++len;
+  return len;
+}
+#define wcslen(str) dokan_test_wcslen(str)
+#endif
+
+// Latin-1 only, enough for the former conversion kept in dokan_fuse utils.cpp.
+static inline int MultiByteToWideChar(UINT CodePage, DWORD Flags,
+                                      const char *Src, int SrcLen,
+                                      wchar_t *Dest, int DestLen) {
+  int f;
+  (void)CodePage;
+  (void)Flags;
+  if (SrcLen < 0)
+    SrcLen = (int)strlen(Src) + 1;
+  if (DestLen == 0)
+    return SrcLen;
+  if (DestLen < SrcLen)
+    return 0;
+  for (f = 0; f < SrcLen; ++f)
+    Dest[f] = (unsigned char)Src[f];
+  return SrcLen;
+}
+
+static inline DWORD CharUpperBuffW(LPWSTR Str, DWORD Length) {
+  DWORD f;
+  for (f = 0; f < Length; ++f)
+    Str[f] = (WCHAR)towupper(Str[f]);
+  return Length;
+}
+
+static inline int wcscpy_s(wchar_t *Dest, size_t Size, const wchar_t *Src) {
+  wcsncpy(Dest, Src, Size);
+  Dest[Size - 1] = L'\0';
+  return 0;
+}
+
+#ifdef __cplusplus
+template <size_t N, class... Args>
+int swprintf_s(wchar_t (&buffer)[N], size_t size, const wchar_t *format,
+               Args... args) {
+  return swprintf(buffer, size, format, args...);
+}
+#endif
+
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0x00000000L
+#define WAIT_TIMEOUT 258L
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Handles are events for dokan and files or mappings for memfs, CloseHandle
+// frees them.
+HANDLE CreateEvent(PVOID EventAttributes, BOOL ManualReset, BOOL InitialState,
+                   LPCWSTR Name);
+BOOL SetEvent(HANDLE Event);
+BOOL ResetEvent(HANDLE Event);
+DWORD WaitForSingleObject(HANDLE Handle, DWORD Milliseconds);
+BOOL CloseHandle(HANDLE Object);
+BOOL CancelSynchronousIo(HANDLE Thread);
+
+DWORD GetLastError(VOID);
+void GetSystemTimeAsFileTime(LPFILETIME lpSystemTimeAsFileTime);
+BOOL GlobalMemoryStatusEx(LPMEMORYSTATUSEX lpBuffer);
+HANDLE GetProcessHeap(VOID);
+LPVOID HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes);
+BOOL HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
+void *LocalFree(void *hMem);
+
+HANDLE CreateFile(LPCWSTR lpFileName, DWORD dwDesiredAccess,
+                  DWORD dwShareMode, void *lpSecurityAttributes,
+                  DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes,
+                  HANDLE hTemplateFile);
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+HANDLE CreateFileMapping(HANDLE hFile, void *lpFileMappingAttributes,
+                         DWORD flProtect, DWORD dwMaximumSizeHigh,
+                         DWORD dwMaximumSizeLow, LPCWSTR lpName);
+LPVOID MapViewOfFile(HANDLE hFileMappingObject, DWORD dwDesiredAccess,
+                     DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow,
+                     SIZE_T dwNumberOfBytesToMap);
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress);
+
+HANDLE GetCurrentProcess(VOID);
+BOOL OpenProcessToken(HANDLE ProcessHandle, DWORD DesiredAccess,
+                      HANDLE *TokenHandle);
+BOOL GetTokenInformation(HANDLE TokenHandle,
+                         TOKEN_INFORMATION_CLASS TokenInformationClass,
+                         LPVOID TokenInformation,
+                         DWORD TokenInformationLength, PDWORD ReturnLength);
+BOOL ConvertSidToStringSid(PSID Sid, LPWSTR *StringSid);
+BOOL ConvertStringSecurityDescriptorToSecurityDescriptor(
+    LPCWSTR StringSecurityDescriptor, DWORD StringSDRevision,
+    PSECURITY_DESCRIPTOR *SecurityDescriptor, PULONG SecurityDescriptorSize);
+BOOL ConvertSecurityDescriptorToStringSecurityDescriptor(
+    PSECURITY_DESCRIPTOR SecurityDescriptor, DWORD RequestedStringSDRevision,
+    SECURITY_INFORMATION SecurityInformation, LPWSTR *StringSecurityDescriptor,
+    PULONG StringSecurityDescriptorLen);
+BOOL SetPrivateObjectSecurity(SECURITY_INFORMATION SecurityInformation,
+                              PSECURITY_DESCRIPTOR ModificationDescriptor,
+                              PSECURITY_DESCRIPTOR *ObjectsSecurityDescriptor,
+                              PGENERIC_MAPPING GenericMapping, HANDLE Token);
+BOOL IsValidSecurityDescriptor(PSECURITY_DESCRIPTOR pSecurityDescriptor);
+DWORD GetSecurityDescriptorLength(PSECURITY_DESCRIPTOR pSecurityDescriptor);
+BOOL InitializeSecurityDescriptor(SECURITY_DESCRIPTOR *pSecurityDescriptor,
+                                  DWORD dwRevision);
+BOOL GetSecurityDescriptorOwner(PSECURITY_DESCRIPTOR pSecurityDescriptor,
+                                PSID *pOwner, PBOOL lpbOwnerDefaulted);
+BOOL GetSecurityDescriptorGroup(PSECURITY_DESCRIPTOR pSecurityDescriptor,
+                                PSID *pGroup, PBOOL lpbGroupDefaulted);
+BOOL GetSecurityDescriptorDacl(PSECURITY_DESCRIPTOR pSecurityDescriptor,
+                               PBOOL lpbDaclPresent, PACL *pDacl,
+                               PBOOL lpbDaclDefaulted);
+BOOL GetSecurityDescriptorSacl(PSECURITY_DESCRIPTOR pSecurityDescriptor,
+                               PBOOL lpbSaclPresent, PACL *pSacl,
+                               PBOOL lpbSaclDefaulted);
+BOOL GetSecurityDescriptorControl(PSECURITY_DESCRIPTOR pSecurityDescriptor,
+                                  PSECURITY_DESCRIPTOR_CONTROL pControl,
+                                  LPDWORD lpdwRevision);
+BOOL SetSecurityDescriptorOwner(SECURITY_DESCRIPTOR *pSecurityDescriptor,
+                                PSID pOwner, BOOL bOwnerDefaulted);
+BOOL SetSecurityDescriptorGroup(SECURITY_DESCRIPTOR *pSecurityDescriptor,
+                                PSID pGroup, BOOL bGroupDefaulted);
+BOOL SetSecurityDescriptorDacl(SECURITY_DESCRIPTOR *pSecurityDescriptor,
+                               BOOL bDaclPresent, PACL pDacl,
+                               BOOL bDaclDefaulted);
+BOOL SetSecurityDescriptorSacl(SECURITY_DESCRIPTOR *pSecurityDescriptor,
+                               BOOL bSaclPresent, PACL pSacl,
+                               BOOL bSaclDefaulted);
+BOOL SetSecurityDescriptorControl(
+    SECURITY_DESCRIPTOR *pSecurityDescriptor,
+    SECURITY_DESCRIPTOR_CONTROL ControlBitsOfInterest,
+    SECURITY_DESCRIPTOR_CONTROL ControlBitsToSet);
+BOOL MakeSelfRelativeSD(SECURITY_DESCRIPTOR *pAbsoluteSecurityDescriptor,
+                        PSECURITY_DESCRIPTOR pSelfRelativeSecurityDescriptor,
+                        LPDWORD lpdwBufferLength);
+BOOL InitializeAcl(PACL pAcl, DWORD nAclLength, DWORD dwAclRevision);
+BOOL GetAce(PACL pAcl, DWORD dwAceIndex, LPVOID *pAce);
+BOOL AddAce(PACL pAcl, DWORD dwAceRevision, DWORD dwStartingAceIndex,
+            LPVOID pAceList, DWORD nAceListLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DOKAN_TEST_WINDOWS_H_